@@ -0,0 +1,87 @@
+// Adaptive iteration limit
+// maxIter is chosen for every frame instead of being fixed at 10000. Interior pixels run to the limit, so a shallow view
+// with a high limit spends most of its time inside the set, while deep views need more iterations before their
+// filaments escape. The choice looks at:
+//  - the zoom: a floor that grows with the number of 2x zooms (octaves) from the starting view
+//  - the previous frame's histogram: if escapes were still arriving in the top half of its limit, the limit was cutting
+//    detail off and is raised to where the tail of the escapes, extrapolated octave by octave, would have thinned out
+//    (at most MAX_ITER_MAX_JUMP times higher); otherwise it is set to a few times the iteration count that 99.9% of the
+//    escapes beat.
+// Limits are rounded up to powers of two, so small changes in the statistics do not move the limit (and with it the
+// colour bands, the palette table and the iteration cache) from one frame to the next.
+#ifndef ADAPTIVE_ITER_H
+#define ADAPTIVE_ITER_H
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+static const float MAX_ITER_MIN = 256.0f;
+// Largest limit the packed escape results can hold: interior pixels store iter = maxIter, and
+// ((2^20 * 8 + band) << MANDEL_FRAC_BITS) no longer fits a signed 32-bit int (see packEscape())
+static const float MAX_ITER_MAX = 1048575.0f;
+static const float MAX_ITER_PER_OCTAVE = 128.0f;
+static const double MAX_ITER_LATE_FRACTION = 0.001; // escapes in the top half of the limit that call for a higher one
+static const double MAX_ITER_HEADROOM = 4.0;        // limit as a multiple of the 99.9th percentile escape
+static const double MAX_ITER_MAX_JUMP = 16.0;       // largest factor one frame raises a limit that cut off detail by
+
+struct MaxIterChoice
+{
+    float maxIter = 0.0f;
+    char reason[160] = "";
+};
+
+// Smallest power of two >= v, at least MAX_ITER_MIN and at most MAX_ITER_MAX
+static inline float roundMaxIter(double v)
+{
+    double p = MAX_ITER_MIN;
+    while (p < v && p < MAX_ITER_MAX)
+    {
+        p *= 2.0;
+    }
+    return (float)std::min<double>(p, MAX_ITER_MAX);
+}
+
+// Limit for the next frame at 'zoomOctaves' 2x zooms in from the starting view. 'previous' is the histogram of the last
+// complete frame, rendered with limit 'previousMaxIter' (NULL for the first frame).
+static MaxIterChoice chooseMaxIter(double zoomOctaves, const IterHistogram *previous, float previousMaxIter)
+{
+    MaxIterChoice choice;
+    double floorIter = MAX_ITER_MIN + MAX_ITER_PER_OCTAVE * std::max(zoomOctaves, 0.0);
+    if (!previous || previous->escaped == 0)
+    {
+        choice.maxIter = roundMaxIter(floorIter);
+        snprintf(choice.reason, sizeof(choice.reason), "zoom floor %.0f at %.1f octaves, no escapes to go by",
+                 floorIter, zoomOctaves);
+        return choice;
+    }
+    double late = 1.0 - previous->cdf(previousMaxIter / 2);
+    double p999 = previous->percentile(0.999);
+    if (late > MAX_ITER_LATE_FRACTION)
+    {
+        // The share of escapes above x fell by 'decay' from x = limit / 4 to limit / 2. If it keeps falling at that rate
+        // per octave, it drops to MAX_ITER_LATE_FRACTION above half a limit 'octaves' doublings higher.
+        double decay = late / (1.0 - previous->cdf(previousMaxIter / 4));
+        double octaves = decay < 1.0 ? ceil(log(MAX_ITER_LATE_FRACTION / late) / log(decay)) : log2(MAX_ITER_MAX_JUMP);
+        double factor = std::min(pow(2.0, std::max(octaves, 1.0)), MAX_ITER_MAX_JUMP);
+        choice.maxIter = roundMaxIter(std::max<double>(previousMaxIter * factor, floorIter));
+        snprintf(choice.reason, sizeof(choice.reason),
+                 "%.2f%% of escapes were above %.0f, the limit was cutting off detail (raised %.0fx)", late * 100.0,
+                 previousMaxIter / 2, factor);
+    }
+    else if (p999 * MAX_ITER_HEADROOM >= floorIter)
+    {
+        choice.maxIter = roundMaxIter(p999 * MAX_ITER_HEADROOM);
+        snprintf(choice.reason, sizeof(choice.reason), "99.9%% of escapes were below %.0f (zoom floor %.0f)", p999,
+                 floorIter);
+    }
+    else
+    {
+        choice.maxIter = roundMaxIter(floorIter);
+        snprintf(choice.reason, sizeof(choice.reason), "zoom floor %.0f at %.1f octaves (99.9%% of escapes below %.0f)",
+                 floorIter, zoomOctaves, p999);
+    }
+    return choice;
+}
+
+#endif // ADAPTIVE_ITER_H
@@ -0,0 +1,284 @@
+// Adaptive anti-aliasing
+// One sample per pixel aliases wherever the iteration count changes faster than the pixel grid (filaments, the edge of
+// the set), while most of the frame is smooth and would gain nothing from supersampling. After a frame is complete:
+//  1. every pixel gets a contrast level (0..AA_LEVELS-1) from its four neighbours: the top level where the colour band
+//     changes (including set / not set), otherwise 2 log2(1 + d) for the largest difference d in smooth iteration count
+//  2. pixels at AA_MIN_LEVEL (a difference of one iteration) or more are candidates. If there are more than the
+//     per-frame budget, the lowest levels are dropped until the rest fit (aaCutoffLevel()), so the budget goes to the
+//     strongest edges first. If the top level alone is over budget, an even share of it is kept everywhere in the
+//     frame, picked by a hash of the pixel index (aaCutoffThreshold()), so the same pixels are refined in every frame
+//     of a view and in both engines
+//  3. each refined pixel gets AA_SAMPLES more samples, spread over the pixel by the first points of the Halton (2, 3)
+//     sequence shifted by a hash of the pixel's position (a Cranley-Patterson rotation), so neighbouring pixels do
+//     not share a pattern and the jitter does not form a visible grid but is the same in every frame
+//  4. the pixel's colour is the mean of the palette colours of its own sample and the extra ones
+// The extra samples are kept with the frame (AntialiasFrame), so a palette change recolours them without iterating.
+// Frames in the iteration format (FRAME_ITER) are coloured by the display shader and are not anti-aliased.
+// The same steps run in Mandel.cl ('mandelAAMark', 'mandelAASelect', 'mandelAARefine', 'mandelAAColour'); keep the
+// constants, the hash and the contrast measure in step.
+// Needs CpuRender.h included first.
+#ifndef ANTIALIAS_H
+#define ANTIALIAS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+static const unsigned int AA_SAMPLES = 8;
+static const int AA_LEVELS = 16;
+static const int AA_MIN_LEVEL = 2;
+static const unsigned int AA_DEFAULT_BUDGET = 65536; // pixels per frame, 1/16 of a 1024x1024 frame
+
+static const float AA_JITTER[AA_SAMPLES][2] = {{0.5f, 0.333333f},   {0.25f, 0.666667f}, {0.75f, 0.111111f},
+                                               {0.125f, 0.444444f}, {0.625f, 0.777778f}, {0.375f, 0.222222f},
+                                               {0.875f, 0.555556f}, {0.0625f, 0.888889f}};
+
+// Offset (-0.5..0.5 pixels) of extra sample 's' of pixel (x, y)
+static inline void aaSampleOffset(unsigned int x, unsigned int y, unsigned int s, float &dx, float &dy)
+{
+    uint32_t h = (x * 0x8da6b343u) ^ (y * 0xd8163841u);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    float ox = (float)(h & 0xffff) / 65536.0f;
+    float oy = (float)(h >> 16) / 65536.0f;
+    dx = AA_JITTER[s][0] + ox;
+    dy = AA_JITTER[s][1] + oy;
+    dx = (dx >= 1.0f ? dx - 1.0f : dx) - 0.5f;
+    dy = (dy >= 1.0f ? dy - 1.0f : dy) - 0.5f;
+}
+
+// Contrast level of pixel (x, y) of a w x h packed field. Pixels that are unknown (-1) have none.
+static inline int aaContrastLevel(const int *field, unsigned int w, unsigned int h, unsigned int x, unsigned int y)
+{
+    const int v = field[(size_t)y * w + x];
+    if (v < 0)
+    {
+        return 0;
+    }
+    const int band = packedBand(v);
+    const float smooth = (float)packedIter(v) + packedFrac(v);
+    const int neighbours[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    float d = 0.0f;
+    for (int n = 0; n < 4; n++)
+    {
+        int nx = (int)x + neighbours[n][0];
+        int ny = (int)y + neighbours[n][1];
+        if (nx < 0 || ny < 0 || nx >= (int)w || ny >= (int)h)
+        {
+            continue;
+        }
+        int q = field[(size_t)ny * w + nx];
+        if (q < 0)
+        {
+            continue;
+        }
+        if (packedBand(q) != band)
+        {
+            return AA_LEVELS - 1;
+        }
+        if (band != 0)
+        {
+            d = std::max(d, fabsf((float)packedIter(q) + packedFrac(q) - smooth));
+        }
+    }
+    return std::min((int)(2.0f * log2f(1.0f + d)), AA_LEVELS - 2);
+}
+
+// Lowest level (>= AA_MIN_LEVEL) whose pixels and those above it fit in 'budget', AA_LEVELS if none do
+static int aaCutoffLevel(const unsigned int counts[AA_LEVELS], unsigned int budget)
+{
+    unsigned int total = 0;
+    int cutoff = AA_LEVELS;
+    for (int level = AA_LEVELS - 1; level >= AA_MIN_LEVEL; level--)
+    {
+        total += counts[level];
+        if (total > budget)
+        {
+            break;
+        }
+        cutoff = level;
+    }
+    // The top level on its own is over budget: take as much of it as fits
+    return cutoff == AA_LEVELS && budget > 0 ? AA_LEVELS - 1 : cutoff;
+}
+
+// Hash of pixel index i (= y * w + x) deciding which pixels of a partly refined level are kept
+static inline uint32_t aaSelectHash(uint32_t i)
+{
+    uint32_t h = i * 0x9e3779b1u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Pixels at 'cutoff' are refined where aaSelectHash() is below the returned threshold (out of 2^32): all of them if
+// they fit in the budget after the levels above, otherwise the share that fits. The share is a few standard deviations
+// short, so the pick practically never runs over the budget and is never cut off at some point in the frame.
+static uint64_t aaCutoffThreshold(const unsigned int counts[AA_LEVELS], int cutoff, unsigned int budget)
+{
+    if (cutoff >= AA_LEVELS)
+    {
+        return 0;
+    }
+    unsigned int above = 0;
+    for (int level = cutoff + 1; level < AA_LEVELS; level++)
+    {
+        above += counts[level];
+    }
+    if (above + counts[cutoff] <= budget)
+    {
+        return (uint64_t)1 << 32;
+    }
+    double room = budget > above ? (double)(budget - above) : 0.0;
+    double keep = std::max(0.0, room - 3.0 * sqrt(room));
+    return (uint64_t)(keep / counts[cutoff] * 4294967296.0);
+}
+
+struct AntialiasStats
+{
+    unsigned int candidates = 0; // pixels at AA_MIN_LEVEL or more
+    unsigned int refined = 0;    // pixels supersampled, at most the budget
+    int cutoff = AA_LEVELS;      // lowest level refined
+};
+
+// Extra samples of the refined pixels of the last frame: pixel indices and AA_SAMPLES packed results per pixel
+struct AntialiasFrame
+{
+    std::vector<unsigned int> pixels;
+    std::vector<int> samples;
+
+    void clear()
+    {
+        pixels.clear();
+        samples.clear();
+    }
+};
+
+// Choose and supersample the pixels of 'frame' (steps 1 to 3 above). 'deep' as for renderMandelCpu().
+static void antialiasFrameCpu(const CpuFrame &frame, ThreadPool &pool, const MandelView &view, const PerturbFrame *deep,
+                              unsigned int budget, AntialiasFrame &aa, AntialiasStats &stats)
+{
+    const unsigned int w = frame.width;
+    const unsigned int h = frame.height;
+    const int *field = frame.pixelIter.data();
+    std::vector<unsigned char> levels((size_t)w * h);
+    std::atomic<unsigned int> counts[AA_LEVELS];
+    for (int l = 0; l < AA_LEVELS; l++)
+    {
+        counts[l] = 0;
+    }
+    pool.parallelFor(h, [&](unsigned int y) {
+        unsigned int rowCounts[AA_LEVELS] = {0};
+        for (unsigned int x = 0; x < w; x++)
+        {
+            int level = aaContrastLevel(field, w, h, x, y);
+            levels[(size_t)y * w + x] = (unsigned char)level;
+            rowCounts[level]++;
+        }
+        for (int l = AA_MIN_LEVEL; l < AA_LEVELS; l++)
+        {
+            counts[l] += rowCounts[l];
+        }
+    });
+    unsigned int levelCounts[AA_LEVELS];
+    stats.candidates = 0;
+    for (int l = 0; l < AA_LEVELS; l++)
+    {
+        levelCounts[l] = counts[l];
+        stats.candidates += l >= AA_MIN_LEVEL ? levelCounts[l] : 0;
+    }
+    stats.cutoff = aaCutoffLevel(levelCounts, budget);
+    const uint64_t threshold = aaCutoffThreshold(levelCounts, stats.cutoff, budget);
+
+    aa.clear();
+    for (size_t i = 0; i < levels.size() && aa.pixels.size() < budget; i++)
+    {
+        if (levels[i] > stats.cutoff || (levels[i] == stats.cutoff && aaSelectHash((uint32_t)i) < threshold))
+        {
+            aa.pixels.push_back((unsigned int)i);
+        }
+    }
+    stats.refined = (unsigned int)aa.pixels.size();
+
+    aa.samples.resize(aa.pixels.size() * AA_SAMPLES);
+    const float maxIter = g_mandelMaxIter;
+    const unsigned int chunk = 256;
+    pool.parallelFor((unsigned int)((aa.pixels.size() + chunk - 1) / chunk), [&](unsigned int c) {
+        MandelShortcutCounts counts;
+        unsigned int rebases = 0;
+        size_t end = std::min(aa.pixels.size(), (size_t)(c + 1) * chunk);
+        for (size_t p = (size_t)c * chunk; p < end; p++)
+        {
+            unsigned int x = aa.pixels[p] % w;
+            unsigned int y = aa.pixels[p] / w;
+            for (unsigned int s = 0; s < AA_SAMPLES; s++)
+            {
+                float dx;
+                float dy;
+                aaSampleOffset(x, y, s, dx, dy);
+                int iter;
+                float frac;
+                int band;
+                if (deep)
+                {
+                    band = perturbEscapeCpu(*deep, ((double)x + dx - deep->refX) * deep->Re_factor,
+                                            -((double)y + dy - deep->refY) * deep->Im_factor, maxIter, iter, frac, rebases);
+                }
+                else
+                {
+                    band = g_mandelEscape(view.minX + ((double)x + dx) * view.Re_factor,
+                                          view.MaxIm - ((double)y + dy) * view.Im_factor,
+                                          maxIter, iter, frac, counts);
+                }
+                aa.samples[p * AA_SAMPLES + s] = packEscape(band, iter, frac);
+            }
+        }
+    });
+}
+
+// Colour the refined pixels of 'frame' as the mean of their samples (step 4 above), after the frame has been coloured
+static void colourAntialiasedCpu(CpuFrame &frame, ThreadPool &pool, const AntialiasFrame &aa)
+{
+    if (frame.format == FRAME_ITER)
+    {
+        return;
+    }
+    const unsigned int chunk = 1024;
+    pool.parallelFor((unsigned int)((aa.pixels.size() + chunk - 1) / chunk), [&](unsigned int c) {
+        size_t end = std::min(aa.pixels.size(), (size_t)(c + 1) * chunk);
+        for (size_t p = (size_t)c * chunk; p < end; p++)
+        {
+            size_t i = aa.pixels[p];
+            float sum[4];
+            paletteColour(g_mandelPalette, frame.pixelIter[i], sum);
+            for (unsigned int s = 0; s < AA_SAMPLES; s++)
+            {
+                float colour[4];
+                paletteColour(g_mandelPalette, aa.samples[p * AA_SAMPLES + s], colour);
+                for (int k = 0; k < 4; k++)
+                {
+                    sum[k] += colour[k];
+                }
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                sum[k] /= (float)(AA_SAMPLES + 1);
+            }
+            if (frame.format == FRAME_RGBA32F)
+            {
+                memcpy(&frame.rgba[i * 4], sum, sizeof(sum));
+            }
+            else
+            {
+                frame.texels[i] = packRgba8(sum);
+            }
+        }
+    });
+}
+
+#endif // ANTIALIAS_H
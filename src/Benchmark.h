@@ -0,0 +1,107 @@
+// Benchmark suite (--benchmark)
+// Renders a fixed set of named viewports several times each with the selected engine and reports, for every view, the
+// frame time (median and 99th percentile), the time the kernels ran for according to the OpenCL profiling counters
+// (GPU engine), Mpixels/s and iterations/s. Each view has its own fixed iteration limit, the iteration cache and
+// progressive rendering are off, and every view gets one untimed warm-up frame, so runs of the same build on the same
+// machine can be compared. The results are printed as a table and written as JSON (--bench-out), one object per view,
+// for comparing builds.
+// Iterations are counted from the frame's packed results with packedIterationSum(): the work of a plain escape-time
+// loop. Interior short-circuits and perturbation skip some of it, which shows up as a higher rate.
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+struct BenchView
+{
+    const char *name;
+    const char *re; // centre, as decimal strings for the deep views
+    const char *im;
+    double width;
+    float maxIter;
+};
+
+static const BenchView BENCH_VIEWS[] = {
+    {"default", "-0.55", "0", 3.0, 1024.0f},
+    {"seahorse", "-0.7443", "0.1137", 0.002, 4096.0f},
+    {"elephant", "0.28", "0.008", 0.02, 4096.0f},
+    {"minibrot", "-1.7548776662466927", "0", 0.04, 4096.0f},
+    {"deep", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139", 1e-12, 8192.0f},
+};
+static const unsigned int BENCH_VIEW_COUNT = sizeof(BENCH_VIEWS) / sizeof(BENCH_VIEWS[0]);
+
+struct BenchResult
+{
+    const BenchView *view = NULL;
+    float maxIter = 0.0f;
+    unsigned int pixels = 0;
+    double iterations = 0.0;     // per frame, see above
+    std::vector<double> frameMs; // one per timed run
+    std::vector<double> kernelMs;
+};
+
+// Nearest rank percentile (0..1) of 'values', 0 if there are none
+static double benchPercentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)(fraction * values.size() + 0.999999);
+    return values[std::min(std::max(rank, (size_t)1), values.size()) - 1];
+}
+
+static void printBenchResult(const BenchResult &r)
+{
+    double p50 = benchPercentile(r.frameMs, 0.5);
+    char kernels[32] = "     n/a   ";
+    if (!r.kernelMs.empty())
+    {
+        snprintf(kernels, sizeof(kernels), "%8.2f ms", benchPercentile(r.kernelMs, 0.5));
+    }
+    printf("%-10s maxIter %7.0f  frame p50 %8.2f ms  p99 %8.2f ms  kernels p50 %s  %8.2f Mpixels/s  %9.1f Miterations/s\n",
+           r.view->name, r.maxIter, p50, benchPercentile(r.frameMs, 0.99), kernels,
+           p50 > 0.0 ? r.pixels / (p50 * 1000.0) : 0.0, p50 > 0.0 ? r.iterations / (p50 * 1000.0) : 0.0);
+}
+
+// JSON with the machine and settings in 'engine' (already JSON-safe) and one object per view
+static bool writeBenchJson(const char *path, const std::string &engine, unsigned int width, unsigned int height,
+                           const std::vector<BenchResult> &results)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+    {
+        return false;
+    }
+    fprintf(fp, "{\n  \"engine\": \"%s\",\n  \"width\": %u,\n  \"height\": %u,\n  \"views\": [\n", engine.c_str(), width,
+            height);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        double p50 = benchPercentile(r.frameMs, 0.5);
+        fprintf(fp, "    {\"name\": \"%s\", \"re\": \"%s\", \"im\": \"%s\", \"width\": %.17g, \"maxIter\": %.0f, \"runs\": %zu,\n",
+                r.view->name, r.view->re, r.view->im, r.view->width, r.maxIter, r.frameMs.size());
+        fprintf(fp, "     \"frameMs\": {\"p50\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f},\n", p50,
+                benchPercentile(r.frameMs, 0.99), benchPercentile(r.frameMs, 0.0), benchPercentile(r.frameMs, 1.0));
+        if (r.kernelMs.empty())
+        {
+            fprintf(fp, "     \"kernelMs\": null,\n");
+        }
+        else
+        {
+            fprintf(fp, "     \"kernelMs\": {\"p50\": %.4f, \"p99\": %.4f},\n", benchPercentile(r.kernelMs, 0.5),
+                    benchPercentile(r.kernelMs, 0.99));
+        }
+        fprintf(fp, "     \"iterations\": %.0f, \"mpixelsPerSecond\": %.4f, \"iterationsPerSecond\": %.6g}%s\n",
+                r.iterations, p50 > 0.0 ? r.pixels / (p50 * 1000.0) : 0.0, p50 > 0.0 ? r.iterations * 1000.0 / p50 : 0.0,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+#endif // BENCHMARK_H
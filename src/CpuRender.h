@@ -0,0 +1,997 @@
+// CPU render engine
+// A native C++ port of the 'mandel' kernel in Mandel.cl. It writes texels into a plain host framebuffer
+// so the explorer can render on machines without a GPU, an OpenCL runtime or a display.
+// The escape-time loop, band thresholds and packed escape results below must be kept in step with Mandel.cl, otherwise
+// the CPU and GPU engines will produce different images for the same minX / maxX / minY viewport.
+#ifndef CPU_RENDER_H
+#define CPU_RENDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Simple fixed size thread pool. parallelFor() hands out indices [0, count) to every worker (and the calling thread)
+// through an atomic counter and returns once every index has been processed.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int numThreads = 0)
+    {
+        if (numThreads == 0)
+        {
+            numThreads = std::thread::hardware_concurrency();
+        }
+        if (numThreads == 0)
+        {
+            numThreads = 1;
+        }
+        // The calling thread also takes part in parallelFor(), so one fewer worker is needed
+        for (unsigned int i = 1; i < numThreads; i++)
+        {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            bStop = true;
+        }
+        cvWork.notify_all();
+        for (std::thread &t : workers)
+        {
+            t.join();
+        }
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int threadCount() const { return (unsigned int)workers.size() + 1; }
+
+    void parallelFor(unsigned int count, const std::function<void(unsigned int)> &fn)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            job = &fn;
+            jobCount = count;
+            nextIndex = 0;
+            busyWorkers = (unsigned int)workers.size();
+            generation++;
+        }
+        cvWork.notify_all();
+        runJob(fn, count);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        cvDone.wait(lock, [this] { return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+private:
+    void runJob(const std::function<void(unsigned int)> &fn, unsigned int count)
+    {
+        for (unsigned int i = nextIndex.fetch_add(1); i < count; i = nextIndex.fetch_add(1))
+        {
+            fn(i);
+        }
+    }
+    void workerLoop()
+    {
+        unsigned long long seenGeneration = 0;
+        for (;;)
+        {
+            const std::function<void(unsigned int)> *fn;
+            unsigned int count;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cvWork.wait(lock, [&] { return bStop || generation != seenGeneration; });
+                if (bStop)
+                {
+                    return;
+                }
+                seenGeneration = generation;
+                fn = job;
+                count = jobCount;
+            }
+            runJob(*fn, count);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                busyWorkers--;
+            }
+            cvDone.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cvWork;
+    std::condition_variable cvDone;
+    const std::function<void(unsigned int)> *job = nullptr;
+    unsigned int jobCount = 0;
+    std::atomic<unsigned int> nextIndex{0};
+    unsigned int busyWorkers = 0;
+    unsigned long long generation = 0;
+    bool bStop = false;
+};
+
+// Interior short-circuits, shared with Mandel.cl. Points inside the main cardioid or the period-2 bulb never escape,
+// so they are painted black without iterating. Orbits that come back to within MANDEL_PERIOD_EPSILON of a checkpoint
+// (Brent-style: the checkpoint interval doubles each time it is reached) are periodic and will never escape either.
+static const double MANDEL_PERIOD_EPSILON = 1e-12;
+static const int MANDEL_PERIOD_FIRST_CHECK = 8;
+static bool g_bMandelShortcuts = true;
+
+// Iteration limit of the frame being rendered (see AdaptiveIter.h), passed to the kernels as 'maxIter'
+static float g_mandelMaxIter = 10000.0f;
+
+// Pixels that skipped the escape loop (cardioid / bulb) or left it early (periodic orbit)
+struct MandelShortcutCounts
+{
+    unsigned int cardioid = 0;
+    unsigned int bulb = 0;
+    unsigned int periodic = 0;
+};
+
+#include "TileScheduler.h"
+#include "MarianiSilver.h"
+#include "Progressive.h"
+
+// Pixel to complex plane mapping used by the 'mandel' kernel
+struct MandelView
+{
+    double minX;
+    double MaxIm;
+    double Re_factor;
+    double Im_factor;
+};
+
+// Pixel format of the framebuffer and of the texture it is shown from
+//  - FRAME_RGBA32F: 4 floats per pixel (16 bytes), the original format
+//  - FRAME_RGBA8: the colour packed into one 32-bit texel, bytes R, G, B, A in memory order
+//  - FRAME_ITER: the packed escape result (see packEscape()) in one 32-bit texel, coloured through the palette by a
+//    shader when the frame is drawn, so a palette change does not touch the framebuffer at all
+enum FrameFormat
+{
+    FRAME_RGBA32F,
+    FRAME_RGBA8,
+    FRAME_ITER,
+};
+
+static const char *const FRAME_FORMAT_NAMES[] = {"rgba32f", "rgba8", "iter"};
+
+static inline size_t frameFormatBytes(FrameFormat format) { return format == FRAME_RGBA32F ? 4 * sizeof(float) : 4; }
+
+// Format called 'name' (one of FRAME_FORMAT_NAMES). Returns false for an unknown name.
+static bool parseFrameFormat(const char *name, FrameFormat &format)
+{
+    for (int f = FRAME_RGBA32F; f <= FRAME_ITER; f++)
+    {
+        if (strcmp(name, FRAME_FORMAT_NAMES[f]) == 0)
+        {
+            format = (FrameFormat)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Host framebuffer with the same layout as 'RenderFromTexture' (row 0 is the bottom row on screen). Only the buffer
+// of the frame's format is allocated.
+struct CpuFrame
+{
+    unsigned int width = 0;
+    unsigned int height = 0;
+    FrameFormat format = FRAME_RGBA32F;
+    std::vector<float> rgba;      // FRAME_RGBA32F
+    std::vector<uint32_t> texels; // FRAME_RGBA8 and FRAME_ITER
+
+    // Per cell iteration totals of the last frame and the viewport they belong to, used to estimate tile costs
+    std::vector<double> cellCost;
+    MandelView costView = {0.0, 0.0, 0.0, 0.0};
+    bool bHasCost = false;
+    TileSchedulerStats schedStats;
+    MandelShortcutCounts shortcutCounts;
+    unsigned int rebases = 0; // perturbation rebases (glitches avoided) in the last frame
+
+    // Packed escape results (see packEscape()) and statistics of the last Mariani-Silver frame
+    std::vector<int> pixelIter;
+    SubdivisionStats subdivStats;
+
+    void resize(unsigned int w, unsigned int h)
+    {
+        width = w;
+        height = h;
+        if (format == FRAME_RGBA32F)
+        {
+            rgba.assign((size_t)w * h * 4, 0.0f);
+            texels.clear();
+        }
+        else
+        {
+            texels.assign((size_t)w * h, 0);
+            rgba.clear();
+        }
+        pixelIter.assign((size_t)w * h, 0);
+        cellCost.clear();
+        bHasCost = false;
+    }
+
+    unsigned char *pixels()
+    {
+        return format == FRAME_RGBA32F ? (unsigned char *)rgba.data() : (unsigned char *)texels.data();
+    }
+};
+
+// Colour band an escape at iteration n falls in (1..6), or 0 if it falls in none of them.
+// NB: The kernel compares against float fractions of maxIter, which leaves a gap between bands 5 and 6 (n = 1428 when
+// maxIter = 10000). Escapes in the gap are not counted as escapes and iteration carries on, exactly as in Mandel.cl.
+static inline int mandelColourBand(int n, float maxIter)
+{
+    if (n >= 0 && n <= (maxIter / 200 - 1))
+        return 1;
+    if (n >= maxIter / 200 && n <= (maxIter / 100 - 1))
+        return 2;
+    if (n >= maxIter / 100 && n <= (maxIter / 50 - 1))
+        return 3;
+    if (n >= maxIter / 50 && n <= (maxIter / 25 - 1))
+        return 4;
+    if (n >= maxIter / 25 && n <= (maxIter / 7 - 1))
+        return 5;
+    if (n >= maxIter / 7 && n <= (maxIter - 1))
+        return 6;
+    return 0;
+}
+
+// Banded colouring from the end of the 'mandel' kernel. Band 0 means the pixel never escaped and is painted black.
+// The gradients were tuned for maxIter = 10000 (BAND_COLOUR_MAX_ITER) and are stretched with the band thresholds, so
+// each band keeps its colours under a higher limit instead of running out to black.
+static const float BAND_COLOUR_MAX_ITER = 10000.0f;
+static inline void mandelBandColour(int band, int iter, float maxIter, float *out)
+{
+    static const float teal[3] = {51.0f / 255.0f, 201.0f / 255.0f, 153.0f / 255.0f};
+    static const float darkOrange[3] = {255.0f / 255.0f, 153.0f / 255.0f, 20.0f / 255.0f};
+    static const float greenOlive[3] = {153.0f / 255.0f, 204.0f / 255.0f, 20.0f / 255.0f};
+    static const float gold[3] = {255.0f / 255.0f, 255.0f / 255.0f, 20.0f / 255.0f};
+    static const float lightRed[3] = {255.0f / 255.0f, 51.0f / 255.0f, 51.0f / 255.0f};
+
+    float fIter = (float)iter * BAND_COLOUR_MAX_ITER / maxIter;
+    for (int c = 0; c < 3; c++)
+    {
+        switch (band)
+        {
+        case 1:
+            out[c] = fIter * teal[c] / 50.0f;
+            break;
+        case 2:
+            out[c] = darkOrange[c] - (fIter * darkOrange[c] / 150.0f);
+            break;
+        case 3:
+            out[c] = greenOlive[c] - (fIter * greenOlive[c] / 200.0f);
+            break;
+        case 4:
+            out[c] = gold[c] - (fIter * gold[c] / 400.0f);
+            break;
+        case 5:
+            out[c] = teal[c] - (fIter * teal[c] / 2000.0f);
+            break;
+        case 6:
+            out[c] = lightRed[c] - (fIter * lightRed[c] / 4000.0f);
+            break;
+        default:
+            out[c] = 0.0f;
+            break;
+        }
+    }
+    out[3] = 1.0f;
+}
+
+// Fractional part of the smooth iteration count n + 1 - log2(log2 |z|) of an escape with |z|^2 = mag2. The escape
+// radius is only 2, so it is clamped to [0, 1].
+static inline float mandelSmoothFraction(double mag2)
+{
+    float f = 1.0f - log2f(0.5f * log2f((float)mag2));
+    return f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+}
+
+// Escape results are stored per pixel as (iter * 8 + band) << MANDEL_FRAC_BITS (band 0..6), with the smooth fraction
+// in the low bits, as in Mandel.cl. Pixels with the same band and iteration compare equal in packedBandIter().
+static const int MANDEL_FRAC_BITS = 8;
+static inline int packEscape(int band, int iter, float frac)
+{
+    int q = (int)(frac * (1 << MANDEL_FRAC_BITS));
+    q = q < (1 << MANDEL_FRAC_BITS) - 1 ? q : (1 << MANDEL_FRAC_BITS) - 1;
+    return ((iter * 8 + band) << MANDEL_FRAC_BITS) | q;
+}
+static inline int packedBandIter(int packed) { return packed >> MANDEL_FRAC_BITS; }
+static inline int packedBand(int packed) { return (packed >> MANDEL_FRAC_BITS) & 7; }
+static inline int packedIter(int packed) { return packed >> (MANDEL_FRAC_BITS + 3); }
+static inline float packedFrac(int packed)
+{
+    return (float)(packed & ((1 << MANDEL_FRAC_BITS) - 1)) / (1 << MANDEL_FRAC_BITS);
+}
+
+// Iterations a plain escape-time loop spends on 'count' packed results: the escape iteration of every escaped pixel
+// plus maxIter for every interior one. Pixels not known yet (negative) count nothing.
+static inline double packedIterationSum(const int *packed, size_t count, float maxIter)
+{
+    double iterations = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int v = packed[i];
+        if (v >= 0)
+        {
+            iterations += packedBand(v) == 0 ? (double)maxIter : (double)packedIter(v);
+        }
+    }
+    return iterations;
+}
+
+// 1 = inside the main cardioid, 2 = inside the period-2 bulb, 0 = neither
+static inline int mandelInteriorTest(double c_re, double c_im)
+{
+    double xq = c_re - 0.25;
+    double y2 = c_im * c_im;
+    double q = xq * xq + y2;
+    if (q * (q + xq) <= 0.25 * y2)
+    {
+        return 1;
+    }
+    double xb = c_re + 1.0;
+    if (xb * xb + y2 <= 0.0625)
+    {
+        return 2;
+    }
+    return 0;
+}
+
+// Escape-time loop for one point. Returns the colour band (0 = inside), the number of iterations run in 'iter' and
+// the smooth fraction of an escape in 'frac'.
+static inline int mandelEscapeCpu(double c_re, double c_im, float maxIter, int &iter, float &frac,
+                                  MandelShortcutCounts &counts)
+{
+    const bool bShortcuts = g_bMandelShortcuts;
+    iter = 0;
+    frac = 0.0f;
+    if (bShortcuts)
+    {
+        int region = mandelInteriorTest(c_re, c_im);
+        if (region == 1)
+        {
+            counts.cardioid++;
+            return 0;
+        }
+        if (region == 2)
+        {
+            counts.bulb++;
+            return 0;
+        }
+    }
+
+    double Z_re = c_re, Z_im = c_im;
+    double saved_re = Z_re, saved_im = Z_im;
+    int checkLen = MANDEL_PERIOD_FIRST_CHECK;
+    int checkCount = 0;
+    for (int n = 0; n < maxIter; n++)
+    {
+        double Z_re2 = Z_re * Z_re;
+        double Z_im2 = Z_im * Z_im;
+        if (Z_re2 + Z_im2 > 4)
+        {
+            int band = mandelColourBand(n, maxIter);
+            if (band != 0)
+            {
+                frac = mandelSmoothFraction(Z_re2 + Z_im2);
+                return band;
+            }
+        }
+        Z_im = 2 * Z_re * Z_im + c_im;
+        Z_re = Z_re2 - Z_im2 + c_re;
+        iter++;
+        if (bShortcuts)
+        {
+            if (fabs(Z_re - saved_re) < MANDEL_PERIOD_EPSILON && fabs(Z_im - saved_im) < MANDEL_PERIOD_EPSILON)
+            {
+                counts.periodic++;
+                return 0;
+            }
+            if (++checkCount == checkLen)
+            {
+                checkCount = 0;
+                checkLen *= 2;
+                saved_re = Z_re;
+                saved_im = Z_im;
+            }
+        }
+    }
+    return 0;
+}
+
+#include "Fractal.h"
+#include "MandelSimd.h"
+#include "Perturbation.h"
+#include "Palette.h"
+
+// Store the packed escape result of pixel 'i' in the framebuffer, coloured unless the frame keeps results
+static inline void storeFramePixel(CpuFrame &frame, size_t i, int packed)
+{
+    switch (frame.format)
+    {
+    case FRAME_RGBA32F:
+        paletteColour(g_mandelPalette, packed, &frame.rgba[i * 4]);
+        break;
+    case FRAME_RGBA8:
+        frame.texels[i] = paletteColourRgba8(g_mandelPalette, packed);
+        break;
+    case FRAME_ITER:
+        frame.texels[i] = (uint32_t)packed;
+        break;
+    }
+}
+
+// Escape-time span function used by the CPU engine, chosen at startup by initCpuRender()
+static MandelSpanFn g_mandelSpan = mandelSpanScalar;
+
+// Pick the escape-time span function for 'level', which is clamped to what the CPU supports
+static void initCpuRender(SimdLevel &level)
+{
+    g_mandelSpan = selectMandelSpan(level);
+    printf("CPU render engine escape loop: %s\n", simdLevelName(level));
+}
+
+// Tiles are aligned to cost cells, so each cell of the cost grid is written by exactly one tile
+static const unsigned int CPU_COST_CELL = 16;
+static const unsigned int CPU_TILE_SIZE = 64;
+
+// Escape bands, iteration counts and smooth fractions of 'count' pixels of row y at columns x0, x0 + stride... With
+// 'deep' set, pixels iterate their delta from the reference orbit instead of the full orbit.
+static inline void mandelRowCpu(const MandelView &view, const PerturbFrame *deep, unsigned int y, unsigned int x0,
+                                unsigned int stride, unsigned int count, int *bands, int *iters, float *fracs,
+                                MandelShortcutCounts &counts, unsigned int &rebases)
+{
+    const float maxIter = g_mandelMaxIter;
+    if (deep)
+    {
+        double dcIm = -((double)y - deep->refY) * deep->Im_factor;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            double dcRe = ((double)(x0 + i * stride) - deep->refX) * deep->Re_factor;
+            bands[i] = perturbEscapeCpu(*deep, dcRe, dcIm, maxIter, iters[i], fracs[i], rebases);
+        }
+    }
+    else if (g_fractalFamily == FRACTAL_MANDELBROT)
+    {
+        g_mandelSpan(view.minX, view.Re_factor, view.MaxIm - y * view.Im_factor, x0, stride, count, maxIter, bands, iters,
+                     fracs, counts);
+    }
+    else
+    {
+        // The other families (Fractal.h) have no SIMD spans and go through the dispatch table a pixel at a time
+        double c_im = view.MaxIm - y * view.Im_factor;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            bands[i] = g_mandelEscape(view.minX + (x0 + i * stride) * view.Re_factor, c_im, maxIter, iters[i], fracs[i],
+                                      counts);
+        }
+    }
+}
+
+// Render one tile of the frame, keeping the packed results in frame.pixelIter, and add its iteration totals to
+// 'cellCost'. Pixels with a result in 'known' (packed, -1 = unknown) are copied instead of iterated.
+static void renderMandelTileCpu(CpuFrame &frame, const MandelView &view, const PerturbFrame *deep,
+                                const RenderTile &tile, const int *known, std::vector<double> &cellCost,
+                                unsigned int cellsX, MandelShortcutCounts &counts, unsigned int &rebases)
+{
+    const unsigned int w = frame.width;
+    std::vector<int> bands(tile.w);
+    std::vector<int> iters(tile.w);
+    std::vector<float> fracs(tile.w);
+
+    for (unsigned int y = tile.y0; y < tile.y0 + tile.h; y++)
+    {
+        int *packedRow = &frame.pixelIter[(size_t)y * w];
+        double *costRow = &cellCost[(y / CPU_COST_CELL) * cellsX];
+
+        if (known)
+        {
+            // Iterate the runs of unknown pixels only
+            const int *knownRow = &known[(size_t)y * w];
+            unsigned int i = 0;
+            while (i < tile.w)
+            {
+                unsigned int x = tile.x0 + i;
+                if (knownRow[x] >= 0)
+                {
+                    bands[i] = packedBand(knownRow[x]);
+                    iters[i] = packedIter(knownRow[x]);
+                    fracs[i] = packedFrac(knownRow[x]);
+                    i++;
+                    continue;
+                }
+                unsigned int run = 1;
+                while (i + run < tile.w && knownRow[x + run] < 0)
+                {
+                    run++;
+                }
+                mandelRowCpu(view, deep, y, x, 1, run, &bands[i], &iters[i], &fracs[i], counts, rebases);
+                i += run;
+            }
+        }
+        else
+        {
+            mandelRowCpu(view, deep, y, tile.x0, 1, tile.w, bands.data(), iters.data(), fracs.data(), counts, rebases);
+        }
+        for (unsigned int i = 0; i < tile.w; i++)
+        {
+            unsigned int x = tile.x0 + i;
+            packedRow[x] = packEscape(bands[i], iters[i], fracs[i]);
+            storeFramePixel(frame, (size_t)y * w + x, packedRow[x]);
+            // A few iterations' worth of per pixel overhead so cheap regions are not estimated as free
+            costRow[x / CPU_COST_CELL] += iters[i] + 4;
+        }
+    }
+}
+
+// Expected cost of every cost cell of the new viewport, looked up from the previous frame's iteration totals at the
+// same point of the complex plane. Cells that were off screen in the previous frame get its mean cell cost.
+static std::vector<double> predictCellCosts(const CpuFrame &frame, const MandelView &view, unsigned int cellsX,
+                                            unsigned int cellsY)
+{
+    std::vector<double> predicted((size_t)cellsX * cellsY, 1.0);
+    if (!frame.bHasCost || frame.cellCost.size() != predicted.size())
+    {
+        return predicted;
+    }
+    double meanCost = 0.0;
+    for (double c : frame.cellCost)
+    {
+        meanCost += c;
+    }
+    meanCost /= frame.cellCost.size();
+
+    const MandelView &prev = frame.costView;
+    // Cell cost scales with pixel area: a zoom in spreads one old cell over several new ones
+    double areaScale = (view.Re_factor * view.Im_factor) / (prev.Re_factor * prev.Im_factor);
+    for (unsigned int cy = 0; cy < cellsY; cy++)
+    {
+        for (unsigned int cx = 0; cx < cellsX; cx++)
+        {
+            double c_re = view.minX + (cx + 0.5) * CPU_COST_CELL * view.Re_factor;
+            double c_im = view.MaxIm - (cy + 0.5) * CPU_COST_CELL * view.Im_factor;
+            double px = (c_re - prev.minX) / prev.Re_factor;
+            double py = (prev.MaxIm - c_im) / prev.Im_factor;
+            double cost = meanCost;
+            if (px >= 0 && py >= 0 && px < frame.width && py < frame.height)
+            {
+                cost = frame.cellCost[(size_t)(py / CPU_COST_CELL) * cellsX + (size_t)(px / CPU_COST_CELL)] * areaScale;
+            }
+            predicted[(size_t)cy * cellsX + cx] = cost > 1.0 ? cost : 1.0;
+        }
+    }
+    return predicted;
+}
+
+// Render a whole frame on every thread of the pool through the work-stealing tile scheduler. Tile costs are estimated
+// from the previous frame so tiles over the set are split finely and handed out first. 'deep' selects perturbation
+// rendering against a precomputed reference orbit (NULL for the plain double precision loop). 'known' optionally holds
+// packed results already known for some pixels (-1 for the rest), e.g. from the iteration cache.
+static void renderMandelCpu(CpuFrame &frame, ThreadPool &pool, const MandelView &view, const PerturbFrame *deep = NULL,
+                            const std::vector<int> *known = NULL)
+{
+    const unsigned int cellsX = (frame.width + CPU_COST_CELL - 1) / CPU_COST_CELL;
+    const unsigned int cellsY = (frame.height + CPU_COST_CELL - 1) / CPU_COST_CELL;
+    std::vector<double> predicted = predictCellCosts(frame, view, cellsX, cellsY);
+    std::vector<double> cellCost((size_t)cellsX * cellsY, 0.0);
+
+    TileScheduler::CostFn estimate = [&](const RenderTile &t) {
+        double cost = 0.0;
+        for (unsigned int cy = t.y0 / CPU_COST_CELL; cy < (t.y0 + t.h + CPU_COST_CELL - 1) / CPU_COST_CELL; cy++)
+        {
+            for (unsigned int cx = t.x0 / CPU_COST_CELL; cx < (t.x0 + t.w + CPU_COST_CELL - 1) / CPU_COST_CELL; cx++)
+            {
+                cost += predicted[(size_t)cy * cellsX + cx];
+            }
+        }
+        return cost;
+    };
+
+    std::vector<RenderTile> tiles;
+    for (unsigned int y = 0; y < frame.height; y += CPU_TILE_SIZE)
+    {
+        for (unsigned int x = 0; x < frame.width; x += CPU_TILE_SIZE)
+        {
+            RenderTile t = {x, y, std::min(CPU_TILE_SIZE, frame.width - x), std::min(CPU_TILE_SIZE, frame.height - y), 0.0};
+            t.cost = estimate(t);
+            tiles.push_back(t);
+        }
+    }
+
+    std::atomic<unsigned int> cardioid{0};
+    std::atomic<unsigned int> bulb{0};
+    std::atomic<unsigned int> periodic{0};
+    std::atomic<unsigned int> rebases{0};
+    const int *knownData = known ? known->data() : NULL;
+    TileScheduler scheduler(CPU_COST_CELL);
+    scheduler.run(pool, tiles, estimate,
+                  [&](const RenderTile &t) {
+                      MandelShortcutCounts counts;
+                      unsigned int tileRebases = 0;
+                      renderMandelTileCpu(frame, view, deep, t, knownData, cellCost, cellsX, counts, tileRebases);
+                      cardioid += counts.cardioid;
+                      bulb += counts.bulb;
+                      periodic += counts.periodic;
+                      rebases += tileRebases;
+                  },
+                  frame.schedStats);
+    frame.shortcutCounts.cardioid = cardioid;
+    frame.shortcutCounts.bulb = bulb;
+    frame.shortcutCounts.periodic = periodic;
+
+    frame.rebases = rebases;
+    frame.cellCost.swap(cellCost);
+    frame.costView = view;
+    frame.bHasCost = true;
+}
+
+// Colour the frame from the packed results in frame.pixelIter through the palette, showing each cellW x cellH cell
+// (powers of two) in the colour of its top left pixel. This is all a palette change needs. For a complete frame (1x1 cells), the cost grid for the tile scheduler is rebuilt as
+// if every pixel had been iterated.
+static void colourPackedFrameCpu(CpuFrame &frame, ThreadPool &pool, const MandelView &view, unsigned int cellW,
+                                 unsigned int cellH)
+{
+    const unsigned int w = frame.width;
+    const unsigned int h = frame.height;
+    const bool bComplete = cellW == 1 && cellH == 1;
+    const unsigned int cellsX = (w + CPU_COST_CELL - 1) / CPU_COST_CELL;
+    const unsigned int cellsY = (h + CPU_COST_CELL - 1) / CPU_COST_CELL;
+    const size_t pixelBytes = frameFormatBytes(frame.format);
+    unsigned char *pixels = frame.pixels();
+    std::vector<double> cellCost(bComplete ? (size_t)cellsX * cellsY : 0, 0.0);
+    pool.parallelFor(cellsY, [&](unsigned int cy) {
+        // Cost cells are at least as tall as the display cells, so each task colours whole cells
+        for (unsigned int y = cy * CPU_COST_CELL; y < std::min(h, (cy + 1) * CPU_COST_CELL); y++)
+        {
+            unsigned char *row = pixels + (size_t)y * w * pixelBytes;
+            if ((y & (cellH - 1)) != 0)
+            {
+                // Same colours as the top row of the cell
+                memcpy(row, pixels + (size_t)(y & ~(cellH - 1)) * w * pixelBytes, w * pixelBytes);
+                continue;
+            }
+            const int *src = &frame.pixelIter[(size_t)y * w];
+            for (unsigned int x = 0; x < w; x += cellW)
+            {
+                storeFramePixel(frame, (size_t)y * w + x, src[x]);
+                for (unsigned int k = 1; k < cellW && x + k < w; k++)
+                {
+                    memcpy(row + (x + k) * pixelBytes, row + x * pixelBytes, pixelBytes);
+                }
+                if (bComplete)
+                {
+                    cellCost[(size_t)cy * cellsX + x / CPU_COST_CELL] += packedIter(src[x]) + 4;
+                }
+            }
+        }
+    });
+    if (bComplete)
+    {
+        frame.cellCost.swap(cellCost);
+        frame.costView = view;
+        frame.bHasCost = true;
+    }
+}
+
+// Iteration histogram of a packed field. Each thread counts a contiguous share of the pixels into its own histogram and
+// the per-thread histograms are summed at the end, so there is no sharing between threads while counting. Within a
+// thread, neighbouring pixels go to HISTOGRAM_LANES interleaved copies of the bins: neighbours usually have the same
+// count, and incrementing one counter back to back would wait on the previous increment every time.
+static const unsigned int HISTOGRAM_LANES = 4;
+
+static void buildHistogramCpu(const std::vector<int> &packed, ThreadPool &pool, float maxIter, IterHistogram &histogram)
+{
+    const unsigned int parts = pool.threadCount();
+    std::vector<IterHistogram> partial(parts);
+    pool.parallelFor(parts, [&](unsigned int p) {
+        IterHistogram &h = partial[p];
+        h.clear(maxIter);
+        // Bin HISTOGRAM_BINS of each lane counts the interior pixels
+        std::vector<unsigned int> lanes((size_t)HISTOGRAM_LANES * (HISTOGRAM_BINS + 1), 0);
+        int low = INT_MAX;
+        int high = -1;
+        const size_t begin = packed.size() * p / parts;
+        const size_t end = packed.size() * (p + 1) / parts;
+        for (size_t i = begin; i < end; i++)
+        {
+            const int v = packed[i];
+            if (v < 0)
+            {
+                continue;
+            }
+            // Branch free: interior and escaped pixels are mixed along the edges of the set
+            unsigned int *lane = &lanes[(i & (HISTOGRAM_LANES - 1)) * (HISTOGRAM_BINS + 1)];
+            const int iter = packedIter(v);
+            const bool bInterior = packedBand(v) == 0;
+            lane[bInterior ? HISTOGRAM_BINS : histogramBin(iter, h.binScale)]++;
+            low = bInterior ? low : std::min(low, iter);
+            high = bInterior ? high : std::max(high, iter);
+        }
+        for (unsigned int l = 0; l < HISTOGRAM_LANES; l++)
+        {
+            const unsigned int *lane = &lanes[(size_t)l * (HISTOGRAM_BINS + 1)];
+            for (unsigned int b = 0; b < HISTOGRAM_BINS; b++)
+            {
+                h.bins[b] += lane[b];
+                h.escaped += lane[b];
+            }
+            h.interior += lane[HISTOGRAM_BINS];
+        }
+        h.lowIter = h.escaped > 0 ? low : -1;
+        h.highIter = high;
+    });
+    histogram.clear(maxIter);
+    for (const IterHistogram &h : partial)
+    {
+        histogram.merge(h);
+    }
+    histogram.finish();
+}
+
+// Iterate 'count' pixels of row y from column x0 into the packed escape buffer
+static void subdivComputeRow(CpuFrame &frame, const MandelView &view, const PerturbFrame *deep, unsigned int y,
+                             unsigned int x0, unsigned int count, std::vector<int> &bands, std::vector<int> &iters,
+                             std::vector<float> &fracs, MandelShortcutCounts &counts, unsigned int &rebases)
+{
+    bands.resize(count);
+    iters.resize(count);
+    fracs.resize(count);
+    mandelRowCpu(view, deep, y, x0, 1, count, bands.data(), iters.data(), fracs.data(), counts, rebases);
+    int *dst = &frame.pixelIter[(size_t)y * frame.width + x0];
+    for (unsigned int i = 0; i < count; i++)
+    {
+        dst[i] = packEscape(bands[i], iters[i], fracs[i]);
+    }
+}
+
+// Render a whole frame with Mariani-Silver subdivision (see MarianiSilver.h). The grid lines and then each pass of
+// rectangles are spread over the pool; the packed results are coloured at the end.
+static void renderMandelSubdivideCpu(CpuFrame &frame, ThreadPool &pool, const MandelView &view,
+                                     const PerturbFrame *deep = NULL)
+{
+    const unsigned int w = frame.width;
+    const unsigned int h = frame.height;
+    std::vector<int> xs = subdivGridLines(w);
+    std::vector<int> ys = subdivGridLines(h);
+
+    std::atomic<unsigned int> cardioid{0};
+    std::atomic<unsigned int> bulb{0};
+    std::atomic<unsigned int> periodic{0};
+    std::atomic<unsigned int> rebases{0};
+    std::atomic<unsigned int> filled{0};
+    std::atomic<unsigned int> computed{0};
+    std::atomic<unsigned int> overflows{0};
+    auto addCounts = [&](const MandelShortcutCounts &counts, unsigned int taskRebases) {
+        cardioid += counts.cardioid;
+        bulb += counts.bulb;
+        periodic += counts.periodic;
+        rebases += taskRebases;
+    };
+
+    // Grid lines: whole rows, then the columns between them
+    pool.parallelFor((unsigned int)(ys.size() + xs.size()), [&](unsigned int i) {
+        MandelShortcutCounts counts;
+        unsigned int taskRebases = 0;
+        std::vector<int> bands, iters;
+        std::vector<float> fracs;
+        if (i < ys.size())
+        {
+            subdivComputeRow(frame, view, deep, ys[i], 0, w, bands, iters, fracs, counts, taskRebases);
+            computed += w;
+        }
+        else
+        {
+            int x = xs[i - ys.size()];
+            for (size_t j = 0; j + 1 < ys.size(); j++)
+            {
+                for (int y = ys[j] + 1; y < ys[j + 1]; y++)
+                {
+                    subdivComputeRow(frame, view, deep, y, x, 1, bands, iters, fracs, counts, taskRebases);
+                    computed++;
+                }
+            }
+        }
+        addCounts(counts, taskRebases);
+    });
+
+    BoundedRectQueue queues[2] = {BoundedRectQueue(SUBDIV_QUEUE_CAPACITY), BoundedRectQueue(SUBDIV_QUEUE_CAPACITY)};
+    queues[0].assign(subdivInitialRects(w, h));
+    SubdivisionStats stats;
+    for (unsigned int pass = 0; queues[pass & 1].size() > 0; pass++)
+    {
+        const BoundedRectQueue &current = queues[pass & 1];
+        BoundedRectQueue &next = queues[(pass + 1) & 1];
+        next.clear();
+        stats.passes++;
+        stats.rects += current.size();
+
+        pool.parallelFor(current.size(), [&](unsigned int i) {
+            const SubdivRect r = current[i];
+            const int iw = r.x1 - r.x0 - 1;
+            const int ih = r.y1 - r.y0 - 1;
+            if (iw <= 0 || ih <= 0)
+            {
+                return;
+            }
+            const int *px = frame.pixelIter.data();
+            // Uniform means the same band and iteration count; the smooth fraction of the corner is copied as well
+            const int value = px[(size_t)r.y0 * w + r.x0];
+            const int key = packedBandIter(value);
+            bool bUniform = true;
+            for (int x = r.x0; x <= r.x1 && bUniform; x++)
+            {
+                bUniform = packedBandIter(px[(size_t)r.y0 * w + x]) == key && packedBandIter(px[(size_t)r.y1 * w + x]) == key;
+            }
+            for (int y = r.y0 + 1; y < r.y1 && bUniform; y++)
+            {
+                bUniform = packedBandIter(px[(size_t)y * w + r.x0]) == key && packedBandIter(px[(size_t)y * w + r.x1]) == key;
+            }
+            if (bUniform)
+            {
+                for (int y = r.y0 + 1; y < r.y1; y++)
+                {
+                    std::fill_n(&frame.pixelIter[(size_t)y * w + r.x0 + 1], iw, value);
+                }
+                filled += iw * ih;
+                return;
+            }
+
+            MandelShortcutCounts counts;
+            unsigned int taskRebases = 0;
+            std::vector<int> bands, iters;
+            std::vector<float> fracs;
+            const int mx = (r.x0 + r.x1) / 2;
+            const int my = (r.y0 + r.y1) / 2;
+            SubdivRect quads[4] = {{r.x0, r.y0, mx, my}, {mx, r.y0, r.x1, my}, {r.x0, my, mx, r.y1}, {mx, my, r.x1, r.y1}};
+            bool bSplit = iw > (int)SUBDIV_MIN_SIZE && ih > (int)SUBDIV_MIN_SIZE;
+            if (bSplit && !next.push4(quads))
+            {
+                bSplit = false;
+                overflows++;
+            }
+            if (bSplit)
+            {
+                // Middle row and column become the shared borders of the four quarters
+                subdivComputeRow(frame, view, deep, my, r.x0 + 1, iw, bands, iters, fracs, counts, taskRebases);
+                for (int y = r.y0 + 1; y < r.y1; y++)
+                {
+                    if (y != my)
+                    {
+                        subdivComputeRow(frame, view, deep, y, mx, 1, bands, iters, fracs, counts, taskRebases);
+                    }
+                }
+                computed += iw + ih - 1;
+            }
+            else
+            {
+                for (int y = r.y0 + 1; y < r.y1; y++)
+                {
+                    subdivComputeRow(frame, view, deep, y, r.x0 + 1, iw, bands, iters, fracs, counts, taskRebases);
+                }
+                computed += iw * ih;
+            }
+            addCounts(counts, taskRebases);
+        });
+    }
+
+    colourPackedFrameCpu(frame, pool, view, 1, 1);
+
+    stats.filled = filled;
+    stats.computed = computed;
+    stats.overflows = overflows;
+    frame.subdivStats = stats;
+    frame.schedStats = TileSchedulerStats();
+    frame.shortcutCounts.cardioid = cardioid;
+    frame.shortcutCounts.bulb = bulb;
+    frame.shortcutCounts.periodic = periodic;
+    frame.rebases = rebases;
+}
+
+// Iterate rows [rowBegin, rowEnd) of the pixel lattice of a progressive pass into frame.pixelIter, skipping pixels
+// that are already known (>= 0). Shortcut and rebase counts are added to the frame's.
+static void renderProgressiveRowsCpu(CpuFrame &frame, ThreadPool &pool, const MandelView &view,
+                                     const PerturbFrame *deep, const ProgressivePass &pass, unsigned int rowBegin,
+                                     unsigned int rowEnd)
+{
+    const unsigned int w = frame.width;
+    const unsigned int columns = w > pass.xOffset ? (w - pass.xOffset + pass.xStep - 1) / pass.xStep : 0;
+    std::atomic<unsigned int> cardioid{0};
+    std::atomic<unsigned int> bulb{0};
+    std::atomic<unsigned int> periodic{0};
+    std::atomic<unsigned int> rebases{0};
+
+    pool.parallelFor(rowEnd - rowBegin, [&](unsigned int r) {
+        const unsigned int y = pass.yOffset + (rowBegin + r) * pass.yStep;
+        int *packedRow = &frame.pixelIter[(size_t)y * w];
+        std::vector<int> bands(columns);
+        std::vector<int> iters(columns);
+        std::vector<float> fracs(columns);
+        MandelShortcutCounts counts;
+        unsigned int rowRebases = 0;
+        // Iterate the runs of unknown pixels along the lattice row
+        unsigned int i = 0;
+        while (i < columns)
+        {
+            if (packedRow[pass.xOffset + i * pass.xStep] >= 0)
+            {
+                i++;
+                continue;
+            }
+            unsigned int run = 1;
+            while (i + run < columns && packedRow[pass.xOffset + (i + run) * pass.xStep] < 0)
+            {
+                run++;
+            }
+            mandelRowCpu(view, deep, y, pass.xOffset + i * pass.xStep, pass.xStep, run, bands.data(), iters.data(),
+                         fracs.data(), counts, rowRebases);
+            for (unsigned int k = 0; k < run; k++)
+            {
+                packedRow[pass.xOffset + (i + k) * pass.xStep] = packEscape(bands[k], iters[k], fracs[k]);
+            }
+            i += run;
+        }
+        cardioid += counts.cardioid;
+        bulb += counts.bulb;
+        periodic += counts.periodic;
+        rebases += rowRebases;
+    });
+    frame.shortcutCounts.cardioid += cardioid;
+    frame.shortcutCounts.bulb += bulb;
+    frame.shortcutCounts.periodic += periodic;
+    frame.rebases += rebases;
+}
+
+// Write the framebuffer as a binary PPM. Rows are written top to bottom as they appear on screen, i.e. in reverse
+// texture row order.
+static bool saveFramePPM(const CpuFrame &frame, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        printf("Failed to open %s for writing\n", path);
+        return false;
+    }
+    fprintf(fp, "P6\n%u %u\n255\n", frame.width, frame.height);
+    std::vector<unsigned char> line((size_t)frame.width * 3);
+    for (unsigned int row = frame.height; row-- > 0;)
+    {
+        for (unsigned int x = 0; x < frame.width; x++)
+        {
+            size_t i = (size_t)row * frame.width + x;
+            uint32_t texel = frame.texels.empty() ? 0 : frame.texels[i];
+            if (frame.format == FRAME_RGBA32F)
+            {
+                texel = packRgba8(&frame.rgba[i * 4]);
+            }
+            else if (frame.format == FRAME_ITER)
+            {
+                texel = paletteColourRgba8(g_mandelPalette, (int)texel);
+            }
+            memcpy(&line[x * 3], &texel, 3);
+        }
+        fwrite(line.data(), 1, line.size(), fp);
+    }
+    bool success = ferror(fp) == 0;
+    fclose(fp);
+    return success;
+}
+
+#endif // CPU_RENDER_H
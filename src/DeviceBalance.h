@@ -0,0 +1,78 @@
+// Splitting frames across several OpenCL devices
+// With --devices, every chosen device iterates one band of whole rows of each frame. Bands are sized in proportion to
+// each device's measured throughput (rows per millisecond, including its transfers), averaged over the frames so one
+// unusually cheap or expensive band does not swing the split. Devices that have not rendered yet count as the mean of
+// the others, so the first frame is split evenly. Rows are handed out in DEVICE_BAND_ROWS row granules and every device
+// keeps at least one, so a slow device is still measured and can win rows back when the view changes.
+#ifndef DEVICE_BALANCE_H
+#define DEVICE_BALANCE_H
+
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const unsigned int DEVICE_BAND_ROWS = 16;
+static const double DEVICE_RATE_SMOOTHING = 0.5; // weight of the latest frame in the throughput average
+
+struct DeviceShare
+{
+    std::string name;
+    double rowsPerMs = 0.0; // 0 until the device has rendered a band
+    unsigned int rowStart = 0;
+    unsigned int rowCount = 0;
+    double lastMs = 0.0; // time taken for the last band
+};
+
+static void splitDeviceRows(std::vector<DeviceShare> &shares, unsigned int height)
+{
+    double measuredTotal = 0.0;
+    unsigned int measured = 0;
+    for (const DeviceShare &s : shares)
+    {
+        if (s.rowsPerMs > 0.0)
+        {
+            measuredTotal += s.rowsPerMs;
+            measured++;
+        }
+    }
+    const double fallback = measured > 0 ? measuredTotal / measured : 1.0;
+    auto rate = [fallback](const DeviceShare &s) { return s.rowsPerMs > 0.0 ? s.rowsPerMs : fallback; };
+    double total = 0.0;
+    for (const DeviceShare &s : shares)
+    {
+        total += rate(s);
+    }
+
+    const unsigned int count = (unsigned int)shares.size();
+    const unsigned int granules = (height + DEVICE_BAND_ROWS - 1) / DEVICE_BAND_ROWS;
+    unsigned int granule = 0;
+    double cumulative = 0.0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        cumulative += rate(shares[i]);
+        unsigned int end = (unsigned int)llround(granules * cumulative / total);
+        // At least one granule for this device, and one left for each device after it
+        unsigned int remaining = count - 1 - i;
+        end = std::max(end, std::min(granule + 1, granules));
+        end = std::min(end, granules > remaining ? granules - remaining : granule);
+        end = i + 1 == count ? granules : std::max(end, granule);
+        shares[i].rowStart = std::min(granule * DEVICE_BAND_ROWS, height);
+        shares[i].rowCount = std::min(end * DEVICE_BAND_ROWS, height) - shares[i].rowStart;
+        granule = end;
+    }
+}
+
+// The device took 'ms' for its band of the frame just rendered
+static void recordDeviceTime(DeviceShare &share, double ms)
+{
+    share.lastMs = ms;
+    if (share.rowCount == 0 || ms <= 0.0)
+    {
+        return;
+    }
+    double rate = share.rowCount / ms;
+    share.rowsPerMs = share.rowsPerMs > 0.0 ? share.rowsPerMs + DEVICE_RATE_SMOOTHING * (rate - share.rowsPerMs) : rate;
+}
+
+#endif // DEVICE_BALANCE_H
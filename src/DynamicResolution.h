@@ -0,0 +1,121 @@
+// Dynamic resolution
+// The cost of a frame grows with its pixel count, and a zoom that takes longer than a frame or two to render no longer
+// feels like it follows the mouse. With a frame-time budget (--frame-budget) the CPU engine renders the frames that
+// answer input at a lower internal resolution, the largest one predicted to fit the budget, and once the input has
+// stopped for RESOLUTION_IDLE_MS it renders the view again at full resolution, or above it (--rest-scale), where the
+// display filters it down to the window.
+// Resolutions are powers of two of the full one: a frame at level L is FRACTAL_IMAGE_WIDTH x FRACTAL_IMAGE_HEIGHT
+// scaled by 2^L, and its pixels are every 2^-L-th pixel of the full resolution frame (above it, that lattice
+// subdivided). A scaled frame keeps the full frame's origin, so the rest frame only iterates the pixels the scaled one
+// did not, and saved fields and the iteration cache see the same lattice at every level.
+// The controller learns the cost from the frames just rendered: the time of the last frame, scaled to another pixel
+// count by (pixels / lastPixels)^exponent, where the exponent is the slope of log time against log pixels over the
+// last RESOLUTION_HISTORY frames (1 until they span more than one resolution). The last frame's time follows the cost
+// per pixel as the view moves into deeper, slower parts of the set.
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <math.h>
+#include <algorithm>
+
+static const int RESOLUTION_MIN_LEVEL = -3; // 1/8 of the full width and height
+static const int RESOLUTION_MAX_LEVEL = 1;  // twice the full width and height, at rest only
+static const unsigned int RESOLUTION_HISTORY = 16;
+static const double RESOLUTION_IDLE_MS = 300.0;
+static const double RESOLUTION_MIN_EXPONENT = 0.3;
+static const double RESOLUTION_MAX_EXPONENT = 1.5;
+
+// Size of a width x height frame at 'level': the pixels at every 2^-level-th column and row of the full frame
+static void resolutionSize(unsigned int width, unsigned int height, int level, unsigned int &w, unsigned int &h)
+{
+    if (level >= 0)
+    {
+        w = width << level;
+        h = height << level;
+    }
+    else
+    {
+        w = (width - 1) >> -level;
+        h = (height - 1) >> -level;
+        w++;
+        h++;
+    }
+}
+
+class ResolutionController
+{
+public:
+    // A frame of 'pixels' took 'ms' to render
+    void record(unsigned int pixels, double ms)
+    {
+        Sample &s = samples[next];
+        s.pixels = pixels;
+        s.ms = std::max(ms, 0.01);
+        next = (next + 1) % RESOLUTION_HISTORY;
+        count = std::min(count + 1, RESOLUTION_HISTORY);
+        last = s;
+    }
+
+    // Least squares slope of log time against log pixels over the recent frames
+    double exponent() const
+    {
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            double x = log((double)samples[i].pixels);
+            double y = log(samples[i].ms);
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        double varX = count * sxx - sx * sx;
+        // All at one resolution (or none): nothing to fit, cost is taken to be proportional to pixels
+        if (count < 2 || varX < 1e-6 * count * count)
+        {
+            return 1.0;
+        }
+        double slope = (count * sxy - sx * sy) / varX;
+        return std::min(std::max(slope, RESOLUTION_MIN_EXPONENT), RESOLUTION_MAX_EXPONENT);
+    }
+
+    // Predicted time of a frame of 'pixels', 0 before the first frame
+    double predictMs(unsigned int pixels) const
+    {
+        if (count == 0)
+        {
+            return 0.0;
+        }
+        return last.ms * pow((double)pixels / last.pixels, exponent());
+    }
+
+    // Highest level from RESOLUTION_MIN_LEVEL to maxLevel whose width x height frame is predicted to take at most
+    // budgetMs (RESOLUTION_MIN_LEVEL if none is)
+    int chooseLevel(unsigned int width, unsigned int height, int maxLevel, double budgetMs) const
+    {
+        for (int level = maxLevel; level > RESOLUTION_MIN_LEVEL; level--)
+        {
+            unsigned int w;
+            unsigned int h;
+            resolutionSize(width, height, level, w, h);
+            if (predictMs(w * h) <= budgetMs)
+            {
+                return level;
+            }
+        }
+        return RESOLUTION_MIN_LEVEL;
+    }
+
+private:
+    struct Sample
+    {
+        unsigned int pixels = 0;
+        double ms = 0.0;
+    };
+    Sample samples[RESOLUTION_HISTORY];
+    Sample last;
+    unsigned int next = 0;
+    unsigned int count = 0;
+};
+
+#endif // DYNAMIC_RESOLUTION_H
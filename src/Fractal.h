@@ -0,0 +1,185 @@
+// Fractal families
+// Besides the Mandelbrot set (z^2 + c) the explorer renders:
+//  - multibrot3 .. multibrot8: z^d + c, z starting at c
+//  - julia, julia3 .. julia8:  the Julia sets of the same formulas, z starting at the pixel and c a constant (each
+//                              family has its own, --julia re im replaces it)
+//  - burningship:              z = (|Re z| + |Im z| i)^2 + c
+// A runtime exponent would need a complex pow() (a log, an exp and a sin / cos per iteration) or a loop over the
+// exponent in the escape loop. Instead each family is its own specialisation of the loop: in the CPU engine an
+// instantiation of fractalEscapeCpu<D, JULIA, SHIP>(), where fractalPower<D>() expands z^d into squarings and
+// multiplies by z at compile time (z^8 is three squarings), and on the GPU a build of Mandel.cl with -D FRACTAL_POWER,
+// FRACTAL_JULIA and FRACTAL_BURNING_SHIP (see kernelBuildOptions() in main.cpp), which expands to the same steps.
+// FRACTAL_FAMILIES is the dispatch table: setFractalFamily() points g_mandelEscape at the family's loop, and the GPU
+// keeps a built program per family. The Mandelbrot family stays on mandelEscapeCpu() and its SIMD spans, and is the
+// only one with the cardioid / bulb test and perturbation (deep zoom); the periodic orbit test holds for all of them.
+// The escape radius stays 2, which bounds every one of these sets, and the smooth fraction of an escape becomes
+// 1 - log_d(log2 |z|). Keep the expansion in step with FRACTAL_POW in Mandel.cl.
+// Needs CpuRender.h included first (included from there).
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include <math.h>
+#include <string.h>
+
+typedef int (*MandelEscapeFn)(double p_re, double p_im, float maxIter, int &iter, float &frac,
+                              MandelShortcutCounts &counts);
+
+// 1 / log2(d), the smooth fraction scale of z^d
+static const float FRACTAL_SMOOTH_SCALE[9] = {0.0f,         0.0f,        1.0f,         0.630929754f, 0.5f,
+                                              0.430676558f, 0.386852807f, 0.356207187f, 0.333333333f};
+
+// Julia constant of the current family (or --julia)
+static double g_fractalJuliaRe = 0.0;
+static double g_fractalJuliaIm = 0.0;
+
+// w = a^D, as squarings of a^(D/2) and one multiply by a for odd D
+template <int D>
+static inline void fractalPower(double a_re, double a_im, double &w_re, double &w_im)
+{
+    if constexpr (D == 1)
+    {
+        w_re = a_re;
+        w_im = a_im;
+    }
+    else if constexpr (D % 2 == 0)
+    {
+        double h_re;
+        double h_im;
+        fractalPower<D / 2>(a_re, a_im, h_re, h_im);
+        w_re = h_re * h_re - h_im * h_im;
+        w_im = 2 * h_re * h_im;
+    }
+    else
+    {
+        double p_re;
+        double p_im;
+        fractalPower<D - 1>(a_re, a_im, p_re, p_im);
+        w_re = p_re * a_re - p_im * a_im;
+        w_im = p_re * a_im + p_im * a_re;
+    }
+}
+
+// Escape-time loop of mandelEscapeCpu() for z = fold(z)^D + c, with the same results and shortcut counts. With JULIA
+// the pixel (p_re, p_im) is z0 and c the Julia constant, otherwise z0 = c = the pixel. SHIP folds z into the first
+// quadrant before every step.
+template <int D, bool JULIA, bool SHIP>
+static int fractalEscapeCpu(double p_re, double p_im, float maxIter, int &iter, float &frac,
+                            MandelShortcutCounts &counts)
+{
+    const bool bShortcuts = g_bMandelShortcuts;
+    const double c_re = JULIA ? g_fractalJuliaRe : p_re;
+    const double c_im = JULIA ? g_fractalJuliaIm : p_im;
+    iter = 0;
+    frac = 0.0f;
+
+    double Z_re = p_re, Z_im = p_im;
+    double saved_re = Z_re, saved_im = Z_im;
+    int checkLen = MANDEL_PERIOD_FIRST_CHECK;
+    int checkCount = 0;
+    for (int n = 0; n < maxIter; n++)
+    {
+        double Z_re2 = Z_re * Z_re;
+        double Z_im2 = Z_im * Z_im;
+        if (Z_re2 + Z_im2 > 4)
+        {
+            int band = mandelColourBand(n, maxIter);
+            if (band != 0)
+            {
+                float f = 1.0f - FRACTAL_SMOOTH_SCALE[D] * log2f(0.5f * log2f((float)(Z_re2 + Z_im2)));
+                frac = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+                return band;
+            }
+        }
+        double w_re;
+        double w_im;
+        if constexpr (SHIP)
+        {
+            fractalPower<D>(fabs(Z_re), fabs(Z_im), w_re, w_im);
+        }
+        else
+        {
+            fractalPower<D>(Z_re, Z_im, w_re, w_im);
+        }
+        Z_re = w_re + c_re;
+        Z_im = w_im + c_im;
+        iter++;
+        if (bShortcuts)
+        {
+            if (fabs(Z_re - saved_re) < MANDEL_PERIOD_EPSILON && fabs(Z_im - saved_im) < MANDEL_PERIOD_EPSILON)
+            {
+                counts.periodic++;
+                return 0;
+            }
+            if (++checkCount == checkLen)
+            {
+                checkCount = 0;
+                checkLen *= 2;
+                saved_re = Z_re;
+                saved_im = Z_im;
+            }
+        }
+    }
+    return 0;
+}
+
+struct FractalFamily
+{
+    const char *name;
+    int power;
+    bool bJulia;
+    bool bBurningShip;
+    double juliaRe; // default Julia constant
+    double juliaIm;
+    double centreRe; // default view
+    double centreIm;
+    double width;
+    MandelEscapeFn escape;
+};
+
+static const int FRACTAL_MANDELBROT = 0;
+static const FractalFamily FRACTAL_FAMILIES[] = {
+    {"mandelbrot", 2, false, false, 0.0, 0.0, -0.55, 0.0, 3.0, mandelEscapeCpu},
+    {"multibrot3", 3, false, false, 0.0, 0.0, 0.0, 0.0, 3.0, fractalEscapeCpu<3, false, false>},
+    {"multibrot4", 4, false, false, 0.0, 0.0, -0.2, 0.0, 2.8, fractalEscapeCpu<4, false, false>},
+    {"multibrot5", 5, false, false, 0.0, 0.0, 0.0, 0.0, 2.6, fractalEscapeCpu<5, false, false>},
+    {"multibrot6", 6, false, false, 0.0, 0.0, -0.05, 0.0, 2.6, fractalEscapeCpu<6, false, false>},
+    {"multibrot7", 7, false, false, 0.0, 0.0, 0.0, 0.0, 2.6, fractalEscapeCpu<7, false, false>},
+    {"multibrot8", 8, false, false, 0.0, 0.0, -0.05, 0.0, 2.6, fractalEscapeCpu<8, false, false>},
+    {"julia", 2, true, false, -0.8, 0.156, 0.0, 0.0, 3.2, fractalEscapeCpu<2, true, false>},
+    {"julia3", 3, true, false, 0.4, 0.62, 0.0, 0.0, 2.8, fractalEscapeCpu<3, true, false>},
+    {"julia4", 4, true, false, 0.68, 0.77, 0.0, 0.0, 2.6, fractalEscapeCpu<4, true, false>},
+    {"julia5", 5, true, false, 0.77, 0.32, 0.0, 0.0, 2.6, fractalEscapeCpu<5, true, false>},
+    {"julia6", 6, true, false, 0.9, 0.55, 0.0, 0.0, 2.6, fractalEscapeCpu<6, true, false>},
+    {"julia7", 7, true, false, 0.86, 0.36, 0.0, 0.0, 2.6, fractalEscapeCpu<7, true, false>},
+    {"julia8", 8, true, false, 0.78, 0.2, 0.0, 0.0, 2.6, fractalEscapeCpu<8, true, false>},
+    {"burningship", 2, false, true, 0.0, 0.0, -0.3, -0.6, 3.2, fractalEscapeCpu<2, false, true>},
+};
+static const int FRACTAL_FAMILY_COUNT = (int)(sizeof(FRACTAL_FAMILIES) / sizeof(FRACTAL_FAMILIES[0]));
+
+// Current family, and its escape loop for the CPU engine
+static int g_fractalFamily = FRACTAL_MANDELBROT;
+static MandelEscapeFn g_mandelEscape = mandelEscapeCpu;
+
+static bool parseFractalFamily(const char *name, int &family)
+{
+    for (int f = 0; f < FRACTAL_FAMILY_COUNT; f++)
+    {
+        if (strcmp(name, FRACTAL_FAMILIES[f].name) == 0)
+        {
+            family = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Switch the CPU engine to 'family', with its default Julia constant
+static void setFractalFamily(int family)
+{
+    g_fractalFamily = family;
+    g_mandelEscape = FRACTAL_FAMILIES[family].escape;
+    g_fractalJuliaRe = FRACTAL_FAMILIES[family].juliaRe;
+    g_fractalJuliaIm = FRACTAL_FAMILIES[family].juliaIm;
+}
+
+#endif // FRACTAL_H
@@ -0,0 +1,149 @@
+// Iteration histogram of a frame
+// Counts the escaped pixels of the packed iteration field (see packEscape()) per iteration count, for histogram
+// equalised colouring and the frame statistics. The first HISTOGRAM_EXACT_BINS iterations have a bin each, where
+// shallow frames spend their escapes, and the rest of the range up to maxIter shares the remaining bins evenly, so the
+// table stays small enough for OpenCL local memory whatever maxIter is. 'mandelHistogram' in Mandel.cl builds the same
+// bins on the GPU.
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+static const unsigned int HISTOGRAM_BINS = 4096;
+static const unsigned int HISTOGRAM_EXACT_BINS = 2048;
+
+// Width of the shared bins for 'maxIter' as a 0.32 fixed point reciprocal, so binning needs no division. It is passed
+// to the kernel, which bins with the same integer arithmetic.
+static inline uint32_t histogramBinScale(float maxIter)
+{
+    double span = std::max((double)maxIter - HISTOGRAM_EXACT_BINS, 1.0);
+    return (uint32_t)std::min(4294967295.0, floor(4294967296.0 * (HISTOGRAM_BINS - HISTOGRAM_EXACT_BINS) / span));
+}
+
+// Bin of an escape at iteration 'iter' (same as histogramBin() in Mandel.cl)
+static inline unsigned int histogramBin(int iter, uint32_t binScale)
+{
+    const int over = std::max(iter - (int)HISTOGRAM_EXACT_BINS, 0);
+    unsigned int shared = HISTOGRAM_EXACT_BINS + (unsigned int)(((uint64_t)over * binScale) >> 32);
+    return over > 0 ? std::min(shared, HISTOGRAM_BINS - 1) : (unsigned int)std::max(iter, 0);
+}
+
+// Iteration count where bin 'bin' starts, as a continuous position (bins past the exact ones are wider than one)
+static inline double histogramBinStart(unsigned int bin, uint32_t binScale)
+{
+    if (bin <= HISTOGRAM_EXACT_BINS)
+    {
+        return (double)bin;
+    }
+    return HISTOGRAM_EXACT_BINS + (bin - HISTOGRAM_EXACT_BINS) * 4294967296.0 / std::max(binScale, 1u);
+}
+
+struct IterHistogram
+{
+    std::vector<unsigned int> bins;
+    std::vector<unsigned int> cumulative; // escapes in the bins before each bin, filled by finish()
+    float maxIter = 0.0f;
+    uint32_t binScale = 0; // see histogramBinScale()
+    unsigned int escaped = 0;
+    unsigned int interior = 0; // pixels that never escaped
+    int lowIter = -1;          // lowest and highest escape iteration, -1 if nothing escaped
+    int highIter = -1;
+
+    void clear(float frameMaxIter)
+    {
+        bins.assign(HISTOGRAM_BINS, 0);
+        cumulative.clear();
+        maxIter = frameMaxIter;
+        binScale = histogramBinScale(frameMaxIter);
+        escaped = 0;
+        interior = 0;
+        lowIter = -1;
+        highIter = -1;
+    }
+
+    // Count a packed escape result (-1, unknown, is skipped)
+    void add(int packed)
+    {
+        if (packed < 0)
+        {
+            return;
+        }
+        if (packedBand(packed) == 0)
+        {
+            interior++;
+            return;
+        }
+        int iter = packedIter(packed);
+        bins[histogramBin(iter, binScale)]++;
+        lowIter = escaped == 0 ? iter : std::min(lowIter, iter);
+        highIter = std::max(highIter, iter);
+        escaped++;
+    }
+
+    void merge(const IterHistogram &other)
+    {
+        for (unsigned int b = 0; b < HISTOGRAM_BINS; b++)
+        {
+            bins[b] += other.bins[b];
+        }
+        if (other.escaped > 0)
+        {
+            lowIter = escaped == 0 ? other.lowIter : std::min(lowIter, other.lowIter);
+            highIter = std::max(highIter, other.highIter);
+        }
+        escaped += other.escaped;
+        interior += other.interior;
+    }
+
+    // Once every pixel has been counted
+    void finish()
+    {
+        cumulative.assign(HISTOGRAM_BINS + 1, 0);
+        for (unsigned int b = 0; b < HISTOGRAM_BINS; b++)
+        {
+            cumulative[b + 1] = cumulative[b] + bins[b];
+        }
+    }
+
+    // Fraction of the escaped pixels that escaped before iteration 'iter', interpolated within the wide bins. Linear
+    // in 'iter' before there is a histogram.
+    double cdf(double iter) const
+    {
+        if (escaped == 0 || cumulative.empty())
+        {
+            return maxIter > 0.0f ? std::min(std::max(iter / maxIter, 0.0), 1.0) : 0.0;
+        }
+        if (iter <= 0.0)
+        {
+            return 0.0;
+        }
+        unsigned int bin = histogramBin((int)iter, binScale);
+        double start = histogramBinStart(bin, binScale);
+        double width = histogramBinStart(bin + 1, binScale) - start;
+        double within = std::min(std::max((iter - start) / width, 0.0), 1.0);
+        return (cumulative[bin] + bins[bin] * within) / escaped;
+    }
+
+    // Iteration count below which 'fraction' of the escaped pixels escaped
+    double percentile(double fraction) const
+    {
+        double target = fraction * escaped;
+        double below = 0.0;
+        for (unsigned int b = 0; b < HISTOGRAM_BINS; b++)
+        {
+            if (bins[b] > 0 && below + bins[b] >= target)
+            {
+                double start = histogramBinStart(b, binScale);
+                double width = histogramBinStart(b + 1, binScale) - start;
+                return start + width * (target - below) / bins[b];
+            }
+            below += bins[b];
+        }
+        return highIter;
+    }
+};
+
+#endif // HISTOGRAM_H
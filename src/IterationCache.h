@@ -0,0 +1,274 @@
+// Iteration field cache shared by the CPU and OpenCL engines
+// Zooming by exactly 2x keeps the pixel spacing at a power of two of the starting spacing, so once the view origin is
+// snapped to a multiple of the spacing every pixel of every frame sits on one lattice:
+//     c = anchor + (kx, -ky) * spacing0 / 2^level
+// A 2x zoom in reuses the previous samples at every other row and column, and a 2x zoom out contains the whole
+// previous frame at half scale. Samples are stored under their canonical key, with even coordinates divided out (and
+// the level lowered) as far as possible, so each point of the plane has exactly one entry whatever level it was
+// computed at. Entries are packed escape results (see packEscape()) in TILE_SIZE x TILE_SIZE tiles, evicted least
+// recently used first once the memory budget is reached.
+#ifndef ITERATION_CACHE_H
+#define ITERATION_CACHE_H
+
+#include <math.h>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <unordered_map>
+
+// Lattice position of pixel (0, 0) of a frame; pixel (x, y) is at (kx0 + x, ky0 + y)
+struct CacheGrid
+{
+    int level;
+    long long kx0;
+    long long ky0;
+};
+
+struct IterationCacheStats
+{
+    unsigned int hits = 0;      // pixels copied from the cache this frame
+    unsigned int misses = 0;    // pixels that had to be iterated
+    unsigned int evictions = 0; // tiles evicted this frame
+    size_t tiles = 0;
+    size_t bytes = 0;
+
+    double hitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0; }
+};
+
+class IterationCache
+{
+public:
+    static const int TILE_SHIFT = 5;
+    static const int TILE_SIZE = 1 << TILE_SHIFT;
+    static const int MIN_LEVEL = -64; // canonical keys never go coarser than this
+
+    explicit IterationCache(size_t budgetBytes) { setBudget(budgetBytes); }
+
+    void setBudget(size_t budgetBytes)
+    {
+        maxTiles = budgetBytes / TILE_BYTES;
+        evict();
+    }
+    size_t budget() const { return maxTiles * TILE_BYTES; }
+
+    void clear()
+    {
+        lru.clear();
+        index.clear();
+    }
+
+    // Fix the lattice to the view with origin (minX, MaxIm) and pixel spacing (Re_factor, Im_factor) at level 0.
+    // Changes the meaning of every key, so the cache is emptied.
+    void setAnchor(double minX, double MaxIm, double Re_factor, double Im_factor)
+    {
+        anchorX = minX;
+        anchorY = MaxIm;
+        spacingX = Re_factor;
+        spacingY = Im_factor;
+        bAnchored = true;
+        clear();
+    }
+
+    // Lattice position of a view. Fails if the spacing is not a power of two of the anchor's, i.e. the view was not
+    // reached by 2x zooms from it.
+    bool gridFor(double minX, double MaxIm, double Re_factor, double Im_factor, CacheGrid &grid) const
+    {
+        if (!bAnchored || Re_factor <= 0.0 || Im_factor <= 0.0)
+        {
+            return false;
+        }
+        int level = ilogb(spacingX) - ilogb(Re_factor);
+        if (ldexp(spacingX, -level) != Re_factor || ldexp(spacingY, -level) != Im_factor)
+        {
+            return false;
+        }
+        double kx0 = (minX - anchorX) / Re_factor;
+        double ky0 = (anchorY - MaxIm) / Im_factor;
+        if (fabs(kx0) > 4e15 || fabs(ky0) > 4e15)
+        {
+            return false;
+        }
+        grid.level = level;
+        grid.kx0 = llround(kx0);
+        grid.ky0 = llround(ky0);
+        return true;
+    }
+    // Origin of 'grid' in the complex plane, for snapping a view onto the lattice
+    void gridOrigin(const CacheGrid &grid, double &minX, double &MaxIm) const
+    {
+        minX = anchorX + grid.kx0 * ldexp(spacingX, -grid.level);
+        MaxIm = anchorY - grid.ky0 * ldexp(spacingY, -grid.level);
+    }
+
+    // Fill 'packed' (width x height, row 0 = pixel row 0) with the cached results of a frame, -1 where unknown
+    IterationCacheStats lookupFrame(const CacheGrid &grid, unsigned int width, unsigned int height, std::vector<int> &packed)
+    {
+        IterationCacheStats stats;
+        packed.assign((size_t)width * height, -1);
+        visitFrame(grid, width, height, [&](const TileKey &tk) { return findTile(tk, false); },
+                   [&](Tile *tile, size_t pixel, size_t sample) {
+                       int v = tile->samples[sample];
+                       packed[pixel] = v;
+                       stats.hits += v >= 0;
+                   });
+        stats.misses = width * height - stats.hits;
+        frameStats = stats;
+        return stats;
+    }
+
+    // Store the results of a frame. Only the pixels that were unknown in 'known' (from lookupFrame()) are added.
+    IterationCacheStats storeFrame(const CacheGrid &grid, unsigned int width, unsigned int height,
+                                   const std::vector<int> &packed, const std::vector<int> &known)
+    {
+        evictions = 0;
+        visitFrame(grid, width, height, [&](const TileKey &tk) { return findTile(tk, true); },
+                   [&](Tile *tile, size_t pixel, size_t sample) {
+                       if (known[pixel] < 0 && packed[pixel] >= 0)
+                       {
+                           tile->samples[sample] = packed[pixel];
+                       }
+                   });
+        frameStats.evictions = evictions;
+        frameStats.tiles = lru.size();
+        frameStats.bytes = lru.size() * TILE_BYTES;
+        return frameStats;
+    }
+
+private:
+    // Tile coordinates (the sample within the tile is dropped)
+    struct TileKey
+    {
+        int level;
+        long long tx;
+        long long ty;
+        bool operator==(const TileKey &o) const { return level == o.level && tx == o.tx && ty == o.ty; }
+    };
+    struct TileKeyHash
+    {
+        size_t operator()(const TileKey &k) const
+        {
+            unsigned long long h = (unsigned long long)k.tx * 0x9E3779B97F4A7C15ULL;
+            h ^= (unsigned long long)k.ty * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+            h ^= (unsigned long long)(k.level + 128) * 0x165667B19E3779F9ULL;
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+    struct Tile
+    {
+        TileKey key;
+        std::vector<int> samples;
+    };
+    static const size_t TILE_BYTES = TILE_SIZE * TILE_SIZE * sizeof(int) + sizeof(Tile) + 64;
+
+    // v / 2^m rounded down, and v * 2^m, for any m (past 62 only the lattice origin is left)
+    static long long floorShift(long long v, int m) { return m < 63 ? v >> m : (v < 0 ? -1 : 0); }
+    static long long scaleUp(long long v, int m) { return v == 0 ? 0 : v * (1LL << m); }
+
+    // Visit every pixel of a frame, grouped by the tile holding its canonical key. Pass m covers the pixels whose
+    // lattice coordinates divide by 2^m but not both by 2^(m+1): at level - m their coordinates are (kx >> m, ky >> m),
+    // not both even. beginTile(tileKey) returns the tile (NULL skips it) and pixel(tile, pixelIndex, sampleIndex) is
+    // called for each of its pixels in the frame.
+    template <typename BeginTileFn, typename PixelFn>
+    static void visitFrame(const CacheGrid &grid, unsigned int width, unsigned int height, BeginTileFn beginTile,
+                           PixelFn pixel)
+    {
+        for (int m = 0; grid.level - m >= MIN_LEVEL; m++)
+        {
+            const int level = grid.level - m;
+            const bool bLast = level == MIN_LEVEL;
+            // Coordinates at 'level' of the pixels in the frame whose lattice coordinates divide by 2^m
+            long long kxFirst = -floorShift(-grid.kx0, m);
+            long long kxLast = floorShift(grid.kx0 + width - 1, m);
+            long long kyFirst = -floorShift(-grid.ky0, m);
+            long long kyLast = floorShift(grid.ky0 + height - 1, m);
+            if (kxFirst > kxLast || kyFirst > kyLast)
+            {
+                break;
+            }
+            for (long long ty = kyFirst >> TILE_SHIFT; ty <= kyLast >> TILE_SHIFT; ty++)
+            {
+                for (long long tx = kxFirst >> TILE_SHIFT; tx <= kxLast >> TILE_SHIFT; tx++)
+                {
+                    Tile *tile = NULL;
+                    bool bAsked = false;
+                    long long kyEnd = std::min(kyLast, (ty << TILE_SHIFT) + TILE_SIZE - 1);
+                    long long kxEnd = std::min(kxLast, (tx << TILE_SHIFT) + TILE_SIZE - 1);
+                    for (long long ky = std::max(kyFirst, ty << TILE_SHIFT); ky <= kyEnd; ky++)
+                    {
+                        size_t row = (size_t)(scaleUp(ky, m) - grid.ky0) * width;
+                        long long kxStart = std::max(kxFirst, tx << TILE_SHIFT);
+                        // Rows with even ky only have odd kx pixels at this level; the rest belong to later passes
+                        long long kxStep = 1;
+                        if ((ky & 1) == 0 && !bLast)
+                        {
+                            kxStart |= 1;
+                            kxStep = 2;
+                        }
+                        for (long long kx = kxStart; kx <= kxEnd; kx += kxStep)
+                        {
+                            if (!bAsked)
+                            {
+                                tile = beginTile(TileKey{level, tx, ty});
+                                bAsked = true;
+                            }
+                            if (!tile)
+                            {
+                                break;
+                            }
+                            pixel(tile, row + (size_t)(scaleUp(kx, m) - grid.kx0),
+                                  (size_t)((ky & (TILE_SIZE - 1)) * TILE_SIZE + (kx & (TILE_SIZE - 1))));
+                        }
+                        if (bAsked && !tile)
+                        {
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Tile for 'tk', moved to the front of the LRU list. With bCreate, a missing tile is added (evicting the least
+    // recently used one when over budget), otherwise NULL is returned.
+    Tile *findTile(const TileKey &tk, bool bCreate)
+    {
+        auto it = index.find(tk);
+        if (it != index.end())
+        {
+            lru.splice(lru.begin(), lru, it->second);
+            return &lru.front();
+        }
+        if (!bCreate || maxTiles == 0)
+        {
+            return NULL;
+        }
+        lru.push_front(Tile{tk, std::vector<int>(TILE_SIZE * TILE_SIZE, -1)});
+        index[tk] = lru.begin();
+        evict();
+        return &lru.front();
+    }
+
+    void evict()
+    {
+        while (lru.size() > maxTiles)
+        {
+            index.erase(lru.back().key);
+            lru.pop_back();
+            evictions++;
+        }
+    }
+
+    std::list<Tile> lru;
+    std::unordered_map<TileKey, std::list<Tile>::iterator, TileKeyHash> index;
+    size_t maxTiles = 0;
+    unsigned int evictions = 0;
+    IterationCacheStats frameStats;
+
+    bool bAnchored = false;
+    double anchorX = 0.0;
+    double anchorY = 0.0;
+    double spacingX = 0.0;
+    double spacingY = 0.0;
+};
+
+#endif // ITERATION_CACHE_H
@@ -0,0 +1,262 @@
+// Saved iteration fields (.mif)
+// A frame only ever lived in the framebuffer and was lost on exit, so an expensive deep view had to be iterated again
+// in every session. An iteration field file keeps a render's packed escape results (see packEscape()) together with
+// everything needed to reuse them: the view, the iteration limit, the precision it was iterated in and the fractal
+// family. Colours are not stored, so a saved field can be recoloured with any palette, cropped or shown again without
+// iterating a pixel.
+// Layout (little-endian, as on every platform the explorer builds for):
+//  - one ITERATION_FIELD_PAGE byte header (IterationFieldHeader)
+//  - the rows in chunks of chunkRows rows, each chunk starting on a page boundary (chunkStride bytes apart), so a
+//    chunk can be mapped on its own. A row is width 32-bit packed results.
+// File row r, pixel x is the point (minRe + x * reStep) + (minIm + r * imStep) i: rows go up the imaginary axis, which
+// is the order of the poster formats (the frame's last row first). The view is kept both as doubles and as decimal
+// strings of any length, since the doubles of a deep zoom no longer tell its pixels apart.
+// Fields are read through one read-only mapping of the file (IterationFieldFile), so only the pages of the rows that
+// are actually touched are read from disk, and a field of any size opens at once.
+// Needs Precision.h (PRECISION_TIER_NAMES) included first.
+#ifndef ITERATION_FIELD_H
+#define ITERATION_FIELD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const char ITERATION_FIELD_MAGIC[8] = {'M', 'A', 'N', 'D', 'I', 'T', 'E', 'R'};
+static const uint32_t ITERATION_FIELD_VERSION = 1;
+static const uint32_t ITERATION_FIELD_PAGE = 4096;
+static const uint32_t ITERATION_FIELD_CHUNK_ROWS = 64;
+static const size_t ITERATION_FIELD_DIGITS = 1988;
+// 'precision' of a field rendered with perturbation; the other values are PrecisionTier
+static const uint32_t ITERATION_FIELD_PERTURBATION = PRECISION_TIER_COUNT;
+
+struct IterationFieldHeader
+{
+    char magic[8];        // ITERATION_FIELD_MAGIC
+    uint32_t version;     // ITERATION_FIELD_VERSION
+    uint32_t headerBytes; // offset of the first chunk
+    uint32_t width;
+    uint32_t height;
+    uint32_t chunkRows; // rows per chunk, the last chunk may hold fewer
+    uint32_t chunkCount;
+    uint64_t chunkStride; // bytes from the start of one chunk to the next
+    double minX;          // bounds, as for --view
+    double maxX;
+    double minY;
+    double reStep; // pixel spacing
+    double imStep;
+    float maxIter;
+    uint32_t precision; // PrecisionTier or ITERATION_FIELD_PERTURBATION
+    char family[16];    // FRACTAL_FAMILIES name
+    double juliaRe;
+    double juliaIm;
+    char minRe[ITERATION_FIELD_DIGITS]; // minX and minY as decimal strings
+    char minIm[ITERATION_FIELD_DIGITS];
+};
+static_assert(sizeof(IterationFieldHeader) == ITERATION_FIELD_PAGE, "IterationFieldHeader must fill one page");
+
+static const char *iterationFieldPrecisionName(uint32_t precision)
+{
+    return precision < PRECISION_TIER_COUNT ? PRECISION_TIER_NAMES[precision] : "perturbation";
+}
+
+// True if 'path' names an iteration field (.mif)
+static bool isIterationFieldPath(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    return dot && strcmp(dot, ".mif") == 0;
+}
+
+// Header of a width x height field of 'family'; the caller fills in the view, the limit and the precision
+static void initIterationFieldHeader(IterationFieldHeader &header, unsigned int width, unsigned int height,
+                                     const char *family, double juliaRe, double juliaIm)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ITERATION_FIELD_MAGIC, sizeof(header.magic));
+    header.version = ITERATION_FIELD_VERSION;
+    header.headerBytes = ITERATION_FIELD_PAGE;
+    header.width = width;
+    header.height = height;
+    header.chunkRows = ITERATION_FIELD_CHUNK_ROWS;
+    header.chunkCount = (height + ITERATION_FIELD_CHUNK_ROWS - 1) / ITERATION_FIELD_CHUNK_ROWS;
+    uint64_t chunkBytes = (uint64_t)ITERATION_FIELD_CHUNK_ROWS * width * sizeof(int32_t);
+    header.chunkStride = (chunkBytes + ITERATION_FIELD_PAGE - 1) / ITERATION_FIELD_PAGE * ITERATION_FIELD_PAGE;
+    snprintf(header.family, sizeof(header.family), "%s", family);
+    header.juliaRe = juliaRe;
+    header.juliaIm = juliaIm;
+}
+
+// Set the decimal corner of 'header'. Returns false if a string does not fit.
+static bool setIterationFieldCorner(IterationFieldHeader &header, const std::string &minRe, const std::string &minIm)
+{
+    if (minRe.size() >= ITERATION_FIELD_DIGITS || minIm.size() >= ITERATION_FIELD_DIGITS)
+    {
+        return false;
+    }
+    memcpy(header.minRe, minRe.c_str(), minRe.size() + 1);
+    memcpy(header.minIm, minIm.c_str(), minIm.size() + 1);
+    return true;
+}
+
+// Streams the rows of a field, first file row first, into a .mif file
+class IterationFieldWriter
+{
+public:
+    ~IterationFieldWriter() { close(); }
+
+    bool open(const char *path, const IterationFieldHeader &fieldHeader)
+    {
+        header = fieldHeader;
+        fp = fopen(path, "wb");
+        bOk = fp && fwrite(&header, sizeof(header), 1, fp) == 1;
+        rows = 0;
+        return bOk;
+    }
+
+    // One row of width packed results
+    void writeRow(const int *packed)
+    {
+        if (!bOk || rows == header.height)
+        {
+            bOk = false;
+            return;
+        }
+        // Pad the previous chunk out to its stride, so every chunk starts on a page
+        if (rows > 0 && rows % header.chunkRows == 0)
+        {
+            size_t padding = header.chunkStride - (size_t)header.chunkRows * header.width * sizeof(int32_t);
+            zeros.resize(std::max(zeros.size(), padding), 0);
+            bOk = padding == 0 || fwrite(zeros.data(), 1, padding, fp) == padding;
+        }
+        bOk = bOk && fwrite(packed, sizeof(int32_t), header.width, fp) == header.width;
+        rows++;
+    }
+
+    // Finish the file. Returns false if anything failed to write or rows are missing.
+    bool close()
+    {
+        if (!fp)
+        {
+            return bOk;
+        }
+        bOk = fclose(fp) == 0 && bOk && rows == header.height;
+        fp = NULL;
+        return bOk;
+    }
+
+private:
+    IterationFieldHeader header;
+    FILE *fp = NULL;
+    bool bOk = false;
+    unsigned int rows = 0;
+    std::vector<char> zeros;
+};
+
+// A .mif file mapped read-only. Rows are paged in from disk on first access.
+class IterationFieldFile
+{
+public:
+    ~IterationFieldFile() { close(); }
+
+    // Map 'path' and check its header. Prints the reason and returns false if it is not a usable field.
+    bool open(const char *path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            printf("Failed to open %s\n", path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IterationFieldHeader))
+        {
+            printf("%s is not an iteration field\n", path);
+            ::close(fd);
+            return false;
+        }
+        mapBytes = (size_t)st.st_size;
+        void *map = mmap(NULL, mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+        {
+            printf("Failed to map %s\n", path);
+            return false;
+        }
+        data = (const unsigned char *)map;
+        const IterationFieldHeader &h = header();
+        const uint64_t rowBytes = (uint64_t)h.width * sizeof(int32_t);
+        bool bValid = memcmp(h.magic, ITERATION_FIELD_MAGIC, sizeof(h.magic)) == 0;
+        if (bValid && h.version != ITERATION_FIELD_VERSION)
+        {
+            printf("%s is an iteration field of version %u, not %u\n", path, h.version, ITERATION_FIELD_VERSION);
+            close();
+            return false;
+        }
+        bValid = bValid && h.headerBytes >= sizeof(IterationFieldHeader) && h.width > 0 && h.height > 0 &&
+                 h.chunkRows > 0 && h.chunkCount == ((uint64_t)h.height + h.chunkRows - 1) / h.chunkRows &&
+                 memchr(h.minRe, 0, sizeof(h.minRe)) && memchr(h.minIm, 0, sizeof(h.minIm)) &&
+                 memchr(h.family, 0, sizeof(h.family));
+        // Bounded by division first, so a crafted header cannot wrap the sizes below: a chunk's rows fit its stride and
+        // the strides before the last chunk fit the file
+        bValid = bValid && h.chunkRows <= h.chunkStride / rowBytes &&
+                 h.chunkStride <= mapBytes / std::max(h.chunkCount - 1, 1u);
+        // The last chunk ends with its last row, without padding
+        bValid = bValid && mapBytes >= h.headerBytes + (uint64_t)(h.chunkCount - 1) * h.chunkStride +
+                                           (h.height - (uint64_t)(h.chunkCount - 1) * h.chunkRows) * rowBytes;
+        if (!bValid)
+        {
+            printf("%s is not an iteration field or is truncated\n", path);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+        {
+            munmap((void *)data, mapBytes);
+            data = NULL;
+        }
+    }
+
+    bool isOpen() const { return data != NULL; }
+    const IterationFieldHeader &header() const { return *(const IterationFieldHeader *)data; }
+
+    // File row r (0 = minIm)
+    const int *row(unsigned int r) const
+    {
+        const IterationFieldHeader &h = header();
+        return (const int *)(data + h.headerBytes + (uint64_t)(r / h.chunkRows) * h.chunkStride +
+                             (uint64_t)(r % h.chunkRows) * h.width * sizeof(int32_t));
+    }
+
+    // Tell the kernel how rows first .. first + count - 1 will be used (MADV_WILLNEED before reading them,
+    // MADV_DONTNEED once done so a pass over a huge field does not keep it all resident)
+    void adviseRows(unsigned int first, unsigned int count, int advice) const
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        const IterationFieldHeader &h = header();
+        uintptr_t begin = (uintptr_t)row(first);
+        uintptr_t end = (uintptr_t)(row(first + count - 1) + h.width);
+        begin &= ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+        madvise((void *)begin, end - begin, advice);
+    }
+
+private:
+    const unsigned char *data = NULL;
+    size_t mapBytes = 0;
+};
+
+#endif // ITERATION_FIELD_H
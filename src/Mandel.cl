@@ -1,139 +1,1159 @@
 #pragma OPENCL EXTENSION cl_khr_gl_event : enable
+// Interior short-circuits (keep in step with CpuRender.h): orbits that return to within PERIOD_EPSILON of a Brent
+// checkpoint are periodic and never escape. The checkpoint interval starts at PERIOD_FIRST_CHECK and doubles.
+#define PERIOD_EPSILON 1e-12
+#define PERIOD_EPSILON_FLOAT 1e-12f
+#define PERIOD_FIRST_CHECK 8
+// Mariani-Silver subdivision (keep in step with MarianiSilver.h): the frame starts as rectangles on a SUBDIV_GRID_SIZE
+// pixel grid, rectangles whose interior is SUBDIV_MIN_SIZE pixels or less across are iterated in full
+#define SUBDIV_GRID_SIZE 64
+#define SUBDIV_MIN_SIZE 6
+// Escape results are packed as (iter * 8 + band) << ESCAPE_FRAC_BITS with the smooth fraction in the low bits
+// (keep in step with packEscape() in CpuRender.h)
+#define ESCAPE_FRAC_BITS 8
+// The iteration limit is chosen for each frame by the host (see AdaptiveIter.h) and passed to every kernel that iterates
+// as 'maxIter'
+// Specialisation (see kernelBuildOptions() in main.cpp): arguments that stay the same for the whole run can be fixed
+// when the program is built, so the compiler folds them into the loops instead of reading them per pixel:
+//  -D MAX_ITER=n        the iteration limit set with --max-iter
+//  -D USE_SHORTCUTS=0|1 the interior short-circuits (--no-shortcuts)
+//  -D NO_FP64           the device has no double precision: every kernel that needs it is left out, and frames are
+//                       iterated by 'mandelProgressiveFloat' only
+//  -D FRACTAL_POWER=d   the fractal family (see Fractal.h): z^d + c for d = 2..8, 2 if not given
+//  -D FRACTAL_JULIA     the Julia set of the family: z starts at the pixel and c is FRACTAL_JULIA_RE + FRACTAL_JULIA_IM i,
+//                       also given as double-single pairs in FRACTAL_JULIA_DS = (re hi, re lo, im hi, im lo)
+//  -D FRACTAL_BURNING_SHIP  z = (|Re z| + |Im z| i)^d + c
+// The kernels keep their arguments either way, so the host sets them the same for every build.
+#ifdef MAX_ITER
+#define MAX_ITER_ARG(arg) ((float)(MAX_ITER))
+#else
+#define MAX_ITER_ARG(arg) (arg)
+#endif
+#ifdef USE_SHORTCUTS
+#define USE_SHORTCUTS_ARG(arg) (USE_SHORTCUTS)
+#else
+#define USE_SHORTCUTS_ARG(arg) (arg)
+#endif
+// Fractal families (keep in step with Fractal.h): every family is a build of its own, with z^d expanded into squarings
+// and multiplies by z (FRACTAL_POW), so the escape loops have no pow() and no test of the formula. Only z^2 + c keeps
+// its original step and the cardioid / bulb test.
+#ifndef FRACTAL_POWER
+#define FRACTAL_POWER 2
+#endif
+#if FRACTAL_POWER == 2 && !defined(FRACTAL_JULIA) && !defined(FRACTAL_BURNING_SHIP)
+#define FRACTAL_MANDELBROT
+#endif
+#ifdef FRACTAL_BURNING_SHIP
+#define FRACTAL_FOLD(x) fabs(x)
+#define FRACTAL_FOLD_DS(x) dsAbs(x)
+#else
+#define FRACTAL_FOLD(x) (x)
+#define FRACTAL_FOLD_DS(x) (x)
+#endif
+// w = w^2 and w = w a, with a the folded z
+#define FRACTAL_SQR { w_t = w_re*w_re - w_im*w_im; w_im = 2*w_re*w_im; w_re = w_t; }
+#define FRACTAL_MUL { w_t = w_re*a_re - w_im*a_im; w_im = w_re*a_im + w_im*a_re; w_re = w_t; }
+#define FRACTAL_SQR_DS { w_t = dsAdd(dsMul(w_re, w_re), -dsMul(w_im, w_im)); w_im = 2.0f*dsMul(w_re, w_im); w_re = w_t; }
+#define FRACTAL_MUL_DS { w_t = dsAdd(dsMul(w_re, a_re), -dsMul(w_im, a_im)); w_im = dsAdd(dsMul(w_re, a_im), dsMul(w_im, a_re)); w_re = w_t; }
+#if FRACTAL_POWER == 2
+#define FRACTAL_POW(SQR, MUL) SQR
+#elif FRACTAL_POWER == 3
+#define FRACTAL_POW(SQR, MUL) SQR MUL
+#elif FRACTAL_POWER == 4
+#define FRACTAL_POW(SQR, MUL) SQR SQR
+#elif FRACTAL_POWER == 5
+#define FRACTAL_POW(SQR, MUL) SQR SQR MUL
+#elif FRACTAL_POWER == 6
+#define FRACTAL_POW(SQR, MUL) SQR MUL SQR
+#elif FRACTAL_POWER == 7
+#define FRACTAL_POW(SQR, MUL) SQR MUL SQR MUL
+#elif FRACTAL_POWER == 8
+#define FRACTAL_POW(SQR, MUL) SQR SQR SQR
+#else
+#error FRACTAL_POWER must be 2..8
+#endif
+// z = fold(z)^FRACTAL_POWER + c, for z of type T (double or float) and in double-single
+#define FRACTAL_STEP(T, Z_re, Z_im, c_re, c_im) \
+    { \
+        T a_re = FRACTAL_FOLD(Z_re), a_im = FRACTAL_FOLD(Z_im); \
+        T w_re = a_re, w_im = a_im, w_t; \
+        FRACTAL_POW(FRACTAL_SQR, FRACTAL_MUL) \
+        Z_re = w_re + c_re; \
+        Z_im = w_im + c_im; \
+    }
+#define FRACTAL_STEP_DS(Z_re, Z_im, c_re, c_im) \
+    { \
+        float2 a_re = FRACTAL_FOLD_DS(Z_re), a_im = FRACTAL_FOLD_DS(Z_im); \
+        float2 w_re = a_re, w_im = a_im, w_t; \
+        FRACTAL_POW(FRACTAL_SQR_DS, FRACTAL_MUL_DS) \
+        Z_re = dsAdd(w_re, c_re); \
+        Z_im = dsAdd(w_im, c_im); \
+    }
+// The smooth iteration count of z^d + c is n + 1 - log_d(log2 |z|)
+#define FRACTAL_SMOOTH_SCALE (1.0f / log2((float)FRACTAL_POWER))
+// Iteration histogram (keep in step with Histogram.h): an exact bin for each of the first HISTOGRAM_EXACT_BINS
+// iterations, the rest of the range up to maxIter spread evenly over the remaining bins
+#define HISTOGRAM_BINS 4096
+#define HISTOGRAM_EXACT_BINS 2048
+
+// Colour band an escape at iteration n falls in (1..6), or 0 if it falls in none of them. NB: the float thresholds
+// leave a gap between bands 5 and 6; an escape in the gap is not counted and iteration carries on.
+int colourBand(int n, float maxIter)
+{
+    if(n >= 0 && n <= (maxIter/200-1))
+        return 1;
+    if(n >= maxIter/200 && n <= (maxIter/100-1))
+        return 2;
+    if(n >= maxIter/100 && n <= (maxIter/50-1))
+        return 3;
+    if(n >= maxIter/50 && n <= (maxIter/25-1))
+        return 4;
+    if(n >= maxIter/25 && n <= (maxIter/7-1))
+        return 5;
+    if(n >= maxIter/7 && n <= (maxIter-1))
+        return 6;
+    return 0;
+}
+
+// Fractional part of the smooth iteration count n + 1 - log2(log2 |z|) of an escape with |z|^2 = mag2. The escape
+// radius is only 2, so it is clamped to [0, 1].
+#ifndef NO_FP64
+float smoothFraction(double mag2)
+{
+    float f = 1.0f - FRACTAL_SMOOTH_SCALE*log2(0.5f * log2((float)mag2));
+    return clamp(f, 0.0f, 1.0f);
+}
+#endif
+
+int packEscape(int band, int iter, float frac)
+{
+    int q = min((int)(frac * (1 << ESCAPE_FRAC_BITS)), (1 << ESCAPE_FRAC_BITS) - 1);
+    return ((iter * 8 + band) << ESCAPE_FRAC_BITS) | q;
+}
+
+// Colour of a packed escape result from the palette lookup table built on the host (see Palette.h): entry 'iter' when
+// paletteDensity is 0, otherwise the smooth iteration count times paletteDensity, wrapped around the table and
+// interpolated between entries. Pixels that never escaped are black.
+float4 paletteColour(int v, __global const float4 *palette, int paletteSize, float paletteDensity)
+{
+    int band = (v >> ESCAPE_FRAC_BITS) & 7;
+    int iter = v >> (ESCAPE_FRAC_BITS + 3);
+    if(band == 0)
+    {
+        return (float4)(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    if(paletteDensity <= 0.0f)
+    {
+        return palette[min(iter, paletteSize - 1)];
+    }
+    float frac = (float)(v & ((1 << ESCAPE_FRAC_BITS) - 1)) / (1 << ESCAPE_FRAC_BITS);
+    float t = ((float)iter + frac) * paletteDensity;
+    float ft = floor(t);
+    uint i0 = (uint)ft % (uint)paletteSize;
+    uint i1 = (i0 + 1) % (uint)paletteSize;
+    return palette[i0] + (palette[i1] - palette[i0]) * (t - ft);
+}
+
+// Write a packed escape result to the render target: its palette colour, or with -D ITER_TEXTURE the packed value
+// itself, for a single channel integer texture that is coloured through the palette when it is drawn
+void writeResult(write_only image2d_t writeToImage, int2 pos, int packed, __global const float4 *palette,
+                 int paletteSize, float paletteDensity)
+{
+#ifdef ITER_TEXTURE
+    write_imagei(writeToImage, pos, (int4)(packed, 0, 0, 0));
+#else
+    write_imagef(writeToImage, pos, paletteColour(packed, palette, paletteSize, paletteDensity));
+#endif
+}
+
+#ifndef NO_FP64
+// Escape-time loop for one point: returns the colour band (0 = inside), the iterations run in 'iter' and the smooth
+// fraction of an escape in 'frac'. 'shortcut' is set to 1 (main cardioid), 2 (period-2 bulb) or 3 (periodic orbit)
+// when an interior short-circuit painted the pixel black, 0 otherwise.
+int escapeTime(double c_re, double c_im, float maxIter, int useShortcuts, int *iter, int *shortcut, float *frac)
+{
+    *iter = 0;
+    *shortcut = 0;
+    *frac = 0.0f;
+#ifdef FRACTAL_MANDELBROT
+    // Points inside the main cardioid or the period-2 bulb never escape: skip the loop and paint them black
+    if(useShortcuts)
+    {
+        double xq = c_re - 0.25;
+        double y2 = c_im*c_im;
+        double q = xq*xq + y2;
+        double xb = c_re + 1.0;
+        if(q*(q + xq) <= 0.25*y2)
+        {
+            *shortcut = 1;
+            return 0;
+        }
+        else if(xb*xb + y2 <= 0.0625)
+        {
+            *shortcut = 2;
+            return 0;
+        }
+    }
+#endif
+    // C imaginary, C real, Z real
+    double Z_re = c_re, Z_im = c_im;
+#ifdef FRACTAL_JULIA
+    // The pixel is z0 and c the constant of the set
+    c_re = FRACTAL_JULIA_RE;
+    c_im = FRACTAL_JULIA_IM;
+#endif
+    double saved_re = Z_re, saved_im = Z_im;
+    int checkLen = PERIOD_FIRST_CHECK;
+    int checkCount = 0;
+    int n_iter = 0;
+
+    for(int n=0; n<maxIter; n++)
+    {
+        // Z - real and imaginary
+        double Z_re2 = Z_re*Z_re;
+        double Z_im2 = Z_im*Z_im;
+        //if Z real squared plus Z imaginary squared is greater than c squared
+        if(Z_re2 + Z_im2 > 4)
+        {
+            int band = colourBand(n, maxIter);
+            if(band != 0)
+            {
+                *iter = n_iter;
+                *frac = smoothFraction(Z_re2 + Z_im2);
+                return band;
+            }
+        }
+#ifdef FRACTAL_MANDELBROT
+        Z_im = 2*Z_re*Z_im + c_im;
+        Z_re = Z_re2 - Z_im2 + c_re;
+#else
+        FRACTAL_STEP(double, Z_re, Z_im, c_re, c_im)
+#endif
+        n_iter++;
+        if(useShortcuts)
+        {
+            if(fabs(Z_re - saved_re) < PERIOD_EPSILON && fabs(Z_im - saved_im) < PERIOD_EPSILON)
+            {
+                *iter = n_iter;
+                *shortcut = 3;
+                return 0;
+            }
+            if(++checkCount == checkLen)
+            {
+                checkCount = 0;
+                checkLen *= 2;
+                saved_re = Z_re;
+                saved_im = Z_im;
+            }
+        }
+    }
+    *iter = n_iter;
+    return 0;
+}
+
+// shortcutCounts: [0] pixels in the main cardioid, [1] pixels in the period-2 bulb, [2] periodic orbits found
+// The packed escape results are kept in pixelIter so a palette change only needs 'mandelColourize'.
 __kernel void mandel(write_only image2d_t writeToImage,                             
                      double minX,                                                  
                      double maxX,                                                  
-                     double minY)                                                  
-        {                                                               
+                     double minY,
+                     __global int *shortcutCounts,
+                     int useShortcuts,
+                     __global int *pixelIter,
+                     __global const float4 *palette,
+                     int paletteSize,
+                     float paletteDensity,
+                     float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            __local int localCounts[3];
+            bool bLocalLeader = get_local_id(0) == 0 && get_local_id(1) == 0;
+            if(bLocalLeader)
+            {
+                localCounts[0] = 0;
+                localCounts[1] = 0;
+                localCounts[2] = 0;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
             // get id of element in array                                   
             uint x = get_global_id(0);                                      
             uint y = get_global_id(1);                                      
             uint w = get_global_size(0);                                    
             uint h = get_global_size(1);                                    
-            float4 result = (float4)(0.0f, 0.0f, 0.0f, 1.0f);               
             double MaxIm = minY+(maxX-minX)*h/w;                        
             double Re_factor = (maxX-minX)/(w-1);                          
             double Im_factor = (MaxIm-minY)/(h-1);                       
-            const float maxIter = 10000.0f;
             
-            // declare 4 bands of colour gradient to be used for low to high iterations
-            bool bColBand1 = false;
-            bool bColBand2 = false;
-            bool bColBand3 = false;
-            bool bColBand4 = false;  
-            bool bColBand5 = false;
-            bool bColBand6 = false; 
-            
-            // colour min and max per band
-            float4 white =       {1.0f, 1.0f, 1.0f, 1.0f};
-            float4 lightOrange = {255.0f, 200.0f, 50.0f,   1.0f};
-            float4 darkOrange =  {255.0f, 153.0f, 20.0f,   1.0f};
-            float4 teal =        {51.0f,  201.0f, 153.0f, 1.0f};
-            float4 tealBright =  {50.0f,   255.0f, 255.0f, 1.0f};
-            float4 greenOlive =  {153.0f, 204.0f, 20.0f,   1.0f};
-            float4 gold =        {255.0f, 255.0f, 20.0f,   1.0f};
-            float4 teal2 =       {50.0f,   153.0f, 153.0f, 1.0f};
-            float4 lightRed =    {255.0f, 51.0f,  51.0f,   1.0f};
-            float4 darkRed =     {102.0f, 10.0f,  10.0f,   1.0f};
-            lightOrange = lightOrange / 255.0f;
-            darkOrange = darkOrange / 255.0f;
-            teal   = teal   / 255.0f;
-            tealBright = tealBright / 255.0f;
-            teal2   = teal2   / 255.0f;
-            greenOlive = greenOlive / 255.0f;
-            gold = gold / 255.0f;
-            lightRed = lightRed / 255.0f;
-            darkRed = darkRed / 255.0f;
-            // C imaginary, C real, Z real                                                  
+            // C imaginary, C real
             double c_im = MaxIm - y*Im_factor;                           
             double c_re = minX + x*Re_factor;                            
-            double Z_re = c_re, Z_im = c_im;                             
-            bool isInside = true;                                        
-            int iter = 0; 
-            
-            for(int n=0; n<maxIter; n++)                                    
-            {                                                               
-                // Z - real and imaginary                                   
-                double Z_re2 = Z_re*Z_re;
-                double Z_im2 = Z_im*Z_im;                
-                //if Z real squared plus Z imaginary squared is greater than c squared  \n"
-                if(Z_re2 + Z_im2 > 4)                                       
-                {                                                           
-                    if(n >= 0 && n <= (maxIter/200-1))                        
-                    {   
-                        bColBand1 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                    else if(n >= maxIter/200 && n <= (maxIter/100-1))                        
-                    {   
-                        bColBand2 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                    else if(n >= maxIter/100 && n <= (maxIter/50-1))                        
-                    {   
-                        bColBand3 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                    else if(n >= maxIter/50 && n <= (maxIter/25-1))                        
-                    {   
-                        bColBand4 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                    else if(n >= maxIter/25 && n <= (maxIter/7-1))                        
-                    {   
-                        bColBand5 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                    else if(n >= maxIter/7 && n <= (maxIter-1))                        
-                    {   
-                        bColBand6 = true;                        
-                        isInside = false;                                   
-                        break;                                              
-                    }
-                }                                                         
-                Z_im = 2*Z_re*Z_im + c_im;                                  
-                Z_re = Z_re2 - Z_im2 + c_re;                                
-                iter++;                                                     
-            }                                                             
+            int iter;
+            int shortcut;
+            float frac;
+            int band = escapeTime(c_re, c_im, maxIter, useShortcuts, &iter, &shortcut, &frac);
+            if(shortcut != 0)
+            {
+                atomic_inc(&localCounts[shortcut - 1]);
+            }
             //histogram[iter] +=1;                                            
-            //xyIter[x][y] = iter;
-            if(bColBand1)                                                        
-            {                                                               
-                result = iter * teal / 50.0f;
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            if(bColBand2)                                                        
-            {                                                               
-                result = darkOrange - (iter * darkOrange / 150.0f);
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            else if(bColBand3)                                                        
-            {                                                               
-                result = greenOlive - (iter * greenOlive / 200.0f);
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            else if(bColBand4)                                                        
-            {                                                               
-                result = gold - (iter * gold / 400.0f);
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            else if(bColBand5)                                                        
-            {                                                               
-                result = teal - (iter * teal / 2000.0f);
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            else if(bColBand6)                                                        
-            {                                                               
-                result = lightRed - (iter * lightRed / 4000.0f);
-                result = (float4){result.x, result.y, result.z, 1.0f};
-            }
-            else if(isInside)                                               
-            {                                                               
-                result = (float4)(0.0f, 0.0f, 0.0f, 1.0f);                         
-            }
-            write_imagef(writeToImage, (int2)(x, y), result);               
+            int packed = packEscape(band, iter, frac);
+            pixelIter[y * w + x] = packed;
+            writeResult(writeToImage, (int2)(x, y), packed, palette, paletteSize, paletteDensity);
+
+            // One global atomic per work-group rather than per pixel
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if(bLocalLeader && useShortcuts)
+            {
+                atomic_add(&shortcutCounts[0], localCounts[0]);
+                atomic_add(&shortcutCounts[1], localCounts[1]);
+                atomic_add(&shortcutCounts[2], localCounts[2]);
+            }
         }                                                                
+
+
+// Perturbation kernel for deep zooms (see Perturbation.h). Each pixel iterates only its difference dz from the high
+// precision reference orbit refOrbit (Z_0 = 0) computed on the host:
+//     dz' = (2 Z_m + dz) dz + dc
+// rebasing onto the start of the reference (dz = Z_m + dz, m = 0) when |z| < |dz| or the reference runs out.
+// The first skipIter iterations are replaced by the series dz = A dc + B dc^2 + C dc^3.
+// rebaseCount: number of rebases (glitches avoided) in the frame
+__kernel void mandelPerturb(write_only image2d_t writeToImage,
+                            __global const double2 *refOrbit,
+                            int refLength,
+                            double2 refPixel,
+                            double Re_factor,
+                            double Im_factor,
+                            int skipIter,
+                            double2 saA,
+                            double2 saB,
+                            double2 saC,
+                            __global int *rebaseCount,
+                            __global int *pixelIter,
+                            __global const float4 *palette,
+                            int paletteSize,
+                            float paletteDensity,
+                            float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            __local int localRebases;
+            bool bLocalLeader = get_local_id(0) == 0 && get_local_id(1) == 0;
+            if(bLocalLeader)
+            {
+                localRebases = 0;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            uint x = get_global_id(0);
+            uint y = get_global_id(1);
+            const int last = refLength - 1;
+            double2 dc = (double2)((x - refPixel.x) * Re_factor, -(y - refPixel.y) * Im_factor);
+
+            // Series approximation for the first skipIter iterations
+            double2 dc2 = (double2)(dc.x*dc.x - dc.y*dc.y, 2.0*dc.x*dc.y);
+            double2 dc3 = (double2)(dc2.x*dc.x - dc2.y*dc.y, dc2.x*dc.y + dc2.y*dc.x);
+            double2 dz = (double2)(saA.x*dc.x - saA.y*dc.y + saB.x*dc2.x - saB.y*dc2.y + saC.x*dc3.x - saC.y*dc3.y,
+                                   saA.x*dc.y + saA.y*dc.x + saB.x*dc2.y + saB.y*dc2.x + saC.x*dc3.y + saC.y*dc3.x);
+            int m = skipIter;
+            int band = 0;
+            int iter = (int)maxIter;
+            float frac = 0.0f;
+            int rebases = 0;
+
+            // Check n of the 'mandel' kernel tests z_{n+1} of an orbit starting at zero
+            for(int n=skipIter; n<maxIter; n++)
+            {
+                double2 t = 2.0*refOrbit[m] + dz;
+                dz = (double2)(t.x*dz.x - t.y*dz.y + dc.x, t.x*dz.y + t.y*dz.x + dc.y);
+                m++;
+                double2 z = refOrbit[m] + dz;
+                double mag2 = z.x*z.x + z.y*z.y;
+                if(mag2 > 4)
+                {
+                    band = colourBand(n, maxIter);
+                    if(band != 0)
+                    {
+                        iter = n;
+                        frac = smoothFraction(mag2);
+                        break;
+                    }
+                }
+                if(mag2 < dz.x*dz.x + dz.y*dz.y || m == last)
+                {
+                    dz = z;
+                    m = 0;
+                    rebases++;
+                }
+            }
+            int packed = packEscape(band, iter, frac);
+            pixelIter[y * get_global_size(0) + x] = packed;
+            writeResult(writeToImage, (int2)(x, y), packed, palette, paletteSize, paletteDensity);
+
+            atomic_add(&localRebases, rebases);
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if(bLocalLeader)
+            {
+                atomic_add(rebaseCount, localRebases);
+            }
+        }
+
+
+// Pixel to complex plane mapping of the 'mandel' kernel for a w x h frame
+double2 pixelToComplex(uint x, uint y, uint w, uint h, double minX, double maxX, double minY)
+{
+    double MaxIm = minY+(maxX-minX)*h/w;
+    double Re_factor = (maxX-minX)/(w-1);
+    double Im_factor = (MaxIm-minY)/(h-1);
+    return (double2)(minX + x*Re_factor, MaxIm - y*Im_factor);
+}
+
+// Packed escape result of pixel (x, y)
+int packedEscape(uint x, uint y, uint w, uint h, double minX, double maxX, double minY, int useShortcuts,
+                 float maxIter)
+{
+    double2 c = pixelToComplex(x, y, w, h, minX, maxX, minY);
+    int iter;
+    int shortcut;
+    float frac;
+    int band = escapeTime(c.x, c.y, maxIter, useShortcuts, &iter, &shortcut, &frac);
+    return packEscape(band, iter, frac);
+}
+
+// Mariani-Silver pass 0: iterate the pixels on the lines of the initial rectangle grid (every SUBDIV_GRID_SIZE-th row
+// and column plus the last ones). Run over the whole frame; pixels off the grid return straight away.
+__kernel void mandelGridLines(__global int *pixelIter,
+                              double minX,
+                              double maxX,
+                              double minY,
+                              int useShortcuts,
+                              float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            uint x = get_global_id(0);
+            uint y = get_global_id(1);
+            uint w = get_global_size(0);
+            uint h = get_global_size(1);
+            bool bOnGrid = x % SUBDIV_GRID_SIZE == 0 || x == w - 1 || y % SUBDIV_GRID_SIZE == 0 || y == h - 1;
+            if(bOnGrid)
+            {
+                pixelIter[y * w + x] = packedEscape(x, y, w, h, minX, maxX, minY, useShortcuts, maxIter);
+            }
+        }
+
+// Mariani-Silver pass n: one work-group per rectangle (x0, y0, x1, y1 inclusive) whose border pixels are known.
+// A border of a single band and iteration count is copied over the interior. Otherwise the middle row and column are iterated and the
+// four quarters are queued for the next pass in nextRects, or, when the rectangle is small or the queue is full, the
+// whole interior is iterated here.
+// nextCount is bumped by 4 per split even past nextCapacity (a multiple of 4), so the host reads min(nextCount,
+// nextCapacity) rectangles.
+// subdivStats: [0] pixels filled without iterating, [1] pixels iterated, [2] rectangles that did not fit in the queue
+__kernel void mandelSubdivide(__global const int4 *rects,
+                              __global int *pixelIter,
+                              __global int4 *nextRects,
+                              __global int *nextCount,
+                              int nextCapacity,
+                              __global int *subdivStats,
+                              int width,
+                              int height,
+                              double minX,
+                              double maxX,
+                              double minY,
+                              int useShortcuts,
+                              float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            __local int value;
+            __local int bUniform;
+            __local int childBase;
+            int4 r = rects[get_group_id(0)];
+            int lid = get_local_id(0);
+            int lsize = get_local_size(0);
+            bool bLocalLeader = lid == 0;
+            int rw = r.z - r.x;
+            int rh = r.w - r.y;
+            int iw = rw - 1;
+            int ih = rh - 1;
+
+            if(bLocalLeader)
+            {
+                value = pixelIter[r.y * width + r.x];
+                bUniform = 1;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            // Border: top and bottom rows, then the left and right columns between them
+            for(int i = lid; i < 2 * (rw + rh); i += lsize)
+            {
+                int px, py;
+                if(i < rw + 1)
+                {
+                    px = r.x + i; py = r.y;
+                }
+                else if(i < 2 * (rw + 1))
+                {
+                    px = r.x + i - (rw + 1); py = r.w;
+                }
+                else if(i < 2 * (rw + 1) + ih)
+                {
+                    px = r.x; py = r.y + 1 + i - 2 * (rw + 1);
+                }
+                else
+                {
+                    px = r.z; py = r.y + 1 + i - 2 * (rw + 1) - ih;
+                }
+                if((pixelIter[py * width + px] >> ESCAPE_FRAC_BITS) != (value >> ESCAPE_FRAC_BITS))
+                {
+                    bUniform = 0;
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            if(bUniform)
+            {
+                for(int i = lid; i < iw * ih; i += lsize)
+                {
+                    pixelIter[(r.y + 1 + i / iw) * width + r.x + 1 + i % iw] = value;
+                }
+                if(bLocalLeader && iw > 0 && ih > 0)
+                {
+                    atomic_add(&subdivStats[0], iw * ih);
+                }
+                return;
+            }
+
+            if(bLocalLeader)
+            {
+                childBase = -1;
+                if(iw > SUBDIV_MIN_SIZE && ih > SUBDIV_MIN_SIZE)
+                {
+                    childBase = atomic_add(nextCount, 4);
+                    if(childBase >= nextCapacity)
+                    {
+                        childBase = -1;
+                        atomic_inc(&subdivStats[2]);
+                    }
+                }
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            if(childBase < 0)
+            {
+                for(int i = lid; i < iw * ih; i += lsize)
+                {
+                    uint px = r.x + 1 + i % iw;
+                    uint py = r.y + 1 + i / iw;
+                    pixelIter[py * width + px] = packedEscape(px, py, width, height, minX, maxX, minY, useShortcuts, maxIter);
+                }
+                if(bLocalLeader && iw > 0 && ih > 0)
+                {
+                    atomic_add(&subdivStats[1], iw * ih);
+                }
+                return;
+            }
+
+            // Middle row and column; they become the shared borders of the four quarters
+            int mx = (r.x + r.z) / 2;
+            int my = (r.y + r.w) / 2;
+            for(int i = lid; i < iw + ih - 1; i += lsize)
+            {
+                uint px, py;
+                if(i < iw)
+                {
+                    px = r.x + 1 + i; py = my;
+                }
+                else
+                {
+                    px = mx; py = r.y + 1 + i - iw;
+                    py += py >= my ? 1 : 0;
+                }
+                pixelIter[py * width + px] = packedEscape(px, py, width, height, minX, maxX, minY, useShortcuts, maxIter);
+            }
+            if(bLocalLeader)
+            {
+                nextRects[childBase + 0] = (int4)(r.x, r.y, mx, my);
+                nextRects[childBase + 1] = (int4)(mx, r.y, r.z, my);
+                nextRects[childBase + 2] = (int4)(r.x, my, mx, r.w);
+                nextRects[childBase + 3] = (int4)(mx, my, r.z, r.w);
+                atomic_add(&subdivStats[1], iw + ih - 1);
+            }
+        }
+#endif // NO_FP64
+
+// Colour the packed iteration buffer through the palette (or copy it to an ITER_TEXTURE target); also all a palette
+// change needs. Each cellW x cellH cell (powers of two, 1 x 1 for a complete frame) takes the colour of its top left
+// pixel, which is all a progressive pass has computed so far.
+__kernel void mandelColourize(write_only image2d_t writeToImage,
+                              __global const int *pixelIter,
+                              int cellW,
+                              int cellH,
+                              __global const float4 *palette,
+                              int paletteSize,
+                              float paletteDensity)
+        {
+            uint x = get_global_id(0);
+            uint y = get_global_id(1);
+            int v = pixelIter[(y & ~(cellH - 1)) * get_global_size(0) + (x & ~(cellW - 1))];
+            writeResult(writeToImage, (int2)(x, y), v, palette, paletteSize, paletteDensity);
+        }
+
+
+// Bin of an escape at iteration 'iter'; binScale is the width of the shared bins as a 0.32 fixed point reciprocal
+// (histogramBinScale() in Histogram.h)
+uint histogramBin(int iter, uint binScale)
+{
+    int over = max(iter - HISTOGRAM_EXACT_BINS, 0);
+    uint shared = HISTOGRAM_EXACT_BINS + mul_hi((uint)over, binScale);
+    return over > 0 ? min(shared, (uint)HISTOGRAM_BINS - 1) : (uint)max(iter, 0);
+}
+
+// Iteration histogram of the packed results. Launched with a fixed number of work-groups that stride over the frame:
+// each group counts its pixels into a histogram in local memory and then merges it into 'histogram' with one global
+// atomic per non-empty bin, so the cost of the merge does not grow with the image size. stats: [0] interior pixels,
+// [1] lowest and [2] highest escape iteration (the host starts them at 0, INT_MAX and -1).
+__kernel void mandelHistogram(__global const int *pixelIter,
+                              int pixelCount,
+                              uint binScale,
+                              __global uint *histogram,
+                              __global int *stats)
+        {
+            __local uint bins[HISTOGRAM_BINS];
+            __local int localStats[3];
+            const uint lid = get_local_id(0);
+            for(uint b = lid; b < HISTOGRAM_BINS; b += get_local_size(0))
+            {
+                bins[b] = 0;
+            }
+            if(lid == 0)
+            {
+                localStats[0] = 0;
+                localStats[1] = INT_MAX;
+                localStats[2] = -1;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            int interior = 0;
+            int low = INT_MAX;
+            int high = -1;
+            for(int i = get_global_id(0); i < pixelCount; i += get_global_size(0))
+            {
+                int v = pixelIter[i];
+                if(v < 0)
+                {
+                    continue;
+                }
+                if(((v >> ESCAPE_FRAC_BITS) & 7) == 0)
+                {
+                    interior++;
+                    continue;
+                }
+                int iter = v >> (ESCAPE_FRAC_BITS + 3);
+                atomic_inc(&bins[histogramBin(iter, binScale)]);
+                low = min(low, iter);
+                high = max(high, iter);
+            }
+            atomic_add(&localStats[0], interior);
+            atomic_min(&localStats[1], low);
+            atomic_max(&localStats[2], high);
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            for(uint b = lid; b < HISTOGRAM_BINS; b += get_local_size(0))
+            {
+                if(bins[b] != 0)
+                {
+                    atomic_add(&histogram[b], bins[b]);
+                }
+            }
+            if(lid == 0)
+            {
+                atomic_add(&stats[0], localStats[0]);
+                atomic_min(&stats[1], localStats[1]);
+                atomic_max(&stats[2], localStats[2]);
+            }
+        }
+
+#ifndef NO_FP64
+// Iteration cache: iterate only the pixels whose packed result is still unknown (-1); the others were copied from the
+// cache by the host. The buffer is then coloured by 'mandelColourize' and read back to fill the cache.
+__kernel void mandelFillMissing(__global int *pixelIter,
+                                double minX,
+                                double maxX,
+                                double minY,
+                                int useShortcuts,
+                                float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            uint x = get_global_id(0);
+            uint y = get_global_id(1);
+            uint w = get_global_size(0);
+            uint h = get_global_size(1);
+            if(pixelIter[y * w + x] < 0)
+            {
+                pixelIter[y * w + x] = packedEscape(x, y, w, h, minX, maxX, minY, useShortcuts, maxIter);
+            }
+        }
+
+
+// One slice of a progressive pass (see Progressive.h): iterate the pixels at (xOffset + i * xStep, yOffset + j * yStep)
+// that are still unknown (-1). Rows of the pass lattice are picked with the global work offset.
+__kernel void mandelProgressive(__global int *pixelIter,
+                                double minX,
+                                double maxX,
+                                double minY,
+                                int width,
+                                int height,
+                                int xStep,
+                                int yStep,
+                                int xOffset,
+                                int yOffset,
+                                int useShortcuts,
+                                float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            uint x = xOffset + get_global_id(0) * xStep;
+            uint y = yOffset + get_global_id(1) * yStep;
+            if(x >= width || y >= height)
+            {
+                return;
+            }
+            if(pixelIter[y * width + x] < 0)
+            {
+                pixelIter[y * width + x] = packedEscape(x, y, width, height, minX, maxX, minY, useShortcuts, maxIter);
+            }
+        }
+#endif // NO_FP64
+
+// Precision tiers for devices with slow or no double precision (keep in step with Precision.h). The host picks the
+// tier of each frame from the zoom; 'mandelProgressiveFloat' iterates in float or in double-single, where a value is
+// the unevaluated sum hi + lo of two floats and the rounding error of every operation is recovered exactly.
+#define PRECISION_FLOAT 0
+#define PRECISION_DOUBLE_SINGLE 1
+
+float smoothFractionFloat(float mag2)
+{
+    float f = 1.0f - FRACTAL_SMOOTH_SCALE*log2(0.5f * log2(mag2));
+    return clamp(f, 0.0f, 1.0f);
+}
+
+// a + b exactly, as a double-single
+float2 dsTwoSum(float a, float b)
+{
+    float s = a + b;
+    float v = s - a;
+    return (float2)(s, (a - (s - v)) + (b - v));
+}
+
+// Renormalise hi + lo with |hi| >= |lo|
+float2 dsQuickTwoSum(float hi, float lo)
+{
+    float s = hi + lo;
+    return (float2)(s, lo - (s - hi));
+}
+
+float2 dsAdd(float2 a, float2 b)
+{
+    float2 s = dsTwoSum(a.x, b.x);
+    return dsQuickTwoSum(s.x, s.y + a.y + b.y);
+}
+
+float2 dsMul(float2 a, float2 b)
+{
+    float p = a.x * b.x;
+    float e = fma(a.x, b.x, -p);
+    return dsQuickTwoSum(p, e + (a.x * b.y + a.y * b.x));
+}
+
+// |a|: the sign of hi + lo is the sign of hi
+float2 dsAbs(float2 a)
+{
+    return a.x < 0.0f ? -a : a;
+}
+
+// Escape-time loop of escapeTime() in float
+int escapeTimeFloat(float c_re, float c_im, float maxIter, int useShortcuts, int *iter, int *shortcut, float *frac)
+{
+    *iter = 0;
+    *shortcut = 0;
+    *frac = 0.0f;
+#ifdef FRACTAL_MANDELBROT
+    if(useShortcuts)
+    {
+        float xq = c_re - 0.25f;
+        float y2 = c_im*c_im;
+        float q = xq*xq + y2;
+        float xb = c_re + 1.0f;
+        if(q*(q + xq) <= 0.25f*y2)
+        {
+            *shortcut = 1;
+            return 0;
+        }
+        else if(xb*xb + y2 <= 0.0625f)
+        {
+            *shortcut = 2;
+            return 0;
+        }
+    }
+#endif
+    float Z_re = c_re, Z_im = c_im;
+#ifdef FRACTAL_JULIA
+    c_re = FRACTAL_JULIA_DS.x;
+    c_im = FRACTAL_JULIA_DS.z;
+#endif
+    float saved_re = Z_re, saved_im = Z_im;
+    int checkLen = PERIOD_FIRST_CHECK;
+    int checkCount = 0;
+    int n_iter = 0;
+
+    for(int n=0; n<maxIter; n++)
+    {
+        float Z_re2 = Z_re*Z_re;
+        float Z_im2 = Z_im*Z_im;
+        if(Z_re2 + Z_im2 > 4)
+        {
+            int band = colourBand(n, maxIter);
+            if(band != 0)
+            {
+                *iter = n_iter;
+                *frac = smoothFractionFloat(Z_re2 + Z_im2);
+                return band;
+            }
+        }
+#ifdef FRACTAL_MANDELBROT
+        Z_im = 2*Z_re*Z_im + c_im;
+        Z_re = Z_re2 - Z_im2 + c_re;
+#else
+        FRACTAL_STEP(float, Z_re, Z_im, c_re, c_im)
+#endif
+        n_iter++;
+        if(useShortcuts)
+        {
+            if(fabs(Z_re - saved_re) < PERIOD_EPSILON_FLOAT && fabs(Z_im - saved_im) < PERIOD_EPSILON_FLOAT)
+            {
+                *iter = n_iter;
+                *shortcut = 3;
+                return 0;
+            }
+            if(++checkCount == checkLen)
+            {
+                checkCount = 0;
+                checkLen *= 2;
+                saved_re = Z_re;
+                saved_im = Z_im;
+            }
+        }
+    }
+    *iter = n_iter;
+    return 0;
+}
+
+// Escape-time loop of escapeTime() in double-single. Only the escape test and the smooth fraction use the hi parts.
+int escapeTimeDS(float2 c_re, float2 c_im, float maxIter, int useShortcuts, int *iter, int *shortcut, float *frac)
+{
+    *iter = 0;
+    *shortcut = 0;
+    *frac = 0.0f;
+#ifdef FRACTAL_MANDELBROT
+    if(useShortcuts)
+    {
+        float2 xq = dsAdd(c_re, (float2)(-0.25f, 0.0f));
+        float2 y2 = dsMul(c_im, c_im);
+        float2 q = dsAdd(dsMul(xq, xq), y2);
+        float2 xb = dsAdd(c_re, (float2)(1.0f, 0.0f));
+        if(dsAdd(dsMul(q, dsAdd(q, xq)), -0.25f*y2).x <= 0.0f)
+        {
+            *shortcut = 1;
+            return 0;
+        }
+        else if(dsAdd(dsAdd(dsMul(xb, xb), y2), (float2)(-0.0625f, 0.0f)).x <= 0.0f)
+        {
+            *shortcut = 2;
+            return 0;
+        }
+    }
+#endif
+    float2 Z_re = c_re, Z_im = c_im;
+#ifdef FRACTAL_JULIA
+    c_re = FRACTAL_JULIA_DS.xy;
+    c_im = FRACTAL_JULIA_DS.zw;
+#endif
+    float2 saved_re = Z_re, saved_im = Z_im;
+    int checkLen = PERIOD_FIRST_CHECK;
+    int checkCount = 0;
+    int n_iter = 0;
+
+    for(int n=0; n<maxIter; n++)
+    {
+        float2 Z_re2 = dsMul(Z_re, Z_re);
+        float2 Z_im2 = dsMul(Z_im, Z_im);
+        if(Z_re2.x + Z_im2.x > 4)
+        {
+            int band = colourBand(n, maxIter);
+            if(band != 0)
+            {
+                *iter = n_iter;
+                *frac = smoothFractionFloat(Z_re2.x + Z_im2.x);
+                return band;
+            }
+        }
+#ifdef FRACTAL_MANDELBROT
+        // 2 Z_re Z_im: doubling both parts is exact
+        Z_im = dsAdd(2.0f*dsMul(Z_re, Z_im), c_im);
+        Z_re = dsAdd(dsAdd(Z_re2, -Z_im2), c_re);
+#else
+        FRACTAL_STEP_DS(Z_re, Z_im, c_re, c_im)
+#endif
+        n_iter++;
+        if(useShortcuts)
+        {
+            if(fabs(dsAdd(Z_re, -saved_re).x) < PERIOD_EPSILON_FLOAT && fabs(dsAdd(Z_im, -saved_im).x) < PERIOD_EPSILON_FLOAT)
+            {
+                *iter = n_iter;
+                *shortcut = 3;
+                return 0;
+            }
+            if(++checkCount == checkLen)
+            {
+                checkCount = 0;
+                checkLen *= 2;
+                saved_re = Z_re;
+                saved_im = Z_im;
+            }
+        }
+    }
+    *iter = n_iter;
+    return 0;
+}
+
+// 'mandelProgressive' in the float or double-single tier ('precision'), without any double arithmetic. The view comes
+// as double-single pairs from the host: pixel (x, y) is at (minX + x * reFactor, maxIm - y * imFactor). Also used with
+// steps of one pixel for whole frames, where it iterates the pixels the iteration cache has not filled in.
+__kernel void mandelProgressiveFloat(__global int *pixelIter,
+                                     float2 minX,
+                                     float2 maxIm,
+                                     float2 reFactor,
+                                     float2 imFactor,
+                                     int width,
+                                     int height,
+                                     int xStep,
+                                     int yStep,
+                                     int xOffset,
+                                     int yOffset,
+                                     int useShortcuts,
+                                     float maxIter,
+                                     int precision)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            uint x = xOffset + get_global_id(0) * xStep;
+            uint y = yOffset + get_global_id(1) * yStep;
+            if(x >= width || y >= height || pixelIter[y * width + x] >= 0)
+            {
+                return;
+            }
+            // Pixel indices are exact in float, so the products lose nothing beyond the rounding of the factors
+            float2 c_re = dsAdd(minX, dsMul(reFactor, (float2)((float)x, 0.0f)));
+            float2 c_im = dsAdd(maxIm, -dsMul(imFactor, (float2)((float)y, 0.0f)));
+            int iter;
+            int shortcut;
+            float frac;
+            int band;
+            if(precision == PRECISION_FLOAT)
+            {
+                band = escapeTimeFloat(c_re.x, c_im.x, maxIter, useShortcuts, &iter, &shortcut, &frac);
+            }
+            else
+            {
+                band = escapeTimeDS(c_re, c_im, maxIter, useShortcuts, &iter, &shortcut, &frac);
+            }
+            pixelIter[y * width + x] = packEscape(band, iter, frac);
+        }
+
+
+// Adaptive anti-aliasing (keep in step with Antialias.h): pixels whose neighbours differ in colour band or by more than
+// an iteration are supersampled with AA_SAMPLES jittered samples, the strongest edges first, up to a budget per frame
+#define AA_SAMPLES 8
+#define AA_LEVELS 16
+#define AA_MIN_LEVEL 2
+__constant float2 AA_JITTER[AA_SAMPLES] = {(float2)(0.5f, 0.333333f), (float2)(0.25f, 0.666667f),
+                                           (float2)(0.75f, 0.111111f), (float2)(0.125f, 0.444444f),
+                                           (float2)(0.625f, 0.777778f), (float2)(0.375f, 0.222222f),
+                                           (float2)(0.875f, 0.555556f), (float2)(0.0625f, 0.888889f)};
+
+// Offset (-0.5..0.5 pixels) of extra sample 's' of pixel (x, y): the jitter pattern shifted by a hash of the pixel
+float2 aaSampleOffset(uint x, uint y, uint s)
+{
+    uint h = (x * 0x8da6b343u) ^ (y * 0xd8163841u);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    float2 o = (float2)((float)(h & 0xffff) / 65536.0f, (float)(h >> 16) / 65536.0f);
+    float2 d = AA_JITTER[s] + o;
+    return select(d, d - 1.0f, isgreaterequal(d, 1.0f)) - 0.5f;
+}
+
+// Hash of pixel index i deciding which pixels of a partly refined level are kept (see aaCutoffThreshold() on the host)
+uint aaSelectHash(uint i)
+{
+    uint h = i * 0x9e3779b1u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Contrast level of pixel (x, y): AA_LEVELS - 1 where the colour band changes, otherwise 2 log2(1 + d) for the largest
+// difference d in smooth iteration count to a neighbour
+int aaContrastLevel(__global const int *pixelIter, int x, int y, int w, int h)
+{
+    int v = pixelIter[y * w + x];
+    if(v < 0)
+    {
+        return 0;
+    }
+    int band = (v >> ESCAPE_FRAC_BITS) & 7;
+    float smooth = (float)(v >> (ESCAPE_FRAC_BITS + 3)) + (float)(v & ((1 << ESCAPE_FRAC_BITS) - 1)) / (1 << ESCAPE_FRAC_BITS);
+    const int2 neighbours[4] = {(int2)(-1, 0), (int2)(1, 0), (int2)(0, -1), (int2)(0, 1)};
+    float d = 0.0f;
+    for(int n = 0; n < 4; n++)
+    {
+        int nx = x + neighbours[n].x;
+        int ny = y + neighbours[n].y;
+        if(nx < 0 || ny < 0 || nx >= w || ny >= h)
+        {
+            continue;
+        }
+        int q = pixelIter[ny * w + nx];
+        if(q < 0)
+        {
+            continue;
+        }
+        if(((q >> ESCAPE_FRAC_BITS) & 7) != band)
+        {
+            return AA_LEVELS - 1;
+        }
+        if(band != 0)
+        {
+            float qs = (float)(q >> (ESCAPE_FRAC_BITS + 3)) + (float)(q & ((1 << ESCAPE_FRAC_BITS) - 1)) / (1 << ESCAPE_FRAC_BITS);
+            d = max(d, fabs(qs - smooth));
+        }
+    }
+    return min((int)(2.0f * log2(1.0f + d)), AA_LEVELS - 2);
+}
+
+// Anti-aliasing step 1: contrast level of every pixel into 'levels' and the number of pixels at each level into
+// 'counts' (AA_LEVELS entries, zeroed by the host), counted per work-group in local memory first
+__kernel void mandelAAMark(__global const int *pixelIter,
+                           __global uchar *levels,
+                           __global uint *counts)
+        {
+            __local uint localCounts[AA_LEVELS];
+            uint lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+            if(lid < AA_LEVELS)
+            {
+                localCounts[lid] = 0;
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+            int x = get_global_id(0);
+            int y = get_global_id(1);
+            int w = get_global_size(0);
+            int level = aaContrastLevel(pixelIter, x, y, w, get_global_size(1));
+            levels[y * w + x] = (uchar)level;
+            if(level >= AA_MIN_LEVEL)
+            {
+                atomic_inc(&localCounts[level]);
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if(lid < AA_LEVELS && localCounts[lid] != 0)
+            {
+                atomic_add(&counts[lid], localCounts[lid]);
+            }
+        }
+
+// Anti-aliasing step 2: list the pixels above 'cutoff' and those at it whose aaSelectHash() is below 'threshold' (both
+// chosen by the host from the counts), at most 'budget'. 'count' (zeroed by the host) ends up as the number of pixels
+// picked, which can be more than the budget.
+__kernel void mandelAASelect(__global const uchar *levels,
+                             int cutoff,
+                             ulong threshold,
+                             __global uint *pixels,
+                             __global uint *count,
+                             uint budget)
+        {
+            uint i = get_global_id(0);
+            if(levels[i] > cutoff || (levels[i] == cutoff && (ulong)aaSelectHash(i) < threshold))
+            {
+                uint slot = atomic_inc(count);
+                if(slot < budget)
+                {
+                    pixels[slot] = i;
+                }
+            }
+        }
+
+#ifndef NO_FP64
+// Anti-aliasing step 3: AA_SAMPLES jittered samples of each listed pixel of the w x h frame, packed into 'samples'
+__kernel void mandelAARefine(__global const uint *pixels,
+                             uint pixelCount,
+                             __global int *samples,
+                             double minX,
+                             double maxX,
+                             double minY,
+                             int w,
+                             int h,
+                             int useShortcuts,
+                             float maxIter)
+        {
+            maxIter = MAX_ITER_ARG(maxIter);
+            useShortcuts = USE_SHORTCUTS_ARG(useShortcuts);
+            uint p = get_global_id(0) / AA_SAMPLES;
+            uint s = get_global_id(0) % AA_SAMPLES;
+            if(p >= pixelCount)
+            {
+                return;
+            }
+            uint x = pixels[p] % w;
+            uint y = pixels[p] / w;
+            double MaxIm = minY+(maxX-minX)*h/w;
+            double Re_factor = (maxX-minX)/(w-1);
+            double Im_factor = (MaxIm-minY)/(h-1);
+            float2 d = aaSampleOffset(x, y, s);
+            int iter;
+            int shortcut;
+            float frac;
+            int band = escapeTime(minX + (x + (double)d.x)*Re_factor, MaxIm - (y + (double)d.y)*Im_factor, maxIter,
+                                  useShortcuts, &iter, &shortcut, &frac);
+            samples[p * AA_SAMPLES + s] = packEscape(band, iter, frac);
+        }
+#endif // NO_FP64
+
+// Anti-aliasing step 4: colour each listed pixel as the mean of the palette colours of its own result and its samples.
+// Run after 'mandelColourize', which has written the other pixels; nothing to do for an ITER_TEXTURE target.
+__kernel void mandelAAColour(write_only image2d_t writeToImage,
+                             __global const int *pixelIter,
+                             __global const uint *pixels,
+                             uint pixelCount,
+                             __global const int *samples,
+                             int w,
+                             __global const float4 *palette,
+                             int paletteSize,
+                             float paletteDensity)
+        {
+#ifndef ITER_TEXTURE
+            uint p = get_global_id(0);
+            if(p >= pixelCount)
+            {
+                return;
+            }
+            uint i = pixels[p];
+            float4 sum = paletteColour(pixelIter[i], palette, paletteSize, paletteDensity);
+            for(int s = 0; s < AA_SAMPLES; s++)
+            {
+                sum += paletteColour(samples[p * AA_SAMPLES + s], palette, paletteSize, paletteDensity);
+            }
+            write_imagef(writeToImage, (int2)(i % w, i / w), sum / (AA_SAMPLES + 1));
+#endif
+        }
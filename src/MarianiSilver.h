@@ -0,0 +1,106 @@
+// Mariani-Silver rectangle subdivision, shared by the CPU engine and the multi-pass OpenCL dispatch
+// The Mandelbrot set is connected, so a rectangle whose whole border has the same escape result (the same band and
+// iteration count) can be filled without iterating its interior. The frame starts as
+// rectangles on a SUBDIV_GRID_SIZE pixel grid whose lines are iterated first. Each pass then looks at every queued
+// rectangle: a uniform border is copied over the interior, otherwise the middle row and column are iterated and the
+// four quarters go into the queue for the next pass. Rectangles share their borders with their neighbours and each
+// interior pixel belongs to exactly one rectangle, so a pass can process its rectangles in any order and in parallel.
+// Thin filaments that cross a rectangle without touching its border are missed, so this is an optional mode.
+#ifndef MARIANI_SILVER_H
+#define MARIANI_SILVER_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+// Keep in step with Mandel.cl
+static const unsigned int SUBDIV_GRID_SIZE = 64; // initial rectangles
+static const unsigned int SUBDIV_MIN_SIZE = 6;   // rectangles with an interior this narrow are iterated in full
+// Rectangles per pass. A split queues 4 rectangles at once, so keep this a multiple of 4.
+static const unsigned int SUBDIV_QUEUE_CAPACITY = 65536;
+
+// Rectangle with inclusive bounds, same layout as the int4 used by the 'mandelSubdivide' kernel
+struct SubdivRect
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+struct SubdivisionStats
+{
+    unsigned int filled = 0;    // pixels filled from a uniform border without iterating
+    unsigned int computed = 0;  // pixels iterated
+    unsigned int rects = 0;     // rectangles examined over all passes
+    unsigned int passes = 0;    // subdivision passes (not counting the grid lines)
+    unsigned int overflows = 0; // rectangles iterated in full because the next pass's queue was full
+
+    double fillFraction() const { return filled + computed > 0 ? (double)filled / (filled + computed) : 0.0; }
+};
+
+// Fixed capacity rectangle queue, filled concurrently during one pass and read back in the next.
+// push4() bumps the count by 4 even when the queue is full, exactly like the atomic_add in the kernel; since the
+// capacity is a multiple of 4, a failed push never leaves a hole below size().
+class BoundedRectQueue
+{
+public:
+    explicit BoundedRectQueue(unsigned int capacity) : rects(capacity) {}
+
+    bool push4(const SubdivRect *quads)
+    {
+        unsigned int base = count.fetch_add(4);
+        if (base >= rects.size())
+        {
+            return false;
+        }
+        std::copy(quads, quads + 4, &rects[base]);
+        return true;
+    }
+    // Used to seed the first pass from a single thread
+    void assign(const std::vector<SubdivRect> &seed)
+    {
+        size_t n = std::min(seed.size(), rects.size());
+        std::copy(seed.begin(), seed.begin() + n, rects.begin());
+        count = (unsigned int)n;
+    }
+    void clear() { count = 0; }
+    unsigned int size() const { return std::min(count.load(), (unsigned int)rects.size()); }
+    unsigned int capacity() const { return (unsigned int)rects.size(); }
+    const SubdivRect &operator[](unsigned int i) const { return rects[i]; }
+    const SubdivRect *data() const { return rects.data(); }
+
+private:
+    std::vector<SubdivRect> rects;
+    std::atomic<unsigned int> count{0};
+};
+
+// Grid line coordinates for a frame dimension: every SUBDIV_GRID_SIZE pixels plus the last pixel
+static std::vector<int> subdivGridLines(unsigned int size)
+{
+    std::vector<int> lines;
+    for (unsigned int v = 0; v < size - 1; v += SUBDIV_GRID_SIZE)
+    {
+        lines.push_back((int)v);
+    }
+    lines.push_back((int)size - 1);
+    return lines;
+}
+
+// The rectangles between the grid lines, which seed the first pass
+static std::vector<SubdivRect> subdivInitialRects(unsigned int width, unsigned int height)
+{
+    std::vector<int> xs = subdivGridLines(width);
+    std::vector<int> ys = subdivGridLines(height);
+    std::vector<SubdivRect> rects;
+    for (size_t j = 0; j + 1 < ys.size(); j++)
+    {
+        for (size_t i = 0; i + 1 < xs.size(); i++)
+        {
+            rects.push_back({xs[i], ys[j], xs[i + 1], ys[j + 1]});
+        }
+    }
+    return rects;
+}
+
+#endif // MARIANI_SILVER_H
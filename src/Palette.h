@@ -0,0 +1,223 @@
+// Palette lookup tables for the colouring pass
+// Both engines keep a packed escape result per pixel (band, iteration count and smooth fraction, see packEscape()),
+// and colouring is a separate pass that maps each result through a table of RGBA entries. Changing the palette
+// therefore only reruns that pass over the iteration field instead of iterating the fractal again. The table is used
+// in one of two ways:
+//  - density 0: entry 'iter' is the colour of an escape at that iteration. The 'bands' palette fills the table with
+//    the original six colour bands, so it gives exactly the images the kernel used to colour in its escape loop.
+//  - density > 0: the smooth iteration count (iter + fraction) times the density indexes a cyclic gradient,
+//    interpolating between neighbouring entries.
+// The 'equalized' palette is rebuilt for every frame from its iteration histogram (see equalizePalette()), so the
+// colours follow where the frame's escapes actually are instead of fixed iteration counts.
+// Pixels that never escaped (band 0) are always black. The same lookup is done by 'paletteColour' in Mandel.cl.
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "Histogram.h"
+
+struct Palette
+{
+    const char *name = "";
+    std::vector<float> rgba;     // entries, 4 floats each (the layout of a float4 buffer)
+    std::vector<uint32_t> rgba8; // the same entries as packed RGBA8 texels (see packRgba8())
+    float density = 0.0f;        // entries per iteration for a cyclic gradient, 0 = one entry per iteration count
+    unsigned int serial = 0;     // different for every palette built, so copies can tell when they are stale
+    bool bEqualized = false;     // rebuilt from each frame's histogram by sweeping once through 'stops'
+    const unsigned char (*stops)[3] = NULL;
+    unsigned int stopCount = 0;
+
+    unsigned int size() const { return (unsigned int)(rgba.size() / 4); }
+};
+
+// RGBA colour (0..1) as one 32-bit texel holding bytes R, G, B, A in memory order
+static inline uint32_t packRgba8(const float *c)
+{
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++)
+    {
+        float v = c[i] < 0.0f ? 0.0f : (c[i] > 1.0f ? 1.0f : c[i]);
+        bytes[i] = (unsigned char)(v * 255.0f + 0.5f);
+    }
+    uint32_t texel;
+    memcpy(&texel, bytes, 4);
+    return texel;
+}
+
+static const unsigned int PALETTE_GRADIENT_ENTRIES = 1024;
+static const char *const PALETTE_NAMES[] = {"bands", "smooth", "fire", "grey", "equalized"};
+static const unsigned int PALETTE_COUNT = sizeof(PALETTE_NAMES) / sizeof(PALETTE_NAMES[0]);
+
+// Current palette: the CPU engine colours with it and main.cpp uploads it for the kernels
+static Palette g_mandelPalette;
+static unsigned int g_paletteSerial = 0;
+
+// Fill in the packed copy of the entries and give the palette a new serial
+static void finishPalette(Palette &palette)
+{
+    palette.rgba8.resize(palette.size());
+    for (unsigned int i = 0; i < palette.size(); i++)
+    {
+        palette.rgba8[i] = packRgba8(&palette.rgba[(size_t)i * 4]);
+    }
+    palette.serial = ++g_paletteSerial;
+}
+
+// Histogram equalisation: entry n is the colour of the gradient at the fraction of the frame's escapes that came before
+// iteration n, so each part of the gradient covers about the same number of pixels at any depth. There is an entry per
+// iteration up to maxIter and density 1, so the smooth fraction interpolates between entries n and n + 1.
+static void equalizePalette(const IterHistogram &histogram, float maxIter, Palette &palette)
+{
+    const unsigned int entries = (unsigned int)maxIter + 1;
+    const unsigned int last = palette.stopCount - 1;
+    palette.density = 1.0f;
+    palette.rgba.resize((size_t)entries * 4);
+    for (unsigned int n = 0; n < entries; n++)
+    {
+        float u = (float)histogram.cdf(n) * last;
+        unsigned int s0 = std::min((unsigned int)u, last - 1);
+        float f = u - s0;
+        for (int c = 0; c < 3; c++)
+        {
+            palette.rgba[(size_t)n * 4 + c] =
+                (palette.stops[s0][c] + (palette.stops[s0 + 1][c] - palette.stops[s0][c]) * f) / 255.0f;
+        }
+        palette.rgba[(size_t)n * 4 + 3] = 1.0f;
+    }
+    finishPalette(palette);
+}
+
+// The original band colours, one entry per iteration count below maxIter
+static void makeBandPalette(float maxIter, Palette &palette)
+{
+    palette.density = 0.0f;
+    palette.rgba.assign((size_t)maxIter * 4, 0.0f);
+    for (int n = 0; n < (int)maxIter; n++)
+    {
+        mandelBandColour(mandelColourBand(n, maxIter), n, maxIter, &palette.rgba[(size_t)n * 4]);
+    }
+}
+
+// Cyclic gradient through evenly spaced RGB stops (0..255), one cycle every PALETTE_GRADIENT_ENTRIES / density
+// iterations
+static void makeGradientPalette(const unsigned char (*stops)[3], unsigned int stopCount, float density, Palette &palette)
+{
+    palette.density = density;
+    palette.rgba.assign((size_t)PALETTE_GRADIENT_ENTRIES * 4, 1.0f);
+    for (unsigned int i = 0; i < PALETTE_GRADIENT_ENTRIES; i++)
+    {
+        float t = (float)i * stopCount / PALETTE_GRADIENT_ENTRIES;
+        unsigned int s0 = (unsigned int)t;
+        unsigned int s1 = (s0 + 1) % stopCount;
+        float f = t - s0;
+        for (int c = 0; c < 3; c++)
+        {
+            palette.rgba[i * 4 + c] = (stops[s0][c] + (stops[s1][c] - stops[s0][c]) * f) / 255.0f;
+        }
+    }
+}
+
+// Build the palette called 'name' (one of PALETTE_NAMES), which must outlive it. Returns false for an unknown name.
+static bool makePalette(const char *name, float maxIter, Palette &palette)
+{
+    static const unsigned char smooth[][3] = {{0, 7, 100}, {32, 107, 203}, {237, 255, 255}, {255, 170, 0}, {0, 2, 0}};
+    static const unsigned char fire[][3] = {{0, 0, 0},       {128, 0, 0},   {255, 64, 0}, {255, 192, 0},
+                                            {255, 255, 224}, {255, 128, 0}, {96, 0, 0}};
+    static const unsigned char grey[][3] = {{0, 0, 0}, {255, 255, 255}};
+    static const unsigned char equalized[][3] = {{0, 7, 100}, {32, 107, 203}, {237, 255, 255}, {255, 170, 0}, {96, 0, 0}};
+
+    palette.bEqualized = false;
+
+    if (strcmp(name, "bands") == 0)
+    {
+        makeBandPalette(maxIter, palette);
+    }
+    else if (strcmp(name, "smooth") == 0)
+    {
+        makeGradientPalette(smooth, 5, 16.0f, palette);
+    }
+    else if (strcmp(name, "fire") == 0)
+    {
+        makeGradientPalette(fire, 7, 8.0f, palette);
+    }
+    else if (strcmp(name, "grey") == 0)
+    {
+        makeGradientPalette(grey, 2, 32.0f, palette);
+    }
+    else if (strcmp(name, "equalized") == 0)
+    {
+        // Spread linearly over the iterations until there is a frame to equalise
+        IterHistogram flat;
+        flat.clear(maxIter);
+        palette.bEqualized = true;
+        palette.stops = equalized;
+        palette.stopCount = 5;
+        palette.name = name;
+        equalizePalette(flat, maxIter, palette);
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+    palette.name = name;
+    finishPalette(palette);
+    return true;
+}
+
+// Colour of a packed escape result
+static inline void paletteColour(const Palette &palette, int packed, float *out)
+{
+    const unsigned int size = palette.size();
+    const int iter = packedIter(packed);
+    if (packedBand(packed) == 0 || size == 0)
+    {
+        out[0] = 0.0f;
+        out[1] = 0.0f;
+        out[2] = 0.0f;
+        out[3] = 1.0f;
+        return;
+    }
+    if (palette.density <= 0.0f)
+    {
+        memcpy(out, &palette.rgba[(size_t)((unsigned int)iter < size ? iter : size - 1) * 4], 4 * sizeof(float));
+        return;
+    }
+    float t = ((float)iter + packedFrac(packed)) * palette.density;
+    float ft = floorf(t);
+    float f = t - ft;
+    unsigned int i0 = (unsigned int)ft % size;
+    unsigned int i1 = (i0 + 1) % size;
+    const float *c0 = &palette.rgba[(size_t)i0 * 4];
+    const float *c1 = &palette.rgba[(size_t)i1 * 4];
+    for (int c = 0; c < 4; c++)
+    {
+        out[c] = c0[c] + (c1[c] - c0[c]) * f;
+    }
+}
+
+// Colour of a packed escape result as a packed RGBA8 texel. One table load per pixel for one entry per iteration.
+static const float PALETTE_BLACK[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+static const uint32_t PALETTE_BLACK_RGBA8 = packRgba8(PALETTE_BLACK);
+
+static inline uint32_t paletteColourRgba8(const Palette &palette, int packed)
+{
+    const unsigned int size = palette.size();
+    if (packedBand(packed) == 0 || size == 0)
+    {
+        return PALETTE_BLACK_RGBA8;
+    }
+    if (palette.density <= 0.0f)
+    {
+        const unsigned int iter = (unsigned int)packedIter(packed);
+        return palette.rgba8[iter < size ? iter : size - 1];
+    }
+    float colour[4];
+    paletteColour(palette, packed, colour);
+    return packRgba8(colour);
+}
+
+#endif // PALETTE_H
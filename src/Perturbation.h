@@ -0,0 +1,484 @@
+// Perturbation rendering for deep zooms
+// Past a zoom of roughly 2^40 the pixel spacing falls below what a double can resolve next to the view's coordinates,
+// and the plain 'mandel' kernel turns into blocks. Instead, one reference orbit Z_n is computed on the host in
+// arbitrary precision (BigFixed) at the centre of the view and stored as doubles. Every pixel then only iterates its
+// small difference from the reference, which doubles hold comfortably:
+//     dz_{n+1} = (2 Z_n + dz_n) dz_n + dc
+// When the pixel's orbit gets closer to zero than its delta, or the reference orbit runs out (it escaped), the delta is
+// rebased onto the start of the reference orbit (dz = Z_m + dz, m = 0). This removes the glitches that plain
+// perturbation shows where the pixel and reference orbits diverge. The rebases are counted as glitches avoided.
+// A cubic series approximation in dc lets every pixel skip the first iterations, where all orbits in the view still
+// follow the reference closely. The skip ends before the cubic term grows beyond a small fraction of the quadratic one
+// at the edge of the view, or the series strays from a grid of probe points across it, and then backs off a margin.
+// Orbits here start at Z_0 = 0 (the 'mandel' kernel starts at z = c, i.e. one iteration later).
+// Deltas are plain doubles, so zooms are limited to about 1e290 before they underflow.
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Signed fixed point number with 32 integer bits and a variable number of 32-bit fractional limbs
+class BigFixed
+{
+public:
+    BigFixed() : bNegative(false), limbs(2, 0) {}
+    explicit BigFixed(double v, unsigned int fracLimbs = 1) { setDouble(v, fracLimbs); }
+
+    unsigned int fracLimbs() const { return (unsigned int)limbs.size() - 1; }
+
+    // Change the number of fractional limbs, truncating or padding with zeros
+    void setPrecision(unsigned int fracLimbs)
+    {
+        unsigned int current = this->fracLimbs();
+        if (fracLimbs > current)
+        {
+            limbs.insert(limbs.begin(), fracLimbs - current, 0);
+        }
+        else if (fracLimbs < current)
+        {
+            limbs.erase(limbs.begin(), limbs.begin() + (current - fracLimbs));
+        }
+    }
+
+    // Exact conversion (every double fits once there are enough fractional limbs)
+    void setDouble(double v, unsigned int fracLimbs)
+    {
+        limbs.assign(fracLimbs + 1, 0);
+        bNegative = v < 0;
+        double x = fabs(v);
+        double whole = floor(x);
+        limbs[fracLimbs] = (uint32_t)whole;
+        x -= whole;
+        for (unsigned int i = fracLimbs; i-- > 0 && x > 0.0;)
+        {
+            x *= 4294967296.0;
+            double limb = floor(x);
+            limbs[i] = (uint32_t)limb;
+            x -= limb;
+        }
+    }
+
+    double toDouble() const
+    {
+        double v = 0.0;
+        double scale = 1.0;
+        for (size_t i = limbs.size(); i-- > 0 && scale > 1e-300;)
+        {
+            v += limbs[i] * scale;
+            scale /= 4294967296.0;
+        }
+        return bNegative ? -v : v;
+    }
+
+    // Parse a decimal string such as "-0.743643887037158704752191506114774"
+    static bool fromString(const char *str, unsigned int fracLimbs, BigFixed &out)
+    {
+        out = BigFixed();
+        out.limbs.assign(fracLimbs + 1, 0);
+        const char *p = str;
+        bool bNeg = false;
+        if (*p == '-' || *p == '+')
+        {
+            bNeg = *p == '-';
+            p++;
+        }
+        uint64_t whole = 0;
+        const char *digits = p;
+        while (*p >= '0' && *p <= '9')
+        {
+            whole = whole * 10 + (uint64_t)(*p++ - '0');
+        }
+        std::string frac;
+        if (*p == '.')
+        {
+            p++;
+            while (*p >= '0' && *p <= '9')
+            {
+                frac += *p++;
+            }
+        }
+        if (*p != '\0' || (p == digits) || whole > 0xFFFFFFFFull)
+        {
+            return false;
+        }
+        // Horner's scheme from the last digit: f = (f + d) / 10
+        for (size_t i = frac.size(); i-- > 0;)
+        {
+            out.limbs[fracLimbs] = (uint32_t)(frac[i] - '0');
+            out.divSmallMag(10);
+        }
+        out.limbs[fracLimbs] = (uint32_t)whole;
+        out.bNegative = bNeg && !out.isZero();
+        return true;
+    }
+
+    // Decimal string with the given number of fractional digits
+    std::string toString(unsigned int fracDigits) const
+    {
+        std::string s = bNegative ? "-" : "";
+        s += std::to_string(limbs.back());
+        s += '.';
+        BigFixed f = *this;
+        f.bNegative = false;
+        for (unsigned int d = 0; d < fracDigits; d++)
+        {
+            f.limbs.back() = 0;
+            f.mulSmallMag(10);
+            s += (char)('0' + f.limbs.back());
+        }
+        return s;
+    }
+
+    BigFixed operator+(const BigFixed &o) const { return addSigned(o, o.bNegative); }
+    BigFixed operator-(const BigFixed &o) const { return addSigned(o, !o.bNegative); }
+
+    BigFixed operator*(const BigFixed &o) const
+    {
+        // Schoolbook product of the magnitudes, keeping the limbs at our own scale. Both operands must have the same
+        // precision.
+        const size_t n = limbs.size();
+        const size_t frac = n - 1;
+        std::vector<uint32_t> product(2 * n, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t carry = 0;
+            uint64_t a = limbs[i];
+            if (a == 0)
+            {
+                continue;
+            }
+            for (size_t j = 0; j < n; j++)
+            {
+                uint64_t t = product[i + j] + a * o.limbs[j] + carry;
+                product[i + j] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            product[i + n] = (uint32_t)carry;
+        }
+        BigFixed r;
+        r.limbs.assign(product.begin() + frac, product.begin() + frac + n);
+        r.bNegative = (bNegative != o.bNegative) && !r.isZero();
+        return r;
+    }
+
+    BigFixed square() const { return *this * *this; }
+
+    // Multiply by 2 (exact)
+    BigFixed twice() const
+    {
+        BigFixed r = *this;
+        uint32_t carry = 0;
+        for (size_t i = 0; i < r.limbs.size(); i++)
+        {
+            uint32_t next = r.limbs[i] >> 31;
+            r.limbs[i] = (r.limbs[i] << 1) | carry;
+            carry = next;
+        }
+        return r;
+    }
+
+    bool isZero() const
+    {
+        for (uint32_t l : limbs)
+        {
+            if (l != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static int compareMag(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+    {
+        for (size_t i = a.size(); i-- > 0;)
+        {
+            if (a[i] != b[i])
+            {
+                return a[i] < b[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    BigFixed addSigned(const BigFixed &o, bool bOtherNegative) const
+    {
+        BigFixed r;
+        r.limbs.assign(limbs.size(), 0);
+        if (bNegative == bOtherNegative)
+        {
+            uint64_t carry = 0;
+            for (size_t i = 0; i < limbs.size(); i++)
+            {
+                uint64_t t = (uint64_t)limbs[i] + o.limbs[i] + carry;
+                r.limbs[i] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            r.bNegative = bNegative;
+        }
+        else
+        {
+            // Subtract the smaller magnitude from the larger one
+            bool bThisLarger = compareMag(limbs, o.limbs) >= 0;
+            const std::vector<uint32_t> &big = bThisLarger ? limbs : o.limbs;
+            const std::vector<uint32_t> &small = bThisLarger ? o.limbs : limbs;
+            int64_t borrow = 0;
+            for (size_t i = 0; i < limbs.size(); i++)
+            {
+                int64_t t = (int64_t)big[i] - small[i] - borrow;
+                borrow = t < 0 ? 1 : 0;
+                r.limbs[i] = (uint32_t)(t + (borrow << 32));
+            }
+            r.bNegative = bThisLarger ? bNegative : bOtherNegative;
+        }
+        if (r.isZero())
+        {
+            r.bNegative = false;
+        }
+        return r;
+    }
+
+    void divSmallMag(uint32_t d)
+    {
+        uint64_t rem = 0;
+        for (size_t i = limbs.size(); i-- > 0;)
+        {
+            uint64_t cur = (rem << 32) | limbs[i];
+            limbs[i] = (uint32_t)(cur / d);
+            rem = cur % d;
+        }
+    }
+
+    void mulSmallMag(uint32_t m)
+    {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < limbs.size(); i++)
+        {
+            uint64_t t = (uint64_t)limbs[i] * m + carry;
+            limbs[i] = (uint32_t)t;
+            carry = t >> 32;
+        }
+    }
+
+    bool bNegative;
+    std::vector<uint32_t> limbs; // little endian; limbs.back() is the integer part
+};
+
+// Fractional limbs needed to resolve 'pixelSpacing' with 64 guard bits to spare
+static unsigned int bigFixedLimbsFor(double pixelSpacing)
+{
+    double bits = pixelSpacing > 0.0 ? -log2(pixelSpacing) : 0.0;
+    if (bits < 0.0)
+    {
+        bits = 0.0;
+    }
+    return (unsigned int)(bits / 32.0) + 3;
+}
+
+// Everything a pixel needs to iterate its delta from the reference orbit. 'orbit' holds Z_0..Z_{refLength-1} as
+// interleaved re, im doubles, in the layout the 'mandelPerturb' kernel reads as a double2 buffer.
+struct PerturbFrame
+{
+    std::vector<double> orbit;
+    int refLength = 0;
+    // Pixel coordinates of the reference point and the size of one pixel (dc = (x - refX) * Re_factor, ...)
+    double refX = 0.0;
+    double refY = 0.0;
+    double Re_factor = 0.0;
+    double Im_factor = 0.0;
+    // Series approximation: dz_skip ~= A dc + B dc^2 + C dc^3, as (re, im) pairs
+    int skipIter = 0;
+    double saA[2] = {0.0, 0.0};
+    double saB[2] = {0.0, 0.0};
+    double saC[2] = {0.0, 0.0};
+};
+
+// Largest absolute error accepted between the series approximation and a probe point, relative to the probe's delta.
+// An error left at the skip grows with the delta on every later iteration, so it has to start out tiny.
+static const double SERIES_PROBE_TOLERANCE = 1e-9;
+// Largest accepted size of the cubic term against the quadratic one at the edge of the view. The terms the series
+// drops are smaller still, so this bounds the truncation error everywhere in the view, between the probes too.
+static const double SERIES_TRUNCATION_RATIO = 1e-6;
+// Probes on a SERIES_PROBE_GRID x SERIES_PROBE_GRID grid spanning the view: corners, edges and interior
+static const int SERIES_PROBE_GRID = 5;
+// Iterations the skip backs off from the last one that passed, as a fraction of it (at least SERIES_SKIP_MARGIN_MIN)
+static const int SERIES_SKIP_MARGIN_DIVISOR = 8;
+static const int SERIES_SKIP_MARGIN_MIN = 4;
+
+// Compute the reference orbit at (refRe, refIm) and the series approximation skip for a w x h view of the given pixel
+// size, with the reference at the centre pixel.
+static void computePerturbFrame(const BigFixed &refRe, const BigFixed &refIm, unsigned int w, unsigned int h,
+                                double Re_factor, double Im_factor, float maxIter, PerturbFrame &pf)
+{
+    pf.refX = (double)(w / 2);
+    pf.refY = (double)(h / 2);
+    pf.Re_factor = Re_factor;
+    pf.Im_factor = Im_factor;
+
+    // Reference orbit, stopping once it escapes (pixels rebase onto its start when they run past the end)
+    pf.orbit.clear();
+    pf.orbit.reserve(((size_t)maxIter + 2) * 2);
+    BigFixed zRe(0.0, refRe.fracLimbs());
+    BigFixed zIm(0.0, refRe.fracLimbs());
+    for (int n = 0; n <= maxIter; n++)
+    {
+        double re = zRe.toDouble();
+        double im = zIm.toDouble();
+        pf.orbit.push_back(re);
+        pf.orbit.push_back(im);
+        if (re * re + im * im > 4.0)
+        {
+            break;
+        }
+        BigFixed zRe2 = zRe.square();
+        BigFixed zIm2 = zIm.square();
+        zIm = (zRe * zIm).twice() + refIm;
+        zRe = zRe2 - zIm2 + refRe;
+    }
+    pf.refLength = (int)(pf.orbit.size() / 2);
+
+    // Series coefficients A_n, B_n, C_n, advanced together with the exact deltas of probes spread over the view
+    std::vector<double> probes;
+    for (int gy = 0; gy < SERIES_PROBE_GRID; gy++)
+    {
+        for (int gx = 0; gx < SERIES_PROBE_GRID; gx++)
+        {
+            double px = (double)(w - 1) * gx / (SERIES_PROBE_GRID - 1);
+            double py = (double)(h - 1) * gy / (SERIES_PROBE_GRID - 1);
+            if (px != pf.refX || py != pf.refY)
+            {
+                probes.push_back((px - pf.refX) * Re_factor);
+                probes.push_back(-(py - pf.refY) * Im_factor);
+            }
+        }
+    }
+    const size_t probeCount = probes.size() / 2;
+    std::vector<double> probeDz(probes.size(), 0.0);
+    // Largest |dc| of the view, at its farthest corner
+    const double radius = hypot(std::max(pf.refX, w - 1 - pf.refX) * Re_factor,
+                                std::max(pf.refY, h - 1 - pf.refY) * Im_factor);
+    // A, B and C after every accepted iteration (6 doubles each, from n = 0), so the skip can back off
+    std::vector<double> history(6, 0.0);
+    double A[2] = {0.0, 0.0}, B[2] = {0.0, 0.0}, C[2] = {0.0, 0.0};
+    int accepted = 0;
+
+    for (int n = 0; n + 1 < pf.refLength - 1; n++)
+    {
+        double Zr = pf.orbit[2 * n], Zi = pf.orbit[2 * n + 1];
+        double twoZr = 2.0 * Zr, twoZi = 2.0 * Zi;
+        // C' = 2 Z C + 2 A B, B' = 2 Z B + A^2, A' = 2 Z A + 1
+        double nC[2] = {twoZr * C[0] - twoZi * C[1] + 2.0 * (A[0] * B[0] - A[1] * B[1]),
+                        twoZr * C[1] + twoZi * C[0] + 2.0 * (A[0] * B[1] + A[1] * B[0])};
+        double nB[2] = {twoZr * B[0] - twoZi * B[1] + A[0] * A[0] - A[1] * A[1],
+                        twoZr * B[1] + twoZi * B[0] + 2.0 * A[0] * A[1]};
+        double nA[2] = {twoZr * A[0] - twoZi * A[1] + 1.0, twoZr * A[1] + twoZi * A[0]};
+
+        // |C dc^3| << |B dc^2| at the largest |dc|
+        bool bValid = hypot(nC[0], nC[1]) * radius <= SERIES_TRUNCATION_RATIO * hypot(nB[0], nB[1]);
+        for (size_t p = 0; p < probeCount && bValid; p++)
+        {
+            double *dz = &probeDz[2 * p];
+            const double *dc = &probes[2 * p];
+            double tr = twoZr + dz[0], ti = twoZi + dz[1];
+            double nr = tr * dz[0] - ti * dz[1] + dc[0];
+            double ni = tr * dz[1] + ti * dz[0] + dc[1];
+            dz[0] = nr;
+            dz[1] = ni;
+            // Series value at this probe
+            double dc2[2] = {dc[0] * dc[0] - dc[1] * dc[1], 2.0 * dc[0] * dc[1]};
+            double dc3[2] = {dc2[0] * dc[0] - dc2[1] * dc[1], dc2[0] * dc[1] + dc2[1] * dc[0]};
+            double sr = nA[0] * dc[0] - nA[1] * dc[1] + nB[0] * dc2[0] - nB[1] * dc2[1] + nC[0] * dc3[0] - nC[1] * dc3[1];
+            double si = nA[0] * dc[1] + nA[1] * dc[0] + nB[0] * dc2[1] + nB[1] * dc2[0] + nC[0] * dc3[1] + nC[1] * dc3[0];
+            double err = hypot(sr - nr, si - ni);
+            double mag = hypot(nr, ni);
+            // The probe itself must still be close to the reference (no rebasing needed yet)
+            double zr = pf.orbit[2 * (n + 1)] + nr, zi = pf.orbit[2 * (n + 1) + 1] + ni;
+            if (!(err <= SERIES_PROBE_TOLERANCE * mag) || zr * zr + zi * zi < nr * nr + ni * ni ||
+                zr * zr + zi * zi > 4.0)
+            {
+                bValid = false;
+            }
+        }
+        if (!bValid)
+        {
+            break;
+        }
+        A[0] = nA[0];
+        A[1] = nA[1];
+        B[0] = nB[0];
+        B[1] = nB[1];
+        C[0] = nC[0];
+        C[1] = nC[1];
+        history.insert(history.end(), {A[0], A[1], B[0], B[1], C[0], C[1]});
+        accepted = n + 1;
+    }
+
+    // Stop short of the last iteration that passed, as the probes only sample the view
+    pf.skipIter = std::max(0, accepted - std::max(SERIES_SKIP_MARGIN_MIN, accepted / SERIES_SKIP_MARGIN_DIVISOR));
+    const double *coeffs = &history[6 * (size_t)pf.skipIter];
+    pf.saA[0] = coeffs[0];
+    pf.saA[1] = coeffs[1];
+    pf.saB[0] = coeffs[2];
+    pf.saB[1] = coeffs[3];
+    pf.saC[0] = coeffs[4];
+    pf.saC[1] = coeffs[5];
+}
+
+// Iterate one pixel's delta from the reference. Returns the colour band (0 = inside) and, in 'iter' and 'frac', the
+// iteration count on the same scale as the 'mandel' kernel and its smooth fraction. 'rebases' counts the
+// glitch-avoiding rebases.
+static inline int perturbEscapeCpu(const PerturbFrame &pf, double dcRe, double dcIm, float maxIter, int &iter,
+                                   float &frac, unsigned int &rebases)
+{
+    const double *Z = pf.orbit.data();
+    const int last = pf.refLength - 1;
+    // Start from the series approximation
+    double dc2r = dcRe * dcRe - dcIm * dcIm, dc2i = 2.0 * dcRe * dcIm;
+    double dc3r = dc2r * dcRe - dc2i * dcIm, dc3i = dc2r * dcIm + dc2i * dcRe;
+    double dzr = pf.saA[0] * dcRe - pf.saA[1] * dcIm + pf.saB[0] * dc2r - pf.saB[1] * dc2i + pf.saC[0] * dc3r -
+                 pf.saC[1] * dc3i;
+    double dzi = pf.saA[0] * dcIm + pf.saA[1] * dcRe + pf.saB[0] * dc2i + pf.saB[1] * dc2r + pf.saC[0] * dc3i +
+                 pf.saC[1] * dc3r;
+    int m = pf.skipIter;
+
+    // Check n of the 'mandel' kernel tests z_{n+1} of an orbit starting at zero
+    for (int n = pf.skipIter; n < maxIter; n++)
+    {
+        double tr = 2.0 * Z[2 * m] + dzr, ti = 2.0 * Z[2 * m + 1] + dzi;
+        double nr = tr * dzr - ti * dzi + dcRe;
+        double ni = tr * dzi + ti * dzr + dcIm;
+        dzr = nr;
+        dzi = ni;
+        m++;
+        double zr = Z[2 * m] + dzr, zi = Z[2 * m + 1] + dzi;
+        double mag2 = zr * zr + zi * zi;
+        if (mag2 > 4)
+        {
+            int band = mandelColourBand(n, maxIter);
+            if (band != 0)
+            {
+                iter = n;
+                frac = mandelSmoothFraction(mag2);
+                return band;
+            }
+        }
+        if (mag2 < dzr * dzr + dzi * dzi || m == last)
+        {
+            dzr = zr;
+            dzi = zi;
+            m = 0;
+            rebases++;
+        }
+    }
+    iter = (int)maxIter;
+    frac = 0.0f;
+    return 0;
+}
+
+#endif // PERTURBATION_H
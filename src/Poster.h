@@ -0,0 +1,312 @@
+// Out-of-core poster rendering (--poster width height)
+// Print-size images (32k x 32k is 4 GB of RGBA8) do not fit the 1024x1024 frame or, at larger sizes, memory. A poster
+// is rendered by the CPU engine in strips of whole rows, top to bottom, and each finished strip is handed to a writer
+// thread that encodes it and appends it to the output file while the next strip renders. At most POSTER_QUEUE_STRIPS
+// strips wait for the writer, so memory use is a few strips however large the poster is.
+// The output format follows the file extension:
+//  - .png: 8-bit RGB, deflated with zlib as the rows arrive and written in IDAT chunks of POSTER_PNG_CHUNK bytes
+//  - .ppm: binary PPM (P6), like --headless
+//  - .raw: the RGB bytes only, top row first
+// Strips arrive in frame layout (row 0 is the bottom row, see CpuFrame), so the writer emits their rows last to first.
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "RenderPipeline.h"
+
+static const unsigned int POSTER_STRIP_ROWS = 128;
+static const unsigned int POSTER_QUEUE_STRIPS = 2;
+static const size_t POSTER_PNG_CHUNK = 1 << 20;
+// The writer is one thread and has to keep up with every core rendering, so it deflates at the fastest level
+static const int POSTER_PNG_LEVEL = Z_BEST_SPEED;
+
+enum PosterFormat
+{
+    POSTER_PNG,
+    POSTER_PPM,
+    POSTER_RAW,
+};
+
+// Format for the extension of 'path'. Returns false for an unknown one.
+static bool posterFormatFor(const char *path, PosterFormat &format)
+{
+    const char *dot = strrchr(path, '.');
+    if (!dot)
+    {
+        return false;
+    }
+    if (strcmp(dot, ".png") == 0)
+    {
+        format = POSTER_PNG;
+    }
+    else if (strcmp(dot, ".ppm") == 0)
+    {
+        format = POSTER_PPM;
+    }
+    else if (strcmp(dot, ".raw") == 0)
+    {
+        format = POSTER_RAW;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Streams rows of RGB bytes, top row first, into a file of one of the poster formats
+class PosterEncoder
+{
+public:
+    ~PosterEncoder() { close(); }
+
+    bool open(const char *path, PosterFormat posterFormat, unsigned int w, unsigned int h)
+    {
+        FILE *out = fopen(path, "wb");
+        return out && open(out, posterFormat, w, h);
+    }
+
+    // As above, into a stream that is already open (a file or a memory stream), which close() closes
+    bool open(FILE *out, PosterFormat posterFormat, unsigned int w, unsigned int h)
+    {
+        fp = out;
+        format = posterFormat;
+        width = w;
+        bOk = true;
+        if (format == POSTER_PPM)
+        {
+            bOk = fprintf(fp, "P6\n%u %u\n255\n", w, h) > 0;
+        }
+        else if (format == POSTER_PNG)
+        {
+            static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            unsigned char ihdr[13];
+            putBigEndian(ihdr, w);
+            putBigEndian(ihdr + 4, h);
+            ihdr[8] = 8;  // bits per channel
+            ihdr[9] = 2;  // RGB
+            ihdr[10] = 0; // deflate
+            ihdr[11] = 0; // adaptive filtering, one filter type byte per row
+            ihdr[12] = 0; // not interlaced
+            bOk = fwrite(signature, sizeof(signature), 1, fp) == 1 && writeChunk("IHDR", ihdr, sizeof(ihdr));
+            memset(&zs, 0, sizeof(zs));
+            bOk = bOk && deflateInit(&zs, POSTER_PNG_LEVEL) == Z_OK;
+            bDeflating = bOk;
+            filtered.assign((size_t)w * 3 + 1, 0);
+            previous.assign((size_t)w * 3, 0);
+            compressed.resize(POSTER_PNG_CHUNK);
+            zs.next_out = compressed.data();
+            zs.avail_out = (uInt)compressed.size();
+        }
+        return bOk;
+    }
+
+    // One row of width RGB triples
+    void writeRow(const unsigned char *rgb)
+    {
+        if (!bOk)
+        {
+            return;
+        }
+        if (format != POSTER_PNG)
+        {
+            bOk = fwrite(rgb, 1, (size_t)width * 3, fp) == (size_t)width * 3;
+            return;
+        }
+        // 'Up' filter: neighbouring rows of a high resolution render are nearly the same, so their differences deflate well
+        filtered[0] = 2;
+        for (size_t i = 0; i < (size_t)width * 3; i++)
+        {
+            filtered[i + 1] = (unsigned char)(rgb[i] - previous[i]);
+        }
+        memcpy(previous.data(), rgb, (size_t)width * 3);
+        zs.next_in = filtered.data();
+        zs.avail_in = (uInt)filtered.size();
+        while (bOk && zs.avail_in > 0)
+        {
+            bOk = deflate(&zs, Z_NO_FLUSH) == Z_OK && (zs.avail_out > 0 || flushIdat());
+        }
+    }
+
+    // Finish the file. Returns false if anything failed to encode or write.
+    bool close()
+    {
+        if (!fp)
+        {
+            return bOk;
+        }
+        if (format == POSTER_PNG && bDeflating)
+        {
+            int result = Z_OK;
+            while (bOk && result != Z_STREAM_END)
+            {
+                result = deflate(&zs, Z_FINISH);
+                bOk = (result == Z_OK || result == Z_STREAM_END) && flushIdat();
+            }
+            deflateEnd(&zs);
+            bDeflating = false;
+            bOk = bOk && writeChunk("IEND", NULL, 0);
+        }
+        bOk = fclose(fp) == 0 && bOk;
+        fp = NULL;
+        return bOk;
+    }
+
+private:
+    static void putBigEndian(unsigned char *out, uint32_t v)
+    {
+        out[0] = (unsigned char)(v >> 24);
+        out[1] = (unsigned char)(v >> 16);
+        out[2] = (unsigned char)(v >> 8);
+        out[3] = (unsigned char)v;
+    }
+    bool writeChunk(const char *type, const unsigned char *data, size_t size)
+    {
+        unsigned char length[4];
+        unsigned char crc[4];
+        putBigEndian(length, (uint32_t)size);
+        uLong c = crc32(0L, (const Bytef *)type, 4);
+        if (size > 0)
+        {
+            c = crc32(c, data, (uInt)size);
+        }
+        putBigEndian(crc, (uint32_t)c);
+        return fwrite(length, 4, 1, fp) == 1 && fwrite(type, 4, 1, fp) == 1 &&
+               (size == 0 || fwrite(data, size, 1, fp) == 1) && fwrite(crc, 4, 1, fp) == 1;
+    }
+    // Write the deflated bytes so far as an IDAT chunk and start a new one
+    bool flushIdat()
+    {
+        size_t size = compressed.size() - zs.avail_out;
+        bool bWritten = size == 0 || writeChunk("IDAT", compressed.data(), size);
+        zs.next_out = compressed.data();
+        zs.avail_out = (uInt)compressed.size();
+        return bWritten;
+    }
+
+    FILE *fp = NULL;
+    PosterFormat format = POSTER_PPM;
+    unsigned int width = 0;
+    bool bOk = false;
+    z_stream zs;
+    bool bDeflating = false;
+    std::vector<unsigned char> filtered; // filter type byte and the filtered row
+    std::vector<unsigned char> previous; // unfiltered previous row
+    std::vector<unsigned char> compressed;
+};
+
+// Writer thread: takes finished strips of RGBA8 texels and encodes them in order while the caller renders the next
+class PosterWriter
+{
+public:
+    double encodeMs = 0.0; // writer thread busy encoding and writing
+    double waitMs = 0.0;   // caller blocked because POSTER_QUEUE_STRIPS strips were already waiting
+
+    bool open(const char *path, PosterFormat format, unsigned int w, unsigned int h)
+    {
+        width = w;
+        if (!encoder.open(path, format, w, h))
+        {
+            return false;
+        }
+        thread = std::thread(&PosterWriter::run, this);
+        return true;
+    }
+
+    // Queue a strip of 'rows' rows in frame layout. 'texels' is swapped for a buffer the writer has finished with (or
+    // an empty one), so strips are never copied and only a few buffers ever exist.
+    void push(std::vector<uint32_t> &texels, unsigned int rows)
+    {
+        double startMs = pipelineNowMs();
+        std::unique_lock<std::mutex> lock(mutex);
+        cvSpace.wait(lock, [this] { return queue.size() < POSTER_QUEUE_STRIPS; });
+        waitMs += pipelineNowMs() - startMs;
+        queue.emplace_back();
+        queue.back().texels.swap(texels);
+        queue.back().rows = rows;
+        if (!spare.empty())
+        {
+            texels.swap(spare.back());
+            spare.pop_back();
+        }
+        cvWork.notify_one();
+    }
+
+    // Write out the queued strips and close the file. Returns false if anything failed.
+    bool finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bDone = true;
+        }
+        cvWork.notify_one();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+        return encoder.close();
+    }
+
+private:
+    struct Strip
+    {
+        std::vector<uint32_t> texels;
+        unsigned int rows = 0;
+    };
+
+    void run()
+    {
+        std::vector<unsigned char> rgb((size_t)width * 3);
+        for (;;)
+        {
+            Strip strip;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cvWork.wait(lock, [this] { return bDone || !queue.empty(); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                strip.texels.swap(queue.front().texels);
+                strip.rows = queue.front().rows;
+                queue.pop_front();
+            }
+            cvSpace.notify_one();
+            double startMs = pipelineNowMs();
+            for (unsigned int row = strip.rows; row-- > 0;)
+            {
+                const uint32_t *texels = &strip.texels[(size_t)row * width];
+                for (unsigned int x = 0; x < width; x++)
+                {
+                    memcpy(&rgb[(size_t)x * 3], &texels[x], 3);
+                }
+                encoder.writeRow(rgb.data());
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            encodeMs += pipelineNowMs() - startMs;
+            spare.emplace_back();
+            spare.back().swap(strip.texels);
+        }
+    }
+
+    PosterEncoder encoder;
+    unsigned int width = 0;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cvWork;
+    std::condition_variable cvSpace;
+    std::deque<Strip> queue;
+    std::vector<std::vector<uint32_t>> spare;
+    bool bDone = false;
+};
+
+#endif // POSTER_H
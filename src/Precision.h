@@ -0,0 +1,71 @@
+// Precision tiers of the GPU escape loop
+// Consumer GPUs run double precision at 1/16 to 1/64 of the float rate, or not at all, while most views do not need
+// it. Each GPU frame is iterated in the cheapest of three tiers that still places every pixel to within
+// 2^-PRECISION_GUARD_BITS of its width:
+//  - float:          24 bit mantissa, shallow views
+//  - double-single:  the value as the unevaluated sum of two floats (hi + lo), about 46 bits, built from float
+//                    operations with exact error terms (fma), so it runs at a fraction of the float rate
+//  - double:         53 bits, only between the double-single limit and the perturbation threshold (see Deep zoom)
+// A pixel's coordinate is known to the precision of the largest coordinate in the view, so the test compares the
+// pixel spacing with that magnitude. Devices without double precision build Mandel.cl with -D NO_FP64 and stay with
+// double-single however deep the view. --precision fixes a tier instead. The CPU engine always iterates in double.
+// Keep the tier numbers in step with Mandel.cl. Needs CpuRender.h (MandelView) included first.
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+enum PrecisionTier
+{
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE_SINGLE,
+    PRECISION_DOUBLE,
+    PRECISION_TIER_COUNT
+};
+static const char *const PRECISION_TIER_NAMES[PRECISION_TIER_COUNT] = {"float", "double-single", "double"};
+static const int PRECISION_MANTISSA_BITS[PRECISION_TIER_COUNT] = {24, 46, 53};
+static const int PRECISION_GUARD_BITS = 10;
+
+// "float", "ds" or "double"
+static bool parsePrecisionTier(const char *name, PrecisionTier &tier)
+{
+    static const char *const shortNames[PRECISION_TIER_COUNT] = {"float", "ds", "double"};
+    for (int t = 0; t < PRECISION_TIER_COUNT; t++)
+    {
+        if (strcmp(name, shortNames[t]) == 0)
+        {
+            tier = (PrecisionTier)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Cheapest tier for a w x h frame of 'view'. Without bFp64 the deepest tier is double-single.
+static PrecisionTier choosePrecisionTier(const MandelView &view, unsigned int w, unsigned int h, bool bFp64)
+{
+    const double maxX = view.minX + (w - 1) * view.Re_factor;
+    const double minY = view.MaxIm - (h - 1) * view.Im_factor;
+    const double spacing = std::min(view.Re_factor, view.Im_factor);
+    const double magnitude = std::max(std::max(fabs(view.minX), fabs(maxX)), std::max(fabs(view.MaxIm), fabs(minY)));
+    const PrecisionTier deepest = bFp64 ? PRECISION_DOUBLE : PRECISION_DOUBLE_SINGLE;
+    for (int t = PRECISION_FLOAT; t < deepest; t++)
+    {
+        if (spacing >= ldexp(magnitude, PRECISION_GUARD_BITS - PRECISION_MANTISSA_BITS[t]))
+        {
+            return (PrecisionTier)t;
+        }
+    }
+    return deepest;
+}
+
+// v as a double-single pair: hi the nearest float, lo the nearest float to the rest
+static inline void splitDoubleSingle(double v, float out[2])
+{
+    out[0] = (float)v;
+    out[1] = (float)(v - (double)out[0]);
+}
+
+#endif // PRECISION_H
@@ -0,0 +1,157 @@
+// On-disk cache of built OpenCL programs
+// Building Mandel.cl from source is the slowest part of startup, and it was done on every launch. After a build, the
+// device binary (CL_PROGRAM_BINARIES) is written to the cache directory, and later starts load it instead of compiling.
+// Binaries are only valid for the exact compiler that made them, so the cache key covers everything that can change the
+// result: the device name and OpenCL version, the driver version, the build options and a hash of the source. The full
+// key is stored in the file as well as hashed into its name, so a hash collision is treated as a miss. Files are written
+// to a temporary name and renamed, so a run that is killed mid-write never leaves a truncated binary behind.
+// This header holds no OpenCL calls: main.cpp queries the device, builds the program and hands the bytes over.
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+static const char PROGRAM_CACHE_MAGIC[8] = {'M', 'A', 'N', 'D', 'C', 'L', 'B', '1'};
+
+// 64-bit FNV-1a, continued from 'h'
+static inline uint64_t fnv1a64(const void *data, size_t size, uint64_t h = 14695981039346656037ULL)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+struct ProgramCacheKey
+{
+    std::string text; // every input of the build, one per line
+    uint64_t hash = 0;
+};
+
+static ProgramCacheKey makeProgramCacheKey(const std::string &source, const char *deviceName, const char *deviceVersion,
+                                           const char *driverVersion, const std::string &options)
+{
+    char sourceHash[32];
+    snprintf(sourceHash, sizeof(sourceHash), "%016llx", (unsigned long long)fnv1a64(source.data(), source.size()));
+    ProgramCacheKey key;
+    key.text = std::string("device ") + deviceName + "\nversion " + deviceVersion + "\ndriver " + driverVersion +
+               "\noptions " + options + "\nsource " + sourceHash + "\n";
+    key.hash = fnv1a64(key.text.data(), key.text.size());
+    return key;
+}
+
+// $XDG_CACHE_HOME/name, else ~/.cache/name, else .name-cache under the working directory
+static std::string defaultCacheDir(const char *name)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0])
+    {
+        return std::string(xdg) + "/" + name;
+    }
+    const char *home = getenv("HOME");
+    if (home && home[0])
+    {
+        return std::string(home) + "/.cache/" + name;
+    }
+    return std::string(".") + name + "-cache";
+}
+
+static std::string defaultProgramCacheDir()
+{
+    return defaultCacheDir("mandel-cl");
+}
+
+static std::string programCachePath(const std::string &dir, const ProgramCacheKey &key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/mandel-%016llx.bin", (unsigned long long)key.hash);
+    return dir + name;
+}
+
+// Create 'dir' and any missing parents
+static bool makeProgramCacheDir(const std::string &dir)
+{
+    for (size_t slash = dir.find('/', 1);; slash = dir.find('/', slash + 1))
+    {
+        std::string part = dir.substr(0, slash);
+        if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+        if (slash == std::string::npos)
+        {
+            return true;
+        }
+    }
+}
+
+// Binary stored under 'key', if there is one. File layout: magic, key length (uint32), key text, binary length
+// (uint64), binary.
+static bool loadProgramBinary(const std::string &dir, const ProgramCacheKey &key, std::vector<unsigned char> &binary)
+{
+    FILE *fp = fopen(programCachePath(dir, key).c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+    char magic[sizeof(PROGRAM_CACHE_MAGIC)];
+    uint32_t keyLength = 0;
+    uint64_t binaryLength = 0;
+    std::string text;
+    bool bOk = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, PROGRAM_CACHE_MAGIC, sizeof(magic)) == 0 &&
+               fread(&keyLength, sizeof(keyLength), 1, fp) == 1 && keyLength == key.text.size();
+    if (bOk)
+    {
+        text.resize(keyLength);
+        bOk = fread(&text[0], 1, keyLength, fp) == keyLength && text == key.text &&
+              fread(&binaryLength, sizeof(binaryLength), 1, fp) == 1 && binaryLength > 0 && binaryLength < (1ULL << 31);
+    }
+    if (bOk)
+    {
+        binary.resize((size_t)binaryLength);
+        bOk = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+    }
+    fclose(fp);
+    return bOk;
+}
+
+static bool storeProgramBinary(const std::string &dir, const ProgramCacheKey &key, const std::vector<unsigned char> &binary)
+{
+    if (binary.empty() || !makeProgramCacheDir(dir))
+    {
+        return false;
+    }
+    std::string path = programCachePath(dir, key);
+    std::string tmpPath = path + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    uint32_t keyLength = (uint32_t)key.text.size();
+    uint64_t binaryLength = binary.size();
+    bool bOk = fwrite(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC), 1, fp) == 1 &&
+               fwrite(&keyLength, sizeof(keyLength), 1, fp) == 1 &&
+               fwrite(key.text.data(), 1, keyLength, fp) == keyLength &&
+               fwrite(&binaryLength, sizeof(binaryLength), 1, fp) == 1 &&
+               fwrite(binary.data(), 1, binary.size(), fp) == binary.size();
+    bOk = fclose(fp) == 0 && bOk;
+    if (!bOk || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif // PROGRAM_CACHE_H
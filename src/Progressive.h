@@ -0,0 +1,58 @@
+// Progressive coarse-to-fine rendering
+// A frame is computed in interleaved passes, like Adam7 in PNG but on 16x16 blocks: the first pass iterates one pixel
+// in every 16x16 block (1/16 of the resolution in each direction) and each later pass doubles the resolution in one
+// direction, filling in the pixels between those already computed. No pixel is iterated twice. After each pass every
+// pixel is shown with the colour of the computed pixel at the top left of its cell, so the image sharpens in place.
+// Passes are worked through in short time slices so the event loop can cancel a frame as soon as a new view arrives.
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+struct ProgressivePass
+{
+    unsigned int xStep;   // pixels iterated in this pass: x = xOffset + i * xStep, y = yOffset + j * yStep
+    unsigned int yStep;
+    unsigned int xOffset;
+    unsigned int yOffset;
+    unsigned int cellW;   // size of the cells shown after this pass (powers of two)
+    unsigned int cellH;
+};
+
+static const unsigned int PROGRESSIVE_PASS_COUNT = 9;
+static const ProgressivePass PROGRESSIVE_PASSES[PROGRESSIVE_PASS_COUNT] = {
+    {16, 16, 0, 0, 16, 16},
+    {16, 16, 8, 0, 8, 16},
+    {8, 16, 0, 8, 8, 8},
+    {8, 8, 4, 0, 4, 8},
+    {4, 8, 0, 4, 4, 4},
+    {4, 4, 2, 0, 2, 4},
+    {2, 4, 0, 2, 2, 2},
+    {2, 2, 1, 0, 1, 2},
+    {1, 2, 0, 1, 1, 1},
+};
+
+// Time slice for a step of a progressive frame before control goes back to the event loop
+static const double PROGRESSIVE_SLICE_MS = 15.0;
+
+// Where a progressive frame has got to
+struct ProgressiveState
+{
+    bool bActive = false;
+    unsigned int pass = 0; // index into PROGRESSIVE_PASSES
+    unsigned int row = 0;  // next row of the pass lattice (y = yOffset + row * yStep)
+    unsigned int frames = 0;
+    unsigned int cancelled = 0; // frames abandoned for a newer view
+    double firstPassMs = 0.0;   // time from the start of the frame to the first pass on screen
+
+    unsigned int passRows(unsigned int height) const
+    {
+        const ProgressivePass &p = PROGRESSIVE_PASSES[pass];
+        return height > p.yOffset ? (height - p.yOffset + p.yStep - 1) / p.yStep : 0;
+    }
+    unsigned int passColumns(unsigned int width) const
+    {
+        const ProgressivePass &p = PROGRESSIVE_PASSES[pass];
+        return width > p.xOffset ? (width - p.xOffset + p.xStep - 1) / p.xStep : 0;
+    }
+};
+
+#endif // PROGRESSIVE_H
@@ -0,0 +1,201 @@
+// Asynchronous render pipeline between the SDL event loop and the render engines
+// The event loop only posts view requests (zooms) and shows the latest finished frame; a render thread applies the
+// requests, renders and publishes frames. Frames go through PIPELINE_SLOTS buffers (a triple buffer): the render thread
+// writes the back slot while the event loop shows the front slot, and publishing or taking a frame only swaps slot
+// indices with the middle (ready) slot, so neither side waits for the other. Requests that arrive while a frame is
+// being rendered are applied together before the next one, and a finished frame that is replaced by a newer one before
+// the event loop gets to it is dropped. Both are counted, along with the click to display latency.
+#ifndef RENDER_PIPELINE_H
+#define RENDER_PIPELINE_H
+
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+static const unsigned int PIPELINE_SLOTS = 3;
+
+// Milliseconds on a steady clock, for latencies measured across threads
+static double pipelineNowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum ViewRequestType
+{
+    VIEW_REQUEST_RENDER,     // render the current view
+    VIEW_REQUEST_ZOOM,       // zoom by 'scale' about window pixel (dx, dy)
+    VIEW_REQUEST_PALETTE,    // switch to the next palette, which only needs the colouring pass
+    VIEW_REQUEST_FRACTAL,    // switch to the next fractal family (Fractal.h) and its default view
+    VIEW_REQUEST_SAVE_FIELD, // save the iteration field of the current frame once it is complete (IterationField.h)
+};
+
+// A view change posted by the event loop
+struct ViewRequest
+{
+    ViewRequestType type;
+    double dx;
+    double dy;
+    double scale;
+    unsigned int seq;
+    double postedMs;
+};
+
+// Which request a published frame answers
+struct FrameInfo
+{
+    unsigned int seq = 0;
+    double postedMs = 0.0; // when the oldest request applied for this frame was posted
+    bool bComplete = false; // false for the coarse passes of a progressive frame
+};
+
+struct LatencyStats
+{
+    unsigned int count = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    double lastMs = 0.0;
+
+    void add(double ms)
+    {
+        count++;
+        totalMs += ms;
+        maxMs = ms > maxMs ? ms : maxMs;
+        lastMs = ms;
+    }
+    double meanMs() const { return count > 0 ? totalMs / count : 0.0; }
+};
+
+struct PipelineStats
+{
+    unsigned int published = 0; // frames (and progressive passes) finished by the render thread
+    unsigned int presented = 0; // frames put on screen
+    unsigned int dropped = 0;   // finished frames replaced by a newer one before they were shown
+    unsigned int coalesced = 0; // requests applied together with a later one instead of getting a frame of their own
+    LatencyStats firstShown;    // click to the first frame of the new view on screen
+    LatencyStats completeShown; // click to the complete frame on screen
+};
+
+class RenderPipeline
+{
+public:
+    RenderPipeline() {}
+
+    // Event loop: queue a view request and wake the render thread
+    void post(ViewRequestType type, double dx = 0.0, double dy = 0.0, double scale = 1.0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(ViewRequest{type, dx, dy, scale, ++lastSeq, pipelineNowMs()});
+        wake.notify_one();
+    }
+
+    // Render thread: take every pending request. With bBlock, waits until there is one, or for at most waitMs if that
+    // is not negative. Returns false once stopped.
+    bool takeRequests(std::vector<ViewRequest> &requests, bool bBlock, double waitMs = -1.0)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ready = [this] { return bStopped || !pending.empty(); };
+        if (bBlock && waitMs < 0.0)
+        {
+            wake.wait(lock, ready);
+        }
+        else if (bBlock)
+        {
+            wake.wait_for(lock, std::chrono::duration<double, std::milli>(waitMs), ready);
+        }
+        requests.swap(pending);
+        pending.clear();
+        if (requests.size() > 1)
+        {
+            stats.coalesced += (unsigned int)requests.size() - 1;
+        }
+        return !bStopped;
+    }
+    // Render thread: a request is waiting, so the frame in progress is out of date
+    bool hasPendingRequests()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !pending.empty();
+    }
+
+    // Render thread: the slot to render into
+    unsigned int backSlot() const { return back; }
+    // Render thread: hand the back slot over as the latest frame and get the next slot to render into
+    unsigned int publish(const FrameInfo &info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (bReadyIsNew)
+        {
+            stats.dropped++;
+        }
+        std::swap(back, ready);
+        readyInfo = info;
+        bReadyIsNew = true;
+        stats.published++;
+        return back;
+    }
+
+    // Event loop: swap in the latest published frame, if there is one that has not been shown yet
+    bool takeLatest(unsigned int &slot, FrameInfo &info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!bReadyIsNew)
+        {
+            return false;
+        }
+        std::swap(front, ready);
+        bReadyIsNew = false;
+        slot = front;
+        info = readyInfo;
+        return true;
+    }
+    // Event loop: the frame taken with takeLatest() is on screen
+    void presented(const FrameInfo &info)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        double latencyMs = pipelineNowMs() - info.postedMs;
+        stats.presented++;
+        if (info.seq != shownSeq)
+        {
+            shownSeq = info.seq;
+            stats.firstShown.add(latencyMs);
+        }
+        if (info.bComplete)
+        {
+            stats.completeShown.add(latencyMs);
+        }
+    }
+
+    // Wake the render thread and make takeRequests() return false
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bStopped = true;
+        wake.notify_one();
+    }
+
+    PipelineStats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<ViewRequest> pending;
+    unsigned int lastSeq = 0;
+    bool bStopped = false;
+
+    unsigned int back = 0;
+    unsigned int ready = 1;
+    unsigned int front = 2;
+    bool bReadyIsNew = false;
+    FrameInfo readyInfo;
+    unsigned int shownSeq = 0;
+
+    PipelineStats stats;
+};
+
+#endif // RENDER_PIPELINE_H
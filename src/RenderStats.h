@@ -0,0 +1,207 @@
+// Render instrumentation: per-stage timers, the iteration cost heatmap and the periodic stats file
+// Each frame goes through stages that are timed separately, so a slow frame can be pinned on one of them:
+//  - render:  host time of one render step (a whole frame, or one slice of a progressive frame) on the render thread
+//  - antialias: host time of the adaptive anti-aliasing of a complete frame (see Antialias.h), part of its render step
+//  - acquire, kernels, release: device time of clEnqueueAcquireGLObjects, the frame's kernels and
+//    clEnqueueReleaseGLObjects, from the OpenCL profiling counters of their events (GPU engine)
+//  - upload:  glTexSubImage2D of a CPU engine frame
+//  - quad, swap, finish: host time of renderGLQuad(), SDL_GL_SwapWindow() and the glFinish() after it. Drivers queue
+//    GL work, so the time the GPU spends drawing shows up in whichever of them waits for it.
+// The render thread and the event loop both record, so the timers are behind a mutex. Every stage keeps totals since
+// start and a window since the last stats file was written.
+// The heatmap is the iteration work of each HEATMAP_TILE x HEATMAP_TILE tile of the last complete frame, counted by
+// packedIterationSum(): the escape iteration of every escaped pixel plus maxIter for every interior pixel. It is written
+// as a greyscale PGM the size of the frame (log scale, white = the most expensive tile) and as a CSV of the raw totals.
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include "CpuRender.h"
+#include "RenderPipeline.h"
+
+enum RenderStage
+{
+    STAGE_RENDER,
+    STAGE_ANTIALIAS,
+    STAGE_ACQUIRE,
+    STAGE_KERNELS,
+    STAGE_RELEASE,
+    STAGE_UPLOAD,
+    STAGE_QUAD,
+    STAGE_SWAP,
+    STAGE_FINISH,
+    STAGE_COUNT
+};
+static const char *const RENDER_STAGE_NAMES[STAGE_COUNT] = {"render",  "antialias", "acquire", "kernels", "release",
+                                                            "upload",  "quad",      "swap",    "finish"};
+
+struct StageTimes
+{
+    LatencyStats total;  // since start
+    LatencyStats window; // since the last snapshot
+};
+
+class RenderStageStats
+{
+public:
+    void record(RenderStage stage, double ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stages[stage].total.add(ms);
+        stages[stage].window.add(ms);
+    }
+    // Copy of every stage's times. With bNewWindow the window restarts.
+    void snapshot(StageTimes out[STAGE_COUNT], bool bNewWindow)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            out[s] = stages[s];
+            if (bNewWindow)
+            {
+                stages[s].window = LatencyStats();
+            }
+        }
+    }
+
+private:
+    std::mutex mutex;
+    StageTimes stages[STAGE_COUNT];
+};
+
+static const unsigned int HEATMAP_TILE = 32;
+
+struct IterationHeatmap
+{
+    unsigned int width = 0; // of the frame, in pixels
+    unsigned int height = 0;
+    unsigned int tilesX = 0;
+    unsigned int tilesY = 0;
+    std::vector<double> iterations; // per tile, row by row
+    double total = 0.0;
+    double maxTile = 0.0;
+
+    bool empty() const { return iterations.empty(); }
+    // Share of the frame's work in its most expensive tile, times the tile count: 1 for an evenly spread frame
+    double imbalance() const { return total > 0.0 ? maxTile * iterations.size() / total : 0.0; }
+};
+
+// Pixels not computed yet (-1) count for nothing
+static void buildIterationHeatmap(const std::vector<int> &packed, unsigned int width, unsigned int height, float maxIter,
+                                  IterationHeatmap &map)
+{
+    map.width = width;
+    map.height = height;
+    map.tilesX = (width + HEATMAP_TILE - 1) / HEATMAP_TILE;
+    map.tilesY = (height + HEATMAP_TILE - 1) / HEATMAP_TILE;
+    map.iterations.assign((size_t)map.tilesX * map.tilesY, 0.0);
+    for (unsigned int y = 0; y < height; y++)
+    {
+        double *row = &map.iterations[(size_t)(y / HEATMAP_TILE) * map.tilesX];
+        const int *pixels = &packed[(size_t)y * width];
+        for (unsigned int x = 0; x < width; x += HEATMAP_TILE)
+        {
+            row[x / HEATMAP_TILE] += packedIterationSum(pixels + x, std::min(HEATMAP_TILE, width - x), maxIter);
+        }
+    }
+    map.total = 0.0;
+    map.maxTile = 0.0;
+    for (double t : map.iterations)
+    {
+        map.total += t;
+        map.maxTile = t > map.maxTile ? t : map.maxTile;
+    }
+}
+
+static bool writeHeatmapPgm(const char *path, const IterationHeatmap &map)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+    fprintf(fp, "P5\n%u %u\n255\n", map.width, map.height);
+    const double scale = map.maxTile > 0.0 ? 255.0 / log1p(map.maxTile) : 0.0;
+    std::vector<unsigned char> row(map.width);
+    bool bOk = true;
+    for (unsigned int y = 0; y < map.height && bOk; y++)
+    {
+        const double *tiles = &map.iterations[(size_t)(y / HEATMAP_TILE) * map.tilesX];
+        for (unsigned int x = 0; x < map.width; x++)
+        {
+            row[x] = (unsigned char)(log1p(tiles[x / HEATMAP_TILE]) * scale + 0.5);
+        }
+        bOk = fwrite(row.data(), 1, row.size(), fp) == row.size();
+    }
+    return fclose(fp) == 0 && bOk;
+}
+
+// One line per tile row, iterations per tile separated by commas
+static bool writeHeatmapCsv(const char *path, const IterationHeatmap &map)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+    {
+        return false;
+    }
+    for (unsigned int ty = 0; ty < map.tilesY; ty++)
+    {
+        for (unsigned int tx = 0; tx < map.tilesX; tx++)
+        {
+            fprintf(fp, "%s%.0f", tx > 0 ? "," : "", map.iterations[(size_t)ty * map.tilesX + tx]);
+        }
+        fprintf(fp, "\n");
+    }
+    return fclose(fp) == 0;
+}
+
+static void writeStageJson(FILE *fp, const char *name, const LatencyStats &stats)
+{
+    fprintf(fp, "\"%s\": {\"count\": %u, \"lastMs\": %.4f, \"meanMs\": %.4f, \"maxMs\": %.4f}", name, stats.count,
+            stats.lastMs, stats.meanMs(), stats.maxMs);
+}
+
+// Stats file: 'members' (already formatted JSON members, each followed by a comma) then the stage times and the
+// heatmap summary. Written to a temporary name and renamed, so a reader never sees half a file.
+static bool writeRenderStatsJson(const char *path, const std::string &members, const StageTimes stages[STAGE_COUNT],
+                                 const IterationHeatmap &heatmap)
+{
+    std::string tmpPath = std::string(path) + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "w");
+    if (!fp)
+    {
+        return false;
+    }
+    fprintf(fp, "{\n%s\n  \"stages\": {\n", members.c_str());
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        fprintf(fp, "    \"%s\": {", RENDER_STAGE_NAMES[s]);
+        writeStageJson(fp, "total", stages[s].total);
+        fprintf(fp, ", ");
+        writeStageJson(fp, "window", stages[s].window);
+        fprintf(fp, "}%s\n", s + 1 < STAGE_COUNT ? "," : "");
+    }
+    fprintf(fp, "  },\n");
+    if (heatmap.empty())
+    {
+        fprintf(fp, "  \"heatmap\": null\n}\n");
+    }
+    else
+    {
+        fprintf(fp, "  \"heatmap\": {\"tile\": %u, \"tilesX\": %u, \"tilesY\": %u, \"iterations\": %.0f, \"maxTile\": %.0f, \"imbalance\": %.3f}\n}\n",
+                HEATMAP_TILE, heatmap.tilesX, heatmap.tilesY, heatmap.total, heatmap.maxTile, heatmap.imbalance());
+    }
+    if (fclose(fp) != 0 || rename(tmpPath.c_str(), path) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+#endif // RENDER_STATS_H
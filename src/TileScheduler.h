@@ -0,0 +1,214 @@
+// Work-stealing tile scheduler for the CPU render engine
+// Pixels inside the set cost the full maxIter while pixels outside cost a handful of iterations, so handing out equal
+// sized pieces of the image leaves most threads idle while a few finish the tiles over the main cardioid.
+// The scheduler splits tiles whose estimated cost is too large for one thread, deals them out to per-thread deques
+// (most expensive first) and lets threads that run dry steal from the back of the other deques. A thread that pops a
+// large tile while others are idle splits it again so the stragglers at the end of a frame can be shared out.
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+struct RenderTile
+{
+    unsigned int x0;
+    unsigned int y0;
+    unsigned int w;
+    unsigned int h;
+    double cost; // estimated cost, in iterations
+};
+
+struct TileSchedulerStats
+{
+    unsigned int tiles = 0;  // tiles processed
+    unsigned int splits = 0; // tiles split into quadrants (up front or at run time)
+    unsigned int steals = 0; // tiles taken from another thread's deque
+};
+
+class TileScheduler
+{
+public:
+    typedef std::function<double(const RenderTile &)> CostFn;
+    typedef std::function<void(const RenderTile &)> TileFn;
+
+    // Tiles are never split below minTileSize pixels in either direction
+    explicit TileScheduler(unsigned int minTileSize) : minTileSize(minTileSize) {}
+
+    // Process every tile on every thread of 'pool'. 'estimate' gives the expected cost of a (sub-)tile.
+    void run(ThreadPool &pool, std::vector<RenderTile> tiles, const CostFn &estimate, const TileFn &fn,
+             TileSchedulerStats &stats)
+    {
+        const unsigned int numThreads = pool.threadCount();
+        stats = TileSchedulerStats();
+
+        // Split up front until no tile is expected to cost more than a fraction of one thread's share of the frame
+        double totalCost = 0.0;
+        for (const RenderTile &t : tiles)
+        {
+            totalCost += t.cost;
+        }
+        double budget = totalCost / (numThreads * 16.0);
+        std::vector<RenderTile> work;
+        while (!tiles.empty())
+        {
+            RenderTile t = tiles.back();
+            tiles.pop_back();
+            if (t.cost > budget && canSplit(t))
+            {
+                splitTile(t, estimate, tiles);
+                stats.splits++;
+            }
+            else
+            {
+                work.push_back(t);
+            }
+        }
+        std::sort(work.begin(), work.end(), [](const RenderTile &a, const RenderTile &b) { return a.cost > b.cost; });
+
+        // Deal the tiles round robin so every deque starts with a similar share of expensive and cheap tiles
+        queues = std::vector<WorkQueue>(numThreads);
+        for (size_t i = 0; i < work.size(); i++)
+        {
+            queues[i % numThreads].tiles.push_back(work[i]);
+        }
+        remaining = (unsigned int)work.size();
+        idleThreads = 0;
+        splitCount = 0;
+        stealCount = 0;
+
+        pool.parallelFor(numThreads, [&](unsigned int self) { workerLoop(self, estimate, fn); });
+
+        stats.tiles = tilesDone;
+        stats.splits += splitCount;
+        stats.steals = stealCount;
+        tilesDone = 0;
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mtx;
+        std::deque<RenderTile> tiles;
+
+        WorkQueue() {}
+        WorkQueue(const WorkQueue &) {}
+    };
+
+    bool canSplit(const RenderTile &t) const { return t.w >= 2 * minTileSize && t.h >= 2 * minTileSize; }
+
+    // Split into quadrants on minTileSize boundaries and append them to 'out' with fresh cost estimates
+    void splitTile(const RenderTile &t, const CostFn &estimate, std::vector<RenderTile> &out) const
+    {
+        unsigned int halfW = (t.w / 2 + minTileSize - 1) / minTileSize * minTileSize;
+        unsigned int halfH = (t.h / 2 + minTileSize - 1) / minTileSize * minTileSize;
+        RenderTile quads[4] = {{t.x0, t.y0, halfW, halfH, 0.0},
+                               {t.x0 + halfW, t.y0, t.w - halfW, halfH, 0.0},
+                               {t.x0, t.y0 + halfH, halfW, t.h - halfH, 0.0},
+                               {t.x0 + halfW, t.y0 + halfH, t.w - halfW, t.h - halfH, 0.0}};
+        for (RenderTile &q : quads)
+        {
+            q.cost = estimate(q);
+            out.push_back(q);
+        }
+    }
+
+    bool popOwn(unsigned int self, RenderTile &t)
+    {
+        WorkQueue &q = queues[self];
+        std::lock_guard<std::mutex> lock(q.mtx);
+        if (q.tiles.empty())
+        {
+            return false;
+        }
+        t = q.tiles.front();
+        q.tiles.pop_front();
+        return true;
+    }
+
+    bool steal(unsigned int self, RenderTile &t)
+    {
+        const unsigned int n = (unsigned int)queues.size();
+        for (unsigned int k = 1; k < n; k++)
+        {
+            WorkQueue &q = queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (!q.tiles.empty())
+            {
+                t = q.tiles.back();
+                q.tiles.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned int self, const CostFn &estimate, const TileFn &fn)
+    {
+        bool bIdle = false;
+        while (remaining.load() > 0)
+        {
+            RenderTile t;
+            bool bGot = popOwn(self, t);
+            if (!bGot && steal(self, t))
+            {
+                bGot = true;
+                stealCount++;
+            }
+            if (!bGot)
+            {
+                if (!bIdle)
+                {
+                    bIdle = true;
+                    idleThreads++;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            if (bIdle)
+            {
+                bIdle = false;
+                idleThreads--;
+            }
+
+            // Other threads have run dry: share this tile with them instead of processing it alone
+            if (idleThreads.load() > 0 && canSplit(t))
+            {
+                std::vector<RenderTile> quads;
+                splitTile(t, estimate, quads);
+                splitCount++;
+                remaining += 3;
+                {
+                    std::lock_guard<std::mutex> lock(queues[self].mtx);
+                    for (size_t i = 1; i < quads.size(); i++)
+                    {
+                        queues[self].tiles.push_back(quads[i]);
+                    }
+                }
+                t = quads[0];
+            }
+            fn(t);
+            tilesDone++;
+            remaining--;
+        }
+        if (bIdle)
+        {
+            idleThreads--;
+        }
+    }
+
+    unsigned int minTileSize;
+    std::vector<WorkQueue> queues;
+    std::atomic<unsigned int> remaining{0};
+    std::atomic<unsigned int> idleThreads{0};
+    std::atomic<unsigned int> splitCount{0};
+    std::atomic<unsigned int> stealCount{0};
+    std::atomic<unsigned int> tilesDone{0};
+};
+
+#endif // TILE_SCHEDULER_H
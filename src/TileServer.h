@@ -0,0 +1,702 @@
+// Tile server (--serve port or --serve-socket path)
+// Serves the explorer as a slippy map: GET /z/x/y.png answers a 256x256 PNG tile, for web map viewers (Leaflet,
+// OpenLayers) on the same machine. Level z cuts a square TILE_WORLD_WIDTH wide, centred on the fractal family's own view,
+// into 2^z x 2^z tiles, x from the left and y from the top, down to TILE_MAX_ZOOM where the pixels are still well above
+// the limit of doubles (perturbation is not used). GET /stats answers the counters below as JSON.
+// The server listens on 127.0.0.1 only (or a Unix socket), with a thread per connection and HTTP/1.1 keep-alive, since
+// a map viewer asks for a screenful of tiles at once over a few connections. A tile request:
+//  1. is answered from an in-memory LRU of encoded tiles, bounded in bytes (--tile-cache-mb)
+//  2. joins the request already in flight for the same tile, if there is one, so a tile is never rendered twice when
+//     many viewers pan over the same area
+//  3. is read from the disk cache (--tile-cache), by the requesting thread so reads overlap, one directory per tile
+//     set (family, palette and iteration limit) and per level. Files are written to a temporary name and renamed.
+//  4. otherwise waits for the render thread, which collects the tiles requested within TILE_BATCH_WAIT_MS (up to
+//     TILE_BATCH_MAX) and iterates all their rows in one parallelFor() over the CPU engine's pool, instead of one
+//     small dispatch per tile that would leave most cores idle, then encodes them in parallel
+// The iteration limit of a tile depends on its level only (the adaptive limit's zoom floor, or --max-iter), so a tile
+// looks the same whoever asks for it first; a batch holds the tiles of one limit. POSIX sockets.
+#ifndef TILE_SERVER_H
+#define TILE_SERVER_H
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <condition_variable>
+#include "CpuRender.h"
+#include "AdaptiveIter.h"
+#include "Benchmark.h"
+#include "ProgramCache.h"
+#include "Poster.h"
+
+static const unsigned int TILE_SIZE = 256;
+static const int TILE_MAX_ZOOM = 32;
+static const double TILE_WORLD_WIDTH = 4.0;
+static const unsigned int TILE_BATCH_MAX = 64;
+static const unsigned int TILE_BATCH_WAIT_MS = 2;
+static const unsigned int TILE_MAX_CONNECTIONS = 256;
+static const unsigned int TILE_IDLE_SECONDS = 30;     // keep-alive connections with no request for this long are closed
+static const size_t TILE_LATENCY_SAMPLES = 4096;      // latest request latencies kept for the percentiles
+static const unsigned int TILE_ACCEPT_RETRY_MS = 100; // pause after accept() fails for want of descriptors or memory
+
+struct TileKey
+{
+    int z = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+
+    // "z/x/y", the cache key
+    std::string name() const
+    {
+        char text[48];
+        snprintf(text, sizeof(text), "%d/%u/%u", z, x, y);
+        return text;
+    }
+};
+
+// "/z/x/y.png" (the extension may be left out). Returns false for anything else or a tile outside its level.
+static bool parseTilePath(const char *path, TileKey &key)
+{
+    int z = 0;
+    unsigned long long x = 0;
+    unsigned long long y = 0;
+    int end = 0;
+    if (sscanf(path, "/%d/%llu/%llu%n", &z, &x, &y, &end) != 3 || z < 0 || z > TILE_MAX_ZOOM)
+    {
+        return false;
+    }
+    const char *rest = path + end;
+    if (strcmp(rest, "") != 0 && strcmp(rest, ".png") != 0)
+    {
+        return false;
+    }
+    const unsigned long long tiles = 1ULL << z;
+    if (x >= tiles || y >= tiles)
+    {
+        return false;
+    }
+    key.z = z;
+    key.x = (uint32_t)x;
+    key.y = (uint32_t)y;
+    return true;
+}
+
+// The square that level 0 covers
+struct TileWorld
+{
+    double minRe = -2.0;
+    double maxIm = 2.0;
+    double width = TILE_WORLD_WIDTH;
+};
+
+// Pixel centres of tile 'key', row 0 at the top
+static MandelView tileView(const TileWorld &world, const TileKey &key)
+{
+    const double spacing = world.width / ((double)TILE_SIZE * (double)(1ULL << key.z));
+    MandelView view;
+    view.minX = world.minRe + ((double)key.x * TILE_SIZE + 0.5) * spacing;
+    view.MaxIm = world.maxIm - ((double)key.y * TILE_SIZE + 0.5) * spacing;
+    view.Re_factor = spacing;
+    view.Im_factor = spacing;
+    return view;
+}
+
+typedef std::shared_ptr<const std::string> TileData; // encoded PNG, NULL if it could not be made
+
+// Encoded tiles by name, least recently used first out once their bytes pass the budget. Not thread safe.
+class TileLru
+{
+public:
+    explicit TileLru(size_t budgetBytes) : budget(budgetBytes) {}
+
+    TileData get(const std::string &name)
+    {
+        auto it = index.find(name);
+        if (it == index.end())
+        {
+            return TileData();
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    void put(const std::string &name, const TileData &data)
+    {
+        if (!data || data->size() > budget || index.count(name))
+        {
+            return;
+        }
+        entries.emplace_front(name, data);
+        index[name] = entries.begin();
+        bytes += data->size();
+        while (bytes > budget)
+        {
+            bytes -= entries.back().second->size();
+            index.erase(entries.back().first);
+            entries.pop_back();
+            evictions++;
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t usedBytes() const { return bytes; }
+    unsigned long long evictions = 0;
+
+private:
+    typedef std::list<std::pair<std::string, TileData>> EntryList;
+    size_t budget;
+    size_t bytes = 0;
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+};
+
+// PNG files at dir/z/x-y.png. An empty dir turns the cache off.
+class TileDiskCache
+{
+public:
+    explicit TileDiskCache(const std::string &directory) : dir(directory) {}
+
+    bool enabled() const { return !dir.empty(); }
+
+    bool load(const TileKey &key, std::string &data) const
+    {
+        if (!enabled())
+        {
+            return false;
+        }
+        FILE *fp = fopen(path(key).c_str(), "rb");
+        if (!fp)
+        {
+            return false;
+        }
+        char buffer[16384];
+        size_t n;
+        data.clear();
+        while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        {
+            data.append(buffer, n);
+        }
+        bool bOk = ferror(fp) == 0 && !data.empty();
+        fclose(fp);
+        return bOk;
+    }
+
+    bool store(const TileKey &key, const std::string &data) const
+    {
+        char level[16];
+        snprintf(level, sizeof(level), "/%d", key.z);
+        if (!enabled() || !makeProgramCacheDir(dir + level))
+        {
+            return false;
+        }
+        std::string filePath = path(key);
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+        std::string tmpPath = filePath + suffix;
+        FILE *fp = fopen(tmpPath.c_str(), "wb");
+        if (!fp)
+        {
+            return false;
+        }
+        bool bOk = fwrite(data.data(), 1, data.size(), fp) == data.size();
+        bOk = fclose(fp) == 0 && bOk;
+        if (!bOk || rename(tmpPath.c_str(), filePath.c_str()) != 0)
+        {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string path(const TileKey &key) const
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "/%d/%u-%u.png", key.z, key.x, key.y);
+        return dir + name;
+    }
+
+    std::string dir;
+};
+
+struct TileServerStats
+{
+    unsigned long long requests = 0;
+    unsigned long long memoryHits = 0;
+    unsigned long long diskHits = 0;
+    unsigned long long deduplicated = 0; // joined a render already in flight
+    unsigned long long rendered = 0;
+    unsigned long long batches = 0;
+    unsigned long long failed = 0;
+    double renderMs = 0.0; // iterating, colouring and encoding, summed over batches
+};
+
+class TileServer
+{
+public:
+    // 'diskDir' empty for no disk cache. 'maxIterOverride' 0 for the zoom floor of each level.
+    TileServer(ThreadPool &threadPool, const TileWorld &tileWorld, const std::string &diskDir, size_t memoryBytes,
+               float maxIterOverride, const char *paletteName)
+        : pool(threadPool), world(tileWorld), disk(diskDir), lru(memoryBytes), fixedMaxIter(maxIterOverride),
+          palette(paletteName)
+    {
+        renderThread = std::thread(&TileServer::renderLoop, this);
+    }
+    ~TileServer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bStop = true;
+        }
+        cvQueue.notify_all();
+        renderThread.join();
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+        }
+    }
+
+    bool listenTcp(unsigned int port)
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0)
+        {
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)port);
+        bTcp = true;
+        return bind(listenFd, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(listenFd, SOMAXCONN) == 0;
+    }
+
+    bool listenUnix(const char *path)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        if (strlen(path) >= sizeof(addr.sun_path))
+        {
+            return false;
+        }
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0)
+        {
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        unlink(path);
+        return bind(listenFd, (sockaddr *)&addr, sizeof(addr)) == 0 && listen(listenFd, SOMAXCONN) == 0;
+    }
+
+    // Accept connections until the process is stopped
+    void run()
+    {
+        // A viewer that goes away mid-response must not kill the server
+        signal(SIGPIPE, SIG_IGN);
+        for (;;)
+        {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0)
+            {
+                // Out of file descriptors or buffers the next accept() fails the same way, so wait for connections to
+                // close instead of spinning
+                if (errno != EINTR && errno != ECONNABORTED)
+                {
+                    printf("Tile server: accept failed: %s\n", strerror(errno));
+                    usleep(TILE_ACCEPT_RETRY_MS * 1000);
+                }
+                continue;
+            }
+            if (connections >= TILE_MAX_CONNECTIONS)
+            {
+                sendResponse(fd, "503 Service Unavailable", "text/plain", "busy\n", 5, false);
+                close(fd);
+                continue;
+            }
+            connections++;
+            std::thread(&TileServer::serveConnection, this, fd).detach();
+        }
+    }
+
+    // Encoded tile 'key', rendered if it is in neither cache
+    TileData getTile(const TileKey &key)
+    {
+        const double startMs = pipelineNowMs();
+        const std::string name = key.name();
+        std::shared_ptr<PendingTile> pending;
+        std::shared_future<TileData> future;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.requests++;
+            TileData hit = lru.get(name);
+            if (hit)
+            {
+                stats.memoryHits++;
+                recordLatency(pipelineNowMs() - startMs);
+                return hit;
+            }
+            auto it = inFlight.find(name);
+            if (it != inFlight.end())
+            {
+                stats.deduplicated++;
+                future = it->second->future;
+            }
+            else
+            {
+                pending = std::make_shared<PendingTile>();
+                pending->key = key;
+                pending->maxIter = tileMaxIter(key.z);
+                pending->future = pending->promise.get_future().share();
+                future = pending->future;
+                inFlight[name] = pending;
+            }
+        }
+        if (pending)
+        {
+            std::string bytes;
+            if (disk.load(key, bytes))
+            {
+                finishTile(*pending, std::make_shared<const std::string>(std::move(bytes)), true);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(pending);
+                cvQueue.notify_one();
+            }
+        }
+        TileData data = future.get();
+        std::lock_guard<std::mutex> lock(mutex);
+        recordLatency(pipelineNowMs() - startMs);
+        return data;
+    }
+
+    std::string statsJson()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<double> samples(latencyMs.begin(), latencyMs.end());
+        char text[1024];
+        snprintf(text, sizeof(text),
+                 "{\n  \"requests\": %llu,\n  \"memoryHits\": %llu,\n  \"diskHits\": %llu,\n  \"deduplicated\": %llu,\n"
+                 "  \"rendered\": %llu,\n  \"failed\": %llu,\n  \"batches\": %llu,\n  \"meanBatch\": %.2f,\n"
+                 "  \"renderMsPerTile\": %.2f,\n  \"latencyMs\": {\"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n"
+                 "  \"memoryCache\": {\"tiles\": %zu, \"bytes\": %zu, \"evictions\": %llu},\n  \"connections\": %u\n}\n",
+                 stats.requests, stats.memoryHits, stats.diskHits, stats.deduplicated, stats.rendered, stats.failed,
+                 stats.batches, stats.batches > 0 ? (double)stats.rendered / stats.batches : 0.0,
+                 stats.rendered > 0 ? stats.renderMs / stats.rendered : 0.0, benchPercentile(samples, 0.5),
+                 benchPercentile(samples, 0.99), latencyMaxMs, lru.size(), lru.usedBytes(), lru.evictions,
+                 connections.load());
+        return text;
+    }
+
+private:
+    struct PendingTile
+    {
+        TileKey key;
+        float maxIter = 0.0f;
+        std::promise<TileData> promise;
+        std::shared_future<TileData> future;
+    };
+
+    float tileMaxIter(int z) const
+    {
+        return fixedMaxIter > 0.0f ? fixedMaxIter : chooseMaxIter((double)z, NULL, 0.0f).maxIter;
+    }
+
+    // Called with the mutex held
+    void recordLatency(double ms)
+    {
+        latencyMs.push_back(ms);
+        if (latencyMs.size() > TILE_LATENCY_SAMPLES)
+        {
+            latencyMs.pop_front();
+        }
+        latencyMaxMs = std::max(latencyMaxMs, ms);
+    }
+
+    void finishTile(PendingTile &pending, const TileData &data, bool bFromDisk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lru.put(pending.key.name(), data);
+            inFlight.erase(pending.key.name());
+            stats.diskHits += bFromDisk ? 1 : 0;
+            stats.failed += data ? 0 : 1;
+        }
+        pending.promise.set_value(data);
+    }
+
+    // Render thread: batches of queued tiles with the same iteration limit
+    void renderLoop()
+    {
+        for (;;)
+        {
+            std::vector<std::shared_ptr<PendingTile>> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cvQueue.wait(lock, [&] { return bStop || !queue.empty(); });
+                if (bStop)
+                {
+                    return;
+                }
+                // Give the other requests of a screenful a moment to arrive, so they share the dispatch
+                cvQueue.wait_for(lock, std::chrono::milliseconds(TILE_BATCH_WAIT_MS),
+                                 [&] { return bStop || queue.size() >= TILE_BATCH_MAX; });
+                const float maxIter = queue.front()->maxIter;
+                for (auto it = queue.begin(); it != queue.end() && batch.size() < TILE_BATCH_MAX;)
+                {
+                    if ((*it)->maxIter == maxIter)
+                    {
+                        batch.push_back(*it);
+                        it = queue.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+            const double startMs = pipelineNowMs();
+            std::vector<TileData> tiles = renderBatch(batch);
+            for (size_t t = 0; t < batch.size(); t++)
+            {
+                if (tiles[t])
+                {
+                    disk.store(batch[t]->key, *tiles[t]);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.batches++;
+                stats.rendered += batch.size();
+                stats.renderMs += pipelineNowMs() - startMs;
+            }
+            for (size_t t = 0; t < batch.size(); t++)
+            {
+                finishTile(*batch[t], tiles[t], false);
+            }
+        }
+    }
+
+    std::vector<TileData> renderBatch(const std::vector<std::shared_ptr<PendingTile>> &batch)
+    {
+        const float maxIter = batch.front()->maxIter;
+        auto found = palettes.find(maxIter);
+        if (found == palettes.end())
+        {
+            found = palettes.emplace(maxIter, Palette()).first;
+            makePalette(palette.c_str(), maxIter, found->second);
+        }
+        const Palette &tilePalette = found->second;
+        g_mandelMaxIter = maxIter;
+
+        // Every row of every tile in one parallelFor, as RGB rows top first
+        const size_t tileBytes = (size_t)TILE_SIZE * TILE_SIZE * 3;
+        std::vector<unsigned char> rgb(batch.size() * tileBytes);
+        std::vector<MandelView> views(batch.size());
+        for (size_t t = 0; t < batch.size(); t++)
+        {
+            views[t] = tileView(world, batch[t]->key);
+        }
+        pool.parallelFor((unsigned int)(batch.size() * TILE_SIZE), [&](unsigned int r) {
+            const unsigned int t = r / TILE_SIZE;
+            const unsigned int y = r % TILE_SIZE;
+            int bands[TILE_SIZE];
+            int iters[TILE_SIZE];
+            float fracs[TILE_SIZE];
+            MandelShortcutCounts counts;
+            unsigned int rebases = 0;
+            mandelRowCpu(views[t], NULL, y, 0, 1, TILE_SIZE, bands, iters, fracs, counts, rebases);
+            unsigned char *row = &rgb[t * tileBytes + (size_t)y * TILE_SIZE * 3];
+            for (unsigned int x = 0; x < TILE_SIZE; x++)
+            {
+                uint32_t texel = paletteColourRgba8(tilePalette, packEscape(bands[x], iters[x], fracs[x]));
+                memcpy(&row[x * 3], &texel, 3);
+            }
+        });
+
+        std::vector<TileData> tiles(batch.size());
+        pool.parallelFor((unsigned int)batch.size(), [&](unsigned int t) {
+            char *buffer = NULL;
+            size_t size = 0;
+            FILE *out = open_memstream(&buffer, &size);
+            PosterEncoder encoder;
+            if (!out || !encoder.open(out, POSTER_PNG, TILE_SIZE, TILE_SIZE))
+            {
+                return;
+            }
+            for (unsigned int y = 0; y < TILE_SIZE; y++)
+            {
+                encoder.writeRow(&rgb[t * tileBytes + (size_t)y * TILE_SIZE * 3]);
+            }
+            if (encoder.close())
+            {
+                tiles[t] = std::make_shared<const std::string>(buffer, size);
+            }
+            free(buffer);
+        });
+        return tiles;
+    }
+
+    // One connection: requests until the viewer closes it, asks to, or goes quiet
+    void serveConnection(int fd)
+    {
+        timeval timeout = {(time_t)TILE_IDLE_SECONDS, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (bTcp)
+        {
+            // Small header writes followed by the body must not wait for delayed ACKs
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        std::string buffer;
+        bool bKeepAlive = true;
+        while (bKeepAlive)
+        {
+            size_t headerEnd;
+            while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+            {
+                char chunk[4096];
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n <= 0 || buffer.size() > 65536)
+                {
+                    bKeepAlive = false;
+                    break;
+                }
+                buffer.append(chunk, (size_t)n);
+            }
+            if (!bKeepAlive)
+            {
+                break;
+            }
+            std::string header = buffer.substr(0, headerEnd);
+            buffer.erase(0, headerEnd + 4);
+            for (char &c : header)
+            {
+                c = (char)tolower((unsigned char)c);
+            }
+            char method[8] = "";
+            char target[1024] = "";
+            char version[16] = "";
+            if (sscanf(header.c_str(), "%7s %1023s %15s", method, target, version) != 3)
+            {
+                sendResponse(fd, "400 Bad Request", "text/plain", "bad request\n", 12, false);
+                break;
+            }
+            // HTTP/1.1 keeps the connection unless told otherwise, HTTP/1.0 only when asked
+            bKeepAlive = strcmp(version, "http/1.1") == 0 ? header.find("connection: close") == std::string::npos
+                                                         : header.find("connection: keep-alive") != std::string::npos;
+            char *query = strchr(target, '?');
+            if (query)
+            {
+                *query = '\0';
+            }
+            TileKey key;
+            if (strcmp(method, "get") != 0)
+            {
+                sendResponse(fd, "405 Method Not Allowed", "text/plain", "GET only\n", 9, bKeepAlive);
+            }
+            else if (strcmp(target, "/stats") == 0)
+            {
+                std::string json = statsJson();
+                sendResponse(fd, "200 OK", "application/json", json.data(), json.size(), bKeepAlive);
+            }
+            else if (!parseTilePath(target, key))
+            {
+                sendResponse(fd, "404 Not Found", "text/plain", "no such tile\n", 13, bKeepAlive);
+            }
+            else
+            {
+                TileData data = getTile(key);
+                if (data)
+                {
+                    sendResponse(fd, "200 OK", "image/png", data->data(), data->size(), bKeepAlive);
+                }
+                else
+                {
+                    sendResponse(fd, "500 Internal Server Error", "text/plain", "encoding failed\n", 16, bKeepAlive);
+                }
+            }
+        }
+        close(fd);
+        connections--;
+    }
+
+    static bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = send(fd, data, size, 0);
+            if (n <= 0)
+            {
+                return false;
+            }
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    static bool sendResponse(int fd, const char *status, const char *type, const char *body, size_t size,
+                             bool bKeepAlive)
+    {
+        // Tiles never change for a tile set, so viewers may keep them. CORS lets a map page on another port load them.
+        char header[512];
+        int length = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nCache-Control: %s\r\n"
+                              "Access-Control-Allow-Origin: *\r\nConnection: %s\r\n\r\n",
+                              status, type, size, strcmp(type, "image/png") == 0 ? "public, max-age=86400" : "no-store",
+                              bKeepAlive ? "keep-alive" : "close");
+        return sendAll(fd, header, (size_t)length) && sendAll(fd, body, size);
+    }
+
+    ThreadPool &pool;
+    TileWorld world;
+    TileDiskCache disk;
+    TileLru lru;
+    float fixedMaxIter;
+    std::string palette;
+    std::map<float, Palette> palettes; // by iteration limit, render thread only
+
+    std::mutex mutex; // everything below
+    std::condition_variable cvQueue;
+    std::unordered_map<std::string, std::shared_ptr<PendingTile>> inFlight;
+    std::deque<std::shared_ptr<PendingTile>> queue;
+    TileServerStats stats;
+    std::deque<double> latencyMs;
+    double latencyMaxMs = 0.0;
+    bool bStop = false;
+
+    std::atomic<unsigned int> connections{0};
+    int listenFd = -1;
+    bool bTcp = false;
+    std::thread renderThread;
+};
+
+#endif // TILE_SERVER_H
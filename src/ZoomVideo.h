@@ -0,0 +1,228 @@
+// Zoom videos (--zoom-video re im startWidth endWidth frames)
+// An exponential zoom about a fixed centre: frame i is startWidth * (endWidth / startWidth)^(i / (frames - 1)) wide, so
+// every frame zooms by the same factor. Consecutive frames show nearly the same part of the plane, so most frames are
+// not iterated at all. Keyframes are rendered once per octave, at widths maxWidth / 2^k and ZOOM_KEYFRAME_SCALE times
+// the output resolution, and every frame is resampled from the keyframe with the smallest width that still covers it.
+// That frame is a centred crop of between 1/2 and all of the keyframe's width, so it always has at least one keyframe
+// pixel per output pixel and is box-filtered down by a factor of 1 to 2. A video with 60 frames per octave iterates
+// the pixels of one keyframe (four frames) per 60 frames, 15 times fewer than rendering every frame.
+// Frames are written as they are made, either as a YUV4MPEG2 stream (.y4m, 4:2:0 BT.601, which ffmpeg and most
+// encoders read directly) or as numbered PPM files.
+// Needs CpuRender.h (CpuFrame, ThreadPool) included first.
+#ifndef ZOOM_VIDEO_H
+#define ZOOM_VIDEO_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const unsigned int ZOOM_KEYFRAME_SCALE = 2;
+
+// Width of frame 'i' of 'frames'
+static double zoomFrameWidth(double startWidth, double endWidth, unsigned int frames, unsigned int i)
+{
+    if (frames < 2)
+    {
+        return startWidth;
+    }
+    return startWidth * pow(endWidth / startWidth, (double)i / (frames - 1));
+}
+
+// Keyframe k is maxWidth / 2^k wide. The frame uses the deepest keyframe at least as wide as itself.
+static int zoomKeyframeIndex(double maxWidth, double width)
+{
+    return std::max((int)floor(log2(maxWidth / width) + 1e-9), 0);
+}
+
+// Source pixels covering one output pixel along one axis, with their share of it
+struct ZoomTaps
+{
+    unsigned int first = 0;
+    unsigned int count = 0;
+    float weight[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// Output pixel i of 'outSize' covers source pixels [centre + (i - outSize / 2) * scale, ... + scale) of a source
+// 'srcSize' wide, scale (1..2) source pixels per output pixel
+static std::vector<ZoomTaps> zoomAxisTaps(unsigned int outSize, unsigned int srcSize, double scale)
+{
+    std::vector<ZoomTaps> taps(outSize);
+    const double centre = srcSize / 2.0;
+    for (unsigned int i = 0; i < outSize; i++)
+    {
+        double a = centre + (i - outSize / 2.0) * scale;
+        double b = a + scale;
+        ZoomTaps &t = taps[i];
+        t.first = (unsigned int)std::max(floor(a), 0.0);
+        for (unsigned int p = t.first; p < srcSize && p < b && t.count < 3; p++)
+        {
+            double cover = std::min(b, p + 1.0) - std::max(a, (double)p);
+            t.weight[t.count++] = (float)(cover / scale);
+        }
+    }
+    return taps;
+}
+
+// Frame 'width' wide from keyframe 'key' (RGBA8, keyWidth wide, same centre), box-filtered to outW x outH texels
+static void resampleZoomFrame(const CpuFrame &key, ThreadPool &pool, double width, double keyWidth, unsigned int outW,
+                              unsigned int outH, std::vector<uint32_t> &out)
+{
+    const double scale = width / keyWidth * key.width / outW;
+    const std::vector<ZoomTaps> xTaps = zoomAxisTaps(outW, key.width, scale);
+    const std::vector<ZoomTaps> yTaps = zoomAxisTaps(outH, key.height, scale);
+    out.resize((size_t)outW * outH);
+    pool.parallelFor(outH, [&](unsigned int y) {
+        const ZoomTaps &ty = yTaps[y];
+        for (unsigned int x = 0; x < outW; x++)
+        {
+            const ZoomTaps &tx = xTaps[x];
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (unsigned int j = 0; j < ty.count; j++)
+            {
+                const uint32_t *row = &key.texels[(size_t)(ty.first + j) * key.width + tx.first];
+                for (unsigned int i = 0; i < tx.count; i++)
+                {
+                    unsigned char bytes[4];
+                    memcpy(bytes, &row[i], 4);
+                    float weight = ty.weight[j] * tx.weight[i];
+                    for (int c = 0; c < 4; c++)
+                    {
+                        sum[c] += bytes[c] * weight;
+                    }
+                }
+            }
+            unsigned char bytes[4];
+            for (int c = 0; c < 4; c++)
+            {
+                bytes[c] = (unsigned char)std::min(sum[c] + 0.5f, 255.0f);
+            }
+            memcpy(&out[(size_t)y * outW + x], bytes, 4);
+        }
+    });
+}
+
+// Writes frames of RGBA8 texels in frame layout (row 0 is the bottom row) as a .y4m stream or numbered PPM files
+class ZoomVideoWriter
+{
+public:
+    ~ZoomVideoWriter() { close(); }
+
+    // A path ending in .y4m is a stream; any other gets the frame number before its .ppm extension (added if missing)
+    bool open(const char *path, unsigned int w, unsigned int h, unsigned int fps)
+    {
+        width = w;
+        height = h;
+        std::string p = path;
+        bY4m = p.size() > 4 && p.compare(p.size() - 4, 4, ".y4m") == 0;
+        if (!bY4m)
+        {
+            framePrefix = p.size() > 4 && p.compare(p.size() - 4, 4, ".ppm") == 0 ? p.substr(0, p.size() - 4) : p;
+            return true;
+        }
+        if ((w & 1) || (h & 1))
+        {
+            printf("Error: a 4:2:0 .y4m stream needs an even frame size, not %ux%u\n", w, h);
+            return false;
+        }
+        fp = fopen(path, "wb");
+        return fp && fprintf(fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", w, h, fps) > 0;
+    }
+
+    bool writeFrame(const std::vector<uint32_t> &texels)
+    {
+        return bY4m ? writeY4mFrame(texels) : writePpmFrame(texels);
+    }
+
+    bool close()
+    {
+        bool bOk = true;
+        if (fp)
+        {
+            bOk = fclose(fp) == 0;
+            fp = NULL;
+        }
+        return bOk;
+    }
+
+private:
+    // Texel of screen row 'row' (0 = top)
+    const unsigned char *pixel(const std::vector<uint32_t> &texels, unsigned int row, unsigned int x) const
+    {
+        return (const unsigned char *)&texels[(size_t)(height - 1 - row) * width + x];
+    }
+
+    bool writePpmFrame(const std::vector<uint32_t> &texels)
+    {
+        char number[16];
+        snprintf(number, sizeof(number), "%05u", frameCount++);
+        std::string path = framePrefix + number + ".ppm";
+        FILE *out = fopen(path.c_str(), "wb");
+        if (!out)
+        {
+            return false;
+        }
+        fprintf(out, "P6\n%u %u\n255\n", width, height);
+        std::vector<unsigned char> line((size_t)width * 3);
+        for (unsigned int row = 0; row < height; row++)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                memcpy(&line[(size_t)x * 3], pixel(texels, row, x), 3);
+            }
+            fwrite(line.data(), 1, line.size(), out);
+        }
+        bool bOk = ferror(out) == 0;
+        return fclose(out) == 0 && bOk;
+    }
+
+    // Studio range BT.601: Y from every pixel, Cb and Cr from the mean of each 2x2 block
+    bool writeY4mFrame(const std::vector<uint32_t> &texels)
+    {
+        const unsigned int cw = width / 2;
+        const unsigned int ch = height / 2;
+        planes.resize((size_t)width * height + (size_t)cw * ch * 2);
+        unsigned char *Y = planes.data();
+        unsigned char *Cb = Y + (size_t)width * height;
+        unsigned char *Cr = Cb + (size_t)cw * ch;
+        for (unsigned int row = 0; row < height; row++)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                const unsigned char *c = pixel(texels, row, x);
+                Y[(size_t)row * width + x] = (unsigned char)(16.5f + (65.481f * c[0] + 128.553f * c[1] + 24.966f * c[2]) / 255.0f);
+            }
+        }
+        for (unsigned int cy = 0; cy < ch; cy++)
+        {
+            for (unsigned int cx = 0; cx < cw; cx++)
+            {
+                float rgb[3] = {0.0f, 0.0f, 0.0f};
+                for (unsigned int k = 0; k < 4; k++)
+                {
+                    const unsigned char *c = pixel(texels, cy * 2 + k / 2, cx * 2 + k % 2);
+                    for (int i = 0; i < 3; i++)
+                    {
+                        rgb[i] += c[i] / (4.0f * 255.0f);
+                    }
+                }
+                Cb[(size_t)cy * cw + cx] = (unsigned char)(128.5f - 37.797f * rgb[0] - 74.203f * rgb[1] + 112.0f * rgb[2]);
+                Cr[(size_t)cy * cw + cx] = (unsigned char)(128.5f + 112.0f * rgb[0] - 93.786f * rgb[1] - 18.214f * rgb[2]);
+            }
+        }
+        return fwrite("FRAME\n", 6, 1, fp) == 1 && fwrite(planes.data(), planes.size(), 1, fp) == 1;
+    }
+
+    unsigned int width = 0;
+    unsigned int height = 0;
+    bool bY4m = false;
+    FILE *fp = NULL;
+    std::string framePrefix;
+    unsigned int frameCount = 0;
+    std::vector<unsigned char> planes;
+};
+
+#endif // ZOOM_VIDEO_H
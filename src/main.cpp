@@ -32,8 +32,25 @@
 #include <string>
 #include <sys/time.h>
 #include <fstream>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "CpuRender.h"
+#include "IterationCache.h"
+#include "RenderPipeline.h"
+#include "AdaptiveIter.h"
+#include "ProgramCache.h"
+#include "DeviceBalance.h"
+#include "Benchmark.h"
+#include "RenderStats.h"
+#include "Poster.h"
+#include "ZoomVideo.h"
+#include "Antialias.h"
+#include "Precision.h"
+#include "IterationField.h"
+#include "TileServer.h"
+#include "DynamicResolution.h"
 
-#define MAX_KERNEL_SIZE (0x100000)
 
 // Window dimensions
 const int WINDOW_WIDTH = 1024;
@@ -52,7 +69,88 @@ static bool IsCLExtensionSupported(const char *extension);
 static void exitOnFail(const char *const msg, cl_int sts);
 static bool getOpenClContext();
 static bool buildProgramCreateKernel();
+static std::string kernelBuildOptions();
+static cl_program buildProgram(cl_context context, cl_device_id device, const std::string &source,
+                               const std::string &options);
+static std::string clDeviceString(cl_device_id device, cl_device_info param);
+static void listClDevices(std::vector<cl_device_id> &all);
+static void initClHelpers(const std::string &source, const std::string &options);
+static void createFractalKernels(cl_program program);
+static void releaseFractalKernels();
+static void selectFractalFamily(int family);
+static void nextFractalFamily();
+static void enqueueRowBand(cl_command_queue queue, cl_kernel k, cl_mem field, const DeviceShare &share, cl_event *event);
+static double profiledMs(cl_event first, cl_event last);
+static bool UpdateMultiDeviceKernelArgsRewriteImage(const struct timeval &tvalBefore);
+static void trackKernelEvent(cl_event event);
+static double collectKernelMs();
+static void recordSharedImageStages(cl_event event[3]);
+static void updateHeatmap();
+static void writeStatsFile(bool bForce);
+static void setViewBounds(double viewMinX, double viewMaxX, double viewMinY);
+static bool setViewCentre(const char *re, const char *im, double width);
+static int runBenchmark();
+static const char *clerror(cl_int const status);
 static bool UpdateKernelArgsRewriteImage();
+static bool UpdatePerturbKernelArgsRewriteImage(const struct timeval &tvalBefore);
+static bool UpdateSubdivideKernelArgsRewriteImage(const struct timeval &tvalBefore);
+static void printSubdivisionStats(const SubdivisionStats &stats);
+static bool UpdateCachedKernelArgsRewriteImage(const struct timeval &tvalBefore);
+static bool UpdateFloatKernelArgsRewriteImage(const struct timeval &tvalBefore);
+static void enqueueProgressiveRows(const ProgressivePass &pass, size_t rowBegin, size_t rowEnd, size_t columns);
+static void updatePrecisionTier();
+static void colourizeToTexture(cl_int cellW, cl_int cellH);
+static bool lookupIterationCache();
+static void storeIterationCache(const std::vector<int> &packed);
+static void snapViewToCacheGrid();
+static bool UpdateCpuFrameRewriteImage();
+static bool RenderFrame();
+static bool isProgressiveFrame();
+static void beginProgressiveFrame();
+static bool stepProgressiveFrame();
+static void startRenderPipeline();
+static void stopRenderPipeline();
+static bool renderStep(bool bBlock);
+static void publishFrame();
+static bool presentLatestFrame();
+static bool recolourFrame();
+static void nextPalette();
+static void uploadPalette();
+static void setPaletteKernelArgs(cl_kernel k, cl_uint firstArg);
+static void updateHistogram();
+static void antialiasFrame();
+static void colourAntialiased();
+static MaxIterChoice nextMaxIter();
+static bool updateMaxIter();
+static void setFrameMaxIter(float maxIter);
+static bool initIterDisplay();
+static void uploadDisplayPalette(const Palette &palette);
+static void printShortcutCounts(unsigned int cardioid, unsigned int bulb, unsigned int periodic);
+static bool parseCommandLine(int argc, char *args[]);
+static void zoomAtPixel(double dx, double dy, double scale);
+static bool isDeepZoom();
+static MandelView currentMandelView();
+static MandelView mandelViewAtLevel(int level);
+static void setFrameLevel(int level);
+static void prepareCpuFrame();
+static int chooseFrameLevel();
+static double restRefineWaitMs();
+static unsigned int fillKnownFromCoarseFrame(std::vector<int> &known);
+static void allocateSlotTexture(struct FrameSlot &slot, unsigned int w, unsigned int h);
+static void updatePerturbFrame();
+static int runHeadless();
+static void renderHeadlessFrame();
+static int runPerturbCheck();
+static int runPoster();
+static int runZoomVideo();
+static int runTileServer();
+static int runRecolour();
+static bool loadIterationField(const char *path);
+static bool makeFieldHeader(IterationFieldHeader &header, unsigned int w, unsigned int h, const MandelView &view,
+                            BigFixed minRe, BigFixed minIm, uint32_t precision);
+static bool saveFrameField(const char *path);
+static unsigned int fillKnownFromField(std::vector<int> &known);
+static void renderZoomKeyframe(double keyWidth, CpuFrame &key, PerturbFrame &deep);
 
 static const unsigned int FRACTAL_IMAGE_WIDTH = 1024;
 static const unsigned int FRACTAL_IMAGE_HEIGHT = 1024;
@@ -70,7 +168,7 @@ double midY = (maxY + minY) / 2.0f;
 double dblXrange = 0.0f - minX + maxX;
 double dblYrange = 0.0f - minY + maxY;
 bool bZoomIn = false;
-unsigned long long lZoomFactor = 1;
+double dblZoomFactor = 1;
 int mouseX;
 int mouseY;
 
@@ -80,10 +178,253 @@ cl_device_id devices[1];
 cl_command_queue commands;
 cl_kernel kernel;
 cl_mem writeToImage;
+cl_mem shortcutCountsBuffer; // [0] cardioid, [1] period-2 bulb, [2] periodic orbit pixels skipped by the kernel
 GLuint RenderFromTexture;
+GLfloat RenderTexCoordS = 1.0f; // extent of the frame in RenderFromTexture, which may be allocated larger
+GLfloat RenderTexCoordT = 1.0f;
 cl_platform_id platform;
 cl_int status;
 
+// CPU render engine (selected with --cpu, or --headless for machines without a display)
+bool bUseCpuEngine = false;
+bool bHeadless = false;
+unsigned int cpuThreads = 0; // 0 = one per hardware thread
+SimdLevel cpuSimdLevel = detectSimdLevel();
+
+// Deep zoom: the view origin is also kept in arbitrary precision, and frames switch to perturbation rendering against
+// a high precision reference orbit once the view is too small for doubles (or always with --perturb)
+static const double PERTURB_RANGE_THRESHOLD = 1e-10;
+BigFixed deepMinX;
+BigFixed deepMinY;
+bool bForcePerturb = false;
+PerturbFrame perturbFrame;
+// --check-perturb: render the view plainly and with perturbation, and fail when more than PERTURB_CHECK_MAX_FRACTION
+// of the pixels differ by more than PERTURB_CHECK_ITER_SLACK iterations
+static const double PERTURB_CHECK_MAX_FRACTION = 0.02;
+static const int PERTURB_CHECK_ITER_SLACK = 1;
+bool bCheckPerturb = false;
+cl_kernel kernelPerturb;
+cl_mem refOrbitBuffer = NULL; // reference orbit as double2, grown when a longer orbit is needed
+size_t refOrbitBufferSize = 0;
+cl_mem rebaseCountBuffer;
+
+// Precision tiers (see Precision.h): each GPU frame is iterated in float, double-single or double, chosen from the zoom
+// unless --precision fixes it. Without double precision on the device only the float kernels are built.
+bool bDeviceFp64 = true;
+bool bPrecisionFixed = false;
+PrecisionTier precisionOverride = PRECISION_DOUBLE;
+PrecisionTier frameTier = PRECISION_DOUBLE;
+
+// Fractal families (see Fractal.h), picked with --fractal and cycled with F. Each family is its own build of Mandel.cl,
+// made the first time it is shown and kept for the next.
+bool bJuliaOverride = false; // --julia replaces the families' own Julia constants
+double juliaOverrideRe = 0.0;
+double juliaOverrideIm = 0.0;
+std::string kernelSource;
+cl_program fractalPrograms[FRACTAL_FAMILY_COUNT] = {};
+
+// Mariani-Silver subdivision (--subdivide): uniform rectangles are filled from their border instead of iterated
+bool bSubdivide = false;
+cl_kernel kernelGridLines;
+cl_kernel kernelSubdivide;
+cl_kernel kernelColourize;
+cl_kernel kernelFillMissing;
+cl_kernel kernelProgressive;
+cl_kernel kernelProgressiveFloat;
+cl_mem pixelIterBuffer;     // packed escape result per pixel (see packEscape())
+cl_mem rectQueueBuffers[2]; // rectangles of the current and the next pass
+cl_mem rectCountBuffer;
+cl_mem subdivStatsBuffer;   // [0] filled, [1] iterated, [2] queue overflows
+static const size_t SUBDIV_GROUP_SIZE = 64;
+
+// Built programs are kept in an on-disk cache (see ProgramCache.h) under --cl-cache dir; --no-cl-cache always compiles
+bool bProgramCache = true;
+std::string programCacheDir = defaultProgramCacheDir();
+
+// Multi-device rendering (--devices): other OpenCL devices, on any platform, iterate bands of rows of every frame
+// alongside the display device, which colours the frame (see DeviceBalance.h). Each has its own context, since
+// devices on different platforms cannot share one.
+struct ClHelper
+{
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_kernel kernel; // mandelProgressive, with steps of one pixel
+    cl_mem pixelIter;
+};
+const char *deviceSelection = NULL; // "all" or a comma separated list of indices into the device list printed at startup
+std::vector<cl_device_id> clAllDevices; // every device of every platform, in the order listed at startup
+std::vector<ClHelper> clHelpers;
+std::vector<DeviceShare> deviceShares; // [0] the display device, then one per helper
+
+// Benchmark suite (--benchmark, see Benchmark.h): the kernels of each frame are timed with the profiling counters of
+// their events, which are kept until the frame is done
+bool bBenchmark = false;
+unsigned int benchRuns = 5;
+const char *benchOutPath = "benchmark.json";
+std::vector<cl_event> kernelEvents;
+
+// Render instrumentation (see RenderStats.h): stage timers, the iteration heatmap of the last complete frame (--heatmap
+// base writes base.pgm and base.csv) and the stats file rewritten every statsIntervalMs (--stats-file)
+RenderStageStats renderStages;
+IterationHeatmap frameHeatmap;
+std::vector<int> heatmapField; // the GPU engine's field, read back for the heatmap
+const char *heatmapPath = NULL;
+const char *statsPath = NULL;
+double statsIntervalMs = 5000.0;
+double statsWrittenMs = 0.0;
+double statsStartMs = pipelineNowMs();
+
+// Iteration cache: results of earlier frames are reused after 2x zooms (see IterationCache.h). --cache-mb 0 disables it.
+size_t iterCacheBudgetMB = 256;
+IterationCache *iterCache = NULL;
+CacheGrid cacheGrid;
+std::vector<int> cacheKnown; // packed results found in the cache for the current frame, -1 where unknown
+
+// Progressive rendering in the window (see Progressive.h); --no-progressive renders every frame in one go
+bool bProgressive = true;
+ProgressiveState progressive;
+struct timeval progressiveStart;
+bool bProgressiveCached = false; // the frame was seeded from the iteration cache
+
+// Colouring (see Palette.h): both engines keep the packed iteration field of the last frame, so the palette can be
+// switched ('P') with a colouring pass only
+const char *paletteName = "bands";
+cl_mem paletteBuffer = NULL; // palette lookup table as float4, grown when a larger table is needed
+size_t paletteBufferSize = 0;
+
+// Iteration histogram of the last complete frame (see Histogram.h), which the 'equalized' palette is rebuilt from
+IterHistogram frameHistogram;
+// Iteration limit of the frame (see AdaptiveIter.h), chosen before each frame unless --max-iter fixes it
+float frameMaxIter = 0.0f;
+float maxIterOverride = 0.0f;
+static const int HEADLESS_MAX_ITER_PASSES = 4; // renders of a headless frame at most, each with a higher limit
+cl_kernel kernelHistogram;
+cl_mem histogramBuffer;
+cl_mem histogramStatsBuffer; // [0] interior pixels, [1] lowest and [2] highest escape iteration
+static const size_t HISTOGRAM_GROUPS = 64;
+static const size_t HISTOGRAM_GROUP_SIZE = 256;
+
+// Adaptive anti-aliasing of complete frames (see Antialias.h): at most aaBudget pixels, the strongest edges first, get
+// AA_SAMPLES jittered samples each. --aa-budget 0 disables it.
+unsigned int aaBudget = AA_DEFAULT_BUDGET;
+AntialiasStats aaStats; // of the frame on screen; refined is 0 until it has been anti-aliased
+AntialiasFrame aaFrame; // CPU engine: the refined pixels and their samples
+cl_kernel kernelAAMark;
+cl_kernel kernelAASelect;
+cl_kernel kernelAARefine;
+cl_kernel kernelAAColour;
+cl_mem aaLevelBuffer;  // contrast level per pixel
+cl_mem aaCountBuffer;  // pixels per contrast level
+cl_mem aaListedBuffer; // candidates found by 'mandelAASelect'
+cl_mem aaPixelBuffer;  // refined pixels, aaBudget at most
+cl_mem aaSampleBuffer; // AA_SAMPLES packed results per refined pixel
+static const size_t AA_GROUP_SIZE = 64;
+
+// Render pipeline (see RenderPipeline.h): frames are rendered on their own thread into one of PIPELINE_SLOTS textures
+// while the event loop shows the latest finished one. --sync-render renders in the event loop instead.
+struct FrameSlot
+{
+    GLuint texture;
+    unsigned int texWidth = 0; // size the texture is allocated at, never less than the frames it has shown
+    unsigned int texHeight = 0;
+    unsigned int width = FRACTAL_IMAGE_WIDTH; // size of the frame in the slot
+    unsigned int height = FRACTAL_IMAGE_HEIGHT;
+    cl_mem image;                 // the texture as an OpenCL image (GPU engine)
+    std::vector<float> rgba;      // framebuffer handed over by the CPU engine, uploaded when the slot is shown
+    std::vector<uint32_t> texels; // the same for the 32-bit formats
+    Palette palette;              // FRAME_ITER: palette the frame is drawn with
+};
+bool bRenderThread = true;
+RenderPipeline pipeline;
+FrameSlot frameSlots[PIPELINE_SLOTS];
+std::thread *renderThread = NULL;
+FrameInfo renderInfo; // request answered by the frame being rendered
+Uint32 frameReadyEvent = (Uint32)-1;
+
+// Dynamic resolution (see DynamicResolution.h): the frame being rendered is FRACTAL_IMAGE_WIDTH x FRACTAL_IMAGE_HEIGHT
+// scaled by 2^frameLevel. Only the CPU engine renders at other levels; the OpenCL buffers and images stay at level 0.
+int frameLevel = 0;
+unsigned int frameWidth = FRACTAL_IMAGE_WIDTH;
+unsigned int frameHeight = FRACTAL_IMAGE_HEIGHT;
+ResolutionController resolution;
+double frameBudgetMs = 0.0; // --frame-budget; 0 renders every frame at full resolution
+int restLevel = 0;          // level a view is brought to once input stops (--rest-scale 2 = level 1)
+bool bRestPending = false;  // the last complete frame is below restLevel
+bool bRefining = false;     // the frame in hand is the rest frame, shown only once complete
+double lastInputMs = 0.0;   // when the last request that needed a new frame was posted
+double frameStartMs = 0.0;
+int coarseLevel = 0;        // level and limit of the last complete frame, whose pixels the rest frame reuses
+float coarseMaxIter = 0.0f;
+
+// Format of the frame textures and CPU framebuffers (see FrameFormat in CpuRender.h), selected with --format. RGBA8
+// and the iteration texture take a quarter of the memory and bandwidth of RGBA32F.
+FrameFormat frameFormat = FRAME_RGBA8;
+
+// Display of FRAME_ITER frames: a fragment shader colours the packed escape results through the palette, which is kept
+// in a texture with PALETTE_TEXTURE_WIDTH entries per row. Entry points past GL 1.1 are looked up through SDL, as the
+// system GL headers do not declare them everywhere.
+static const unsigned int PALETTE_TEXTURE_WIDTH = 256;
+struct IterDisplay
+{
+    PFNGLCREATESHADERPROC CreateShader;
+    PFNGLSHADERSOURCEPROC ShaderSource;
+    PFNGLCOMPILESHADERPROC CompileShader;
+    PFNGLGETSHADERIVPROC GetShaderiv;
+    PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+    PFNGLCREATEPROGRAMPROC CreateProgram;
+    PFNGLATTACHSHADERPROC AttachShader;
+    PFNGLLINKPROGRAMPROC LinkProgram;
+    PFNGLGETPROGRAMIVPROC GetProgramiv;
+    PFNGLUSEPROGRAMPROC UseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+    PFNGLUNIFORM1IPROC Uniform1i;
+    PFNGLUNIFORM1FPROC Uniform1f;
+    PFNGLACTIVETEXTUREPROC ActiveTexture;
+
+    GLuint program = 0;
+    GLuint paletteTexture = 0;
+    unsigned int paletteSerial = 0; // Palette::serial of the palette in paletteTexture
+    GLint paletteSizeLocation = -1;
+    GLint paletteDensityLocation = -1;
+};
+IterDisplay iterDisplay;
+
+// Interior short-circuits (cardioid / bulb test and periodicity checking) in both engines, disabled with --no-shortcuts
+bool bShortcuts = true;
+const char *headlessOutPath = "mandel.ppm";
+unsigned int posterWidth = 0; // --poster: render this size strip by strip instead of one frame (see Poster.h)
+unsigned int posterHeight = 0;
+// --zoom-video: an exponential zoom about (videoRe, videoIm) from videoStartWidth to videoEndWidth (see ZoomVideo.h)
+const char *videoRe = NULL;
+const char *videoIm = NULL;
+double videoStartWidth = 0.0;
+double videoEndWidth = 0.0;
+unsigned int videoFrames = 0;
+unsigned int videoWidth = FRACTAL_IMAGE_WIDTH;
+unsigned int videoHeight = FRACTAL_IMAGE_HEIGHT;
+unsigned int videoFps = 30;
+// --serve / --serve-socket: answer z/x/y tile requests on localhost instead of opening a window (see TileServer.h)
+unsigned int tileServerPort = 0;
+const char *tileServerSocket = NULL;
+std::string tileCacheDir = defaultCacheDir("mandel-tiles");
+bool bTileDiskCache = true;
+size_t tileCacheMB = 256;
+// Saved iteration fields (see IterationField.h): --load-field shows one again, --recolour colours or crops one, and
+// the S key saves the current frame's to fieldSavePath. The corner of the loaded field is kept in arbitrary precision.
+IterationFieldFile loadedField;
+BigFixed loadedFieldMinRe;
+BigFixed loadedFieldMinIm;
+const char *fieldSavePath = "mandel.mif";
+const char *recolourPath = NULL;
+unsigned int cropX = 0;
+unsigned int cropY = 0;
+unsigned int cropWidth = 0; // 0: the whole field
+unsigned int cropHeight = 0;
+bool bSaveFieldPending = false;
+ThreadPool *cpuPool = NULL;
+CpuFrame cpuFrame;
+
 #ifdef main
 #undef main
 #endif /* main */
@@ -102,6 +443,69 @@ int main(int argc, char *args[])
     double dx = 7.0f;
     double dy = 88.5f;
 
+    deepMinX = BigFixed(minX, bigFixedLimbsFor(dblXrange / FRACTAL_IMAGE_WIDTH));
+    deepMinY = BigFixed(minY, deepMinX.fracLimbs());
+    if (!parseCommandLine(argc, args))
+    {
+        return 1;
+    }
+    g_bMandelShortcuts = bShortcuts;
+    updateMaxIter();
+    if (!makePalette(paletteName, frameMaxIter, g_mandelPalette))
+    {
+        printf("Unknown palette '%s'\n", paletteName);
+        return 1;
+    }
+    if (bUseCpuEngine)
+    {
+        initCpuRender(cpuSimdLevel);
+        cpuPool = new ThreadPool(cpuThreads);
+        printf("CPU render engine using %u thread(s)\n", cpuPool->threadCount());
+    }
+    else if (frameBudgetMs > 0.0 || restLevel != 0)
+    {
+        // The OpenCL buffers and the images shared with GL are sized for full resolution frames
+        printf("--frame-budget and --rest-scale need the CPU engine (--cpu); frames stay at full resolution\n");
+        frameBudgetMs = 0.0;
+        restLevel = 0;
+    }
+    if (restLevel > 0 && frameFormat == FRAME_ITER)
+    {
+        // Integer textures are not filtered, so the display would only show every other pixel
+        printf("--rest-scale %d needs --format rgba8 or rgba32f\n", 1 << restLevel);
+        restLevel = 0;
+    }
+    if (iterCacheBudgetMB > 0 && !bHeadless && !bBenchmark)
+    {
+        MandelView view = currentMandelView();
+        iterCache = new IterationCache(iterCacheBudgetMB << 20);
+        iterCache->setAnchor(view.minX, view.MaxIm, view.Re_factor, view.Im_factor);
+    }
+    if (bHeadless)
+    {
+        if (bBenchmark)
+        {
+            return runBenchmark();
+        }
+        if (bCheckPerturb)
+        {
+            return runPerturbCheck();
+        }
+        if (videoFrames > 0)
+        {
+            return runZoomVideo();
+        }
+        if (tileServerPort > 0 || tileServerSocket)
+        {
+            return runTileServer();
+        }
+        if (recolourPath)
+        {
+            return runRecolour();
+        }
+        return posterWidth > 0 ? runPoster() : runHeadless();
+    }
+
     /* From khronos: "An OpenCL memory object must be created after the corresponding OpenGL VBO has been created,
     but before the OpenGL rendering starts". 
       This is the crux of how SDL/OpenGL and OpenGL communicate. It requires some careful thought and understanding */
@@ -113,17 +517,33 @@ int main(int argc, char *args[])
     }
     else
     {
+        if (bBenchmark)
+        {
+            int result = runBenchmark();
+            close();
+            return result;
+        }
         //Main loop flag
         bool quit = false;
-        UpdateKernelArgsRewriteImage();
-        renderGLQuad();
-        //Update screen
-        SDL_GL_SwapWindow(glWindow);
-        ;
+        startRenderPipeline();
         SDL_Event e;
 
         while (!quit)
         {
+            // Sleep until there is input or a finished frame. When rendering in the event loop (--sync-render), only
+            // while there is nothing left to render, and no longer than until a rest frame is due.
+            if (bRenderThread || (!progressive.bActive && !pipeline.hasPendingRequests()))
+            {
+                double waitMs = bRenderThread ? -1.0 : restRefineWaitMs();
+                if (waitMs < 0.0)
+                {
+                    SDL_WaitEvent(NULL);
+                }
+                else if (waitMs > 0.0)
+                {
+                    SDL_WaitEventTimeout(NULL, (int)ceil(waitMs));
+                }
+            }
             //Handle events on queue
             while (SDL_PollEvent(&e) != 0)
             {
@@ -141,6 +561,18 @@ int main(int argc, char *args[])
                     close();
                     exit(0);
                 }
+                else if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_P)
+                {
+                    pipeline.post(VIEW_REQUEST_PALETTE);
+                }
+                else if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_F)
+                {
+                    pipeline.post(VIEW_REQUEST_FRACTAL);
+                }
+                else if (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_S)
+                {
+                    pipeline.post(VIEW_REQUEST_SAVE_FIELD);
+                }
                 else if (e.type == SDL_MOUSEBUTTONDOWN)
                 {
                     switch (e.button.button)
@@ -152,26 +584,7 @@ int main(int argc, char *args[])
                         dy = (double)e.button.y;
                         printf("Left Mouse clicked; x = %i pixels. ", (int)dx);
                         printf("y = %i pixels\n", (int)dy);
-                        midX = minX + dx / FRACTAL_IMAGE_WIDTH * dblXrange;
-                        midY = minY + dy / FRACTAL_IMAGE_HEIGHT * dblYrange;
-                        dblXrange = dblXrange / 2;
-                        dblYrange = dblYrange / 2;
-                        minX = midX - (dblXrange / 2);
-                        minY = midY - (dblYrange / 2);
-                        maxX = minX + dblXrange;
-                        maxY = minY + dblYrange;
-                        midX = (maxX + minX) / 2;
-                        midY = (maxY + minY) / 2;
-                        dblXrange = 0 - minX + maxX;
-                        dblYrange = 0 - minY + maxY;
-                        bZoomIn = true;
-                        lZoomFactor *= 2;
-                        printf("Zoom factor= %llu \n", lZoomFactor);
-                        UpdateKernelArgsRewriteImage();
-                        renderGLQuad();
-                        //Update screen
-                        SDL_GL_SwapWindow(glWindow);
-                        ;
+                        pipeline.post(VIEW_REQUEST_ZOOM, dx, dy, 2.0);
                         break;
                     }
                     case SDL_BUTTON_RIGHT:
@@ -181,32 +594,17 @@ int main(int argc, char *args[])
                         dy = (double)e.button.y;
                         printf("Right Mouse clicked; x = %i pixels. ", (int)dx);
                         printf("y = %i pixels\n", (int)dy);
-                        midX = minX + dx / FRACTAL_IMAGE_WIDTH * dblXrange;
-                        midY = minY + dy / FRACTAL_IMAGE_HEIGHT * dblYrange;
-                        dblXrange = dblXrange / 0.5;
-                        dblYrange = dblYrange / 0.5;
-                        minX = midX - (dblXrange / 2);
-                        minY = midY - (dblYrange / 2);
-                        maxX = minX + dblXrange;
-                        maxY = minY + dblYrange;
-                        midX = (maxX + minX) / 2;
-                        midY = (maxY + minY) / 2;
-                        dblXrange = 0 - minX + maxX;
-                        dblYrange = 0 - minY + maxY;
-                        bZoomIn = true;
-                        lZoomFactor *= 0.5;
-                        printf("Zoom factor= %llu \n", lZoomFactor);
-                        UpdateKernelArgsRewriteImage();
-                        renderGLQuad();
-
-                        //Update screen
-                        SDL_GL_SwapWindow(glWindow);
-                        ;
+                        pipeline.post(VIEW_REQUEST_ZOOM, dx, dy, 0.5);
                         break;
                     }
                     }
                 }
             }
+            if (!bRenderThread)
+            {
+                renderStep(false);
+            }
+            presentLatestFrame();
         }
     }
 
@@ -250,12 +648,13 @@ bool init()
             else
             {
                 gContext = SDL_GL_GetCurrentContext();
-                if (!getOpenClContext())
+                // The CPU engine uploads its framebuffer with glTexSubImage2D and needs no OpenCL context
+                if (!bUseCpuEngine && !getOpenClContext())
                 {
                     printf("Error: Initialisation function getOpenClContext failed\n");
                     success = false;
                 }
-                if (!buildProgramCreateKernel())
+                if (!bUseCpuEngine && !buildProgramCreateKernel())
                 {
                     printf("Error: Initialisation function buildProgramCreateKernel failed\n");
                     success = false;
@@ -277,17 +676,46 @@ bool initOpenGL()
     bool success = true;
     GLenum error = GL_NO_ERROR;
 
-    glGenTextures(1, &RenderFromTexture);
-    glBindTexture(GL_TEXTURE_2D, RenderFromTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    // One texture per render pipeline slot
+    for (unsigned int i = 0; i < PIPELINE_SLOTS; i++)
+    {
+        FrameSlot &slot = frameSlots[i];
+        glGenTextures(1, &slot.texture);
+        allocateSlotTexture(slot, FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT);
+        // Integer textures cannot be filtered
+        GLint filter = frameFormat == FRAME_ITER ? GL_NEAREST : GL_LINEAR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 
-    // Create OpenCL memobject from gl texture
-    writeToImage = clCreateFromGLTexture(g_clContext, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, RenderFromTexture, &status);
-    // writeToImage = clCreateFromGLTexture(g_clContext, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, RenderFromTexture, &status );
+        // Create OpenCL memobject from gl texture
+        if (!bUseCpuEngine)
+        {
+            slot.image = clCreateFromGLTexture(g_clContext, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, slot.texture, &status);
+        }
+        else
+        {
+            // Swapped with the CPU framebuffer on publish. Allocated at full size up front; a rest frame above full
+            // resolution (--rest-scale) grows the buffers it passes through once, and they keep that capacity.
+            if (frameFormat == FRAME_RGBA32F)
+            {
+                slot.rgba.assign((size_t)FRACTAL_IMAGE_SIZE * 4, 0.0f);
+            }
+            else
+            {
+                slot.texels.assign(FRACTAL_IMAGE_SIZE, 0);
+            }
+        }
+    }
+    RenderFromTexture = frameSlots[0].texture;
+    writeToImage = frameSlots[pipeline.backSlot()].image;
+    printf("Frame format %s: %.1f MB per frame, %u frames\n", FRAME_FORMAT_NAMES[frameFormat],
+           FRACTAL_IMAGE_SIZE * frameFormatBytes(frameFormat) / 1048576.0, PIPELINE_SLOTS);
+    if (frameFormat == FRAME_ITER && !initIterDisplay())
+    {
+        success = false;
+    }
 
     //Initialize Projection Matrix
     glMatrixMode(GL_PROJECTION);
@@ -326,6 +754,25 @@ bool initOpenGL()
 
     return success;
 }
+static void allocateSlotTexture(FrameSlot &slot, unsigned int w, unsigned int h)
+{
+    // (Re)allocate the slot's texture at w x h; frames up to that size are uploaded into its bottom left corner
+    glBindTexture(GL_TEXTURE_2D, slot.texture);
+    switch (frameFormat)
+    {
+    case FRAME_RGBA32F:
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
+        break;
+    case FRAME_RGBA8:
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        break;
+    case FRAME_ITER:
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, w, h, 0, GL_RED_INTEGER, GL_INT, nullptr);
+        break;
+    }
+    slot.texWidth = w;
+    slot.texHeight = h;
+}
 void renderGLQuad()
 {
     glClear(GL_COLOR_BUFFER_BIT);
@@ -343,22 +790,142 @@ void renderGLQuad()
         glEnable(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, RenderFromTexture);
         glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+        if (frameFormat == FRAME_ITER)
+        {
+            iterDisplay.UseProgram(iterDisplay.program);
+        }
 
         glBegin(GL_QUADS);
         glTexCoord2f(0., 0.);
         glVertex2f(0., 0.);
-        glTexCoord2f(1., 0.);
+        glTexCoord2f(RenderTexCoordS, 0.);
         glVertex2f(1., 0.);
-        glTexCoord2f(1., 1.);
+        glTexCoord2f(RenderTexCoordS, RenderTexCoordT);
         glVertex2f(1., 1.);
-        glTexCoord2f(0., 1.);
+        glTexCoord2f(0., RenderTexCoordT);
         glVertex2f(0., 1.);
         glEnd();
+        if (frameFormat == FRAME_ITER)
+        {
+            iterDisplay.UseProgram(0);
+        }
         glDisable(GL_TEXTURE_2D);
     }
 }
+static bool initIterDisplay()
+{
+    static const char *const source =
+        "#version 130\n"
+        "uniform isampler2D iterField;\n"
+        "uniform sampler2D palette;\n"
+        "uniform int paletteSize;\n"
+        "uniform float paletteDensity;\n"
+        "vec4 entry(int i) { return texelFetch(palette, ivec2(i % 256, i / 256), 0); }\n"
+        "void main()\n"
+        "{\n"
+        "    ivec2 size = textureSize(iterField, 0);\n"
+        "    ivec2 p = clamp(ivec2(gl_TexCoord[0].st * vec2(size)), ivec2(0), size - 1);\n"
+        "    int v = texelFetch(iterField, p, 0).r;\n"
+        "    int iter = v >> 11;\n"
+        "    if (((v >> 8) & 7) == 0 || paletteSize == 0)\n"
+        "    {\n"
+        "        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"
+        "    }\n"
+        "    else if (paletteDensity <= 0.0)\n"
+        "    {\n"
+        "        gl_FragColor = entry(min(iter, paletteSize - 1));\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        float t = (float(iter) + float(v & 255) / 256.0) * paletteDensity;\n"
+        "        float ft = floor(t);\n"
+        "        int i0 = int(uint(ft) % uint(paletteSize));\n"
+        "        gl_FragColor = mix(entry(i0), entry((i0 + 1) % paletteSize), t - ft);\n"
+        "    }\n"
+        "}\n";
+    // The shader decodes packEscape() and reads PALETTE_TEXTURE_WIDTH entries per row
+    static_assert(MANDEL_FRAC_BITS == 8 && PALETTE_TEXTURE_WIDTH == 256, "update the display shader");
+
+    IterDisplay &d = iterDisplay;
+    d.CreateShader = (PFNGLCREATESHADERPROC)SDL_GL_GetProcAddress("glCreateShader");
+    d.ShaderSource = (PFNGLSHADERSOURCEPROC)SDL_GL_GetProcAddress("glShaderSource");
+    d.CompileShader = (PFNGLCOMPILESHADERPROC)SDL_GL_GetProcAddress("glCompileShader");
+    d.GetShaderiv = (PFNGLGETSHADERIVPROC)SDL_GL_GetProcAddress("glGetShaderiv");
+    d.GetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)SDL_GL_GetProcAddress("glGetShaderInfoLog");
+    d.CreateProgram = (PFNGLCREATEPROGRAMPROC)SDL_GL_GetProcAddress("glCreateProgram");
+    d.AttachShader = (PFNGLATTACHSHADERPROC)SDL_GL_GetProcAddress("glAttachShader");
+    d.LinkProgram = (PFNGLLINKPROGRAMPROC)SDL_GL_GetProcAddress("glLinkProgram");
+    d.GetProgramiv = (PFNGLGETPROGRAMIVPROC)SDL_GL_GetProcAddress("glGetProgramiv");
+    d.UseProgram = (PFNGLUSEPROGRAMPROC)SDL_GL_GetProcAddress("glUseProgram");
+    d.GetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)SDL_GL_GetProcAddress("glGetUniformLocation");
+    d.Uniform1i = (PFNGLUNIFORM1IPROC)SDL_GL_GetProcAddress("glUniform1i");
+    d.Uniform1f = (PFNGLUNIFORM1FPROC)SDL_GL_GetProcAddress("glUniform1f");
+    d.ActiveTexture = (PFNGLACTIVETEXTUREPROC)SDL_GL_GetProcAddress("glActiveTexture");
+    if (!d.CreateShader || !d.ShaderSource || !d.CompileShader || !d.GetShaderiv || !d.GetShaderInfoLog ||
+        !d.CreateProgram || !d.AttachShader || !d.LinkProgram || !d.GetProgramiv || !d.UseProgram ||
+        !d.GetUniformLocation || !d.Uniform1i || !d.Uniform1f || !d.ActiveTexture)
+    {
+        printf("Error: --format iter needs GLSL 1.30 (OpenGL 3.0)\n");
+        return false;
+    }
+
+    GLint ok = GL_FALSE;
+    char log[1024];
+    GLuint shader = d.CreateShader(GL_FRAGMENT_SHADER);
+    d.ShaderSource(shader, 1, &source, NULL);
+    d.CompileShader(shader);
+    d.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        d.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("Error: display shader failed to compile: %s\n", log);
+        return false;
+    }
+    d.program = d.CreateProgram();
+    d.AttachShader(d.program, shader);
+    d.LinkProgram(d.program);
+    d.GetProgramiv(d.program, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        printf("Error: display shader failed to link\n");
+        return false;
+    }
+    d.paletteSizeLocation = d.GetUniformLocation(d.program, "paletteSize");
+    d.paletteDensityLocation = d.GetUniformLocation(d.program, "paletteDensity");
+    d.UseProgram(d.program);
+    d.Uniform1i(d.GetUniformLocation(d.program, "iterField"), 0);
+    d.Uniform1i(d.GetUniformLocation(d.program, "palette"), 1);
+    d.UseProgram(0);
+
+    glGenTextures(1, &d.paletteTexture);
+    uploadDisplayPalette(g_mandelPalette);
+    return true;
+}
+// Put 'palette' in the display shader's palette texture (texture unit 1)
+static void uploadDisplayPalette(const Palette &palette)
+{
+    IterDisplay &d = iterDisplay;
+    const unsigned int rows = (palette.size() + PALETTE_TEXTURE_WIDTH - 1) / PALETTE_TEXTURE_WIDTH;
+    std::vector<float> entries((size_t)std::max(rows, 1u) * PALETTE_TEXTURE_WIDTH * 4, 0.0f);
+    std::copy(palette.rgba.begin(), palette.rgba.end(), entries.begin());
+
+    d.ActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, d.paletteTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, PALETTE_TEXTURE_WIDTH, std::max(rows, 1u), 0, GL_RGBA, GL_FLOAT, entries.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    d.ActiveTexture(GL_TEXTURE0);
+
+    d.UseProgram(d.program);
+    d.Uniform1i(d.paletteSizeLocation, (GLint)palette.size());
+    d.Uniform1f(d.paletteDensityLocation, palette.density);
+    d.UseProgram(0);
+    d.paletteSerial = palette.serial;
+}
 void close()
 {
+    stopRenderPipeline();
+
     //Destroy window
     SDL_DestroyWindow(glWindow);
     glWindow = NULL;
@@ -366,107 +933,2869 @@ void close()
     //Quit SDL subsystems
     SDL_Quit();
 }
-static bool UpdateKernelArgsRewriteImage()
+static void printShortcutCounts(unsigned int cardioid, unsigned int bulb, unsigned int periodic)
 {
-    cl_int status = CL_SUCCESS;
-
-    struct timeval tvalBefore;
-    struct timeval tvalAfter;
-
-    gettimeofday(&tvalBefore, NULL);
-
-    // Send / update kernel arguments
-    status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &writeToImage);
-    exitOnFail("clSetKernelArg 0", status);
-    status = clSetKernelArg(kernel, 1, sizeof(double), &minX);
-    exitOnFail("clSetKernelArg 1", status);
-    status = clSetKernelArg(kernel, 2, sizeof(double), &maxX);
-    exitOnFail("clSetKernelArg 2", status);
-    status = clSetKernelArg(kernel, 3, sizeof(double), &minY);
-    exitOnFail("clSetKernelArg 3", status);
-
-    cl_event event[3];
-    // Aquire texture
-    status = clEnqueueAcquireGLObjects(commands, 1, &writeToImage, 0, NULL, &event[0]);
-    exitOnFail("clEnqueueAcquireGLObjects", status);
-    // Execute kernel
-    status = clEnqueueNDRangeKernel(commands, kernel, 2, NULL, GWSize, LocalWorkSize, 1, &event[0], &event[1]);
-    exitOnFail("clEnqueueAcquireGLObjects", status);
-    // Release texture
-    status = clEnqueueReleaseGLObjects(commands, 1, &writeToImage, 1, &event[1], &event[2]);
-    exitOnFail("clEnqueueAcquireGLObjects", status);
-    clWaitForEvents(1, &event[2]);
-    clFinish(commands);
-
-    gettimeofday(&tvalAfter, NULL);
-    uint milliSecondsElapsed = (uint)((tvalAfter.tv_usec - tvalBefore.tv_usec) / 1000);
-    printf("\n\nTime to create Mandelbrot = %u milliseconds\n", milliSecondsElapsed);
-
-    return true;
+    if (!bShortcuts)
+    {
+        return;
+    }
+    printf("Interior shortcuts: cardioid = %u, period-2 bulb = %u, periodic orbit = %u pixels (%.1f%% of frame)\n",
+           cardioid, bulb, periodic, 100.0 * (cardioid + bulb + periodic) / (frameWidth * frameHeight));
 }
-bool getOpenClContext()
+static void printSubdivisionStats(const SubdivisionStats &stats)
 {
-    cl_int status = 0;
-    status = CL_SUCCESS;
-    // Variables for Platforms
-    cl_uint num_platforms = 0;
-    cl_platform_id *platforms = NULL;
-    cl_uint num_devices = 0;
-    cl_uint i;
-    cl_uint correctPlatformIndex = 0;
+    printf("Subdivision: %.1f%% of pixels filled without iterating (%u filled, %u iterated), %u rectangles in %u passes",
+           100.0 * stats.fillFraction(), stats.filled, stats.computed, stats.rects, stats.passes);
+    if (stats.overflows > 0)
+    {
+        printf(", %u queue overflows", stats.overflows);
+    }
+    printf("\n");
+}
+static bool RenderFrame()
+{
+    updateMaxIter();
+    if (!bUseCpuEngine)
+    {
+        updatePrecisionTier();
+    }
+    if (isProgressiveFrame())
+    {
+        // Show the first pass straight away; the main loop steps through the rest between events
+        beginProgressiveFrame();
+        return stepProgressiveFrame();
+    }
+    if (bUseCpuEngine)
+    {
+        return UpdateCpuFrameRewriteImage();
+    }
+    return UpdateKernelArgsRewriteImage();
+}
+static bool isProgressiveFrame()
+{
+    // Perturbation and subdivision frames on the GPU, frames split across devices, and headless renders are done in one
+    // go
+    return bProgressive && !bHeadless && !bSubdivide && (bUseCpuEngine || (!isDeepZoom() && clHelpers.empty()));
+}
+static void beginProgressiveFrame()
+{
+    if (progressive.bActive)
+    {
+        progressive.cancelled++;
+        printf("Progressive frame cancelled at pass %u of %u (%u cancelled so far)\n", progressive.pass + 1,
+               PROGRESSIVE_PASS_COUNT, progressive.cancelled);
+    }
+    gettimeofday(&progressiveStart, NULL);
+    progressive.bActive = true;
+    progressive.pass = 0;
+    progressive.row = 0;
+    progressive.frames++;
 
-    // Get Platforms
-    status = clGetPlatformIDs(num_platforms, platforms, &num_platforms);
-    exitOnFail("clGetPlatformIDs 1st pass", status);
+    // Samples already known from the cache are never iterated again; every other pixel starts unknown (-1)
+    bProgressiveCached = lookupIterationCache();
+    if (!bProgressiveCached)
+    {
+        cacheKnown.assign((size_t)frameWidth * frameHeight, -1);
+    }
+    if (bUseCpuEngine)
+    {
+        prepareCpuFrame();
+        if (isDeepZoom())
+        {
+            updatePerturbFrame();
+        }
+        cpuFrame.pixelIter = cacheKnown;
+        cpuFrame.shortcutCounts = MandelShortcutCounts();
+        cpuFrame.rebases = 0;
+    }
+    else
+    {
+        status = clEnqueueWriteBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), cacheKnown.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer pixelIter", status);
+    }
+}
+static bool stepProgressiveFrame()
+{
+    // Work through the current pass for one time slice. Returns true when a pass was completed and its image is ready.
+    if (!progressive.bActive)
+    {
+        return false;
+    }
+    struct timeval tvalSliceStart;
+    struct timeval tvalNow;
+    gettimeofday(&tvalSliceStart, NULL);
+    const ProgressivePass &pass = PROGRESSIVE_PASSES[progressive.pass];
+    const unsigned int rows = progressive.passRows(frameHeight);
+    const unsigned int chunk = bUseCpuEngine ? cpuPool->threadCount() * 2 : 64;
+    bool bDeep = isDeepZoom();
+    MandelView view = currentMandelView();
 
-    platforms = new cl_platform_id[num_platforms];
+    while (progressive.row < rows)
+    {
+        unsigned int rowEnd = std::min(rows, progressive.row + chunk);
+        if (bUseCpuEngine)
+        {
+            renderProgressiveRowsCpu(cpuFrame, *cpuPool, view, bDeep ? &perturbFrame : NULL, pass, progressive.row, rowEnd);
+        }
+        else
+        {
+            enqueueProgressiveRows(pass, progressive.row, rowEnd, progressive.passColumns(FRACTAL_IMAGE_WIDTH));
+        }
+        progressive.row = rowEnd;
 
-    status = clGetPlatformIDs(num_platforms, platforms, &num_platforms);
-    exitOnFail("clGetPlatformIDs 2nd pass", status);
+        gettimeofday(&tvalNow, NULL);
+        double sliceMs = (tvalNow.tv_sec - tvalSliceStart.tv_sec) * 1000.0 + (tvalNow.tv_usec - tvalSliceStart.tv_usec) / 1000.0;
+        if (progressive.row < rows && sliceMs > PROGRESSIVE_SLICE_MS)
+        {
+            return false;
+        }
+    }
 
-    for (i = 0; i < num_platforms; i++)
+    // Pass complete: colour it, each cell in the colour of its computed pixel
+    if (bUseCpuEngine)
     {
-        correctPlatformIndex = i;
-        char platformVendor[10240];
-        char platformVersion[10240];
-        clGetPlatformInfo(platforms[correctPlatformIndex], CL_PLATFORM_VENDOR, sizeof(platformVendor), platformVendor, NULL);
-        clGetPlatformInfo(platforms[correctPlatformIndex], CL_PLATFORM_VERSION, sizeof(platformVersion), platformVersion, NULL);
-        printf("PLATFORM_VENDOR = %s\n\t VERSION = %s\n", platformVendor, platformVersion);
+        colourPackedFrameCpu(cpuFrame, *cpuPool, view, pass.cellW, pass.cellH);
+    }
+    else
+    {
+        colourizeToTexture((cl_int)pass.cellW, (cl_int)pass.cellH);
+    }
+    gettimeofday(&tvalNow, NULL);
+    double elapsedMs = (tvalNow.tv_sec - progressiveStart.tv_sec) * 1000.0 + (tvalNow.tv_usec - progressiveStart.tv_usec) / 1000.0;
+    if (progressive.pass == 0)
+    {
+        progressive.firstPassMs = elapsedMs;
+    }
+    progressive.pass++;
+    progressive.row = 0;
+    if (progressive.pass < PROGRESSIVE_PASS_COUNT)
+    {
+        return true;
+    }
 
-        // If the Platform Vendor is AMD/NVIDIA/Intel (Change as appropriate for GPU or Intel if none)
-        // NB: If we are relying on Intel, there is no detected GPU and this might fail on AMD chips
-        const char *s1(platformVendor);
-        const char *s2("NVIDIA Corporation");
-        const char *s3("Advanced Micro Devices, Inc.");
-        const char *s4("Intel(R) Corporation");
-        if (strcmp(s1, s2) == 0 || strcmp(s1, s3) == 0)
+    // Last pass: the frame is complete
+    progressive.bActive = false;
+    printf("\n\nTime to create Mandelbrot (progressive) = %.0f milliseconds, first pass shown after %.1f milliseconds\n",
+           elapsedMs, progressive.firstPassMs);
+    if (bProgressiveCached)
+    {
+        if (bUseCpuEngine)
         {
-            correctPlatformIndex = i;
-            platform = platforms[i];
-            printf("PlatformID: %s Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s2);
-            break;
+            storeIterationCache(cpuFrame.pixelIter);
         }
-        else if (strcmp(s1, s3) == 0)
+        else
         {
-            correctPlatformIndex = i;
-            platform = platforms[i];
-            printf("PlatformID: %s Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s3);
-            break;
+            std::vector<int> packed(FRACTAL_IMAGE_SIZE);
+            status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), packed.data(), 0, NULL, NULL);
+            exitOnFail("clEnqueueReadBuffer pixelIter", status);
+            storeIterationCache(packed);
         }
-        if (strcmp(s1, s4) == 0)
+    }
+    if (bUseCpuEngine && bDeep)
+    {
+        printf("Perturbation: rebases (glitches avoided) = %u\n", cpuFrame.rebases);
+    }
+    else if (bUseCpuEngine)
+    {
+        printShortcutCounts(cpuFrame.shortcutCounts.cardioid, cpuFrame.shortcutCounts.bulb, cpuFrame.shortcutCounts.periodic);
+    }
+    return true;
+}
+static void enqueueProgressiveRows(const ProgressivePass &pass, size_t rowBegin, size_t rowEnd, size_t columns)
+{
+    // Iterate the unknown pixels of the pass lattice in rows [rowBegin, rowEnd) in the frame's precision tier
+    const bool bFloat = frameTier != PRECISION_DOUBLE;
+    cl_kernel k = bFloat ? kernelProgressiveFloat : kernelProgressive;
+    cl_uint arg = 0;
+    status = clSetKernelArg(k, arg++, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg pixelIter", status);
+    if (bFloat)
+    {
+        // The view as double-single pairs, the same mapping as currentMandelView()
+        MandelView view = currentMandelView();
+        const double values[4] = {view.minX, view.MaxIm, view.Re_factor, view.Im_factor};
+        for (int v = 0; v < 4; v++)
         {
-            correctPlatformIndex = i;
-            platform = platforms[i];
-            printf("PlatformID: %s Non GPU Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s4);
-            break;
+            cl_float2 pair;
+            splitDoubleSingle(values[v], pair.s);
+            status = clSetKernelArg(k, arg++, sizeof(cl_float2), &pair);
+            exitOnFail("clSetKernelArg view", status);
         }
     }
-
-    clGetDeviceIDs(platforms[0], CL_DEVICE_TYPE_GPU, 1, devices, &num_devices);
-    exitOnFail("clGetDeviceIDs", status);
-    printf("=== %d OpenCL device(s) found on platform:\n", 1);
-
-    for (cl_uint i = 0; i < num_devices; i++)
+    else
+    {
+        const double *bounds[3] = {&minX, &maxX, &minY};
+        for (int b = 0; b < 3; b++)
+        {
+            status = clSetKernelArg(k, arg++, sizeof(double), bounds[b]);
+            exitOnFail("clSetKernelArg view", status);
+        }
+    }
+    cl_int intArgs[6] = {(cl_int)FRACTAL_IMAGE_WIDTH, (cl_int)FRACTAL_IMAGE_HEIGHT, (cl_int)pass.xStep,
+                         (cl_int)pass.yStep,          (cl_int)pass.xOffset,          (cl_int)pass.yOffset};
+    for (int a = 0; a < 6; a++)
+    {
+        status = clSetKernelArg(k, arg++, sizeof(cl_int), &intArgs[a]);
+        exitOnFail("clSetKernelArg size / pass", status);
+    }
+    cl_int useShortcuts = bShortcuts ? 1 : 0;
+    status = clSetKernelArg(k, arg++, sizeof(cl_int), &useShortcuts);
+    exitOnFail("clSetKernelArg useShortcuts", status);
+    status = clSetKernelArg(k, arg++, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg maxIter", status);
+    if (bFloat)
+    {
+        cl_int precision = frameTier;
+        status = clSetKernelArg(k, arg++, sizeof(cl_int), &precision);
+        exitOnFail("clSetKernelArg precision", status);
+    }
+    size_t offset[2] = {0, rowBegin};
+    size_t globalSize[2] = {columns, rowEnd - rowBegin};
+    cl_event kernelDone;
+    status = clEnqueueNDRangeKernel(commands, k, 2, offset, globalSize, NULL, 0, NULL, &kernelDone);
+    exitOnFail(bFloat ? "clEnqueueNDRangeKernel mandelProgressiveFloat" : "clEnqueueNDRangeKernel mandelProgressive", status);
+    clFinish(commands);
+    trackKernelEvent(kernelDone);
+}
+static void updatePrecisionTier()
+{
+    // Precision tier of the next GPU frame, from the zoom unless --precision fixed it
+    PrecisionTier tier = choosePrecisionTier(currentMandelView(), FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, bDeviceFp64);
+    if (bPrecisionFixed)
+    {
+        tier = precisionOverride == PRECISION_DOUBLE && !bDeviceFp64 ? PRECISION_DOUBLE_SINGLE : precisionOverride;
+    }
+    if (tier != frameTier)
+    {
+        printf("Precision: %s (x range %.3g)\n", PRECISION_TIER_NAMES[tier], dblXrange);
+        frameTier = tier;
+    }
+}
+static void startRenderPipeline()
+{
+    // The first frame is requested like any other; the event loop shows it once it has been published
+    frameReadyEvent = SDL_RegisterEvents(1);
+    pipeline.post(VIEW_REQUEST_RENDER);
+    if (bRenderThread)
+    {
+        renderThread = new std::thread([] {
+            while (renderStep(true))
+            {
+            }
+        });
+    }
+}
+static void stopRenderPipeline()
+{
+    // Lets the frame in hand finish (a progressive frame stops at the end of its time slice)
+    pipeline.stop();
+    if (renderThread)
+    {
+        renderThread->join();
+        delete renderThread;
+        renderThread = NULL;
+    }
+}
+static bool renderStep(bool bBlock)
+{
+    // Render side of the pipeline: apply all the view requests posted since the last frame and start the new frame,
+    // or carry on with the progressive frame in hand. Returns false once the pipeline has been stopped.
+    std::vector<ViewRequest> requests;
+    // With a rest frame to come, an idle render thread only waits until it is due
+    if (!pipeline.takeRequests(requests, bBlock && !progressive.bActive, restRefineWaitMs()))
+    {
+        return false;
+    }
+    bool bRender = false;
+    bool bRecolour = false;
+    for (const ViewRequest &request : requests)
+    {
+        if (request.type == VIEW_REQUEST_ZOOM)
+        {
+            zoomAtPixel(request.dx, request.dy, request.scale);
+        }
+        if (request.type == VIEW_REQUEST_FRACTAL)
+        {
+            nextFractalFamily();
+        }
+        if (request.type == VIEW_REQUEST_SAVE_FIELD)
+        {
+            bSaveFieldPending = true;
+        }
+        else if (request.type == VIEW_REQUEST_PALETTE)
+        {
+            nextPalette();
+            bRecolour = true;
+        }
+        else
+        {
+            bRender = true;
+        }
+    }
+    if (bRender || (bRecolour && !progressive.bActive))
+    {
+        renderInfo.seq = requests.back().seq;
+        renderInfo.postedMs = requests.front().postedMs;
+    }
+    double startMs = pipelineNowMs();
+    bool bNewImage = false;
+    bool bIterated = false;
+    // Input has stopped on a frame below the rest resolution: render the view again at it. Its latency is counted from
+    // now, not from the input it follows.
+    bool bRefine = !bRender && !progressive.bActive && restRefineWaitMs() == 0.0;
+    if (bRefine)
+    {
+        renderInfo.postedMs = startMs;
+    }
+    if (bRender || bRefine)
+    {
+        if (progressive.bActive && startMs - frameStartMs > resolution.predictMs(frameWidth * frameHeight))
+        {
+            // A frame cancelled after running past its prediction still tells the controller it was too optimistic
+            resolution.record(frameWidth * frameHeight, startMs - frameStartMs);
+        }
+        if (bRender)
+        {
+            lastInputMs = requests.back().postedMs;
+        }
+        bRefining = bRefine;
+        bRestPending = false;
+        setFrameLevel(bRefine ? restLevel : chooseFrameLevel());
+        frameStartMs = startMs;
+        // The samples belong to the previous frame
+        aaFrame.clear();
+        aaStats = AntialiasStats();
+        bNewImage = RenderFrame();
+        bIterated = true;
+    }
+    else if (progressive.bActive)
+    {
+        // A new palette is picked up by the next pass
+        bNewImage = stepProgressiveFrame();
+        bIterated = true;
+    }
+    else if (bRecolour)
+    {
+        bNewImage = recolourFrame();
+    }
+    if (bNewImage && bIterated && !progressive.bActive)
+    {
+        resolution.record(frameWidth * frameHeight, pipelineNowMs() - frameStartMs);
+        coarseLevel = frameLevel;
+        coarseMaxIter = frameMaxIter;
+        bRestPending = frameLevel < restLevel;
+        bRefining = false;
+        updateHistogram();
+        updateHeatmap();
+        antialiasFrame();
+    }
+    else if (bNewImage && bRefining)
+    {
+        // The passes of a rest frame would be coarser than the frame on screen
+        bNewImage = false;
+    }
+    if (bIterated || bRecolour)
+    {
+        renderStages.record(STAGE_RENDER, pipelineNowMs() - startMs);
+        if (!bUseCpuEngine)
+        {
+            collectKernelMs();
+        }
+    }
+    if (bNewImage)
+    {
+        publishFrame();
+    }
+    // A progressive frame is saved once it is complete
+    if (bSaveFieldPending && !progressive.bActive)
+    {
+        saveFrameField(fieldSavePath);
+        bSaveFieldPending = false;
+    }
+    writeStatsFile(false);
+    return true;
+}
+static void publishFrame()
+{
+    // The back slot holds a finished image: hand it to the event loop and move on to the next slot
+    unsigned int slot = pipeline.backSlot();
+    if (bUseCpuEngine)
+    {
+        // No copy: the slot takes the framebuffer and the CPU engine renders into the slot's old buffer next
+        frameSlots[slot].rgba.swap(cpuFrame.rgba);
+        frameSlots[slot].texels.swap(cpuFrame.texels);
+        frameSlots[slot].width = cpuFrame.width;
+        frameSlots[slot].height = cpuFrame.height;
+    }
+    if (frameFormat == FRAME_ITER && frameSlots[slot].palette.serial != g_mandelPalette.serial)
+    {
+        // The event loop draws the frame with the palette it was published with
+        frameSlots[slot].palette = g_mandelPalette;
+    }
+    renderInfo.bComplete = !progressive.bActive;
+    slot = pipeline.publish(renderInfo);
+    writeToImage = frameSlots[slot].image;
+    if (bRenderThread && frameReadyEvent != (Uint32)-1)
+    {
+        // Wake the event loop
+        SDL_Event e;
+        SDL_zero(e);
+        e.type = frameReadyEvent;
+        SDL_PushEvent(&e);
+    }
+}
+static bool presentLatestFrame()
+{
+    unsigned int slot;
+    FrameInfo info;
+    if (!pipeline.takeLatest(slot, info))
+    {
+        return false;
+    }
+    double startMs = pipelineNowMs();
+    if (bUseCpuEngine)
+    {
+        FrameSlot &s = frameSlots[slot];
+        if (s.width > s.texWidth || s.height > s.texHeight)
+        {
+            // A frame above the size of any this slot has shown: grow the texture, which then keeps that size
+            allocateSlotTexture(s, std::max(s.width, s.texWidth), std::max(s.height, s.texHeight));
+        }
+        glBindTexture(GL_TEXTURE_2D, s.texture);
+        switch (frameFormat)
+        {
+        case FRAME_RGBA32F:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s.width, s.height, GL_RGBA, GL_FLOAT, s.rgba.data());
+            break;
+        case FRAME_RGBA8:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s.width, s.height, GL_RGBA, GL_UNSIGNED_BYTE, s.texels.data());
+            break;
+        case FRAME_ITER:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s.width, s.height, GL_RED_INTEGER, GL_INT, s.texels.data());
+            break;
+        }
+        // A frame at another resolution is stretched over the window
+        RenderTexCoordS = (GLfloat)s.width / s.texWidth;
+        RenderTexCoordT = (GLfloat)s.height / s.texHeight;
+        double uploadedMs = pipelineNowMs();
+        renderStages.record(STAGE_UPLOAD, uploadedMs - startMs);
+        startMs = uploadedMs;
+    }
+    if (frameFormat == FRAME_ITER && frameSlots[slot].palette.serial != iterDisplay.paletteSerial)
+    {
+        uploadDisplayPalette(frameSlots[slot].palette);
+    }
+    RenderFromTexture = frameSlots[slot].texture;
+    renderGLQuad();
+    double quadMs = pipelineNowMs();
+    //Update screen
+    SDL_GL_SwapWindow(glWindow);
+    double swapMs = pipelineNowMs();
+    // GL has to be done with the texture before the slot goes back to the render thread, which writes it from OpenCL
+    glFinish();
+    renderStages.record(STAGE_QUAD, quadMs - startMs);
+    renderStages.record(STAGE_SWAP, swapMs - quadMs);
+    renderStages.record(STAGE_FINISH, pipelineNowMs() - swapMs);
+
+    pipeline.presented(info);
+    if (info.bComplete)
+    {
+        PipelineStats stats = pipeline.getStats();
+        printf("Click to display = %.1f milliseconds (first image after %.1f), mean %.1f, max %.1f; %u of %u frames dropped, %u requests coalesced\n",
+               stats.completeShown.lastMs, stats.firstShown.lastMs, stats.completeShown.meanMs(), stats.completeShown.maxMs,
+               stats.dropped, stats.published, stats.coalesced);
+        StageTimes stages[STAGE_COUNT];
+        renderStages.snapshot(stages, false);
+        printf("Stages (milliseconds, last):");
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            if (stages[s].total.count > 0)
+            {
+                printf(" %s %.2f", RENDER_STAGE_NAMES[s], stages[s].total.lastMs);
+            }
+        }
+        printf("\n");
+    }
+    return true;
+}
+static bool recolourFrame()
+{
+    // The iteration field of the frame on screen is still there: only the colouring pass is needed
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+    gettimeofday(&tvalBefore, NULL);
+    if (bUseCpuEngine)
+    {
+        colourPackedFrameCpu(cpuFrame, *cpuPool, currentMandelView(), 1, 1);
+    }
+    else
+    {
+        colourizeToTexture(1, 1);
+    }
+    colourAntialiased();
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("Recoloured with palette '%s' in %.1f milliseconds\n", g_mandelPalette.name, microSecondsElapsed / 1000.0);
+    return true;
+}
+static void nextPalette()
+{
+    unsigned int next = 0;
+    for (unsigned int i = 0; i < PALETTE_COUNT; i++)
+    {
+        if (strcmp(g_mandelPalette.name, PALETTE_NAMES[i]) == 0)
+        {
+            next = (i + 1) % PALETTE_COUNT;
+        }
+    }
+    makePalette(PALETTE_NAMES[next], frameMaxIter, g_mandelPalette);
+    if (g_mandelPalette.bEqualized && frameHistogram.escaped > 0)
+    {
+        equalizePalette(frameHistogram, frameMaxIter, g_mandelPalette);
+    }
+    if (!bUseCpuEngine)
+    {
+        uploadPalette();
+    }
+    printf("Palette: %s\n", g_mandelPalette.name);
+}
+static void uploadPalette()
+{
+    size_t bytes = g_mandelPalette.rgba.size() * sizeof(float);
+    if (bytes > paletteBufferSize)
+    {
+        if (paletteBuffer)
+        {
+            clReleaseMemObject(paletteBuffer);
+        }
+        paletteBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_ONLY, bytes, NULL, &status);
+        exitOnFail("clCreateBuffer palette", status);
+        paletteBufferSize = bytes;
+    }
+    status = clEnqueueWriteBuffer(commands, paletteBuffer, CL_TRUE, 0, bytes, g_mandelPalette.rgba.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer palette", status);
+}
+static void setPaletteKernelArgs(cl_kernel k, cl_uint firstArg)
+{
+    cl_int paletteSize = (cl_int)g_mandelPalette.size();
+    cl_float paletteDensity = g_mandelPalette.density;
+    status = clSetKernelArg(k, firstArg, sizeof(cl_mem), &paletteBuffer);
+    exitOnFail("clSetKernelArg palette", status);
+    status = clSetKernelArg(k, firstArg + 1, sizeof(cl_int), &paletteSize);
+    exitOnFail("clSetKernelArg paletteSize", status);
+    status = clSetKernelArg(k, firstArg + 2, sizeof(cl_float), &paletteDensity);
+    exitOnFail("clSetKernelArg paletteDensity", status);
+}
+static void updateHistogram()
+{
+    // Histogram of the frame just completed; an equalised palette is rebuilt from it and the frame recoloured
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+    gettimeofday(&tvalBefore, NULL);
+    const float maxIter = frameMaxIter;
+    if (bUseCpuEngine)
+    {
+        buildHistogramCpu(cpuFrame.pixelIter, *cpuPool, maxIter, frameHistogram);
+    }
+    else
+    {
+        cl_int pixelCount = FRACTAL_IMAGE_SIZE;
+        cl_int stats[3] = {0, INT_MAX, -1};
+        std::vector<cl_uint> bins(HISTOGRAM_BINS, 0);
+        status = clEnqueueWriteBuffer(commands, histogramBuffer, CL_FALSE, 0, HISTOGRAM_BINS * sizeof(cl_uint), bins.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer histogram", status);
+        status = clEnqueueWriteBuffer(commands, histogramStatsBuffer, CL_TRUE, 0, sizeof(stats), stats, 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer histogramStats", status);
+        status = clSetKernelArg(kernelHistogram, 0, sizeof(cl_mem), &pixelIterBuffer);
+        exitOnFail("clSetKernelArg 0", status);
+        status = clSetKernelArg(kernelHistogram, 1, sizeof(cl_int), &pixelCount);
+        exitOnFail("clSetKernelArg 1", status);
+        cl_uint binScale = histogramBinScale(maxIter);
+        status = clSetKernelArg(kernelHistogram, 2, sizeof(cl_uint), &binScale);
+        exitOnFail("clSetKernelArg 2", status);
+        status = clSetKernelArg(kernelHistogram, 3, sizeof(cl_mem), &histogramBuffer);
+        exitOnFail("clSetKernelArg 3", status);
+        status = clSetKernelArg(kernelHistogram, 4, sizeof(cl_mem), &histogramStatsBuffer);
+        exitOnFail("clSetKernelArg 4", status);
+        size_t globalSize = HISTOGRAM_GROUPS * HISTOGRAM_GROUP_SIZE;
+        status = clEnqueueNDRangeKernel(commands, kernelHistogram, 1, NULL, &globalSize, &HISTOGRAM_GROUP_SIZE, 0, NULL, NULL);
+        exitOnFail("clEnqueueNDRangeKernel mandelHistogram", status);
+        status = clEnqueueReadBuffer(commands, histogramBuffer, CL_FALSE, 0, HISTOGRAM_BINS * sizeof(cl_uint), bins.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer histogram", status);
+        status = clEnqueueReadBuffer(commands, histogramStatsBuffer, CL_TRUE, 0, sizeof(stats), stats, 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer histogramStats", status);
+
+        frameHistogram.clear(maxIter);
+        for (unsigned int b = 0; b < HISTOGRAM_BINS; b++)
+        {
+            frameHistogram.bins[b] = bins[b];
+            frameHistogram.escaped += bins[b];
+        }
+        frameHistogram.interior = (unsigned int)stats[0];
+        frameHistogram.lowIter = frameHistogram.escaped > 0 ? stats[1] : -1;
+        frameHistogram.highIter = stats[2];
+        frameHistogram.finish();
+    }
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("Histogram: %u escaped (iterations %d to %d, median %.0f, 99%% below %.0f), %u interior, in %.2f milliseconds\n",
+           frameHistogram.escaped, frameHistogram.lowIter, frameHistogram.highIter, frameHistogram.percentile(0.5),
+           frameHistogram.percentile(0.99), frameHistogram.interior, microSecondsElapsed / 1000.0);
+
+    if (g_mandelPalette.bEqualized)
+    {
+        equalizePalette(frameHistogram, frameMaxIter, g_mandelPalette);
+        if (bUseCpuEngine)
+        {
+            colourPackedFrameCpu(cpuFrame, *cpuPool, currentMandelView(), 1, 1);
+        }
+        else
+        {
+            uploadPalette();
+            colourizeToTexture(1, 1);
+        }
+        colourAntialiased();
+    }
+}
+static void updateHeatmap()
+{
+    // Iteration heatmap of the frame just completed, for --heatmap and the stats file
+    if (!heatmapPath && !statsPath)
+    {
+        return;
+    }
+    if (bUseCpuEngine)
+    {
+        buildIterationHeatmap(cpuFrame.pixelIter, frameWidth, frameHeight, frameMaxIter, frameHeatmap);
+    }
+    else
+    {
+        heatmapField.resize(FRACTAL_IMAGE_SIZE);
+        status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), heatmapField.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer pixelIter", status);
+        buildIterationHeatmap(heatmapField, FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, frameMaxIter, frameHeatmap);
+    }
+    if (heatmapPath)
+    {
+        std::string pgmPath = std::string(heatmapPath) + ".pgm";
+        std::string csvPath = std::string(heatmapPath) + ".csv";
+        if (!writeHeatmapPgm(pgmPath.c_str(), frameHeatmap) || !writeHeatmapCsv(csvPath.c_str(), frameHeatmap))
+        {
+            printf("Error: failed to write the heatmap to %s and %s\n", pgmPath.c_str(), csvPath.c_str());
+        }
+    }
+    printf("Heatmap: %.0f iterations, most expensive %ux%u tile %.1fx the mean\n", frameHeatmap.total, HEATMAP_TILE,
+           HEATMAP_TILE, frameHeatmap.imbalance());
+}
+static void antialiasFrame()
+{
+    // Supersample the edges of the frame just completed (see Antialias.h) and recolour them
+    if (aaBudget == 0 || frameFormat == FRAME_ITER)
+    {
+        return;
+    }
+    double startMs = pipelineNowMs();
+    bool bDeep = isDeepZoom();
+    if (bUseCpuEngine)
+    {
+        antialiasFrameCpu(cpuFrame, *cpuPool, currentMandelView(), bDeep ? &perturbFrame : NULL, aaBudget, aaFrame, aaStats);
+    }
+    else if (bDeep || !bDeviceFp64)
+    {
+        // The samples would need the perturbation kernel's reference orbit, or 'mandelAARefine' was not built (no double
+        // precision); these frames keep one sample per pixel
+        return;
+    }
+    else
+    {
+        cl_uint counts[AA_LEVELS] = {0};
+        cl_uint listed = 0;
+        status = clEnqueueWriteBuffer(commands, aaCountBuffer, CL_FALSE, 0, sizeof(counts), counts, 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer aaCount", status);
+        status = clEnqueueWriteBuffer(commands, aaListedBuffer, CL_FALSE, 0, sizeof(listed), &listed, 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer aaListed", status);
+        status = clSetKernelArg(kernelAAMark, 0, sizeof(cl_mem), &pixelIterBuffer);
+        exitOnFail("clSetKernelArg 0", status);
+        status = clSetKernelArg(kernelAAMark, 1, sizeof(cl_mem), &aaLevelBuffer);
+        exitOnFail("clSetKernelArg 1", status);
+        status = clSetKernelArg(kernelAAMark, 2, sizeof(cl_mem), &aaCountBuffer);
+        exitOnFail("clSetKernelArg 2", status);
+        cl_event event;
+        status = clEnqueueNDRangeKernel(commands, kernelAAMark, 2, NULL, GWSize, LocalWorkSize, 0, NULL, &event);
+        exitOnFail("clEnqueueNDRangeKernel mandelAAMark", status);
+        trackKernelEvent(event);
+        status = clEnqueueReadBuffer(commands, aaCountBuffer, CL_TRUE, 0, sizeof(counts), counts, 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer aaCount", status);
+        aaStats.candidates = 0;
+        for (int l = AA_MIN_LEVEL; l < AA_LEVELS; l++)
+        {
+            aaStats.candidates += counts[l];
+        }
+        aaStats.cutoff = aaCutoffLevel(counts, aaBudget);
+
+        cl_int cutoff = aaStats.cutoff;
+        cl_uint budget = std::min(aaBudget, FRACTAL_IMAGE_SIZE);
+        cl_ulong threshold = aaCutoffThreshold(counts, aaStats.cutoff, budget);
+        status = clSetKernelArg(kernelAASelect, 0, sizeof(cl_mem), &aaLevelBuffer);
+        exitOnFail("clSetKernelArg 0", status);
+        status = clSetKernelArg(kernelAASelect, 1, sizeof(cl_int), &cutoff);
+        exitOnFail("clSetKernelArg 1", status);
+        status = clSetKernelArg(kernelAASelect, 2, sizeof(cl_ulong), &threshold);
+        exitOnFail("clSetKernelArg 2", status);
+        status = clSetKernelArg(kernelAASelect, 3, sizeof(cl_mem), &aaPixelBuffer);
+        exitOnFail("clSetKernelArg 3", status);
+        status = clSetKernelArg(kernelAASelect, 4, sizeof(cl_mem), &aaListedBuffer);
+        exitOnFail("clSetKernelArg 4", status);
+        status = clSetKernelArg(kernelAASelect, 5, sizeof(cl_uint), &budget);
+        exitOnFail("clSetKernelArg 5", status);
+        size_t pixels = FRACTAL_IMAGE_SIZE;
+        status = clEnqueueNDRangeKernel(commands, kernelAASelect, 1, NULL, &pixels, NULL, 0, NULL, &event);
+        exitOnFail("clEnqueueNDRangeKernel mandelAASelect", status);
+        trackKernelEvent(event);
+        status = clEnqueueReadBuffer(commands, aaListedBuffer, CL_TRUE, 0, sizeof(cl_uint), &listed, 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer aaListed", status);
+        aaStats.refined = std::min(listed, budget);
+
+        if (aaStats.refined > 0)
+        {
+            cl_uint refined = aaStats.refined;
+            cl_int w = FRACTAL_IMAGE_WIDTH;
+            cl_int h = FRACTAL_IMAGE_HEIGHT;
+            cl_int useShortcuts = bShortcuts ? 1 : 0;
+            status = clSetKernelArg(kernelAARefine, 0, sizeof(cl_mem), &aaPixelBuffer);
+            exitOnFail("clSetKernelArg 0", status);
+            status = clSetKernelArg(kernelAARefine, 1, sizeof(cl_uint), &refined);
+            exitOnFail("clSetKernelArg 1", status);
+            status = clSetKernelArg(kernelAARefine, 2, sizeof(cl_mem), &aaSampleBuffer);
+            exitOnFail("clSetKernelArg 2", status);
+            status = clSetKernelArg(kernelAARefine, 3, sizeof(double), &minX);
+            exitOnFail("clSetKernelArg 3", status);
+            status = clSetKernelArg(kernelAARefine, 4, sizeof(double), &maxX);
+            exitOnFail("clSetKernelArg 4", status);
+            status = clSetKernelArg(kernelAARefine, 5, sizeof(double), &minY);
+            exitOnFail("clSetKernelArg 5", status);
+            status = clSetKernelArg(kernelAARefine, 6, sizeof(cl_int), &w);
+            exitOnFail("clSetKernelArg 6", status);
+            status = clSetKernelArg(kernelAARefine, 7, sizeof(cl_int), &h);
+            exitOnFail("clSetKernelArg 7", status);
+            status = clSetKernelArg(kernelAARefine, 8, sizeof(cl_int), &useShortcuts);
+            exitOnFail("clSetKernelArg 8", status);
+            status = clSetKernelArg(kernelAARefine, 9, sizeof(cl_float), &frameMaxIter);
+            exitOnFail("clSetKernelArg 9", status);
+            // One work item per sample
+            size_t samples = (refined * AA_SAMPLES + AA_GROUP_SIZE - 1) / AA_GROUP_SIZE * AA_GROUP_SIZE;
+            status = clEnqueueNDRangeKernel(commands, kernelAARefine, 1, NULL, &samples, &AA_GROUP_SIZE, 0, NULL, &event);
+            exitOnFail("clEnqueueNDRangeKernel mandelAARefine", status);
+            trackKernelEvent(event);
+        }
+    }
+    colourAntialiased();
+    double ms = pipelineNowMs() - startMs;
+    renderStages.record(STAGE_ANTIALIAS, ms);
+    printf("Antialiasing: refined %u of %u candidate pixels (budget %u, contrast level %d and up), %u samples, in %.2f milliseconds\n",
+           aaStats.refined, aaStats.candidates, aaBudget, aaStats.cutoff, aaStats.refined * AA_SAMPLES, ms);
+}
+static void colourAntialiased()
+{
+    // Colour the refined pixels of the frame on screen from their samples, after the frame itself has been coloured
+    if (aaStats.refined == 0)
+    {
+        return;
+    }
+    if (bUseCpuEngine)
+    {
+        colourAntialiasedCpu(cpuFrame, *cpuPool, aaFrame);
+        return;
+    }
+    cl_uint refined = aaStats.refined;
+    cl_int w = FRACTAL_IMAGE_WIDTH;
+    status = clSetKernelArg(kernelAAColour, 0, sizeof(cl_mem), &writeToImage);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernelAAColour, 1, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernelAAColour, 2, sizeof(cl_mem), &aaPixelBuffer);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernelAAColour, 3, sizeof(cl_uint), &refined);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(kernelAAColour, 4, sizeof(cl_mem), &aaSampleBuffer);
+    exitOnFail("clSetKernelArg 4", status);
+    status = clSetKernelArg(kernelAAColour, 5, sizeof(cl_int), &w);
+    exitOnFail("clSetKernelArg 5", status);
+    setPaletteKernelArgs(kernelAAColour, 6);
+    size_t globalSize = (refined + AA_GROUP_SIZE - 1) / AA_GROUP_SIZE * AA_GROUP_SIZE;
+    cl_event event[3];
+    status = clEnqueueAcquireGLObjects(commands, 1, &writeToImage, 0, NULL, &event[0]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    status = clEnqueueNDRangeKernel(commands, kernelAAColour, 1, NULL, &globalSize, &AA_GROUP_SIZE, 1, &event[0], &event[1]);
+    exitOnFail("clEnqueueNDRangeKernel mandelAAColour", status);
+    status = clEnqueueReleaseGLObjects(commands, 1, &writeToImage, 1, &event[1], &event[2]);
+    exitOnFail("clEnqueueReleaseGLObjects", status);
+    clWaitForEvents(1, &event[2]);
+    clFinish(commands);
+    trackKernelEvent(event[1]);
+    recordSharedImageStages(event);
+}
+static void writeStatsFile(bool bForce)
+{
+    // Rewrite the --stats-file once statsIntervalMs has passed since the last time (any time with bForce)
+    double nowMs = pipelineNowMs();
+    if (!statsPath || (!bForce && nowMs - statsWrittenMs < statsIntervalMs))
+    {
+        return;
+    }
+    statsWrittenMs = nowMs;
+    PipelineStats pipelineStats = pipeline.getStats();
+    char members[1024];
+    snprintf(members, sizeof(members),
+             "  \"engine\": \"%s\",\n  \"fractal\": \"%s\",\n  \"precision\": \"%s\",\n  \"uptimeSeconds\": %.1f,\n  \"maxIter\": %.0f,\n  \"zoomOctaves\": %.2f,\n"
+             "  \"frames\": {\"published\": %u, \"presented\": %u, \"dropped\": %u, \"coalesced\": %u},\n"
+             "  \"clickToDisplayMs\": {\"firstMean\": %.2f, \"firstMax\": %.2f, \"completeMean\": %.2f, \"completeMax\": %.2f},\n"
+             "  \"antialias\": {\"budget\": %u, \"candidates\": %u, \"refined\": %u, \"cutoffLevel\": %d},",
+             bUseCpuEngine ? "cpu" : "opencl", FRACTAL_FAMILIES[g_fractalFamily].name,
+             bUseCpuEngine ? "double" : PRECISION_TIER_NAMES[frameTier],
+             (nowMs - statsStartMs) / 1000.0, frameMaxIter,
+             log2(std::max(dblZoomFactor, 1.0)), pipelineStats.published, pipelineStats.presented,
+             pipelineStats.dropped, pipelineStats.coalesced, pipelineStats.firstShown.meanMs(),
+             pipelineStats.firstShown.maxMs, pipelineStats.completeShown.meanMs(), pipelineStats.completeShown.maxMs,
+             aaBudget, aaStats.candidates, aaStats.refined, aaStats.cutoff);
+    StageTimes stages[STAGE_COUNT];
+    renderStages.snapshot(stages, true);
+    if (!writeRenderStatsJson(statsPath, members, stages, frameHeatmap))
+    {
+        printf("Error: failed to write %s\n", statsPath);
+    }
+}
+static MaxIterChoice nextMaxIter()
+{
+    // Iteration limit for the next frame, from the zoom depth and the last complete frame's histogram
+    MaxIterChoice choice;
+    if (maxIterOverride > 0.0f)
+    {
+        choice.maxIter = maxIterOverride;
+        snprintf(choice.reason, sizeof(choice.reason), "--max-iter");
+        return choice;
+    }
+    // The histogram is binned for the limit its frame was rendered with, which is not the current one while the first
+    // frame after a change is still in progress
+    bool bHistogram = frameHistogram.maxIter > 0.0f;
+    return chooseMaxIter(log2(std::max(dblZoomFactor, 1.0)), bHistogram ? &frameHistogram : NULL, frameHistogram.maxIter);
+}
+static bool updateMaxIter()
+{
+    // Switch to the limit for the next frame. Returns true if it changed.
+    MaxIterChoice choice = nextMaxIter();
+    if (choice.maxIter == frameMaxIter)
+    {
+        return false;
+    }
+    printf("maxIter = %.0f (%s)\n", choice.maxIter, choice.reason);
+    setFrameMaxIter(choice.maxIter);
+    return true;
+}
+static void setFrameMaxIter(float maxIter)
+{
+    bool bFirst = frameMaxIter == 0.0f;
+    frameMaxIter = maxIter;
+    g_mandelMaxIter = maxIter;
+    if (bFirst)
+    {
+        // main() builds the first palette once the limit is known
+        return;
+    }
+    // The band palette has an entry per iteration and the band thresholds are fractions of the limit, and cached
+    // samples that did not escape may escape under a higher one
+    makePalette(g_mandelPalette.name, maxIter, g_mandelPalette);
+    if (g_mandelPalette.bEqualized && frameHistogram.escaped > 0)
+    {
+        equalizePalette(frameHistogram, maxIter, g_mandelPalette);
+    }
+    if (!bUseCpuEngine && !bHeadless)
+    {
+        uploadPalette();
+    }
+    if (iterCache)
+    {
+        iterCache->clear();
+    }
+}
+static bool UpdateCpuFrameRewriteImage()
+{
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+
+    gettimeofday(&tvalBefore, NULL);
+
+    // The known pixels are looked up first, as a rest frame takes them from the frame still in the buffers
+    bool bKnown = !bSubdivide && lookupIterationCache();
+    prepareCpuFrame();
+    bool bDeep = isDeepZoom();
+    if (bDeep)
+    {
+        updatePerturbFrame();
+    }
+    if (bSubdivide)
+    {
+        renderMandelSubdivideCpu(cpuFrame, *cpuPool, currentMandelView(), bDeep ? &perturbFrame : NULL);
+    }
+    else if (bKnown)
+    {
+        renderMandelCpu(cpuFrame, *cpuPool, currentMandelView(), bDeep ? &perturbFrame : NULL, &cacheKnown);
+        storeIterationCache(cpuFrame.pixelIter);
+    }
+    else
+    {
+        renderMandelCpu(cpuFrame, *cpuPool, currentMandelView(), bDeep ? &perturbFrame : NULL);
+    }
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot (CPU) = %lld milliseconds\n", microSecondsElapsed / 1000);
+    if (bSubdivide)
+    {
+        printSubdivisionStats(cpuFrame.subdivStats);
+    }
+    else
+    {
+        printf("Tiles = %u, splits = %u, steals = %u\n", cpuFrame.schedStats.tiles, cpuFrame.schedStats.splits, cpuFrame.schedStats.steals);
+    }
+    if (bDeep)
+    {
+        printf("Perturbation: rebases (glitches avoided) = %u\n", cpuFrame.rebases);
+    }
+    else
+    {
+        printShortcutCounts(cpuFrame.shortcutCounts.cardioid, cpuFrame.shortcutCounts.bulb, cpuFrame.shortcutCounts.periodic);
+    }
+
+    return true;
+}
+static int runHeadless()
+{
+    // Render the requested viewport once, without SDL, OpenGL or OpenCL, and write it to disk
+    printf("Headless render: minX = %.17g, maxX = %.17g, minY = %.17g\n", minX, maxX, minY);
+    renderHeadlessFrame();
+    updateHeatmap();
+    antialiasFrame();
+    writeStatsFile(true);
+    if (isIterationFieldPath(headlessOutPath))
+    {
+        bool bSaved = saveFrameField(headlessOutPath);
+        delete cpuPool;
+        return bSaved ? 0 : 1;
+    }
+    if (!saveFramePPM(cpuFrame, headlessOutPath))
+    {
+        printf("Error: failed to write %s\n", headlessOutPath);
+        return 1;
+    }
+    printf("Wrote %s\n", headlessOutPath);
+    delete cpuPool;
+    return 0;
+}
+static void renderHeadlessFrame()
+{
+    RenderFrame();
+    updateHistogram();
+    // There is no next frame to pick up a higher limit, so render again while the histogram asks for one. Each pass
+    // goes straight to the limit the escapes point to (see chooseMaxIter()), so one more is usually enough.
+    for (int pass = 1; pass < HEADLESS_MAX_ITER_PASSES && nextMaxIter().maxIter > frameMaxIter; pass++)
+    {
+        RenderFrame();
+        updateHistogram();
+    }
+}
+static int runPerturbCheck()
+{
+    // Render the view plainly and then with perturbation, as a deep zoom frame would be (reference orbit at the centre
+    // pixel, series skip), and compare the escape iterations. Meant for shallow views, where the plain render is
+    // reliable: pixels near the edge of the set are chaotic and differ between any two methods, so only a share of
+    // pixels above PERTURB_CHECK_MAX_FRACTION counts as a failure.
+    if (g_fractalFamily != FRACTAL_MANDELBROT)
+    {
+        printf("Error: --check-perturb needs --fractal mandelbrot\n");
+        return 1;
+    }
+    if (dblXrange < PERTURB_RANGE_THRESHOLD)
+    {
+        printf("Warning: a view width of %g is past the perturbation threshold, the plain render is not reliable\n",
+               dblXrange);
+    }
+    printf("Perturbation check: minX = %.17g, maxX = %.17g, minY = %.17g\n", minX, maxX, minY);
+    const bool bWasForced = bForcePerturb;
+    bForcePerturb = false;
+    renderHeadlessFrame();
+    std::vector<int> plain = cpuFrame.pixelIter;
+    // At the limit the plain frame settled on, so only the method differs
+    bForcePerturb = true;
+    UpdateCpuFrameRewriteImage();
+    bForcePerturb = bWasForced;
+
+    const std::vector<int> &perturbed = cpuFrame.pixelIter;
+    const int maxIter = (int)frameMaxIter;
+    size_t differ = 0;
+    size_t far = 0;
+    for (size_t i = 0; i < plain.size(); i++)
+    {
+        // Interior pixels compare equal whatever their iteration field holds
+        const int a = packedBand(plain[i]) == 0 ? maxIter : packedIter(plain[i]);
+        const int b = packedBand(perturbed[i]) == 0 ? maxIter : packedIter(perturbed[i]);
+        if (a != b)
+        {
+            differ++;
+            far += abs(a - b) > PERTURB_CHECK_ITER_SLACK;
+        }
+    }
+    const double farFraction = (double)far / plain.size();
+    printf("Perturbation check: series skip %d iterations, %zu of %zu pixels differ, %zu (%.2f%%) by more than %d "
+           "iteration(s)\n",
+           perturbFrame.skipIter, differ, plain.size(), far, farFraction * 100.0, PERTURB_CHECK_ITER_SLACK);
+    delete cpuPool;
+    if (farFraction > PERTURB_CHECK_MAX_FRACTION)
+    {
+        printf("Perturbation check FAILED: more than %.0f%% of the pixels differ\n", PERTURB_CHECK_MAX_FRACTION * 100.0);
+        return 1;
+    }
+    printf("Perturbation check passed\n");
+    return 0;
+}
+static int runPoster()
+{
+    // Render the viewport at posterWidth x posterHeight strip by strip and stream it to --out (see Poster.h). The
+    // iteration limit and an equalised palette come from a preview frame of the normal size, since the poster itself
+    // is never in memory as a whole.
+    PosterFormat format;
+    const bool bField = isIterationFieldPath(headlessOutPath);
+    if (!bField && !posterFormatFor(headlessOutPath, format))
+    {
+        printf("Error: --out for --poster must end in .png, .ppm, .raw or .mif\n");
+        return 1;
+    }
+    printf("Poster preview: minX = %.17g, maxX = %.17g, minY = %.17g\n", minX, maxX, minY);
+    renderHeadlessFrame();
+
+    // The same width of the complex plane as the preview and the same centre, whatever the poster's aspect ratio
+    const unsigned int w = posterWidth;
+    const unsigned int h = posterHeight;
+    const double yExtent = dblXrange * h / w;
+    MandelView view;
+    view.minX = minX;
+    view.MaxIm = minY + (dblYrange + yExtent) / 2;
+    view.Re_factor = dblXrange / (w - 1);
+    view.Im_factor = yExtent / (h - 1);
+
+    // Perturbation once the poster's pixels are as small as those of a deep zoom frame, against one reference orbit at
+    // the centre of the whole poster
+    PerturbFrame deep;
+    const bool bDeep = g_fractalFamily == FRACTAL_MANDELBROT &&
+                       (bForcePerturb || view.Re_factor * (FRACTAL_IMAGE_WIDTH - 1) < PERTURB_RANGE_THRESHOLD);
+    if (bDeep)
+    {
+        unsigned int limbs = std::max(bigFixedLimbsFor(view.Re_factor), deepMinX.fracLimbs());
+        BigFixed refRe = deepMinX;
+        BigFixed refIm = deepMinY;
+        refRe.setPrecision(limbs);
+        refIm.setPrecision(limbs);
+        refRe = refRe + BigFixed((w / 2) * view.Re_factor, limbs);
+        refIm = refIm + BigFixed((dblYrange + yExtent) / 2 - (h / 2) * view.Im_factor, limbs);
+        computePerturbFrame(refRe, refIm, w, h, view.Re_factor, view.Im_factor, frameMaxIter, deep);
+        printf("Poster reference orbit: %u bits, length = %d, series skip = %d iterations\n", limbs * 32, deep.refLength,
+               deep.skipIter);
+    }
+    const double posterRefY = deep.refY;
+
+    // A .mif poster keeps the packed results instead of colours (see IterationField.h)
+    PosterWriter writer;
+    IterationFieldWriter fieldWriter;
+    bool bOpened;
+    if (bField)
+    {
+        unsigned int limbs = std::max(bigFixedLimbsFor(view.Re_factor), deepMinY.fracLimbs());
+        BigFixed posterMinIm = deepMinY;
+        posterMinIm.setPrecision(limbs);
+        posterMinIm = posterMinIm + BigFixed((dblYrange - yExtent) / 2, limbs);
+        IterationFieldHeader header;
+        bOpened = makeFieldHeader(header, w, h, view, deepMinX, posterMinIm,
+                                  bDeep ? ITERATION_FIELD_PERTURBATION : (uint32_t)PRECISION_DOUBLE) &&
+                  fieldWriter.open(headlessOutPath, header);
+    }
+    else
+    {
+        bOpened = writer.open(headlessOutPath, format, w, h);
+    }
+    if (!bOpened)
+    {
+        printf("Error: failed to open %s\n", headlessOutPath);
+        return 1;
+    }
+    printf("Poster: %ux%u pixels in strips of %u rows, maxIter %.0f, palette '%s'%s\n", w, h, POSTER_STRIP_ROWS,
+           frameMaxIter, g_mandelPalette.name, bDeep ? ", perturbation" : "");
+    double startMs = pipelineNowMs();
+    double renderMs = 0.0;
+    CpuFrame strip;
+    strip.format = bField ? FRAME_ITER : FRAME_RGBA8;
+    const unsigned int stripCount = (h + POSTER_STRIP_ROWS - 1) / POSTER_STRIP_ROWS;
+    unsigned int reported = 0;
+    for (unsigned int s = 0; s < stripCount; s++)
+    {
+        // Strips go to the file top first, and the top of the image is the poster's last frame row
+        const unsigned int rows = std::min(POSTER_STRIP_ROWS, h - s * POSTER_STRIP_ROWS);
+        const unsigned int y0 = h - s * POSTER_STRIP_ROWS - rows;
+        MandelView stripView = view;
+        stripView.MaxIm = view.MaxIm - y0 * view.Im_factor;
+        deep.refY = posterRefY - y0;
+        double stripStartMs = pipelineNowMs();
+        strip.resize(w, rows);
+        renderMandelCpu(strip, *cpuPool, stripView, bDeep ? &deep : NULL);
+        renderMs += pipelineNowMs() - stripStartMs;
+        if (bField)
+        {
+            // Field rows go up the imaginary axis, the strip's last row first
+            for (unsigned int row = rows; row-- > 0;)
+            {
+                fieldWriter.writeRow(&strip.pixelIter[(size_t)row * w]);
+            }
+        }
+        else
+        {
+            writer.push(strip.texels, rows);
+        }
+        if ((s + 1) * 10 / stripCount > reported)
+        {
+            reported = (s + 1) * 10 / stripCount;
+            printf("Poster: %u%% (%u of %u strips)\n", reported * 10, s + 1, stripCount);
+        }
+    }
+    bool bWritten = bField ? fieldWriter.close() : writer.finish();
+    double totalMs = pipelineNowMs() - startMs;
+    if (!bWritten)
+    {
+        printf("Error: failed to write %s\n", headlessOutPath);
+        return 1;
+    }
+    // The strip being rendered (texels and packed results), the queued strips and the one being encoded
+    double stripMB = (double)w * POSTER_STRIP_ROWS * sizeof(uint32_t) / (1 << 20);
+    printf("Wrote %s: %.1f seconds, %.1f Mpixels/s; rendering %.1f s, encoding %.1f s (overlapped), waited %.1f s for the "
+           "writer; about %.0f MB of strips in memory at most\n",
+           headlessOutPath, totalMs / 1000.0, totalMs > 0.0 ? (double)w * h / (totalMs * 1000.0) : 0.0, renderMs / 1000.0,
+           writer.encodeMs / 1000.0, writer.waitMs / 1000.0, stripMB * (POSTER_QUEUE_STRIPS + 3));
+    delete cpuPool;
+    return 0;
+}
+static int runTileServer()
+{
+    // Answer tile requests until the process is stopped (see TileServer.h). Level 0 is centred on the family's own
+    // view, and every tile set (family, Julia constant, palette, iteration limit) has a disk cache directory of its own.
+    const FractalFamily &family = FRACTAL_FAMILIES[g_fractalFamily];
+    TileWorld world;
+    world.minRe = family.centreRe - TILE_WORLD_WIDTH / 2;
+    world.maxIm = family.centreIm + TILE_WORLD_WIDTH / 2;
+    std::string diskDir;
+    if (bTileDiskCache)
+    {
+        char tileSet[256];
+        int length = snprintf(tileSet, sizeof(tileSet), "/%s-%s", family.name, paletteName);
+        if (family.bJulia)
+        {
+            length += snprintf(tileSet + length, sizeof(tileSet) - length, "-c%.17g,%.17g", g_fractalJuliaRe,
+                               g_fractalJuliaIm);
+        }
+        if (maxIterOverride > 0.0f)
+        {
+            snprintf(tileSet + length, sizeof(tileSet) - length, "-i%.0f", maxIterOverride);
+        }
+        diskDir = tileCacheDir + tileSet;
+    }
+    TileServer server(*cpuPool, world, diskDir, tileCacheMB << 20, maxIterOverride, paletteName);
+    bool bListening = tileServerSocket ? server.listenUnix(tileServerSocket) : server.listenTcp(tileServerPort);
+    if (!bListening)
+    {
+        printf("Error: cannot listen on %s\n", tileServerSocket ? tileServerSocket : "127.0.0.1");
+        return 1;
+    }
+    if (tileServerSocket)
+    {
+        printf("Serving %s tiles on %s: GET /{z}/{x}/{y}.png, /stats\n", family.name, tileServerSocket);
+    }
+    else
+    {
+        printf("Serving %s tiles on http://127.0.0.1:%u/{z}/{x}/{y}.png (stats: /stats)\n", family.name, tileServerPort);
+    }
+    printf("Tile caches: %zu MB in memory, %s on disk\n", tileCacheMB, diskDir.empty() ? "none" : diskDir.c_str());
+    server.run();
+    return 0;
+}
+static bool makeFieldHeader(IterationFieldHeader &header, unsigned int w, unsigned int h, const MandelView &view,
+                            BigFixed minRe, BigFixed minIm, uint32_t precision)
+{
+    // Header of a w x h field of 'view' in the current family and iteration limit, with the pixel of file row 0,
+    // column 0 at minRe + minIm i. Returns false if the corner has too many digits to store.
+    const FractalFamily &family = FRACTAL_FAMILIES[g_fractalFamily];
+    initIterationFieldHeader(header, w, h, family.name, g_fractalJuliaRe, g_fractalJuliaIm);
+    header.minX = view.minX;
+    header.maxX = view.minX + (w - 1) * view.Re_factor;
+    header.minY = view.MaxIm - (h - 1) * view.Im_factor;
+    header.reStep = view.Re_factor;
+    header.imStep = view.Im_factor;
+    header.maxIter = frameMaxIter;
+    header.precision = precision;
+    unsigned int limbs = std::max(std::max(minRe.fracLimbs(), minIm.fracLimbs()), bigFixedLimbsFor(view.Re_factor));
+    minRe.setPrecision(limbs);
+    minIm.setPrecision(limbs);
+    return setIterationFieldCorner(header, minRe.toString(limbs * 9 + 1), minIm.toString(limbs * 9 + 1));
+}
+static bool saveFrameField(const char *path)
+{
+    // Write the packed results of the current frame to 'path', its last row first (see IterationField.h). A CPU frame
+    // is saved at the resolution it was rendered at.
+    std::vector<int> packed;
+    uint32_t precision = isDeepZoom() ? ITERATION_FIELD_PERTURBATION : (uint32_t)PRECISION_DOUBLE;
+    if (bUseCpuEngine)
+    {
+        packed = cpuFrame.pixelIter;
+    }
+    else
+    {
+        packed.resize(FRACTAL_IMAGE_SIZE);
+        status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), packed.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer pixelIter", status);
+        if (!isDeepZoom())
+        {
+            precision = frameTier;
+        }
+    }
+    if (packed.size() != (size_t)frameWidth * frameHeight)
+    {
+        printf("Error: there is no frame to save to %s\n", path);
+        return false;
+    }
+    // File row 0 is the frame's last row, which is the view's minY only at full resolution
+    const MandelView view = currentMandelView();
+    const double yExtent = dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    BigFixed fieldMinIm = deepMinY + BigFixed(yExtent - (frameHeight - 1) * view.Im_factor, deepMinY.fracLimbs());
+    IterationFieldHeader header;
+    if (!makeFieldHeader(header, frameWidth, frameHeight, view, deepMinX, fieldMinIm, precision))
+    {
+        printf("Error: the view is too deep to save to %s\n", path);
+        return false;
+    }
+    IterationFieldWriter writer;
+    writer.open(path, header);
+    for (unsigned int row = frameHeight; row-- > 0;)
+    {
+        writer.writeRow(&packed[(size_t)row * frameWidth]);
+    }
+    if (!writer.close())
+    {
+        printf("Error: failed to write %s\n", path);
+        return false;
+    }
+    printf("Wrote %s: %ux%u iteration field, maxIter %.0f, %s precision\n", path, frameWidth, frameHeight,
+           frameMaxIter, iterationFieldPrecisionName(precision));
+    return true;
+}
+static bool loadIterationField(const char *path)
+{
+    // Open a saved field and move to its view, family and iteration limit, so the frames that cover it are filled
+    // from it instead of iterated (see fillKnownFromField())
+    if (!loadedField.open(path))
+    {
+        return false;
+    }
+    const IterationFieldHeader &field = loadedField.header();
+    int family;
+    unsigned int limbs = bigFixedLimbsFor(field.reStep);
+    if (!parseFractalFamily(field.family, family) || !BigFixed::fromString(field.minRe, limbs, loadedFieldMinRe) ||
+        !BigFixed::fromString(field.minIm, limbs, loadedFieldMinIm))
+    {
+        printf("%s: unknown fractal family '%s' or invalid corner\n", path, field.family);
+        loadedField.close();
+        return false;
+    }
+    if (!(field.maxIter >= 1.0f && field.maxIter <= MAX_ITER_MAX))
+    {
+        printf("%s: invalid maxIter %.0f\n", path, field.maxIter);
+        loadedField.close();
+        return false;
+    }
+    setFractalFamily(family);
+    if (FRACTAL_FAMILIES[family].bJulia)
+    {
+        bJuliaOverride = true;
+        juliaOverrideRe = g_fractalJuliaRe = field.juliaRe;
+        juliaOverrideIm = g_fractalJuliaIm = field.juliaIm;
+    }
+    maxIterOverride = field.maxIter;
+    // The frame gets the field's centre and width, at the frame's own aspect ratio
+    const double width = (field.width - 1) * field.reStep;
+    BigFixed centreRe = loadedFieldMinRe + BigFixed(width / 2, limbs);
+    BigFixed centreIm = loadedFieldMinIm + BigFixed((field.height - 1) * field.imStep / 2, limbs);
+    if (!setViewCentre(centreRe.toString(limbs * 9 + 1).c_str(), centreIm.toString(limbs * 9 + 1).c_str(), width))
+    {
+        printf("%s: invalid view\n", path);
+        loadedField.close();
+        return false;
+    }
+    printf("Loaded %s: %ux%u iteration field of %s, maxIter %.0f, %s precision\n", path, field.width, field.height,
+           field.family, field.maxIter, iterationFieldPrecisionName(field.precision));
+    return true;
+}
+static unsigned int fillKnownFromField(std::vector<int> &known)
+{
+    // Copy the loaded field's results into the pixels of the current frame that it covers and nothing else has filled.
+    // A field at least as fine as the frame gives every pixel inside it the nearest of its samples, so the view it was
+    // saved at, pans within it and zooms out of it need no iterating; a coarser one (the frame zoomed in past it) only
+    // the pixels that land on one of its samples. Only a field of the same family and iteration limit fits.
+    const IterationFieldHeader &field = loadedField.header();
+    const FractalFamily &family = FRACTAL_FAMILIES[g_fractalFamily];
+    if (field.maxIter != frameMaxIter || strcmp(field.family, family.name) != 0 ||
+        (family.bJulia && (field.juliaRe != g_fractalJuliaRe || field.juliaIm != g_fractalJuliaIm)))
+    {
+        return 0;
+    }
+    const MandelView view = currentMandelView();
+    // Offset of the frame's bottom left pixel from the field's corner, in field pixels, worked out in arbitrary
+    // precision so it holds at any depth
+    const unsigned int limbs = std::max(deepMinX.fracLimbs(), loadedFieldMinRe.fracLimbs());
+    BigFixed frameRe = deepMinX;
+    BigFixed frameIm = deepMinY;
+    BigFixed fieldRe = loadedFieldMinRe;
+    BigFixed fieldIm = loadedFieldMinIm;
+    frameRe.setPrecision(limbs);
+    frameIm.setPrecision(limbs);
+    fieldRe.setPrecision(limbs);
+    fieldIm.setPrecision(limbs);
+    const double x0 = (frameRe - fieldRe).toDouble() / field.reStep;
+    const double y0 = (frameIm - fieldIm).toDouble() / field.imStep;
+    const double rx = view.Re_factor / field.reStep;
+    const double ry = view.Im_factor / field.imStep;
+    const double tolerance = rx >= 0.999 && ry >= 0.999 ? 0.5 : 0.001;
+    // Frame row 0 is at MaxIm, the frame's minY plus its height
+    const double top = y0 + dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH / field.imStep;
+
+    std::vector<long long> columns(frameWidth); // field column of each frame column, -1 for none
+    for (unsigned int x = 0; x < frameWidth; x++)
+    {
+        double fx = x0 + x * rx;
+        long long c = llround(fx);
+        columns[x] = fabs(fx - c) <= tolerance && c >= 0 && c < field.width ? c : -1;
+    }
+    unsigned int filled = 0;
+    for (unsigned int y = 0; y < frameHeight; y++)
+    {
+        // Frame row y is at MaxIm - y * Im_factor
+        double fy = top - y * ry;
+        long long r = llround(fy);
+        if (fabs(fy - r) > tolerance || r < 0 || r >= field.height)
+        {
+            continue;
+        }
+        const int *fieldRow = loadedField.row((unsigned int)r);
+        int *knownRow = &known[(size_t)y * frameWidth];
+        for (unsigned int x = 0; x < frameWidth; x++)
+        {
+            if (columns[x] >= 0 && knownRow[x] < 0)
+            {
+                knownRow[x] = fieldRow[columns[x]];
+                filled++;
+            }
+        }
+    }
+    return filled;
+}
+static int runRecolour()
+{
+    // Colour a saved field (--recolour) with --palette into --out (.png, .ppm or .raw), or copy a --crop of it into a
+    // new .mif, without iterating. The field is read through its mapping a strip at a time, and each strip's pages are
+    // released once it is written, so a field of any size is never resident as a whole.
+    IterationFieldFile field;
+    if (!field.open(recolourPath))
+    {
+        return 1;
+    }
+    const IterationFieldHeader &header = field.header();
+    if (cropWidth == 0)
+    {
+        cropX = 0;
+        cropY = 0;
+        cropWidth = header.width;
+        cropHeight = header.height;
+    }
+    if ((uint64_t)cropX + cropWidth > header.width || (uint64_t)cropY + cropHeight > header.height)
+    {
+        printf("Error: --crop %u %u %u %u is outside the %ux%u field\n", cropX, cropY, cropWidth, cropHeight,
+               header.width, header.height);
+        return 1;
+    }
+    const unsigned int w = cropWidth;
+    const unsigned int h = cropHeight;
+    const bool bCopyField = isIterationFieldPath(headlessOutPath);
+    PosterFormat format;
+    if (!bCopyField && !posterFormatFor(headlessOutPath, format))
+    {
+        printf("Error: --out for --recolour must end in .png, .ppm, .raw or .mif\n");
+        return 1;
+    }
+    printf("Recolour %s: %ux%u of the %ux%u field from (%u, %u), %s, maxIter %.0f, %s precision\n", recolourPath, w, h,
+           header.width, header.height, cropX, cropY, header.family, header.maxIter,
+           iterationFieldPrecisionName(header.precision));
+    double startMs = pipelineNowMs();
+    bool bWritten;
+    if (bCopyField)
+    {
+        // The crop keeps the pixel spacing, and its corner moves by whole pixels
+        IterationFieldHeader cropped;
+        initIterationFieldHeader(cropped, w, h, header.family, header.juliaRe, header.juliaIm);
+        cropped.reStep = header.reStep;
+        cropped.imStep = header.imStep;
+        cropped.minX = header.minX + cropX * header.reStep;
+        cropped.maxX = cropped.minX + (w - 1) * header.reStep;
+        cropped.minY = header.minY + cropY * header.imStep;
+        cropped.maxIter = header.maxIter;
+        cropped.precision = header.precision;
+        unsigned int limbs = bigFixedLimbsFor(header.reStep);
+        BigFixed minRe;
+        BigFixed minIm;
+        if (!BigFixed::fromString(header.minRe, limbs, minRe) || !BigFixed::fromString(header.minIm, limbs, minIm))
+        {
+            printf("Error: %s has an invalid corner\n", recolourPath);
+            return 1;
+        }
+        minRe = minRe + BigFixed(cropX * header.reStep, limbs);
+        minIm = minIm + BigFixed(cropY * header.imStep, limbs);
+        if (!setIterationFieldCorner(cropped, minRe.toString(limbs * 9 + 1), minIm.toString(limbs * 9 + 1)))
+        {
+            printf("Error: the corner of the crop does not fit a field header\n");
+            return 1;
+        }
+        IterationFieldWriter writer;
+        if (!writer.open(headlessOutPath, cropped))
+        {
+            printf("Error: failed to open %s\n", headlessOutPath);
+            return 1;
+        }
+        for (unsigned int r = 0; r < h; r++)
+        {
+            writer.writeRow(field.row(cropY + r) + cropX);
+            if ((r + 1) % ITERATION_FIELD_CHUNK_ROWS == 0 || r + 1 == h)
+            {
+                unsigned int first = r / ITERATION_FIELD_CHUNK_ROWS * ITERATION_FIELD_CHUNK_ROWS;
+                field.adviseRows(cropY + first, r + 1 - first, MADV_DONTNEED);
+            }
+        }
+        bWritten = writer.close();
+    }
+    else
+    {
+        Palette palette;
+        makePalette(paletteName, header.maxIter, palette);
+        if (palette.bEqualized)
+        {
+            // Equalise over a sample of the crop's rows, about 16M pixels at most
+            IterHistogram histogram;
+            histogram.clear(header.maxIter);
+            const unsigned int rowStep = (unsigned int)std::max<uint64_t>(1, (uint64_t)w * h >> 24);
+            for (unsigned int r = 0; r < h; r += rowStep)
+            {
+                const int *row = field.row(cropY + r) + cropX;
+                for (unsigned int x = 0; x < w; x++)
+                {
+                    histogram.add(row[x]);
+                }
+            }
+            histogram.finish();
+            equalizePalette(histogram, header.maxIter, palette);
+        }
+        PosterWriter writer;
+        if (!writer.open(headlessOutPath, format, w, h))
+        {
+            printf("Error: failed to open %s\n", headlessOutPath);
+            return 1;
+        }
+        std::vector<uint32_t> strip;
+        for (unsigned int r0 = 0; r0 < h; r0 += POSTER_STRIP_ROWS)
+        {
+            const unsigned int rows = std::min(POSTER_STRIP_ROWS, h - r0);
+            strip.resize((size_t)w * rows);
+            field.adviseRows(cropY + r0, rows, MADV_WILLNEED);
+            // The writer emits a strip's rows last to first (frame layout), so file row r0 + j is strip row rows - 1 - j
+            cpuPool->parallelFor(rows, [&](unsigned int j) {
+                const int *packed = field.row(cropY + r0 + j) + cropX;
+                uint32_t *texels = &strip[(size_t)(rows - 1 - j) * w];
+                for (unsigned int x = 0; x < w; x++)
+                {
+                    texels[x] = paletteColourRgba8(palette, packed[x]);
+                }
+            });
+            field.adviseRows(cropY + r0, rows, MADV_DONTNEED);
+            writer.push(strip, rows);
+        }
+        bWritten = writer.finish();
+    }
+    double totalMs = pipelineNowMs() - startMs;
+    if (!bWritten)
+    {
+        printf("Error: failed to write %s\n", headlessOutPath);
+        return 1;
+    }
+    printf("Wrote %s: %.1f seconds, %.1f Mpixels/s\n", headlessOutPath, totalMs / 1000.0,
+           totalMs > 0.0 ? (double)w * h / (totalMs * 1000.0) : 0.0);
+    delete cpuPool;
+    return 0;
+}
+static int runZoomVideo()
+{
+    // Render the zoom frame by frame, iterating only a keyframe per octave (see ZoomVideo.h)
+    ZoomVideoWriter writer;
+    if (!writer.open(headlessOutPath, videoWidth, videoHeight, videoFps))
+    {
+        printf("Error: failed to open %s\n", headlessOutPath);
+        return 1;
+    }
+    // One iteration limit and palette for the whole video, from its deepest frame, so the colours do not jump
+    const double maxWidth = std::max(videoStartWidth, videoEndWidth);
+    setViewCentre(videoRe, videoIm, std::min(videoStartWidth, videoEndWidth));
+    printf("Zoom video preview (deepest frame): minX = %.17g, maxX = %.17g, minY = %.17g\n", minX, maxX, minY);
+    renderHeadlessFrame();
+    printf("Zoom video: %u frames of %ux%u at %u fps, widths %g to %g (%.1f octaves), maxIter %.0f, palette '%s'\n",
+           videoFrames, videoWidth, videoHeight, videoFps, videoStartWidth, videoEndWidth,
+           fabs(log2(videoStartWidth / videoEndWidth)), frameMaxIter, g_mandelPalette.name);
+
+    CpuFrame key;
+    key.format = FRAME_RGBA8;
+    PerturbFrame deep;
+    std::vector<uint32_t> frame;
+    int keyIndex = -1;
+    unsigned int keyframes = 0;
+    double keyMs = 0.0;
+    double resampleMs = 0.0;
+    double startMs = pipelineNowMs();
+    unsigned int reported = 0;
+    for (unsigned int i = 0; i < videoFrames; i++)
+    {
+        double width = zoomFrameWidth(videoStartWidth, videoEndWidth, videoFrames, i);
+        int k = zoomKeyframeIndex(maxWidth, width);
+        double keyWidth = ldexp(maxWidth, -k);
+        double stepMs = pipelineNowMs();
+        if (k != keyIndex)
+        {
+            renderZoomKeyframe(keyWidth, key, deep);
+            keyIndex = k;
+            keyframes++;
+            keyMs += pipelineNowMs() - stepMs;
+            stepMs = pipelineNowMs();
+        }
+        resampleZoomFrame(key, *cpuPool, width, keyWidth, videoWidth, videoHeight, frame);
+        resampleMs += pipelineNowMs() - stepMs;
+        if (!writer.writeFrame(frame))
+        {
+            printf("Error: failed to write frame %u to %s\n", i, headlessOutPath);
+            return 1;
+        }
+        if ((i + 1) * 10 / videoFrames > reported)
+        {
+            reported = (i + 1) * 10 / videoFrames;
+            printf("Zoom video: %u%% (%u of %u frames, %u keyframes)\n", reported * 10, i + 1, videoFrames, keyframes);
+        }
+    }
+    if (!writer.close())
+    {
+        printf("Error: failed to write %s\n", headlessOutPath);
+        return 1;
+    }
+    double totalMs = pipelineNowMs() - startMs;
+    double iterated = (double)keyframes * key.width * key.height;
+    double direct = (double)videoFrames * videoWidth * videoHeight;
+    // Keyframes hold four frames' pixels each, so a video with few frames per octave iterates more than direct rendering
+    const bool bFewer = iterated <= direct;
+    const double ratio = bFewer ? (iterated > 0.0 ? direct / iterated : 0.0) : iterated / direct;
+    printf("Wrote %s: %u frames in %.1f seconds (%.1f frames/s); %u keyframes took %.1f s, resampling %.1f s; %.2f "
+           "pixels iterated per output pixel, %.1fx %s than rendering every frame\n",
+           headlessOutPath, videoFrames, totalMs / 1000.0, totalMs > 0.0 ? videoFrames * 1000.0 / totalMs : 0.0, keyframes,
+           keyMs / 1000.0, resampleMs / 1000.0, direct > 0.0 ? iterated / direct : 0.0, ratio, bFewer ? "fewer" : "more");
+    delete cpuPool;
+    return 0;
+}
+static void renderZoomKeyframe(double keyWidth, CpuFrame &key, PerturbFrame &deep)
+{
+    // Keyframe keyWidth wide centred on the zoom centre, ZOOM_KEYFRAME_SCALE times the video's size. The centre falls
+    // between the middle two pixels in both directions, so the frames resampled from it stay centred.
+    const unsigned int kw = videoWidth * ZOOM_KEYFRAME_SCALE;
+    const unsigned int kh = videoHeight * ZOOM_KEYFRAME_SCALE;
+    const double spacing = keyWidth / kw;
+    MandelView view;
+    view.minX = atof(videoRe) - (kw / 2 - 0.5) * spacing;
+    view.MaxIm = atof(videoIm) + (kh / 2 - 0.5) * spacing;
+    view.Re_factor = spacing;
+    view.Im_factor = spacing;
+    const bool bDeep = g_fractalFamily == FRACTAL_MANDELBROT &&
+                       (bForcePerturb || spacing * (FRACTAL_IMAGE_WIDTH - 1) < PERTURB_RANGE_THRESHOLD);
+    if (bDeep)
+    {
+        // The reference is pixel (kw / 2, kh / 2), half a pixel right of and below the centre
+        unsigned int limbs = bigFixedLimbsFor(spacing);
+        BigFixed centreRe;
+        BigFixed centreIm;
+        BigFixed::fromString(videoRe, limbs, centreRe);
+        BigFixed::fromString(videoIm, limbs, centreIm);
+        computePerturbFrame(centreRe + BigFixed(0.5 * spacing, limbs), centreIm - BigFixed(0.5 * spacing, limbs), kw, kh,
+                            spacing, spacing, frameMaxIter, deep);
+    }
+    if (key.width != kw || key.height != kh)
+    {
+        key.resize(kw, kh);
+    }
+    // The tile scheduler's cost estimate comes from the previous keyframe, which covers this one's centre quarter
+    renderMandelCpu(key, *cpuPool, view, bDeep ? &deep : NULL);
+}
+static void setViewBounds(double viewMinX, double viewMaxX, double viewMinY)
+{
+    minX = viewMinX;
+    maxX = viewMaxX;
+    minY = viewMinY;
+    dblZoomFactor = 3.0 / (maxX - minX);
+    // Keep the derived viewport globals consistent with the zoom code in main()
+    dblXrange = maxX - minX;
+    dblYrange = dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    maxY = minY + dblYrange;
+    midX = (maxX + minX) / 2;
+    midY = (maxY + minY) / 2;
+    deepMinX = BigFixed(minX, bigFixedLimbsFor(dblXrange / FRACTAL_IMAGE_WIDTH));
+    deepMinY = BigFixed(minY, deepMinX.fracLimbs());
+}
+static bool setViewCentre(const char *re, const char *im, double width)
+{
+    // View 'width' wide centred on re + im i, given as decimal strings of any length
+    if (!(width > 0.0))
+    {
+        return false;
+    }
+    double height = width * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    unsigned int limbs = bigFixedLimbsFor(width / FRACTAL_IMAGE_WIDTH);
+    BigFixed centreX;
+    BigFixed centreY;
+    if (!BigFixed::fromString(re, limbs, centreX) || !BigFixed::fromString(im, limbs, centreY))
+    {
+        return false;
+    }
+    dblXrange = width;
+    dblYrange = height;
+    deepMinX = centreX - BigFixed(dblXrange / 2, limbs);
+    deepMinY = centreY - BigFixed(dblYrange / 2, limbs);
+    minX = deepMinX.toDouble();
+    minY = deepMinY.toDouble();
+    maxX = minX + dblXrange;
+    maxY = minY + dblYrange;
+    midX = (maxX + minX) / 2;
+    midY = (maxY + minY) / 2;
+    dblZoomFactor = 3.0 / dblXrange;
+    return true;
+}
+static int runBenchmark()
+{
+    // Render every view of BENCH_VIEWS benchRuns times, after an untimed warm-up frame, and report the timings (see
+    // Benchmark.h). --max-iter overrides the views' own limits.
+    bProgressive = false;
+    const float userMaxIter = maxIterOverride;
+    char engine[512];
+    if (bUseCpuEngine)
+    {
+        snprintf(engine, sizeof(engine), "cpu %s, %u threads%s", simdLevelName(cpuSimdLevel), cpuPool->threadCount(),
+                 bShortcuts ? "" : ", no shortcuts");
+    }
+    else
+    {
+        snprintf(engine, sizeof(engine), "opencl %s (%s), %zu device(s)%s", clDeviceString(devices[0], CL_DEVICE_NAME).c_str(),
+                 clDeviceString(devices[0], CL_DRIVER_VERSION).c_str(), clHelpers.size() + 1, bShortcuts ? "" : ", no shortcuts");
+    }
+    for (char *c = engine; *c; c++)
+    {
+        *c = (*c == '"' || *c == '\\') ? '\'' : *c;
+    }
+    printf("Benchmark: %s, %u runs per view, %ux%u pixels\n", engine, benchRuns, FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT);
+
+    std::vector<BenchResult> results;
+    for (unsigned int v = 0; v < BENCH_VIEW_COUNT; v++)
+    {
+        const BenchView &view = BENCH_VIEWS[v];
+        setViewCentre(view.re, view.im, view.width);
+        maxIterOverride = userMaxIter > 0.0f ? userMaxIter : view.maxIter;
+        BenchResult result;
+        result.view = &view;
+        result.pixels = FRACTAL_IMAGE_SIZE;
+        for (unsigned int run = 0; run <= benchRuns; run++)
+        {
+            double startMs = pipelineNowMs();
+            RenderFrame();
+            double frameMs = pipelineNowMs() - startMs;
+            double kernelMs = bUseCpuEngine ? 0.0 : collectKernelMs();
+            if (run == 0)
+            {
+                continue; // warm-up: reference orbit, program and buffer first use
+            }
+            result.frameMs.push_back(frameMs);
+            if (!bUseCpuEngine)
+            {
+                result.kernelMs.push_back(kernelMs);
+            }
+        }
+        result.maxIter = frameMaxIter;
+        if (bUseCpuEngine)
+        {
+            result.iterations = packedIterationSum(cpuFrame.pixelIter.data(), cpuFrame.pixelIter.size(), frameMaxIter);
+        }
+        else
+        {
+            std::vector<int> packed(FRACTAL_IMAGE_SIZE);
+            status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), packed.data(), 0, NULL, NULL);
+            exitOnFail("clEnqueueReadBuffer pixelIter", status);
+            result.iterations = packedIterationSum(packed.data(), packed.size(), frameMaxIter);
+        }
+        results.push_back(result);
+    }
+
+    printf("\n=== Benchmark results (%s)\n", engine);
+    for (const BenchResult &result : results)
+    {
+        printBenchResult(result);
+    }
+    if (!writeBenchJson(benchOutPath, engine, FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, results))
+    {
+        printf("Error: failed to write %s\n", benchOutPath);
+        return 1;
+    }
+    printf("Wrote %s\n", benchOutPath);
+    return 0;
+}
+static void ensureDeepPrecision()
+{
+    unsigned int limbs = bigFixedLimbsFor(dblXrange / FRACTAL_IMAGE_WIDTH);
+    if (limbs > deepMinX.fracLimbs())
+    {
+        deepMinX.setPrecision(limbs);
+        deepMinY.setPrecision(limbs);
+    }
+}
+static void zoomAtPixel(double dx, double dy, double scale)
+{
+    // Zoom by 'scale' (2 = in, 0.5 = out) centred on the clicked pixel:
+    //   minX = (minX + dx / WIDTH * oldXrange) - newXrange / 2
+    // The origin is moved in arbitrary precision and only then rounded to the double minX / minY used by the
+    // 'mandel' kernel, so deep zooms keep their position once doubles run out of bits.
+    double offsetX = dx / FRACTAL_IMAGE_WIDTH * dblXrange;
+    double offsetY = dy / FRACTAL_IMAGE_HEIGHT * dblYrange;
+    dblXrange = dblXrange / scale;
+    dblYrange = dblYrange / scale;
+    ensureDeepPrecision();
+    deepMinX = deepMinX + BigFixed(offsetX - dblXrange / 2, deepMinX.fracLimbs());
+    deepMinY = deepMinY + BigFixed(offsetY - dblYrange / 2, deepMinY.fracLimbs());
+    minX = deepMinX.toDouble();
+    minY = deepMinY.toDouble();
+    maxX = minX + dblXrange;
+    maxY = minY + dblYrange;
+    midX = (maxX + minX) / 2;
+    midY = (maxY + minY) / 2;
+    bZoomIn = scale > 1.0;
+    snapViewToCacheGrid();
+    dblZoomFactor *= scale;
+    printf("Zoom factor= %g \n", dblZoomFactor);
+    if (isDeepZoom())
+    {
+        unsigned int limbs = deepMinX.fracLimbs();
+        printf("Deep zoom centre: re = %s\n", (deepMinX + BigFixed(dblXrange / 2, limbs)).toString(limbs * 9 + 1).c_str());
+        printf("                  im = %s\n", (deepMinY + BigFixed(dblYrange / 2, limbs)).toString(limbs * 9 + 1).c_str());
+    }
+}
+static bool isDeepZoom()
+{
+    // The GPU perturbation kernel needs double precision; without it frames stay in double-single. Perturbation is
+    // only worked out for z^2 + c, so the other fractal families stop at the limit of doubles.
+    return (bForcePerturb || dblXrange < PERTURB_RANGE_THRESHOLD) && (bUseCpuEngine || bDeviceFp64) &&
+           g_fractalFamily == FRACTAL_MANDELBROT;
+}
+static MandelView currentMandelView()
+{
+    return mandelViewAtLevel(frameLevel);
+}
+static MandelView mandelViewAtLevel(int level)
+{
+    // Same mapping as the 'mandel' kernel (MaxIm = minY + xRange * h / w), but built from the tracked X range so it
+    // stays valid when maxX - minX has no bits left. Other resolution levels keep the origin and scale the spacing by
+    // 2^-level.
+    MandelView view;
+    double yExtent = dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    view.minX = minX;
+    view.MaxIm = minY + yExtent;
+    view.Re_factor = ldexp(dblXrange / (FRACTAL_IMAGE_WIDTH - 1), -level);
+    view.Im_factor = ldexp(yExtent / (FRACTAL_IMAGE_HEIGHT - 1), -level);
+    return view;
+}
+static void setFrameLevel(int level)
+{
+    if (level != frameLevel)
+    {
+        unsigned int w;
+        unsigned int h;
+        resolutionSize(FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, level, w, h);
+        printf("Resolution: %ux%u (level %d), predicted %.1f milliseconds\n", w, h, level,
+               resolution.predictMs(w * h));
+    }
+    frameLevel = level;
+    resolutionSize(FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, level, frameWidth, frameHeight);
+}
+static int chooseFrameLevel()
+{
+    // Level of a frame that answers input: the highest the controller expects to fit --frame-budget
+    if (!bUseCpuEngine || frameBudgetMs <= 0.0)
+    {
+        return 0;
+    }
+    return resolution.chooseLevel(FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT, 0, frameBudgetMs);
+}
+static double restRefineWaitMs()
+{
+    // Milliseconds until the rest frame is due (0 = now), or -1 if the frame on screen needs none
+    if (!bRestPending)
+    {
+        return -1.0;
+    }
+    return std::max(0.0, lastInputMs + RESOLUTION_IDLE_MS - pipelineNowMs());
+}
+static void prepareCpuFrame()
+{
+    // Size the CPU framebuffer for the frame about to be rendered. Vectors keep their capacity, and the colour buffers
+    // circulate through the pipeline slots, so once each has held the largest frame a change of level allocates nothing.
+    if (cpuFrame.width != frameWidth || cpuFrame.height != frameHeight || cpuFrame.format != frameFormat)
+    {
+        cpuFrame.format = frameFormat;
+        cpuFrame.resize(frameWidth, frameHeight);
+        return;
+    }
+    // The colour buffer was taken from a slot on the last publish and may still be the size of an older frame
+    if (frameFormat == FRAME_RGBA32F)
+    {
+        cpuFrame.rgba.resize((size_t)frameWidth * frameHeight * 4);
+    }
+    else
+    {
+        cpuFrame.texels.resize((size_t)frameWidth * frameHeight);
+    }
+}
+static unsigned int fillKnownFromCoarseFrame(std::vector<int> &known)
+{
+    // A rest frame sees the same view as the complete frame before it, at a higher level: that frame's pixels are
+    // every 2^(frameLevel - coarseLevel)-th pixel of this one. Only used before cpuFrame is resized for the rest frame.
+    if (!bRefining || coarseLevel >= frameLevel || coarseMaxIter != frameMaxIter ||
+        cpuFrame.pixelIter.size() != (size_t)cpuFrame.width * cpuFrame.height)
+    {
+        return 0;
+    }
+    const unsigned int shift = frameLevel - coarseLevel;
+    const unsigned int w = std::min(cpuFrame.width, (frameWidth - 1) / (1u << shift) + 1);
+    const unsigned int h = std::min(cpuFrame.height, (frameHeight - 1) / (1u << shift) + 1);
+    unsigned int filled = 0;
+    for (unsigned int y = 0; y < h; y++)
+    {
+        const int *src = &cpuFrame.pixelIter[(size_t)y * cpuFrame.width];
+        int *dst = &known[(size_t)(y << shift) * frameWidth];
+        for (unsigned int x = 0; x < w; x++)
+        {
+            if (dst[x << shift] < 0)
+            {
+                dst[x << shift] = src[x];
+                filled++;
+            }
+        }
+    }
+    return filled;
+}
+static void updatePerturbFrame()
+{
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+    gettimeofday(&tvalBefore, NULL);
+
+    // Reference point at the centre pixel, in arbitrary precision
+    ensureDeepPrecision();
+    MandelView view = currentMandelView();
+    unsigned int limbs = deepMinX.fracLimbs();
+    BigFixed refRe = deepMinX + BigFixed((frameWidth / 2) * view.Re_factor, limbs);
+    BigFixed refIm = deepMinY + BigFixed(dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH - (frameHeight / 2) * view.Im_factor, limbs);
+    computePerturbFrame(refRe, refIm, frameWidth, frameHeight, view.Re_factor, view.Im_factor, frameMaxIter, perturbFrame);
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("Reference orbit: %u bits, length = %d, series skip = %d iterations, %lld milliseconds\n", limbs * 32,
+           perturbFrame.refLength, perturbFrame.skipIter, microSecondsElapsed / 1000);
+}
+static bool lookupIterationCache()
+{
+    // Fill cacheKnown with the results known before the frame is iterated: from the iteration cache, from a field
+    // loaded with --load-field and, for a rest frame, from the frame before it. Returns false, leaving cacheKnown
+    // alone, if there is none of them.
+    bool bCached = false;
+    // Deep zooms are past the reach of the double precision lattice and are never cached, and the pixels of a frame
+    // below full resolution are not a contiguous block of any cache level
+    if (iterCache && !isDeepZoom() && frameLevel >= 0)
+    {
+        MandelView view = currentMandelView();
+        if (!iterCache->gridFor(view.minX, view.MaxIm, view.Re_factor, view.Im_factor, cacheGrid))
+        {
+            // Not reachable by 2x zooms from the anchor (e.g. a new --view): start a new lattice here
+            iterCache->setAnchor(view.minX, view.MaxIm, view.Re_factor, view.Im_factor);
+            iterCache->gridFor(view.minX, view.MaxIm, view.Re_factor, view.Im_factor, cacheGrid);
+        }
+        iterCache->lookupFrame(cacheGrid, frameWidth, frameHeight, cacheKnown);
+        bCached = true;
+    }
+    if (loadedField.isOpen())
+    {
+        if (!bCached)
+        {
+            cacheKnown.assign((size_t)frameWidth * frameHeight, -1);
+        }
+        unsigned int filled = fillKnownFromField(cacheKnown);
+        if (filled > 0)
+        {
+            printf("Loaded field: %u of %u pixels known\n", filled, frameWidth * frameHeight);
+        }
+        bCached = true;
+    }
+    if (bRefining && bUseCpuEngine)
+    {
+        if (!bCached)
+        {
+            cacheKnown.assign((size_t)frameWidth * frameHeight, -1);
+        }
+        unsigned int filled = fillKnownFromCoarseFrame(cacheKnown);
+        printf("Rest frame: %u of %u pixels known from the level %d frame\n", filled, frameWidth * frameHeight,
+               coarseLevel);
+        bCached = true;
+    }
+    return bCached;
+}
+static void storeIterationCache(const std::vector<int> &packed)
+{
+    if (!iterCache || isDeepZoom() || frameLevel < 0)
+    {
+        return;
+    }
+    IterationCacheStats stats = iterCache->storeFrame(cacheGrid, frameWidth, frameHeight, packed, cacheKnown);
+    printf("Iteration cache: hit rate %.1f%% (%u reused, %u iterated), %zu tiles, %.1f of %zu MB, %u evicted\n",
+           100.0 * stats.hitRate(), stats.hits, stats.misses, stats.tiles, stats.bytes / 1048576.0,
+           iterCache->budget() >> 20, stats.evictions);
+}
+static void snapViewToCacheGrid()
+{
+    // Move the view origin (by less than a pixel) onto the cache lattice so the samples of earlier frames line up
+    if (!iterCache || isDeepZoom())
+    {
+        return;
+    }
+    MandelView view = mandelViewAtLevel(0);
+    CacheGrid grid;
+    if (!iterCache->gridFor(view.minX, view.MaxIm, view.Re_factor, view.Im_factor, grid))
+    {
+        return;
+    }
+    double MaxIm;
+    iterCache->gridOrigin(grid, minX, MaxIm);
+    minY = MaxIm - dblXrange * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    maxX = minX + dblXrange;
+    maxY = minY + dblYrange;
+    midX = (maxX + minX) / 2;
+    midY = (maxY + minY) / 2;
+    deepMinX = BigFixed(minX, deepMinX.fracLimbs());
+    deepMinY = BigFixed(minY, deepMinY.fracLimbs());
+}
+static bool parseCommandLine(int argc, char *args[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = args[i];
+        if (strcmp(arg, "--cpu") == 0)
+        {
+            bUseCpuEngine = true;
+        }
+        else if (strcmp(arg, "--headless") == 0)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+        }
+        else if (strcmp(arg, "--threads") == 0 && i + 1 < argc)
+        {
+            cpuThreads = (unsigned int)atoi(args[++i]);
+        }
+        else if (strcmp(arg, "--simd") == 0 && i + 1 < argc && parseSimdLevel(args[i + 1], cpuSimdLevel))
+        {
+            i++;
+        }
+        else if (strcmp(arg, "--no-shortcuts") == 0)
+        {
+            bShortcuts = false;
+        }
+        else if (strcmp(arg, "--poster") == 0 && i + 2 < argc)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            posterWidth = (unsigned int)atoi(args[++i]);
+            posterHeight = (unsigned int)atoi(args[++i]);
+            if (posterWidth < 2 || posterHeight < 2)
+            {
+                printf("Invalid --poster %s %s\n", args[i - 1], args[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--zoom-video") == 0 && i + 5 < argc)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            videoRe = args[++i];
+            videoIm = args[++i];
+            videoStartWidth = atof(args[++i]);
+            videoEndWidth = atof(args[++i]);
+            videoFrames = (unsigned int)std::max(atoi(args[++i]), 0);
+            BigFixed parsed;
+            if (!(videoStartWidth > 0.0) || !(videoEndWidth > 0.0) || videoFrames == 0 ||
+                !BigFixed::fromString(videoRe, 1, parsed) || !BigFixed::fromString(videoIm, 1, parsed))
+            {
+                printf("Invalid --zoom-video %s %s %s %s %s\n", videoRe, videoIm, args[i - 2], args[i - 1], args[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--video-size") == 0 && i + 2 < argc)
+        {
+            videoWidth = (unsigned int)std::max(atoi(args[++i]), 2);
+            videoHeight = (unsigned int)std::max(atoi(args[++i]), 2);
+        }
+        else if (strcmp(arg, "--video-fps") == 0 && i + 1 < argc)
+        {
+            videoFps = (unsigned int)std::max(atoi(args[++i]), 1);
+        }
+        else if (strcmp(arg, "--serve") == 0 && i + 1 < argc)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            int port = atoi(args[++i]);
+            if (port < 1 || port > 65535)
+            {
+                printf("Invalid --serve %s\n", args[i]);
+                return false;
+            }
+            tileServerPort = (unsigned int)port;
+        }
+        else if (strcmp(arg, "--serve-socket") == 0 && i + 1 < argc)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            tileServerSocket = args[++i];
+        }
+        else if (strcmp(arg, "--tile-cache") == 0 && i + 1 < argc)
+        {
+            tileCacheDir = args[++i];
+        }
+        else if (strcmp(arg, "--no-tile-cache") == 0)
+        {
+            bTileDiskCache = false;
+        }
+        else if (strcmp(arg, "--tile-cache-mb") == 0 && i + 1 < argc)
+        {
+            tileCacheMB = (size_t)std::max(atoi(args[++i]), 1);
+        }
+        else if (strcmp(arg, "--load-field") == 0 && i + 1 < argc)
+        {
+            if (!loadIterationField(args[++i]))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--field-out") == 0 && i + 1 < argc)
+        {
+            fieldSavePath = args[++i];
+        }
+        else if (strcmp(arg, "--recolour") == 0 && i + 1 < argc)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            recolourPath = args[++i];
+        }
+        else if (strcmp(arg, "--crop") == 0 && i + 4 < argc)
+        {
+            cropX = (unsigned int)atoi(args[++i]);
+            cropY = (unsigned int)atoi(args[++i]);
+            int cw = atoi(args[++i]);
+            int ch = atoi(args[++i]);
+            if (cw < 1 || ch < 1)
+            {
+                printf("Invalid --crop size %d x %d\n", cw, ch);
+                return false;
+            }
+            cropWidth = (unsigned int)cw;
+            cropHeight = (unsigned int)ch;
+        }
+        else if (strcmp(arg, "--out") == 0 && i + 1 < argc)
+        {
+            headlessOutPath = args[++i];
+        }
+        else if (strcmp(arg, "--view") == 0 && i + 3 < argc)
+        {
+            double viewMinX = atof(args[++i]);
+            double viewMaxX = atof(args[++i]);
+            setViewBounds(viewMinX, viewMaxX, atof(args[++i]));
+        }
+        else if (strcmp(arg, "--centre") == 0 && i + 3 < argc)
+        {
+            // Deep zoom locations, given as decimal strings of any length
+            const char *re = args[++i];
+            const char *im = args[++i];
+            if (!setViewCentre(re, im, atof(args[++i])))
+            {
+                printf("Invalid --centre %s %s %s\n", re, im, args[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--perturb") == 0)
+        {
+            bForcePerturb = true;
+        }
+        else if (strcmp(arg, "--check-perturb") == 0)
+        {
+            bUseCpuEngine = true;
+            bHeadless = true;
+            bCheckPerturb = true;
+        }
+        else if (strcmp(arg, "--subdivide") == 0)
+        {
+            bSubdivide = true;
+        }
+        else if (strcmp(arg, "--sync-render") == 0)
+        {
+            bRenderThread = false;
+        }
+        else if (strcmp(arg, "--no-progressive") == 0)
+        {
+            bProgressive = false;
+        }
+        else if (strcmp(arg, "--frame-budget") == 0 && i + 1 < argc)
+        {
+            frameBudgetMs = std::max(atof(args[++i]), 0.0);
+        }
+        else if (strcmp(arg, "--rest-scale") == 0 && i + 1 < argc)
+        {
+            int scale = atoi(args[++i]);
+            if (scale != 1 && scale != 1 << RESOLUTION_MAX_LEVEL)
+            {
+                printf("--rest-scale must be 1 or %d\n", 1 << RESOLUTION_MAX_LEVEL);
+                return false;
+            }
+            restLevel = scale == 1 ? 0 : RESOLUTION_MAX_LEVEL;
+        }
+        else if (strcmp(arg, "--palette") == 0 && i + 1 < argc)
+        {
+            paletteName = args[++i];
+        }
+        else if (strcmp(arg, "--format") == 0 && i + 1 < argc)
+        {
+            if (!parseFrameFormat(args[++i], frameFormat))
+            {
+                printf("Unknown frame format '%s'\n", args[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--max-iter") == 0 && i + 1 < argc)
+        {
+            maxIterOverride = (float)atof(args[++i]);
+            if (!(maxIterOverride >= 1.0f && maxIterOverride <= MAX_ITER_MAX))
+            {
+                printf("Invalid --max-iter %s (1 to %.0f)\n", args[i], MAX_ITER_MAX);
+                return false;
+            }
+            maxIterOverride = floorf(maxIterOverride);
+        }
+        else if (strcmp(arg, "--benchmark") == 0)
+        {
+            bBenchmark = true;
+        }
+        else if (strcmp(arg, "--bench-runs") == 0 && i + 1 < argc)
+        {
+            benchRuns = (unsigned int)std::max(atoi(args[++i]), 1);
+        }
+        else if (strcmp(arg, "--bench-out") == 0 && i + 1 < argc)
+        {
+            benchOutPath = args[++i];
+        }
+        else if (strcmp(arg, "--devices") == 0 && i + 1 < argc)
+        {
+            deviceSelection = args[++i];
+        }
+        else if (strcmp(arg, "--cl-cache") == 0 && i + 1 < argc)
+        {
+            programCacheDir = args[++i];
+        }
+        else if (strcmp(arg, "--no-cl-cache") == 0)
+        {
+            bProgramCache = false;
+        }
+        else if (strcmp(arg, "--heatmap") == 0 && i + 1 < argc)
+        {
+            heatmapPath = args[++i];
+        }
+        else if (strcmp(arg, "--stats-file") == 0 && i + 1 < argc)
+        {
+            statsPath = args[++i];
+        }
+        else if (strcmp(arg, "--stats-interval") == 0 && i + 1 < argc)
+        {
+            statsIntervalMs = std::max(atof(args[++i]), 0.1) * 1000.0;
+        }
+        else if (strcmp(arg, "--cache-mb") == 0 && i + 1 < argc)
+        {
+            iterCacheBudgetMB = (size_t)atoi(args[++i]);
+        }
+        else if (strcmp(arg, "--precision") == 0 && i + 1 < argc)
+        {
+            bPrecisionFixed = strcmp(args[++i], "auto") != 0;
+            if (bPrecisionFixed && !parsePrecisionTier(args[i], precisionOverride))
+            {
+                printf("Unknown precision '%s'\n", args[i]);
+                return false;
+            }
+        }
+        else if (strcmp(arg, "--aa-budget") == 0 && i + 1 < argc)
+        {
+            aaBudget = (unsigned int)std::max(atoi(args[++i]), 0);
+        }
+        else if (strcmp(arg, "--fractal") == 0 && i + 1 < argc)
+        {
+            // Also moves to the family's own view: --view or --centre after it replace that
+            int family = FRACTAL_MANDELBROT;
+            if (!parseFractalFamily(args[++i], family))
+            {
+                printf("Unknown fractal '%s'\n", args[i]);
+                return false;
+            }
+            selectFractalFamily(family);
+        }
+        else if (strcmp(arg, "--julia") == 0 && i + 2 < argc)
+        {
+            bJuliaOverride = true;
+            juliaOverrideRe = atof(args[++i]);
+            juliaOverrideIm = atof(args[++i]);
+            g_fractalJuliaRe = juliaOverrideRe;
+            g_fractalJuliaIm = juliaOverrideIm;
+        }
+        else
+        {
+            printf("Usage: %s [--cpu] [--headless] [--threads n] [--simd scalar|avx2|avx512] [--no-shortcuts] [--out file.ppm] [--poster width height] [--zoom-video re im startWidth endWidth frames] [--video-size w h] [--video-fps n] [--serve port] [--serve-socket path] [--tile-cache dir] [--no-tile-cache] [--tile-cache-mb n] [--load-field file.mif] [--field-out file.mif] [--recolour file.mif] [--crop x y w h] [--view minX maxX minY] [--centre re im width] [--perturb] [--check-perturb] [--subdivide] [--cache-mb n] [--no-progressive] [--sync-render] [--frame-budget ms] [--rest-scale 1|2] [--palette bands|smooth|fire|grey|equalized] [--format rgba32f|rgba8|iter] [--aa-budget pixels] [--precision auto|float|ds|double] [--fractal mandelbrot|multibrot3..8|julia|julia3..8|burningship] [--julia re im] [--max-iter n] [--cl-cache dir] [--no-cl-cache] [--devices all|i,j,...] [--benchmark] [--bench-runs n] [--bench-out file.json] [--heatmap base] [--stats-file file.json] [--stats-interval seconds]\n", args[0]);
+            return false;
+        }
+    }
+    return true;
+}
+static bool UpdateKernelArgsRewriteImage()
+{
+    cl_int status = CL_SUCCESS;
+
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+
+    gettimeofday(&tvalBefore, NULL);
+
+    if (isDeepZoom())
+    {
+        return UpdatePerturbKernelArgsRewriteImage(tvalBefore);
+    }
+    if (bSubdivide)
+    {
+        return UpdateSubdivideKernelArgsRewriteImage(tvalBefore);
+    }
+    if (!clHelpers.empty())
+    {
+        return UpdateMultiDeviceKernelArgsRewriteImage(tvalBefore);
+    }
+    if (frameTier != PRECISION_DOUBLE)
+    {
+        return UpdateFloatKernelArgsRewriteImage(tvalBefore);
+    }
+    if (lookupIterationCache())
+    {
+        return UpdateCachedKernelArgsRewriteImage(tvalBefore);
+    }
+
+    // Send / update kernel arguments
+    status = clSetKernelArg(kernel, 0, sizeof(cl_mem), &writeToImage);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernel, 1, sizeof(double), &minX);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernel, 2, sizeof(double), &maxX);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernel, 3, sizeof(double), &minY);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(kernel, 4, sizeof(cl_mem), &shortcutCountsBuffer);
+    exitOnFail("clSetKernelArg 4", status);
+    cl_int useShortcuts = bShortcuts ? 1 : 0;
+    status = clSetKernelArg(kernel, 5, sizeof(cl_int), &useShortcuts);
+    exitOnFail("clSetKernelArg 5", status);
+    status = clSetKernelArg(kernel, 6, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 6", status);
+    setPaletteKernelArgs(kernel, 7);
+    status = clSetKernelArg(kernel, 10, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg 10", status);
+
+    cl_int shortcutCounts[3] = {0, 0, 0};
+    status = clEnqueueWriteBuffer(commands, shortcutCountsBuffer, CL_TRUE, 0, sizeof(shortcutCounts), shortcutCounts, 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer shortcutCounts", status);
+
+    cl_event event[3];
+    // Aquire texture
+    status = clEnqueueAcquireGLObjects(commands, 1, &writeToImage, 0, NULL, &event[0]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    // Execute kernel
+    status = clEnqueueNDRangeKernel(commands, kernel, 2, NULL, GWSize, LocalWorkSize, 1, &event[0], &event[1]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    // Release texture
+    status = clEnqueueReleaseGLObjects(commands, 1, &writeToImage, 1, &event[1], &event[2]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    clWaitForEvents(1, &event[2]);
+    clFinish(commands);
+    trackKernelEvent(event[1]);
+    recordSharedImageStages(event);
+
+    status = clEnqueueReadBuffer(commands, shortcutCountsBuffer, CL_TRUE, 0, sizeof(shortcutCounts), shortcutCounts, 0, NULL, NULL);
+    exitOnFail("clEnqueueReadBuffer shortcutCounts", status);
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot = %lld milliseconds\n", microSecondsElapsed / 1000);
+    printShortcutCounts((unsigned int)shortcutCounts[0], (unsigned int)shortcutCounts[1], (unsigned int)shortcutCounts[2]);
+
+    return true;
+}
+static bool UpdatePerturbKernelArgsRewriteImage(const struct timeval &tvalBefore)
+{
+    cl_int status = CL_SUCCESS;
+    struct timeval tvalAfter;
+
+    updatePerturbFrame();
+
+    // Upload the reference orbit, growing the buffer when the orbit no longer fits
+    size_t orbitBytes = perturbFrame.orbit.size() * sizeof(double);
+    if (orbitBytes > refOrbitBufferSize)
+    {
+        if (refOrbitBuffer != NULL)
+        {
+            clReleaseMemObject(refOrbitBuffer);
+        }
+        refOrbitBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_ONLY, orbitBytes, NULL, &status);
+        exitOnFail("clCreateBuffer refOrbit", status);
+        refOrbitBufferSize = orbitBytes;
+    }
+    status = clEnqueueWriteBuffer(commands, refOrbitBuffer, CL_TRUE, 0, orbitBytes, perturbFrame.orbit.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer refOrbit", status);
+    cl_int rebaseCount = 0;
+    status = clEnqueueWriteBuffer(commands, rebaseCountBuffer, CL_TRUE, 0, sizeof(rebaseCount), &rebaseCount, 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer rebaseCount", status);
+
+    cl_int refLength = perturbFrame.refLength;
+    cl_double2 refPixel = {{(double)perturbFrame.refX, (double)perturbFrame.refY}};
+    cl_int skipIter = perturbFrame.skipIter;
+    cl_double2 saA = {{perturbFrame.saA[0], perturbFrame.saA[1]}};
+    cl_double2 saB = {{perturbFrame.saB[0], perturbFrame.saB[1]}};
+    cl_double2 saC = {{perturbFrame.saC[0], perturbFrame.saC[1]}};
+    status = clSetKernelArg(kernelPerturb, 0, sizeof(cl_mem), &writeToImage);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernelPerturb, 1, sizeof(cl_mem), &refOrbitBuffer);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernelPerturb, 2, sizeof(cl_int), &refLength);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernelPerturb, 3, sizeof(cl_double2), &refPixel);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(kernelPerturb, 4, sizeof(double), &perturbFrame.Re_factor);
+    exitOnFail("clSetKernelArg 4", status);
+    status = clSetKernelArg(kernelPerturb, 5, sizeof(double), &perturbFrame.Im_factor);
+    exitOnFail("clSetKernelArg 5", status);
+    status = clSetKernelArg(kernelPerturb, 6, sizeof(cl_int), &skipIter);
+    exitOnFail("clSetKernelArg 6", status);
+    status = clSetKernelArg(kernelPerturb, 7, sizeof(cl_double2), &saA);
+    exitOnFail("clSetKernelArg 7", status);
+    status = clSetKernelArg(kernelPerturb, 8, sizeof(cl_double2), &saB);
+    exitOnFail("clSetKernelArg 8", status);
+    status = clSetKernelArg(kernelPerturb, 9, sizeof(cl_double2), &saC);
+    exitOnFail("clSetKernelArg 9", status);
+    status = clSetKernelArg(kernelPerturb, 10, sizeof(cl_mem), &rebaseCountBuffer);
+    exitOnFail("clSetKernelArg 10", status);
+    status = clSetKernelArg(kernelPerturb, 11, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 11", status);
+    setPaletteKernelArgs(kernelPerturb, 12);
+    status = clSetKernelArg(kernelPerturb, 15, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg 15", status);
+
+    cl_event event[3];
+    status = clEnqueueAcquireGLObjects(commands, 1, &writeToImage, 0, NULL, &event[0]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    status = clEnqueueNDRangeKernel(commands, kernelPerturb, 2, NULL, GWSize, LocalWorkSize, 1, &event[0], &event[1]);
+    exitOnFail("clEnqueueNDRangeKernel mandelPerturb", status);
+    status = clEnqueueReleaseGLObjects(commands, 1, &writeToImage, 1, &event[1], &event[2]);
+    exitOnFail("clEnqueueReleaseGLObjects", status);
+    clWaitForEvents(1, &event[2]);
+    clFinish(commands);
+    trackKernelEvent(event[1]);
+    recordSharedImageStages(event);
+
+    status = clEnqueueReadBuffer(commands, rebaseCountBuffer, CL_TRUE, 0, sizeof(rebaseCount), &rebaseCount, 0, NULL, NULL);
+    exitOnFail("clEnqueueReadBuffer rebaseCount", status);
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot (perturbation) = %lld milliseconds\n", microSecondsElapsed / 1000);
+    printf("Perturbation: rebases (glitches avoided) = %d\n", rebaseCount);
+
+    return true;
+}
+static bool UpdateSubdivideKernelArgsRewriteImage(const struct timeval &tvalBefore)
+{
+    cl_int status = CL_SUCCESS;
+    struct timeval tvalAfter;
+    cl_int useShortcuts = bShortcuts ? 1 : 0;
+
+    cl_int subdivStats[3] = {0, 0, 0};
+    status = clEnqueueWriteBuffer(commands, subdivStatsBuffer, CL_TRUE, 0, sizeof(subdivStats), subdivStats, 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer subdivStats", status);
+
+    // Pass 0: the grid lines that border the initial rectangles
+    status = clSetKernelArg(kernelGridLines, 0, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernelGridLines, 1, sizeof(double), &minX);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernelGridLines, 2, sizeof(double), &maxX);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernelGridLines, 3, sizeof(double), &minY);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(kernelGridLines, 4, sizeof(cl_int), &useShortcuts);
+    exitOnFail("clSetKernelArg 4", status);
+    status = clSetKernelArg(kernelGridLines, 5, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg 5", status);
+    cl_event kernelDone;
+    status = clEnqueueNDRangeKernel(commands, kernelGridLines, 2, NULL, GWSize, LocalWorkSize, 0, NULL, &kernelDone);
+    exitOnFail("clEnqueueNDRangeKernel mandelGridLines", status);
+    trackKernelEvent(kernelDone);
+    std::vector<int> xs = subdivGridLines(FRACTAL_IMAGE_WIDTH);
+    std::vector<int> ys = subdivGridLines(FRACTAL_IMAGE_HEIGHT);
+    SubdivisionStats stats;
+    stats.computed = (unsigned int)(ys.size() * FRACTAL_IMAGE_WIDTH + xs.size() * (FRACTAL_IMAGE_HEIGHT - ys.size()));
+
+    // Passes 1..n: one work-group per queued rectangle, each pass queueing the rectangles of the next
+    std::vector<SubdivRect> seed = subdivInitialRects(FRACTAL_IMAGE_WIDTH, FRACTAL_IMAGE_HEIGHT);
+    status = clEnqueueWriteBuffer(commands, rectQueueBuffers[0], CL_TRUE, 0, seed.size() * sizeof(SubdivRect), seed.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer rectQueue", status);
+    cl_int rectCount = (cl_int)seed.size();
+    cl_int capacity = (cl_int)SUBDIV_QUEUE_CAPACITY;
+    cl_int width = FRACTAL_IMAGE_WIDTH;
+    cl_int height = FRACTAL_IMAGE_HEIGHT;
+    for (int pass = 0; rectCount > 0; pass++)
+    {
+        cl_int nextCount = 0;
+        status = clEnqueueWriteBuffer(commands, rectCountBuffer, CL_TRUE, 0, sizeof(nextCount), &nextCount, 0, NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer rectCount", status);
+        status = clSetKernelArg(kernelSubdivide, 0, sizeof(cl_mem), &rectQueueBuffers[pass & 1]);
+        exitOnFail("clSetKernelArg 0", status);
+        status = clSetKernelArg(kernelSubdivide, 1, sizeof(cl_mem), &pixelIterBuffer);
+        exitOnFail("clSetKernelArg 1", status);
+        status = clSetKernelArg(kernelSubdivide, 2, sizeof(cl_mem), &rectQueueBuffers[(pass + 1) & 1]);
+        exitOnFail("clSetKernelArg 2", status);
+        status = clSetKernelArg(kernelSubdivide, 3, sizeof(cl_mem), &rectCountBuffer);
+        exitOnFail("clSetKernelArg 3", status);
+        status = clSetKernelArg(kernelSubdivide, 4, sizeof(cl_int), &capacity);
+        exitOnFail("clSetKernelArg 4", status);
+        status = clSetKernelArg(kernelSubdivide, 5, sizeof(cl_mem), &subdivStatsBuffer);
+        exitOnFail("clSetKernelArg 5", status);
+        status = clSetKernelArg(kernelSubdivide, 6, sizeof(cl_int), &width);
+        exitOnFail("clSetKernelArg 6", status);
+        status = clSetKernelArg(kernelSubdivide, 7, sizeof(cl_int), &height);
+        exitOnFail("clSetKernelArg 7", status);
+        status = clSetKernelArg(kernelSubdivide, 8, sizeof(double), &minX);
+        exitOnFail("clSetKernelArg 8", status);
+        status = clSetKernelArg(kernelSubdivide, 9, sizeof(double), &maxX);
+        exitOnFail("clSetKernelArg 9", status);
+        status = clSetKernelArg(kernelSubdivide, 10, sizeof(double), &minY);
+        exitOnFail("clSetKernelArg 10", status);
+        status = clSetKernelArg(kernelSubdivide, 11, sizeof(cl_int), &useShortcuts);
+        exitOnFail("clSetKernelArg 11", status);
+        status = clSetKernelArg(kernelSubdivide, 12, sizeof(cl_float), &frameMaxIter);
+        exitOnFail("clSetKernelArg 12", status);
+        size_t globalSize = rectCount * SUBDIV_GROUP_SIZE;
+        status = clEnqueueNDRangeKernel(commands, kernelSubdivide, 1, NULL, &globalSize, &SUBDIV_GROUP_SIZE, 0, NULL, &kernelDone);
+        exitOnFail("clEnqueueNDRangeKernel mandelSubdivide", status);
+        trackKernelEvent(kernelDone);
+        status = clEnqueueReadBuffer(commands, rectCountBuffer, CL_TRUE, 0, sizeof(nextCount), &nextCount, 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer rectCount", status);
+        stats.passes++;
+        stats.rects += rectCount;
+        rectCount = std::min(nextCount, capacity);
+    }
+
+    // Colour the packed results into the shared texture
+    colourizeToTexture(1, 1);
+
+    status = clEnqueueReadBuffer(commands, subdivStatsBuffer, CL_TRUE, 0, sizeof(subdivStats), subdivStats, 0, NULL, NULL);
+    exitOnFail("clEnqueueReadBuffer subdivStats", status);
+    stats.filled = (unsigned int)subdivStats[0];
+    stats.computed += (unsigned int)subdivStats[1];
+    stats.overflows = (unsigned int)subdivStats[2];
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot (subdivision) = %lld milliseconds\n", microSecondsElapsed / 1000);
+    printSubdivisionStats(stats);
+
+    return true;
+}
+static bool UpdateCachedKernelArgsRewriteImage(const struct timeval &tvalBefore)
+{
+    cl_int status = CL_SUCCESS;
+    struct timeval tvalAfter;
+    cl_int useShortcuts = bShortcuts ? 1 : 0;
+
+    // Known results go up, the kernel fills in the rest and the completed field comes back for the cache
+    status = clEnqueueWriteBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), cacheKnown.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer pixelIter", status);
+    status = clSetKernelArg(kernelFillMissing, 0, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernelFillMissing, 1, sizeof(double), &minX);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernelFillMissing, 2, sizeof(double), &maxX);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernelFillMissing, 3, sizeof(double), &minY);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(kernelFillMissing, 4, sizeof(cl_int), &useShortcuts);
+    exitOnFail("clSetKernelArg 4", status);
+    status = clSetKernelArg(kernelFillMissing, 5, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg 5", status);
+    cl_event kernelDone;
+    status = clEnqueueNDRangeKernel(commands, kernelFillMissing, 2, NULL, GWSize, LocalWorkSize, 0, NULL, &kernelDone);
+    exitOnFail("clEnqueueNDRangeKernel mandelFillMissing", status);
+    trackKernelEvent(kernelDone);
+
+    colourizeToTexture(1, 1);
+
+    std::vector<int> packed(FRACTAL_IMAGE_SIZE);
+    status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), packed.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueReadBuffer pixelIter", status);
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot = %lld milliseconds\n", microSecondsElapsed / 1000);
+    storeIterationCache(packed);
+
+    return true;
+}
+static bool UpdateFloatKernelArgsRewriteImage(const struct timeval &tvalBefore)
+{
+    // Whole frame in the float or double-single tier: 'mandelProgressiveFloat' with steps of one pixel, which iterates
+    // only the pixels the iteration cache has not filled in
+    struct timeval tvalAfter;
+    bool bCached = lookupIterationCache();
+    if (!bCached)
+    {
+        cacheKnown.assign(FRACTAL_IMAGE_SIZE, -1);
+    }
+    status = clEnqueueWriteBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), cacheKnown.data(), 0, NULL, NULL);
+    exitOnFail("clEnqueueWriteBuffer pixelIter", status);
+    const ProgressivePass whole = {1, 1, 0, 0, 1, 1};
+    enqueueProgressiveRows(whole, 0, FRACTAL_IMAGE_HEIGHT, FRACTAL_IMAGE_WIDTH);
+
+    colourizeToTexture(1, 1);
+
+    if (bCached)
+    {
+        std::vector<int> packed(FRACTAL_IMAGE_SIZE);
+        status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, 0, FRACTAL_IMAGE_SIZE * sizeof(cl_int), packed.data(), 0, NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer pixelIter", status);
+        storeIterationCache(packed);
+    }
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot (%s) = %lld milliseconds\n", PRECISION_TIER_NAMES[frameTier], microSecondsElapsed / 1000);
+
+    return true;
+}
+static void enqueueRowBand(cl_command_queue queue, cl_kernel k, cl_mem field, const DeviceShare &share, cl_event *event)
+{
+    // Iterate the unknown pixels of the share's rows of 'field' with mandelProgressive, one pixel apart
+    cl_int width = FRACTAL_IMAGE_WIDTH;
+    cl_int height = FRACTAL_IMAGE_HEIGHT;
+    cl_int passArgs[4] = {1, 1, 0, 0};
+    cl_int useShortcuts = bShortcuts ? 1 : 0;
+    status = clSetKernelArg(k, 0, sizeof(cl_mem), &field);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(k, 1, sizeof(double), &minX);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(k, 2, sizeof(double), &maxX);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(k, 3, sizeof(double), &minY);
+    exitOnFail("clSetKernelArg 3", status);
+    status = clSetKernelArg(k, 4, sizeof(cl_int), &width);
+    exitOnFail("clSetKernelArg 4", status);
+    status = clSetKernelArg(k, 5, sizeof(cl_int), &height);
+    exitOnFail("clSetKernelArg 5", status);
+    for (cl_uint a = 0; a < 4; a++)
+    {
+        status = clSetKernelArg(k, 6 + a, sizeof(cl_int), &passArgs[a]);
+        exitOnFail("clSetKernelArg 6..9", status);
+    }
+    status = clSetKernelArg(k, 10, sizeof(cl_int), &useShortcuts);
+    exitOnFail("clSetKernelArg 10", status);
+    status = clSetKernelArg(k, 11, sizeof(cl_float), &frameMaxIter);
+    exitOnFail("clSetKernelArg 11", status);
+    size_t offset[2] = {0, share.rowStart};
+    size_t globalSize[2] = {FRACTAL_IMAGE_WIDTH, share.rowCount};
+    status = clEnqueueNDRangeKernel(queue, k, 2, offset, globalSize, NULL, 0, NULL, event);
+    exitOnFail("clEnqueueNDRangeKernel mandelProgressive (band)", status);
+}
+static double profiledMs(cl_event first, cl_event last)
+{
+    // Device time from the start of 'first' to the end of 'last' (same queue)
+    cl_ulong start = 0;
+    cl_ulong end = 0;
+    clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    return end > start ? (end - start) / 1e6 : 0.0;
+}
+static bool UpdateMultiDeviceKernelArgsRewriteImage(const struct timeval &tvalBefore)
+{
+    // Every device iterates its band of rows at once; the helpers' bands are copied into the display device's field,
+    // which is then coloured into the texture as usual
+    cl_int status = CL_SUCCESS;
+    struct timeval tvalAfter;
+    bool bCached = lookupIterationCache();
+    if (!bCached)
+    {
+        cacheKnown.assign(FRACTAL_IMAGE_SIZE, -1);
+    }
+    std::vector<int> field = cacheKnown;
+    splitDeviceRows(deviceShares, FRACTAL_IMAGE_HEIGHT);
+    const size_t rowInts = FRACTAL_IMAGE_WIDTH;
+
+    // Each device gets its own rows of the field, so the transfers never touch the same part of it
+    const size_t helperCount = clHelpers.size();
+    std::vector<cl_event> firstEvents(helperCount + 1, NULL);
+    std::vector<cl_event> lastEvents(helperCount + 1, NULL);
+    for (size_t d = 0; d <= helperCount; d++)
+    {
+        const DeviceShare &share = deviceShares[d];
+        if (share.rowCount == 0)
+        {
+            continue;
+        }
+        cl_command_queue queue = d == 0 ? commands : clHelpers[d - 1].queue;
+        cl_mem buffer = d == 0 ? pixelIterBuffer : clHelpers[d - 1].pixelIter;
+        size_t offset = share.rowStart * rowInts * sizeof(cl_int);
+        size_t bytes = share.rowCount * rowInts * sizeof(cl_int);
+        int *rows = &field[share.rowStart * rowInts];
+        status = clEnqueueWriteBuffer(queue, buffer, CL_FALSE, offset, bytes, rows, 0, NULL, &firstEvents[d]);
+        exitOnFail("clEnqueueWriteBuffer band", status);
+        if (d == 0)
+        {
+            enqueueRowBand(queue, kernelProgressive, buffer, share, &lastEvents[d]);
+        }
+        else
+        {
+            enqueueRowBand(queue, clHelpers[d - 1].kernel, buffer, share, NULL);
+            status = clEnqueueReadBuffer(queue, buffer, CL_FALSE, offset, bytes, rows, 0, NULL, &lastEvents[d]);
+            exitOnFail("clEnqueueReadBuffer band", status);
+        }
+        clFlush(queue);
+    }
+    // Helpers' bands go up to the display device as they arrive
+    for (size_t d = 1; d <= helperCount; d++)
+    {
+        const DeviceShare &share = deviceShares[d];
+        if (share.rowCount == 0)
+        {
+            continue;
+        }
+        clWaitForEvents(1, &lastEvents[d]);
+        status = clEnqueueWriteBuffer(commands, pixelIterBuffer, CL_FALSE, share.rowStart * rowInts * sizeof(cl_int),
+                                      share.rowCount * rowInts * sizeof(cl_int), &field[share.rowStart * rowInts], 0,
+                                      NULL, NULL);
+        exitOnFail("clEnqueueWriteBuffer helper band", status);
+    }
+    clFinish(commands);
+    for (size_t d = 0; d <= helperCount; d++)
+    {
+        if (deviceShares[d].rowCount > 0)
+        {
+            recordDeviceTime(deviceShares[d], profiledMs(firstEvents[d], lastEvents[d]));
+            clReleaseEvent(firstEvents[d]);
+            if (d == 0)
+            {
+                trackKernelEvent(lastEvents[d]);
+            }
+            else
+            {
+                clReleaseEvent(lastEvents[d]);
+            }
+        }
+    }
+
+    colourizeToTexture(1, 1);
+    if (bCached)
+    {
+        const DeviceShare &share = deviceShares[0];
+        status = clEnqueueReadBuffer(commands, pixelIterBuffer, CL_TRUE, share.rowStart * rowInts * sizeof(cl_int),
+                                     share.rowCount * rowInts * sizeof(cl_int), &field[share.rowStart * rowInts], 0,
+                                     NULL, NULL);
+        exitOnFail("clEnqueueReadBuffer pixelIter", status);
+    }
+
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("\n\nTime to create Mandelbrot (%zu devices) = %lld milliseconds, %.1f Mpixels/s combined\n", helperCount + 1,
+           microSecondsElapsed / 1000, microSecondsElapsed > 0 ? (double)FRACTAL_IMAGE_SIZE / microSecondsElapsed : 0.0);
+    for (size_t d = 0; d <= helperCount; d++)
+    {
+        const DeviceShare &share = deviceShares[d];
+        printf("  %s: rows %u to %u in %.1f milliseconds (%.1f Mpixels/s)\n", share.name.c_str(), share.rowStart,
+               share.rowStart + share.rowCount, share.lastMs,
+               share.lastMs > 0.0 ? share.rowCount * rowInts / (share.lastMs * 1000.0) : 0.0);
+    }
+    if (bCached)
+    {
+        storeIterationCache(field);
+    }
+    return true;
+}
+static void trackKernelEvent(cl_event event)
+{
+    // Completion event of one of the frame's kernels: kept for collectKernelMs()
+    kernelEvents.push_back(event);
+}
+static double collectKernelMs()
+{
+    // Total run time of the kernels tracked since the last call, from their profiling counters. It is recorded as one
+    // 'kernels' stage time.
+    if (kernelEvents.empty())
+    {
+        return 0.0;
+    }
+    double ms = 0.0;
+    for (cl_event event : kernelEvents)
+    {
+        clWaitForEvents(1, &event);
+        ms += profiledMs(event, event);
+        clReleaseEvent(event);
+    }
+    kernelEvents.clear();
+    renderStages.record(STAGE_KERNELS, ms);
+    return ms;
+}
+static void recordSharedImageStages(cl_event event[3])
+{
+    // Acquire (event[0]) and release (event[2]) of the shared texture, which have completed; event[1] is the kernel
+    // between them and goes to trackKernelEvent()
+    renderStages.record(STAGE_ACQUIRE, profiledMs(event[0], event[0]));
+    renderStages.record(STAGE_RELEASE, profiledMs(event[2], event[2]));
+    clReleaseEvent(event[0]);
+    clReleaseEvent(event[2]);
+}
+static void colourizeToTexture(cl_int cellW, cl_int cellH)
+{
+    // Colour pixelIterBuffer into the shared texture, cellW x cellH pixels per computed sample
+    cl_int status = CL_SUCCESS;
+    status = clSetKernelArg(kernelColourize, 0, sizeof(cl_mem), &writeToImage);
+    exitOnFail("clSetKernelArg 0", status);
+    status = clSetKernelArg(kernelColourize, 1, sizeof(cl_mem), &pixelIterBuffer);
+    exitOnFail("clSetKernelArg 1", status);
+    status = clSetKernelArg(kernelColourize, 2, sizeof(cl_int), &cellW);
+    exitOnFail("clSetKernelArg 2", status);
+    status = clSetKernelArg(kernelColourize, 3, sizeof(cl_int), &cellH);
+    exitOnFail("clSetKernelArg 3", status);
+    setPaletteKernelArgs(kernelColourize, 4);
+    cl_event event[3];
+    status = clEnqueueAcquireGLObjects(commands, 1, &writeToImage, 0, NULL, &event[0]);
+    exitOnFail("clEnqueueAcquireGLObjects", status);
+    status = clEnqueueNDRangeKernel(commands, kernelColourize, 2, NULL, GWSize, LocalWorkSize, 1, &event[0], &event[1]);
+    exitOnFail("clEnqueueNDRangeKernel mandelColourize", status);
+    status = clEnqueueReleaseGLObjects(commands, 1, &writeToImage, 1, &event[1], &event[2]);
+    exitOnFail("clEnqueueReleaseGLObjects", status);
+    clWaitForEvents(1, &event[2]);
+    clFinish(commands);
+    trackKernelEvent(event[1]);
+    recordSharedImageStages(event);
+}
+bool getOpenClContext()
+{
+    cl_int status = 0;
+    status = CL_SUCCESS;
+    // Variables for Platforms
+    cl_uint num_platforms = 0;
+    cl_platform_id *platforms = NULL;
+    cl_uint num_devices = 0;
+    cl_uint i;
+    cl_uint correctPlatformIndex = 0;
+
+    // Get Platforms
+    status = clGetPlatformIDs(num_platforms, platforms, &num_platforms);
+    exitOnFail("clGetPlatformIDs 1st pass", status);
+
+    platforms = new cl_platform_id[num_platforms];
+
+    status = clGetPlatformIDs(num_platforms, platforms, &num_platforms);
+    exitOnFail("clGetPlatformIDs 2nd pass", status);
+
+    for (i = 0; i < num_platforms; i++)
+    {
+        correctPlatformIndex = i;
+        char platformVendor[10240];
+        char platformVersion[10240];
+        clGetPlatformInfo(platforms[correctPlatformIndex], CL_PLATFORM_VENDOR, sizeof(platformVendor), platformVendor, NULL);
+        clGetPlatformInfo(platforms[correctPlatformIndex], CL_PLATFORM_VERSION, sizeof(platformVersion), platformVersion, NULL);
+        printf("PLATFORM_VENDOR = %s\n\t VERSION = %s\n", platformVendor, platformVersion);
+
+        // If the Platform Vendor is AMD/NVIDIA/Intel (Change as appropriate for GPU or Intel if none)
+        // NB: If we are relying on Intel, there is no detected GPU and this might fail on AMD chips
+        const char *s1(platformVendor);
+        const char *s2("NVIDIA Corporation");
+        const char *s3("Advanced Micro Devices, Inc.");
+        const char *s4("Intel(R) Corporation");
+        if (strcmp(s1, s2) == 0 || strcmp(s1, s3) == 0)
+        {
+            correctPlatformIndex = i;
+            platform = platforms[i];
+            printf("PlatformID: %s Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s2);
+            break;
+        }
+        else if (strcmp(s1, s3) == 0)
+        {
+            correctPlatformIndex = i;
+            platform = platforms[i];
+            printf("PlatformID: %s Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s3);
+            break;
+        }
+        if (strcmp(s1, s4) == 0)
+        {
+            correctPlatformIndex = i;
+            platform = platforms[i];
+            printf("PlatformID: %s Non GPU Platform Name: %s\n", __STRING(platforms[correctPlatformIndex]), s4);
+            break;
+        }
+    }
+
+    if (!platform)
+    {
+        platform = platforms[0];
+    }
+    // The display device: a GPU on the chosen platform (or the first platform that has one), shared with OpenGL
+    status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, devices, &num_devices);
+    for (i = 0; status != CL_SUCCESS && i < num_platforms; i++)
+    {
+        platform = platforms[i];
+        status = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, devices, &num_devices);
+    }
+    exitOnFail("clGetDeviceIDs", status);
+    printf("=== %d OpenCL device(s) found on platform:\n", 1);
+
+    for (cl_uint i = 0; i < num_devices; i++)
     {
         char buffer[10240];
         cl_uint buf_uint;
@@ -492,6 +3821,7 @@ bool getOpenClContext()
 
         status = clGetDeviceInfo(devices[i], CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(flag), &flag, NULL);
 
+        bDeviceFp64 = flag != 0;
         if (!flag)
         {
             printf("Double precision not supported \n\n");
@@ -525,6 +3855,9 @@ bool getOpenClContext()
             printf("  Floating-point multiply-and-add operation\n\n");
         }
     }
+    listClDevices(clAllDevices);
+    delete[] platforms;
+
     if (IsCLExtensionSupported("cl_khr_gl_sharing"))
     {
         printf("cl_khr_gl_sharing is supported.\n");
@@ -590,37 +3923,368 @@ static bool buildProgramCreateKernel()
     exitOnFail("clCreateCommandQueue", status);
 
     // Read 'Mandel.cl" kernel source file
-    FILE *fp;
-    char *source_str;
-    size_t source_size;
-    fp = fopen("Mandel.cl", "r");
-    if (!fp)
+    std::ifstream sourceFile("Mandel.cl", std::ios::binary);
+    if (!sourceFile)
     {
         printf("Failed to load kernel");
         exit(1);
     }
-    source_str = (char *)malloc(MAX_KERNEL_SIZE);
-    source_size = fread(source_str, 1, MAX_KERNEL_SIZE, fp);
-    fclose(fp);
+    kernelSource.assign((std::istreambuf_iterator<char>(sourceFile)), std::istreambuf_iterator<char>());
+
+    if (!bDeviceFp64)
+    {
+        // Only the float kernels are built (see Precision.h)
+        printf("No double precision on this device: frames are iterated in float or double-single, without perturbation, subdivision, other devices or anti-aliasing\n");
+        bForcePerturb = false;
+        bSubdivide = false;
+        deviceSelection = NULL;
+    }
 
-    cl_program program = clCreateProgramWithSource(g_clContext, 1,
-                                                   (const char **)&source_str, (const size_t *)&source_size, &status);
-    exitOnFail("clCreateProgramWithSource", status);
+    // ### Build Program (or load it from the binary cache)
+    std::string options = kernelBuildOptions();
+    cl_program program = buildProgram(g_clContext, devices[0], kernelSource, options);
+    fractalPrograms[g_fractalFamily] = program;
+    initClHelpers(kernelSource, options);
 
-    // ### Build Program
-    char *compileOptions = NULL;
-    const cl_device_id *deviceList = NULL;
-    cl_uint devicesCount = 0;
-    status = clBuildProgram(program, devicesCount, deviceList, compileOptions, NULL, NULL);
-    exitOnFail("clBuildProgram", status);
+    // ### Create the kernels
+    createFractalKernels(program);
 
-    // ### Create the kernel
-    kernel = clCreateKernel(program, "mandel", &status);
-    exitOnFail("clCreateKernel", status);
+    shortcutCountsBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, 3 * sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer shortcutCounts", status);
+    rebaseCountBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer rebaseCount", status);
 
-    clReleaseProgram(program);
+    kernelColourize = clCreateKernel(program, "mandelColourize", &status);
+    exitOnFail("clCreateKernel mandelColourize", status);
+    kernelHistogram = clCreateKernel(program, "mandelHistogram", &status);
+    exitOnFail("clCreateKernel mandelHistogram", status);
+    histogramBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, HISTOGRAM_BINS * sizeof(cl_uint), NULL, &status);
+    exitOnFail("clCreateBuffer histogram", status);
+    histogramStatsBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, 3 * sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer histogramStats", status);
+    kernelAAMark = clCreateKernel(program, "mandelAAMark", &status);
+    exitOnFail("clCreateKernel mandelAAMark", status);
+    kernelAASelect = clCreateKernel(program, "mandelAASelect", &status);
+    exitOnFail("clCreateKernel mandelAASelect", status);
+    kernelAAColour = clCreateKernel(program, "mandelAAColour", &status);
+    exitOnFail("clCreateKernel mandelAAColour", status);
+    size_t aaCapacity = std::max(std::min((size_t)aaBudget, (size_t)FRACTAL_IMAGE_SIZE), (size_t)1);
+    aaLevelBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, FRACTAL_IMAGE_SIZE, NULL, &status);
+    exitOnFail("clCreateBuffer aaLevel", status);
+    aaCountBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, AA_LEVELS * sizeof(cl_uint), NULL, &status);
+    exitOnFail("clCreateBuffer aaCount", status);
+    aaListedBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &status);
+    exitOnFail("clCreateBuffer aaListed", status);
+    aaPixelBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, aaCapacity * sizeof(cl_uint), NULL, &status);
+    exitOnFail("clCreateBuffer aaPixel", status);
+    aaSampleBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, aaCapacity * AA_SAMPLES * sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer aaSample", status);
+    pixelIterBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, FRACTAL_IMAGE_SIZE * sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer pixelIter", status);
+    for (int i = 0; i < 2; i++)
+    {
+        rectQueueBuffers[i] = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, SUBDIV_QUEUE_CAPACITY * sizeof(SubdivRect), NULL, &status);
+        exitOnFail("clCreateBuffer rectQueue", status);
+    }
+    rectCountBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer rectCount", status);
+    subdivStatsBuffer = clCreateBuffer(g_clContext, CL_MEM_READ_WRITE, 3 * sizeof(cl_int), NULL, &status);
+    exitOnFail("clCreateBuffer subdivStats", status);
+    uploadPalette();
     return true;
 }
+static void createFractalKernels(cl_program program)
+{
+    // The kernels that iterate, which differ between the fractal families. The ones that iterate in double precision
+    // are only built with it (NO_FP64 in Mandel.cl).
+    cl_int status;
+    if (bDeviceFp64)
+    {
+        kernel = clCreateKernel(program, "mandel", &status);
+        exitOnFail("clCreateKernel", status);
+        kernelPerturb = clCreateKernel(program, "mandelPerturb", &status);
+        exitOnFail("clCreateKernel mandelPerturb", status);
+        kernelGridLines = clCreateKernel(program, "mandelGridLines", &status);
+        exitOnFail("clCreateKernel mandelGridLines", status);
+        kernelSubdivide = clCreateKernel(program, "mandelSubdivide", &status);
+        exitOnFail("clCreateKernel mandelSubdivide", status);
+        kernelFillMissing = clCreateKernel(program, "mandelFillMissing", &status);
+        exitOnFail("clCreateKernel mandelFillMissing", status);
+        kernelProgressive = clCreateKernel(program, "mandelProgressive", &status);
+        exitOnFail("clCreateKernel mandelProgressive", status);
+        kernelAARefine = clCreateKernel(program, "mandelAARefine", &status);
+        exitOnFail("clCreateKernel mandelAARefine", status);
+    }
+    kernelProgressiveFloat = clCreateKernel(program, "mandelProgressiveFloat", &status);
+    exitOnFail("clCreateKernel mandelProgressiveFloat", status);
+}
+static void releaseFractalKernels()
+{
+    cl_kernel *kernels[] = {&kernel, &kernelPerturb, &kernelGridLines, &kernelSubdivide, &kernelFillMissing,
+                            &kernelProgressive, &kernelAARefine, &kernelProgressiveFloat};
+    for (cl_kernel *k : kernels)
+    {
+        if (*k)
+        {
+            clReleaseKernel(*k);
+            *k = NULL;
+        }
+    }
+}
+static void selectFractalFamily(int family)
+{
+    // Switch the CPU engine's escape loop and move to the family's own view
+    setFractalFamily(family);
+    if (bJuliaOverride)
+    {
+        g_fractalJuliaRe = juliaOverrideRe;
+        g_fractalJuliaIm = juliaOverrideIm;
+    }
+    const FractalFamily &f = FRACTAL_FAMILIES[family];
+    double height = f.width * FRACTAL_IMAGE_HEIGHT / FRACTAL_IMAGE_WIDTH;
+    setViewBounds(f.centreRe - f.width / 2, f.centreRe + f.width / 2, f.centreIm - height / 2);
+}
+static void nextFractalFamily()
+{
+    // Render thread: show the next family (F key). The GPU swaps in the kernels of the family's program, building it
+    // the first time, and the other devices rebuild theirs (from the binary cache after the first time).
+    selectFractalFamily((g_fractalFamily + 1) % FRACTAL_FAMILY_COUNT);
+    if (!bUseCpuEngine)
+    {
+        std::string options = kernelBuildOptions();
+        if (!fractalPrograms[g_fractalFamily])
+        {
+            fractalPrograms[g_fractalFamily] = buildProgram(g_clContext, devices[0], kernelSource, options);
+        }
+        releaseFractalKernels();
+        createFractalKernels(fractalPrograms[g_fractalFamily]);
+        for (ClHelper &helper : clHelpers)
+        {
+            cl_int status;
+            cl_program program = buildProgram(helper.context, helper.device, kernelSource, options);
+            clReleaseKernel(helper.kernel);
+            helper.kernel = clCreateKernel(program, "mandelProgressive", &status);
+            exitOnFail("clCreateKernel mandelProgressive (helper device)", status);
+            clReleaseProgram(program);
+        }
+    }
+    // Cached samples belong to the previous family
+    if (iterCache)
+    {
+        iterCache->clear();
+    }
+    printf("Fractal: %s\n", FRACTAL_FAMILIES[g_fractalFamily].name);
+}
+static std::string kernelBuildOptions()
+{
+    // Specialise the kernels for the settings that are fixed for the whole run (see the top of Mandel.cl)
+    std::string options = bShortcuts ? "-D USE_SHORTCUTS=1" : "-D USE_SHORTCUTS=0";
+    if (maxIterOverride > 0.0f)
+    {
+        char define[48];
+        snprintf(define, sizeof(define), " -D MAX_ITER=%.0f", maxIterOverride);
+        options += define;
+    }
+    if (frameFormat == FRAME_ITER)
+    {
+        // A single channel iteration texture takes the packed results instead of colours
+        options += " -D ITER_TEXTURE";
+    }
+    if (!bDeviceFp64)
+    {
+        options += " -D NO_FP64";
+    }
+    const FractalFamily &family = FRACTAL_FAMILIES[g_fractalFamily];
+    if (g_fractalFamily != FRACTAL_MANDELBROT)
+    {
+        char define[256];
+        snprintf(define, sizeof(define), " -D FRACTAL_POWER=%d", family.power);
+        options += define;
+        if (family.bBurningShip)
+        {
+            options += " -D FRACTAL_BURNING_SHIP";
+        }
+        if (family.bJulia)
+        {
+            // The constant in double and as double-single pairs (see Precision.h), for the float tiers. Exponent
+            // notation keeps every literal a valid float literal with its f suffix.
+            float re[2];
+            float im[2];
+            splitDoubleSingle(g_fractalJuliaRe, re);
+            splitDoubleSingle(g_fractalJuliaIm, im);
+            snprintf(define, sizeof(define),
+                     " -D FRACTAL_JULIA -D FRACTAL_JULIA_RE=%.17e -D FRACTAL_JULIA_IM=%.17e"
+                     " -D FRACTAL_JULIA_DS=(float4)(%.9ef,%.9ef,%.9ef,%.9ef)",
+                     g_fractalJuliaRe, g_fractalJuliaIm, re[0], re[1], im[0], im[1]);
+            options += define;
+        }
+    }
+    return options;
+}
+static std::string clDeviceString(cl_device_id device, cl_device_info param)
+{
+    size_t size = 0;
+    clGetDeviceInfo(device, param, 0, NULL, &size);
+    std::string value(size, '\0');
+    clGetDeviceInfo(device, param, size, &value[0], NULL);
+    return value.c_str();
+}
+static cl_program buildProgram(cl_context context, cl_device_id device, const std::string &source,
+                               const std::string &options)
+{
+    // Load the program from the binary cache if this device and driver have built it with these options before,
+    // otherwise compile it and store the binary for next time
+    struct timeval tvalBefore;
+    struct timeval tvalAfter;
+    gettimeofday(&tvalBefore, NULL);
+    ProgramCacheKey key = makeProgramCacheKey(source, clDeviceString(device, CL_DEVICE_NAME).c_str(),
+                                              clDeviceString(device, CL_DEVICE_VERSION).c_str(),
+                                              clDeviceString(device, CL_DRIVER_VERSION).c_str(), options);
+    cl_program program = NULL;
+    std::vector<unsigned char> binary;
+    if (bProgramCache && loadProgramBinary(programCacheDir, key, binary))
+    {
+        const unsigned char *binaryData = binary.data();
+        size_t binarySize = binary.size();
+        cl_int binaryStatus = CL_SUCCESS;
+        program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryData, &binaryStatus, &status);
+        if (status == CL_SUCCESS && binaryStatus == CL_SUCCESS)
+        {
+            status = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+        }
+        else if (status == CL_SUCCESS)
+        {
+            status = binaryStatus;
+        }
+        if (status != CL_SUCCESS)
+        {
+            // A driver update that kept its version string, or a damaged file: build it again and replace the file
+            printf("Cached program binary rejected (%s), building from source\n", clerror(status));
+            if (program)
+            {
+                clReleaseProgram(program);
+            }
+            program = NULL;
+        }
+    }
+    bool bCompiled = program == NULL;
+    if (bCompiled)
+    {
+        const char *sourceText = source.c_str();
+        size_t sourceSize = source.size();
+        program = clCreateProgramWithSource(context, 1, &sourceText, &sourceSize, &status);
+        exitOnFail("clCreateProgramWithSource", status);
+        status = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+        if (status != CL_SUCCESS)
+        {
+            size_t logSize = 0;
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+            std::string log(logSize, '\0');
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], NULL);
+            printf("Build log (%s):\n%s\n", options.c_str(), log.c_str());
+        }
+        exitOnFail("clBuildProgram", status);
+        if (bProgramCache)
+        {
+            size_t binarySize = 0;
+            status = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, NULL);
+            exitOnFail("clGetProgramInfo CL_PROGRAM_BINARY_SIZES", status);
+            binary.resize(binarySize);
+            unsigned char *binaryData = binary.data();
+            status = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaryData), &binaryData, NULL);
+            exitOnFail("clGetProgramInfo CL_PROGRAM_BINARIES", status);
+            if (!storeProgramBinary(programCacheDir, key, binary))
+            {
+                printf("Could not write the program binary to %s\n", programCacheDir.c_str());
+            }
+        }
+    }
+    gettimeofday(&tvalAfter, NULL);
+    long long microSecondsElapsed = (tvalAfter.tv_sec - tvalBefore.tv_sec) * 1000000LL + (tvalAfter.tv_usec - tvalBefore.tv_usec);
+    printf("Program for %s %s in %.1f milliseconds (options: %s)\n", clDeviceString(device, CL_DEVICE_NAME).c_str(),
+           bCompiled ? "compiled" : "loaded from the binary cache", microSecondsElapsed / 1000.0, options.c_str());
+    return program;
+}
+static void listClDevices(std::vector<cl_device_id> &all)
+{
+    // Every device on every platform (GPUs, CPU runtimes such as PoCL, accelerators), numbered for --devices
+    cl_uint platformCount = 0;
+    clGetPlatformIDs(0, NULL, &platformCount);
+    std::vector<cl_platform_id> platformIds(platformCount);
+    clGetPlatformIDs(platformCount, platformIds.data(), NULL);
+    printf("=== OpenCL devices on all platforms:\n");
+    for (cl_platform_id p : platformIds)
+    {
+        char platformName[1024] = "";
+        clGetPlatformInfo(p, CL_PLATFORM_NAME, sizeof(platformName), platformName, NULL);
+        cl_uint deviceCount = 0;
+        if (clGetDeviceIDs(p, CL_DEVICE_TYPE_ALL, 0, NULL, &deviceCount) != CL_SUCCESS)
+        {
+            continue;
+        }
+        std::vector<cl_device_id> ids(deviceCount);
+        clGetDeviceIDs(p, CL_DEVICE_TYPE_ALL, deviceCount, ids.data(), NULL);
+        for (cl_device_id id : ids)
+        {
+            cl_device_type type = 0;
+            cl_uint computeUnits = 0;
+            clGetDeviceInfo(id, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+            clGetDeviceInfo(id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+            const char *typeName = (type & CL_DEVICE_TYPE_GPU) ? "GPU" : (type & CL_DEVICE_TYPE_CPU) ? "CPU" : "accelerator";
+            printf("  [%zu] %s: %s (%s, %u compute units)%s\n", all.size(), platformName,
+                   clDeviceString(id, CL_DEVICE_NAME).c_str(), typeName, (unsigned int)computeUnits,
+                   id == devices[0] ? " - display device" : "");
+            all.push_back(id);
+        }
+    }
+}
+static void initClHelpers(const std::string &source, const std::string &options)
+{
+    // Set up the devices picked with --devices, besides the display device, to render bands of each frame
+    deviceShares.assign(1, DeviceShare());
+    deviceShares[0].name = clDeviceString(devices[0], CL_DEVICE_NAME);
+    if (!deviceSelection)
+    {
+        return;
+    }
+    bool bAll = strcmp(deviceSelection, "all") == 0;
+    for (size_t i = 0; i < clAllDevices.size(); i++)
+    {
+        cl_device_id device = clAllDevices[i];
+        bool bPicked = bAll;
+        for (const char *p = deviceSelection; p && !bPicked; p = strchr(p, ','), p = p ? p + 1 : NULL)
+        {
+            bPicked = (size_t)atoi(p) == i;
+        }
+        if (!bPicked || device == devices[0])
+        {
+            continue;
+        }
+        cl_device_fp_config doubles = 0;
+        clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(doubles), &doubles, NULL);
+        if (!doubles)
+        {
+            printf("Device [%zu] %s has no double precision, not used\n", i, clDeviceString(device, CL_DEVICE_NAME).c_str());
+            continue;
+        }
+        ClHelper helper;
+        helper.device = device;
+        helper.context = clCreateContext(NULL, 1, &device, NULL, NULL, &status);
+        exitOnFail("clCreateContext (helper device)", status);
+        helper.queue = clCreateCommandQueue(helper.context, device, CL_QUEUE_PROFILING_ENABLE, &status);
+        exitOnFail("clCreateCommandQueue (helper device)", status);
+        cl_program program = buildProgram(helper.context, device, source, options);
+        helper.kernel = clCreateKernel(program, "mandelProgressive", &status);
+        exitOnFail("clCreateKernel mandelProgressive (helper device)", status);
+        clReleaseProgram(program);
+        helper.pixelIter = clCreateBuffer(helper.context, CL_MEM_READ_WRITE, FRACTAL_IMAGE_SIZE * sizeof(cl_int), NULL, &status);
+        exitOnFail("clCreateBuffer pixelIter (helper device)", status);
+        clHelpers.push_back(helper);
+        deviceShares.push_back(DeviceShare());
+        deviceShares.back().name = clDeviceString(device, CL_DEVICE_NAME);
+    }
+    printf("Rendering on %zu device(s)\n", clHelpers.size() + 1);
+}
 static bool IsCLExtensionSupported(const char *extension)
 {
     // see if the extension is bogus: